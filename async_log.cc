@@ -0,0 +1,163 @@
+#include "async_log.h"
+#include "timeutils.h"
+
+
+bool AsyncLogQueue::push(const char *file, int line, int severity, std::string &text) {
+	uint32_t head = head_.load(std::memory_order_relaxed);
+	if (head - tail_.load(std::memory_order_acquire) >= kAsyncLogQueueSize) {
+		dropped_.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+	Record &record = records_[head % kAsyncLogQueueSize];
+	record.file = file;
+	record.line = line;
+	record.severity = severity;
+	record.text.swap(text);
+	head_.store(head + 1, std::memory_order_release);
+	return true;
+}
+
+bool AsyncLogQueue::pop(Record &out) {
+	uint32_t tail = tail_.load(std::memory_order_relaxed);
+	if (tail == head_.load(std::memory_order_acquire)) {
+		return false;
+	}
+	Record &record = records_[tail % kAsyncLogQueueSize];
+	out.file = record.file;
+	out.line = record.line;
+	out.severity = record.severity;
+	// 换出来, 槽里留下 out 原来的缓冲, 下次生产者再换走, 不用每条都重新分配
+	out.text.swap(record.text);
+	tail_.store(tail + 1, std::memory_order_release);
+	return true;
+}
+
+
+// 线程退出时关闭它的队列
+struct AsyncLogQueueHolder {
+	AsyncLogQueueHolder() : queue(NULL) { }
+	~AsyncLogQueueHolder() {
+		if (queue) {
+			queue->close();
+		}
+	}
+	AsyncLogQueue *queue;
+};
+static thread_local AsyncLogQueueHolder local_queue_holder;
+
+AsyncLogQueue *AsyncLog::local_queue(void) {
+	if (!local_queue_holder.queue) {
+		AsyncLogQueue *queue = new AsyncLogQueue();
+		std::lock_guard<std::mutex> guard(lock_);
+		queues_.push_back(queue);
+		local_queue_holder.queue = queue;
+	}
+	return local_queue_holder.queue;
+}
+
+void AsyncLog::start(AsyncLogSink sink) {
+	if (thread_) {
+		return ;
+	}
+	sink_ = sink;
+	stopping_ = false;
+	running_.store(true, std::memory_order_release);
+	thread_ = g_thread_new("async_log", &AsyncLog::writer_main, this);
+}
+
+void AsyncLog::stop(void) {
+	if (!thread_) {
+		return ;
+	}
+	running_.store(false, std::memory_order_release);
+	stopping_ = true;
+	g_thread_join(thread_);
+	thread_ = NULL;
+	// 停止前刚放进队列的
+	drain();
+	uint64_t dropped = this->dropped();
+	if (dropped > 0) {
+		LOG(WARNING) << "Async log: " << dropped << " lines dropped (queue full)";
+	}
+}
+
+void AsyncLog::write(const char *file, int line, int severity, std::string &text) {
+	if ((severity < google::GLOG_FATAL) && running_.load(std::memory_order_acquire)) {
+		// 队列满时丢掉, 不让客户端线程等写日志线程
+		local_queue()->push(file, line, severity, text);
+		return ;
+	}
+	emit(file, line, severity, text);
+}
+
+uint64_t AsyncLog::dropped(void) const {
+	std::lock_guard<std::mutex> guard(lock_);
+	uint64_t dropped = dropped_;
+	for (size_t i = 0; i < queues_.size(); i++) {
+		dropped += queues_[i]->dropped();
+	}
+	return dropped;
+}
+
+void AsyncLog::emit(const char *file, int line, int severity, const std::string &text) const {
+	if (sink_) {
+		sink_(file, line, severity, text);
+		return ;
+	}
+	google::LogMessage(file, line, severity).stream() << text;
+}
+
+size_t AsyncLog::drain(void) {
+	std::vector<AsyncLogQueue *> queues;
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		queues = queues_;
+	}
+	// 写 glog 时不拿着 lock_, 新线程注册队列不用等
+	size_t written = 0;
+	std::vector<AsyncLogQueue *> finished;
+	AsyncLogQueue::Record record;
+	for (size_t i = 0; i < queues.size(); i++) {
+		// 先看是否关闭再取, 关闭之后所属线程不会再放
+		bool closed = queues[i]->closed();
+		while (queues[i]->pop(record)) {
+			emit(record.file, record.line, record.severity, record.text);
+			written++;
+		}
+		if (closed) {
+			finished.push_back(queues[i]);
+		}
+	}
+	written_.fetch_add(written, std::memory_order_relaxed);
+	if (!finished.empty()) {
+		std::lock_guard<std::mutex> guard(lock_);
+		for (size_t i = 0; i < finished.size(); i++) {
+			dropped_ += finished[i]->dropped();
+			queues_.erase(std::find(queues_.begin(), queues_.end(), finished[i]));
+			delete finished[i];
+		}
+	}
+	return written;
+}
+
+gpointer AsyncLog::writer_main(gpointer data) {
+	AsyncLog *self = static_cast<AsyncLog *>(data);
+	while (!self->stopping_.load()) {
+		if (self->drain() == 0) {
+			usleep(kAsyncLogFlushMs * 1000);
+		}
+	}
+	self->drain();
+	return NULL;
+}
+
+
+bool AsyncLogRateLimit(std::atomic<uint64_t> &last, uint64_t interval_usec) {
+	uint64_t now = now_usec();
+	uint64_t prev = last.load(std::memory_order_relaxed);
+	if ((prev != 0) && (now < prev + interval_usec)) {
+		return false;
+	}
+	// 同一时刻有多个线程到期时只有一个记
+	return last.compare_exchange_strong(prev, now, std::memory_order_relaxed);
+}
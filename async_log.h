@@ -0,0 +1,144 @@
+#ifndef __ASYNC_LOG_H__
+#define __ASYNC_LOG_H__
+
+#include "common.h"
+#include <atomic>
+#include <mutex>
+
+// 每个线程的日志队列能放多少条, 写日志线程来不及写时后面的丢掉 (计数)
+const uint32_t kAsyncLogQueueSize = 256;
+// 写日志线程没有东西可写时睡这么久
+const int kAsyncLogFlushMs = 20;
+
+
+// AsyncLogQueue: 一个线程的日志队列, 单生产者 (所属线程) 单消费者 (写日志线程) 的环形队列, 不加锁
+class AsyncLogQueue {
+public:
+	struct Record {
+		const char *file;
+		int line;
+		int severity;
+		std::string text;
+	};
+
+	AsyncLogQueue() : head_(0), tail_(0), dropped_(0), closed_(false) { }
+
+	// 只在所属线程调用; @text 被移走
+	// @return false: 队列满了, 这条丢掉
+	bool push(const char *file, int line, int severity, std::string &text);
+	// 只在写日志线程调用
+	// @return false: 队列空
+	bool pop(Record &out);
+
+	uint64_t dropped(void) const { return dropped_.load(std::memory_order_relaxed); }
+	// 所属线程退出, 写日志线程写完剩下的之后释放这个队列
+	void close(void) { closed_.store(true, std::memory_order_release); }
+	bool closed(void) const { return closed_.load(std::memory_order_acquire); }
+
+private:
+	Record records_[kAsyncLogQueueSize];
+	// 生产者和消费者各写各的, 放在不同的 cache line 上
+	alignas(64) std::atomic<uint32_t> head_;	// 下一个写的位置, 只有生产者改
+	alignas(64) std::atomic<uint32_t> tail_;	// 下一个读的位置, 只有消费者改
+	std::atomic<uint64_t> dropped_;
+	std::atomic<bool> closed_;
+};
+
+// 测试用: 代替 glog 接收写日志线程写出的每一条
+typedef void (*AsyncLogSink)(const char *file, int line, int severity, const std::string &text);
+
+// AsyncLog: 客户端热路径上的日志, 格式化在调用线程, 写文件在单独的写日志线程;
+// 调用线程只把格式化好的一行放进自己的队列, 不碰 glog 的全局锁, 也不做文件 IO.
+// 没有 start (比如工具和测试) 或者已经 stop 时直接同步写 glog; FATAL 总是同步写.
+// 用 ALOG/ALOG_EVERY_N/ALOG_EVERY_SEC, 不要直接调用
+class AsyncLog {
+public:
+	~AsyncLog() { stop(); }
+	AsyncLog() : thread_(NULL), running_(false), stopping_(false), written_(0), dropped_(0) { }
+
+public:
+	// 启动写日志线程; @sink: NULL: 写到 glog
+	void start(AsyncLogSink sink = NULL);
+	// 写完所有队列里的日志再返回; 之后的日志同步写
+	void stop(void);
+	bool running(void) const { return running_.load(std::memory_order_relaxed); }
+
+	void write(const char *file, int line, int severity, std::string &text);
+
+	// 写出的条数, 队列满丢掉的条数
+	uint64_t written(void) const { return written_.load(std::memory_order_relaxed); }
+	uint64_t dropped(void) const;
+
+private:
+	AsyncLogQueue *local_queue(void);
+	static gpointer writer_main(gpointer data);
+	// @return: 这一轮写了多少条
+	size_t drain(void);
+	void emit(const char *file, int line, int severity, const std::string &text) const;
+
+private:
+	GThread *thread_;
+	AsyncLogSink sink_;
+	std::atomic<bool> running_;
+	std::atomic<bool> stopping_;
+	mutable std::mutex lock_;				// 保护 queues_, 每个线程第一次写日志时才用到
+	std::vector<AsyncLogQueue *> queues_;
+	std::atomic<uint64_t> written_;
+	uint64_t dropped_;						// 已经释放的队列丢掉的条数
+};
+typedef singleton_default<AsyncLog> AsyncLog_Singleton;
+#define ASYNC_LOG (AsyncLog_Singleton::instance())
+
+// AsyncLogLine: 一条 ALOG, 析构时交给 ASYNC_LOG
+class AsyncLogLine {
+public:
+	AsyncLogLine(const char *file, int line, int severity) : file_(file), line_(line), severity_(severity) { }
+	~AsyncLogLine() {
+		std::string text = stream_.str();
+		ASYNC_LOG.write(file_, line_, severity_, text);
+	}
+	std::ostream &stream(void) { return stream_; }
+
+private:
+	const char *file_;
+	int line_;
+	int severity_;
+	std::ostringstream stream_;
+};
+
+struct AsyncLogVoidify {
+	void operator&(std::ostream &) { }
+};
+
+// 每个调用点自己计数, 每 every 次记一次 (第一次总是记), 0 表示不记; 计数是每个线程各自的, 不在线程间竞争
+inline bool AsyncLogSample(uint32_t &count, uint32_t every) {
+	if (every <= 1) {
+		return every == 1;
+	}
+	return (count++ % every) == 0;
+}
+
+// 每个调用点 (所有线程一起) 每 interval_usec 最多记一次
+bool AsyncLogRateLimit(std::atomic<uint64_t> &last, uint64_t interval_usec);
+
+// 和 LOG(severity) 一样的用法; 条件不成立时后面 << 的表达式 (比如 Utf8DebugString()) 都不会求值
+#define ALOG_IF(severity, condition) \
+	!(condition) ? (void)0 : AsyncLogVoidify() & AsyncLogLine(__FILE__, __LINE__, google::GLOG_##severity).stream()
+#define ALOG(severity) ALOG_IF(severity, true)
+// 每个线程在这个调用点每 n 次记一次, n 是 0 时不记
+#define ALOG_EVERY_N(severity, n) \
+	ALOG_IF(severity, ([](uint32_t every) { \
+		static thread_local uint32_t count = 0; \
+		return AsyncLogSample(count, every); \
+	}(n)))
+// 这个调用点每 seconds 秒最多记一次
+#define ALOG_EVERY_SEC(severity, seconds) \
+	ALOG_IF(severity, ([](double interval) { \
+		static std::atomic<uint64_t> last(0); \
+		return AsyncLogRateLimit(last, uint64_t(interval * 1000000)); \
+	}(seconds)))
+// VLOG(verboselevel) 的采样版本
+#define AVLOG_EVERY_N(verboselevel, n) ALOG_EVERY_N(INFO, VLOG_IS_ON(verboselevel) ? (n) : 0)
+
+
+#endif // __ASYNC_LOG_H__
@@ -0,0 +1,60 @@
+// Micro-benchmark: scalar vs. vectorized checksum kernels across packet sizes.
+//   ./bench_checksum [total_mbytes_per_case]
+#include "checksum.h"
+#include "timeutils.h"
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+namespace {
+
+typedef uint32_t (*ChecksumFn)(const char *buf, size_t len);
+
+// Keeps the checksums observable so the loops are not optimized away.
+volatile uint32_t g_sink = 0;
+
+// @return: MB/s
+double Throughput(ChecksumFn fn, const std::string& buf, size_t len, long iterations) {
+    uint64_t start = now_usec();
+    uint32_t acc = 0;
+    for (long n = 0; n < iterations; n++) {
+        acc += fn(buf.data() + (n & 7), len);
+    }
+    uint64_t elapsed = now_usec() - start;
+    g_sink = g_sink + acc;
+    return elapsed ? double(len) * iterations / elapsed : 0.0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    long total_mbytes = (argc > 1) ? atol(argv[1]) : 512;
+    const size_t sizes[] = { 16, 64, 256, 1024, 4096, 16384, 65536 };
+    std::string buf(sizes[sizeof(sizes) / sizeof(sizes[0]) - 1] + 8, '\0');
+    for (size_t i = 0; i < buf.size(); i++) {
+        buf[i] = static_cast<char>(i * 2654435761u >> 13);
+    }
+    bool hw = crc32c_hw_available();
+
+    printf("%8s %14s %14s %8s %14s %14s %8s\n", "bytes", "sum32 MB/s", "sum32 simd", "speedup",
+           "crc32c MB/s", hw ? "crc32c sse4.2" : "crc32c (n/a)", "speedup");
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        size_t len = sizes[i];
+        long iterations = total_mbytes * 1000000 / len;
+
+        if (checksum_sum32_simd(buf.data(), len) != checksum_sum32_scalar(buf.data(), len) ||
+            (hw && crc32c_hw(buf.data(), len) != crc32c_scalar(buf.data(), len))) {
+            fprintf(stderr, "MISMATCH at %zu bytes\n", len);
+            return 1;
+        }
+
+        double sum_scalar = Throughput(checksum_sum32_scalar, buf, len, iterations);
+        double sum_simd = Throughput(checksum_sum32_simd, buf, len, iterations);
+        double crc_scalar = Throughput(crc32c_scalar, buf, len, iterations);
+        double crc_hw = hw ? Throughput(crc32c_hw, buf, len, iterations) : 0.0;
+        printf("%8zu %14.0f %14.0f %7.1fx %14.0f %14.0f %7.1fx\n", len,
+               sum_scalar, sum_simd, sum_simd / sum_scalar,
+               crc_scalar, crc_hw, crc_hw / crc_scalar);
+    }
+    return 0;
+}
@@ -0,0 +1,350 @@
+// Micro-benchmark: epoll + read/write vs. io_uring transport of the --engine=epoll loops,
+// against an in-process loopback echo server.
+//   ./bench_io_backend [connections] [round_trips_per_connection] [payload_bytes] [pipeline_depth]
+// Every connection keeps pipeline_depth packets in flight. The client loop runs on the calling
+// thread, so CPU time (getrusage RUSAGE_THREAD) is that of the client side only. Syscalls are the
+// send/recv calls the clients count themselves (Client::io_syscalls; /proc/thread-self/io syscw does
+// not count sendmsg) plus epoll_wait or io_uring_enter; connects are excluded.
+#include "client.h"
+#include "event_loop.h"
+#include "uring.h"
+#include "message_pool.h"
+#include "robot.pb.h"
+#include "timeutils.h"
+#include <arpa/inet.h>
+#include <sys/resource.h>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+namespace {
+
+const char kTypeName[] = "pbcfg.Client";
+
+// Blocking echo server, one thread per connection; stops when the peer closes.
+class EchoServer {
+public:
+    EchoServer() : listenfd_(-1), port_(0) { }
+    ~EchoServer() {
+        if (listenfd_ >= 0) {
+            shutdown(listenfd_, SHUT_RDWR);
+            close(listenfd_);
+        }
+        if (acceptor_.joinable()) {
+            acceptor_.join();
+        }
+    }
+
+    bool start() {
+        listenfd_ = socket(AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr);
+        if (listenfd_ == -1 || bind(listenfd_, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+            listen(listenfd_, 1024) == -1 || getsockname(listenfd_, (struct sockaddr *)&addr, &len) == -1) {
+            perror("echo server");
+            return false;
+        }
+        port_ = ntohs(addr.sin_port);
+        acceptor_ = std::thread(&EchoServer::accept_loop, this);
+        return true;
+    }
+
+    std::string addr() const { return "127.0.0.1:" + std::to_string(port_); }
+
+private:
+    void accept_loop() {
+        while (true) {
+            int fd = accept(listenfd_, NULL, NULL);
+            if (fd == -1) {
+                return;
+            }
+            int yes = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+            std::thread(&EchoServer::echo, fd).detach();
+        }
+    }
+
+    static void echo(int fd) {
+        char buf[65536];
+        ssize_t n;
+        while ((n = read(fd, buf, sizeof(buf))) > 0) {
+            for (ssize_t off = 0; off < n; ) {
+                ssize_t w = write(fd, buf + off, n - off);
+                if (w <= 0) {
+                    close(fd);
+                    return;
+                }
+                off += w;
+            }
+        }
+        close(fd);
+    }
+
+    int listenfd_;
+    int port_;
+    std::thread acceptor_;
+};
+
+// One ping-pong connection on the loop under test.
+class EchoConn : public EventHandler {
+public:
+    EchoConn(EventLoop *loop, const std::string &body)
+        : loop_(loop), client_(NewLoopClient(loop->uring(), this, 1 << 20, false, kChecksumSum32)),
+          body_(body), connected_(false), done_(false), failed_(false), total_(0), sent_(0), received_(0) {
+        head_.set_msg_type_name(kTypeName);
+        head_.set_uid(1);
+        head_.set_role_tm(0);
+        head_.set_ret(0);
+    }
+    ~EchoConn() {
+        close();
+        delete client_;
+    }
+
+    bool connect(const std::string &addr) {
+        std::ostringstream err;
+        int ret = client_->start_connect(addr, err);
+        if (ret == -1 || loop_->add_fd(client_->connfd(), EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, this) == -1) {
+            fprintf(stderr, "connect: %s\n", err.str().c_str());
+            return false;
+        }
+        connected_ = (ret == 0);
+        return true;
+    }
+
+    // Sends the first pipeline_depth packets; the rest are sent as replies arrive.
+    void kick(int round_trips, int depth) {
+        total_ = round_trips;
+        loop_->hold();
+        while (sent_ < total_ && sent_ < depth) {
+            send_one();
+        }
+        flush();
+    }
+
+    void on_events(uint32_t events) override {
+        if (done_) {
+            return;
+        }
+        if (!connected_) {
+            std::ostringstream err;
+            if (!(events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+                return;
+            }
+            if (!client_->finish_connect(err)) {
+                fail(err.str());
+                return;
+            }
+            connected_ = true;
+            return;
+        }
+        std::ostringstream err;
+        if ((events & EPOLLOUT) && client_->net_tcp_send(err) == -1) {
+            fail(err.str());
+            return;
+        }
+        if ((events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) && client_->net_tcp_recv(err) == -1) {
+            fail(err.str());
+            return;
+        }
+        bool queued = false;
+        while (true) {
+            google::protobuf::Message *head = NULL, *body = NULL;
+            bool complete = false;
+            if (!client_->recv_msg(&head, &body, complete, err)) {
+                fail(err.str());
+                return;
+            }
+            if (!complete) {
+                break;
+            }
+            MessagePool::local().release(head);
+            MessagePool::local().release(body);
+            received_++;
+            if (sent_ < total_) {
+                send_one();
+                queued = true;
+            }
+        }
+        if (queued) {
+            flush();
+        }
+        if (received_ == total_) {
+            done_ = true;
+            close();
+            loop_->release();
+        }
+    }
+
+    void on_timer() override { }
+
+    bool connected() const { return connected_; }
+    bool failed() const { return failed_; }
+    uint64_t io_syscalls() const { return client_->io_syscalls(); }
+
+private:
+    void send_one() {
+        std::ostringstream err;
+        if (!client_->send_msg(head_, kTypeName, body_, err)) {
+            fail(err.str());
+            return;
+        }
+        sent_++;
+    }
+
+    void flush() {
+        std::ostringstream err;
+        if (client_->net_tcp_send(err) == -1) {
+            fail(err.str());
+        }
+    }
+
+    void fail(const std::string &err) {
+        fprintf(stderr, "connection failed: %s\n", err.c_str());
+        failed_ = true;
+        if (!done_) {
+            done_ = true;
+            close();
+            if (total_ > 0) {
+                loop_->release();
+            }
+        }
+    }
+
+    void close() {
+        if (client_->is_connected()) {
+            loop_->del_fd(client_->connfd());
+            client_->close_connection();
+        }
+    }
+
+    EventLoop *loop_;
+    Client *client_;
+    pbcfg::CsMsgHead head_;
+    std::string body_;
+    bool connected_;
+    bool done_;
+    bool failed_;
+    int total_;
+    int sent_;
+    int received_;
+};
+
+struct Counters {
+    uint64_t cpu_usec;
+    uint64_t syscalls;      // sendmsg/read of every connection
+    uint64_t waits;         // epoll_wait or io_uring_enter
+};
+
+Counters Sample(const EventLoop &loop, const std::vector<EchoConn *> &clients) {
+    Counters c;
+    struct rusage ru;
+    getrusage(RUSAGE_THREAD, &ru);
+    c.cpu_usec = (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000ULL + ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+    c.syscalls = 0;
+    for (size_t i = 0; i < clients.size(); i++) {
+        c.syscalls += clients[i]->io_syscalls();
+    }
+    c.waits = loop.waits();
+    return c;
+}
+
+// A pbcfg.Client body (uid 1, role_time 0) padded with an unknown length-delimited field (number 15).
+std::string Body(size_t payload) {
+    std::string body("\x08\x01\x10\x00\x7a", 5);
+    size_t len = payload;
+    do {
+        body += static_cast<char>((len & 0x7f) | (len > 0x7f ? 0x80 : 0));
+        len >>= 7;
+    } while (len);
+    body.append(payload, 'x');
+    return body;
+}
+
+bool RunBackend(const char *name, bool uring, const std::string &addr, int conns, int round_trips,
+                const std::string &body, int depth) {
+    EventLoop loop;
+    std::ostringstream err;
+    if (!loop.init(err)) {
+        fprintf(stderr, "%s\n", err.str().c_str());
+        return false;
+    }
+    if (uring && !loop.enable_uring(err)) {
+        printf("%-6s unavailable: %s\n", name, err.str().c_str());
+        return true;
+    }
+
+    std::vector<EchoConn *> clients;
+    bool ok = true;
+    for (int i = 0; i < conns && ok; i++) {
+        clients.push_back(new EchoConn(&loop, body));
+        ok = clients.back()->connect(addr);
+    }
+    for (int spins = 0; ok; spins++) {
+        int connected = 0;
+        for (size_t i = 0; i < clients.size(); i++) {
+            connected += clients[i]->connected();
+            ok = ok && !clients[i]->failed();
+        }
+        if (connected == conns) {
+            break;
+        }
+        ok = ok && spins < 1000 && loop.poll(10) != -1;
+    }
+
+    if (ok) {
+        Counters before = Sample(loop, clients);
+        uint64_t start = now_usec();
+        for (size_t i = 0; i < clients.size(); i++) {
+            clients[i]->kick(round_trips, depth);
+        }
+        loop.run();
+        uint64_t elapsed = now_usec() - start;
+        Counters after = Sample(loop, clients);
+        for (size_t i = 0; i < clients.size(); i++) {
+            ok = ok && !clients[i]->failed();
+        }
+
+        double msgs = double(conns) * round_trips;
+        uint64_t waits = after.waits - before.waits;
+        printf("%-6s %10.0f %10.0f %12.3f %12.3f %12.3f %12.3f\n", name, msgs, msgs * 1e6 / elapsed,
+               (after.syscalls - before.syscalls + waits) / msgs, waits / msgs,
+               double(after.cpu_usec - before.cpu_usec) / msgs, double(elapsed) / msgs);
+    }
+    // Not polled again: completions would reach deleted clients. The ring submits the queued
+    // cancels/closes when it is destroyed.
+    for (size_t i = 0; i < clients.size(); i++) {
+        delete clients[i];
+    }
+    return ok;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    int conns = (argc > 1) ? atoi(argv[1]) : 64;
+    int round_trips = (argc > 2) ? atoi(argv[2]) : 5000;
+    int payload = (argc > 3) ? atoi(argv[3]) : 128;
+    int depth = (argc > 4) ? atoi(argv[4]) : 1;
+    if (conns <= 0 || round_trips <= 0 || payload < 0 || depth <= 0) {
+        fprintf(stderr, "usage: %s [connections] [round_trips_per_connection] [payload_bytes] [pipeline_depth]\n",
+                argv[0]);
+        return 2;
+    }
+
+    EchoServer server;
+    if (!server.start()) {
+        return 1;
+    }
+    std::string body = Body(payload);
+    printf("%d connections x %d round trips, %d byte payload, %d in flight per connection\n",
+           conns, round_trips, payload, depth);
+    printf("%-6s %10s %10s %12s %12s %12s %12s\n", "io", "msgs", "msgs/s", "syscalls/msg", "waits/msg",
+           "cpu us/msg", "wall us/msg");
+    bool ok = RunBackend("epoll", false, server.addr(), conns, round_trips, body, depth) &&
+              RunBackend("uring", true, server.addr(), conns, round_trips, body, depth);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,172 @@
+#include "checksum.h"
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CHECKSUM_X86 1
+#include <emmintrin.h>
+#include <nmmintrin.h>
+#endif
+
+// CRC-32C 多项式 (reflected)
+const uint32_t kCrc32cPoly = 0x82F63B78;
+
+
+namespace {
+
+// slicing-by-8 的 8 张表: table[k][b] 是字节 b 后面再跟 k 个 0 字节的 CRC
+struct Crc32cTables {
+	uint32_t table[8][256];
+
+	Crc32cTables() {
+		for (uint32_t b = 0; b < 256; b++) {
+			uint32_t crc = b;
+			for (int i = 0; i < 8; i++) {
+				crc = (crc >> 1) ^ ((crc & 1) ? kCrc32cPoly : 0);
+			}
+			table[0][b] = crc;
+		}
+		for (uint32_t b = 0; b < 256; b++) {
+			for (int k = 1; k < 8; k++) {
+				uint32_t prev = table[k - 1][b];
+				table[k][b] = (prev >> 8) ^ table[0][prev & 0xff];
+			}
+		}
+	}
+};
+
+const Crc32cTables &crc32c_tables(void) {
+	static const Crc32cTables tables;
+	return tables;
+}
+
+inline uint32_t load_le32(const unsigned char *p) {
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap32(v);
+#endif
+	return v;
+}
+
+} // namespace
+
+
+uint32_t checksum_sum32_scalar(const char *buf, size_t len) {
+	const unsigned char *p = reinterpret_cast<const unsigned char *>(buf);
+	uint32_t sum = 0;
+	for (size_t i = 0; i < len; i++) {
+		sum += p[i];
+	}
+	return sum;
+}
+
+uint32_t checksum_sum32_simd(const char *buf, size_t len) {
+#ifdef CHECKSUM_X86
+	// psadbw 把 16 个字节两两分组求和到两个 64 位 lane, 不会溢出
+	const __m128i zero = _mm_setzero_si128();
+	__m128i acc = zero;
+	size_t i = 0;
+	for (; i + 16 <= len; i += 16) {
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(buf + i));
+		acc = _mm_add_epi64(acc, _mm_sad_epu8(v, zero));
+	}
+	uint64_t lanes[2];
+	_mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), acc);
+	uint32_t sum = static_cast<uint32_t>(lanes[0] + lanes[1]);
+	return sum + checksum_sum32_scalar(buf + i, len - i);
+#else
+	return checksum_sum32_scalar(buf, len);
+#endif
+}
+
+// CRC 的结果是取反过的, 接着算要先取反回来; prev 是 0 时从 0xFFFFFFFF 开始, 就是整段算
+static uint32_t crc32c_scalar_extend(uint32_t prev, const char *buf, size_t len) {
+	const Crc32cTables &t = crc32c_tables();
+	const unsigned char *p = reinterpret_cast<const unsigned char *>(buf);
+	uint32_t crc = ~prev;
+	while (len >= 8) {
+		uint32_t lo = load_le32(p) ^ crc;
+		uint32_t hi = load_le32(p + 4);
+		crc = t.table[7][lo & 0xff] ^ t.table[6][(lo >> 8) & 0xff]
+			^ t.table[5][(lo >> 16) & 0xff] ^ t.table[4][lo >> 24]
+			^ t.table[3][hi & 0xff] ^ t.table[2][(hi >> 8) & 0xff]
+			^ t.table[1][(hi >> 16) & 0xff] ^ t.table[0][hi >> 24];
+		p += 8;
+		len -= 8;
+	}
+	while (len--) {
+		crc = (crc >> 8) ^ t.table[0][(crc ^ *p++) & 0xff];
+	}
+	return ~crc;
+}
+
+uint32_t crc32c_scalar(const char *buf, size_t len) {
+	return crc32c_scalar_extend(0, buf, len);
+}
+
+#ifdef CHECKSUM_X86
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hw_extend(uint32_t prev, const char *buf, size_t len) {
+	const unsigned char *p = reinterpret_cast<const unsigned char *>(buf);
+#if defined(__x86_64__)
+	uint64_t crc = ~prev;
+	while (len >= 8) {
+		uint64_t v;
+		memcpy(&v, p, sizeof(v));
+		crc = _mm_crc32_u64(crc, v);
+		p += 8;
+		len -= 8;
+	}
+	uint32_t crc32 = static_cast<uint32_t>(crc);
+#else
+	uint32_t crc32 = ~prev;
+#endif
+	while (len >= 4) {
+		uint32_t v;
+		memcpy(&v, p, sizeof(v));
+		crc32 = _mm_crc32_u32(crc32, v);
+		p += 4;
+		len -= 4;
+	}
+	while (len--) {
+		crc32 = _mm_crc32_u8(crc32, *p++);
+	}
+	return ~crc32;
+}
+
+uint32_t crc32c_hw(const char *buf, size_t len) {
+	return crc32c_hw_extend(0, buf, len);
+}
+
+bool crc32c_hw_available(void) {
+	return __builtin_cpu_supports("sse4.2");
+}
+#else
+static uint32_t crc32c_hw_extend(uint32_t prev, const char *buf, size_t len) {
+	return crc32c_scalar_extend(prev, buf, len);
+}
+
+uint32_t crc32c_hw(const char *buf, size_t len) {
+	return crc32c_scalar(buf, len);
+}
+
+bool crc32c_hw_available(void) {
+	return false;
+}
+#endif
+
+uint32_t calc_checksum(ChecksumType type, const char *buf, size_t len) {
+	return calc_checksum_extend(type, 0, buf, len);
+}
+
+uint32_t calc_checksum_extend(ChecksumType type, uint32_t prev, const char *buf, size_t len) {
+	switch (type) {
+	case kChecksumCrc32c: {
+		static const bool hw = crc32c_hw_available();
+		return hw ? crc32c_hw_extend(prev, buf, len) : crc32c_scalar_extend(prev, buf, len);
+	}
+	case kChecksumSum32:
+	default:
+		return prev + checksum_sum32_simd(buf, len);
+	}
+}
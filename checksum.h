@@ -0,0 +1,31 @@
+#ifndef __CHECKSUM_H__
+#define __CHECKSUM_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+// 包尾校验和算法 (seeto: pbcfg::Group.checksum_type)
+enum ChecksumType {
+	kChecksumSum32 = 0,		// 所有字节 (unsigned char) 累加, 模 2^32, 与服务端一致
+	kChecksumCrc32c = 1,	// CRC-32C (Castagnoli), x86 上优先用 SSE4.2 的 crc32 指令
+};
+
+// 按 type 计算 [buf, buf+len) 的校验和, 自动选用当前 CPU 支持的最快实现
+uint32_t calc_checksum(ChecksumType type, const char *buf, size_t len);
+// 接着前面各段的结果 prev 算下一段 [buf, buf+len), 分段算的结果和把各段拼起来一次算的相同;
+// prev 是 0 时等于 calc_checksum
+uint32_t calc_checksum_extend(ChecksumType type, uint32_t prev, const char *buf, size_t len);
+
+// 以下是各个具体实现, 结果两两相同; 供测试和 bench 对比使用
+uint32_t checksum_sum32_scalar(const char *buf, size_t len);
+// SSE2 psadbw, 不支持时等同 scalar
+uint32_t checksum_sum32_simd(const char *buf, size_t len);
+// slicing-by-8 查表
+uint32_t crc32c_scalar(const char *buf, size_t len);
+// SSE4.2 crc32 指令, 调用前必须确认 crc32c_hw_available()
+uint32_t crc32c_hw(const char *buf, size_t len);
+bool crc32c_hw_available(void);
+
+
+#endif // __CHECKSUM_H__
@@ -19,7 +19,7 @@ inline void Client::close_connection(void) {
 }
 
 inline uint32_t Client::calc_checksum(const char *buf, int start, int len) {
-	buf = 0; start = len = 0; return 0; // make gcc shut up
+	return ::calc_checksum(checksum_type_, buf + start, len);
 }
 
 inline int Client::set_fd_nonblock(int s) {
@@ -41,9 +41,5 @@ inline int Client::set_tcp_nodelay(int s) {
     return 0;
 }
 
-inline int Client::calc_buffer_size(int needsize) {
-	return ((needsize + kBlockSize - 1) / kBlockSize) * kBlockSize;
-}
-
 
 #endif // __CLIENT_INL_H__
@@ -1,148 +1,36 @@
 #include "client.h"
 #include "pb_master.h"
 #include "config.h" // Added for global_frame_header_config
+#include "frame_codec.h"
+#include "robot.pb.h"
+#include "message_pool.h"
+#include "flags.h"
+#include "async_log.h"
+#include "source_binder.h"
 #include <arpa/inet.h> // For htonl, htons (should be in common.h but good to ensure here)
-#include <vector>      // For byte manipulation if needed
-#include <iomanip>     // For std::setfill, std::setw (if using stringstream for hex)
-#include <algorithm>   // For std::min
-
-// Anonymous namespace for helper functions
-namespace {
-
-// Helper to append a string, padding with nulls or truncating to target_size
-void append_string_fixed_size(std::string& dest, const std::string& src, int target_size) {
-    if (target_size <= 0) return;
-    std::string temp = src;
-    if (temp.length() > static_cast<size_t>(target_size)) {
-        temp.resize(target_size);
-    } else {
-        temp.resize(target_size, '\0'); // Pad with null characters
-    }
-    dest.append(temp);
-}
-
-// --- Integer to Byte Array Helpers ---
-// Note: These assume network byte order is Big Endian for BE types.
-// For LE types, direct memory copy is fine on LE machines. For portability, byte-by-byte construction is better.
-
-void append_uint8(std::string& dest, uint8_t val) {
-    dest.push_back(static_cast<char>(val));
-}
-
-void append_int8(std::string& dest, int8_t val) {
-    dest.push_back(static_cast<char>(val));
-}
-
-void append_uint16_be(std::string& dest, uint16_t val) {
-    uint16_t net_val = htons(val);
-    dest.append(reinterpret_cast<const char*>(&net_val), sizeof(net_val));
-}
-
-void append_uint16_le(std::string& dest, uint16_t val) {
-    char bytes[2];
-    bytes[0] = val & 0xFF;
-    bytes[1] = (val >> 8) & 0xFF;
-    dest.append(bytes, 2);
-}
-
-void append_int16_be(std::string& dest, int16_t val) {
-    uint16_t net_val = htons(static_cast<uint16_t>(val));
-    dest.append(reinterpret_cast<const char*>(&net_val), sizeof(net_val));
-}
-
-void append_int16_le(std::string& dest, int16_t val) {
-    char bytes[2];
-    uint16_t u_val = static_cast<uint16_t>(val);
-    bytes[0] = u_val & 0xFF;
-    bytes[1] = (u_val >> 8) & 0xFF;
-    dest.append(bytes, 2);
-}
-
-void append_uint32_be(std::string& dest, uint32_t val) {
-    uint32_t net_val = htonl(val);
-    dest.append(reinterpret_cast<const char*>(&net_val), sizeof(net_val));
-}
-
-void append_uint32_le(std::string& dest, uint32_t val) {
-    char bytes[4];
-    bytes[0] = val & 0xFF;
-    bytes[1] = (val >> 8) & 0xFF;
-    bytes[2] = (val >> 16) & 0xFF;
-    bytes[3] = (val >> 24) & 0xFF;
-    dest.append(bytes, 4);
-}
-
-void append_int32_be(std::string& dest, int32_t val) {
-    uint32_t net_val = htonl(static_cast<uint32_t>(val));
-    dest.append(reinterpret_cast<const char*>(&net_val), sizeof(net_val));
-}
-
-void append_int32_le(std::string& dest, int32_t val) {
-    char bytes[4];
-    uint32_t u_val = static_cast<uint32_t>(val);
-    bytes[0] = u_val & 0xFF;
-    bytes[1] = (u_val >> 8) & 0xFF;
-    bytes[2] = (u_val >> 16) & 0xFF;
-    bytes[3] = (u_val >> 24) & 0xFF;
-    dest.append(bytes, 4);
-}
-
-// For 64-bit, htobe64/le64toh are preferred if available (POSIX 2008, but check system)
-// Otherwise, manual byte swapping.
-void append_uint64_be(std::string& dest, uint64_t val) {
-#if __BYTE_ORDER == __LITTLE_ENDIAN
-    uint64_t net_val = __builtin_bswap64(val);
-#else
-    uint64_t net_val = val;
-#endif
-    dest.append(reinterpret_cast<const char*>(&net_val), sizeof(net_val));
-}
-
-void append_uint64_le(std::string& dest, uint64_t val) {
-#if __BYTE_ORDER == __BIG_ENDIAN
-    uint64_t net_val = __builtin_bswap64(val);
-#else
-    uint64_t net_val = val;
-#endif
-    dest.append(reinterpret_cast<const char*>(&net_val), sizeof(net_val));
-}
-
-void append_int64_be(std::string& dest, int64_t val) {
-    append_uint64_be(dest, static_cast<uint64_t>(val));
-}
-
-void append_int64_le(std::string& dest, int64_t val) {
-    append_uint64_le(dest, static_cast<uint64_t>(val));
-}
-
-} // end anonymous namespace
-
-using google::protobuf::Reflection;
-using google::protobuf::Descriptor;
-using google::protobuf::FieldDescriptor;
+#include <poll.h>
 
 const int kBlockSize = 4096;
+const int kBufferShrinkWatermark = 16 * kBlockSize;
+const int kDefaultConnectTimeoutMs = 3000;
+const int kSendRefMinBytes = 256;
 
 
 Client::~Client() {
 	if (is_connected()) {
 		close_connection();
 	}
-	if (buffer_.recvbuf) {
-		free(buffer_.recvbuf);
-		buffer_.recvbuf = 0;
-	}
-	if (buffer_.sendbuf) {
-		free(buffer_.sendbuf);
-		buffer_.sendbuf = 0;
-	}
-	buffer_.recvlen = buffer_.sendlen = buffer_.recvbuf_len = buffer_.sendbuf_len = 0;
 }
 
-Client::Client(int max_pkg_len, bool has_checksum)
+Client::Client(int max_pkg_len, bool has_checksum, ChecksumType checksum_type)
 	: connfd_(-1),
 	  max_pkg_len_(max_pkg_len),
-	  has_checksum_(has_checksum) { }
+	  has_checksum_(has_checksum),
+	  checksum_type_(checksum_type),
+	  connect_timeout_ms_(kDefaultConnectTimeoutMs),
+	  last_recv_len_(0),
+	  source_(NULL),
+	  io_syscalls_(0) { }
 
 bool Client::send_msg(const Message &msghead, const Message &msg, std::ostringstream &err) {
 	if (!is_connected()) {
@@ -150,259 +38,188 @@ bool Client::send_msg(const Message &msghead, const Message &msg, std::ostringst
 			<< ", when sending msg: " << msg.GetTypeName();
 		return false;
 	}
-
-	std::string pkg;
-	if (!encode(msghead, msg, pkg)) {
+	if (!msg.IsInitialized()) {
+		LOG(ERROR) << "Failed to serialize msg body for: " << msg.GetTypeName();
 		err << "failed send: err encode: " << msg.GetTypeName();
 		return false;
 	}
-	if (static_cast<int32_t>(pkg.size()) > max_pkg_len_) {
-		err << "failed send: too big msg: " << msg.GetTypeName()
-			<< ", size=" << pkg.size() << " > max_pkg_len=" << max_pkg_len_;
+	if (!push_frame(msghead, msg.GetTypeName(), &msg, NULL, err)) {
+		return false;
+	}
+
+	AVLOG_EVERY_N(2, FLAGS_message_log_every) << "[SEND: (msghead_pb_len=" << msghead.GetCachedSize()
+			<< ", msgbody_pb_len=" << msg.GetCachedSize() << ")]\n"
+			<< msghead.Utf8DebugString() << msg.Utf8DebugString();
+	return true;
+}
+
+bool Client::send_msg(const Message &msghead, const std::string &type_name,
+					  const std::string &body, std::ostringstream &err) {
+	if (!is_connected()) {
+		err << "Not connecting to peer: " << peer_addr_
+			<< ", when sending msg: " << type_name;
+		return false;
+	}
+	return push_frame(msghead, type_name, NULL, &body, err);
+}
+
+bool Client::push_frame(const Message &msghead, const std::string &type_name,
+						const Message *msg, const std::string *body, std::ostringstream &err) {
+	if (!msghead.IsInitialized()) {
+		LOG(ERROR) << "Failed encode msghead: " << msghead.InitializationErrorString();
+		err << "failed send: err encode: " << type_name;
+		return false;
+	}
+	// ByteSizeLong 顺带缓存了各层的大小, 后面按缓存的大小直接序列化到发送缓冲里
+	int32_t header_len = frame_header_len();
+	int32_t head_len = static_cast<int32_t>(msghead.ByteSizeLong());
+	int32_t body_len = static_cast<int32_t>(msg ? msg->ByteSizeLong() : body->size());
+	int32_t checksum_len = has_checksum_ ? 4 : 0;
+	int64_t total = int64_t(header_len) + head_len + body_len + checksum_len;
+	if (total > max_pkg_len_) {
+		err << "failed send: too big msg: " << type_name
+			<< ", size=" << total << " > max_pkg_len=" << max_pkg_len_;
 		return false;
 	}
 
-	if (buffer_.sendlen + (int)pkg.size() + 128 >= buffer_.sendbuf_len) { // 快满了, 扩容
-		int new_size = calc_buffer_size(buffer_.sendbuf_len + pkg.size());
-		buffer_.sendbuf = (char *)realloc(buffer_.sendbuf, new_size);
-		buffer_.sendbuf_len = new_size;
+	// 大的预序列化 body 只引用: [包头 CsMsgHead] [body] [校验和] 三段, 发送时一起 writev
+	bool ref_body = !msg && (body_len >= kSendRefMinBytes);
+	int32_t inline_len = ref_body ? (header_len + head_len) : static_cast<int32_t>(total);
+	char *out = buffer_.send.reserve(inline_len);
+	render_frame_header(out, head_len, body_len);
+	uint8_t *p = msghead.SerializeWithCachedSizesToArray(reinterpret_cast<uint8_t *>(out + header_len));
+	if (msg) {
+		p = msg->SerializeWithCachedSizesToArray(p);
+	} else if (!ref_body) {
+		memcpy(p, body->data(), body_len);
+		p += body_len;
+	}
+	if (!ref_body) {
+		if (has_checksum_) {
+			uint32_t sum = htonl(calc_checksum(out, 0, total - 4));
+			memcpy(p, &sum, sizeof(sum));
+		}
+		buffer_.send.commit(inline_len);
+		return true;
 	}
-	memcpy(buffer_.sendbuf + buffer_.sendlen, pkg.c_str(), pkg.size());
-	buffer_.sendlen += pkg.size();
 
+	uint32_t sum = has_checksum_ ? calc_checksum(out, 0, inline_len) : 0;
+	buffer_.send.commit(inline_len);
+	buffer_.send.append_ref(body->data(), body_len);
+	if (has_checksum_) {
+		sum = htonl(calc_checksum_extend(checksum_type_, sum, body->data(), body_len));
+		buffer_.send.append(reinterpret_cast<const char *>(&sum), sizeof(sum));
+	}
 	return true;
 }
 
+int32_t Client::frame_header_len(void) const {
+	if (global_frame_header_config_loaded) {
+		return static_cast<int32_t>(global_frame_header_config.header_template.bytes.size());
+	}
+	return 8;	// totlen + headlen
+}
+
+void Client::render_frame_header(char *out, int32_t head_len, int32_t body_len) const {
+	if (global_frame_header_config_loaded) {
+		// Header template compiled at load time (seeto: FrameConfigLoader::load_config)
+		render_frame_header_template(global_frame_header_config.header_template, head_len, body_len, out);
+		return ;
+	}
+	// totlen 包括它自己, headlen 字段, CsMsgHead, body 和校验和; headlen 包括它自己和 CsMsgHead
+	int32_t totlen = htonl(4 + 4 + head_len + body_len + (has_checksum_ ? 4 : 0));
+	int32_t headlen = htonl(4 + head_len);
+	memcpy(out, &totlen, sizeof(totlen));
+	memcpy(out + 4, &headlen, sizeof(headlen));
+}
+
 bool Client::recv_msg(Message **msghead, Message **msg, bool &complete, std::ostringstream &err) {
 	complete = false;
-	if (buffer_.recvlen < 4) {
+	if (buffer_.recv.size() < 4) {
 		return true;
 	}
-	char *recvbuf = buffer_.recvbuf;
+	char *recvbuf = buffer_.recv.readable();
 	int len = ntohl(*(uint32_t *)recvbuf);
 	if (len < 8 || len > max_pkg_len_) {
 		err << "failed recv: invalid msg,"
 			<< " errlen=" << len << ", not in range [8, " << max_pkg_len_ << "]";
 		return false;
 	}
-	if (buffer_.recvlen < len) {
+	if (buffer_.recv.size() < len) {
 		return true;
 	}
-	std::string recvstr(recvbuf, len);
-	if (!decode(recvstr, msghead, msg)) {
+	// 直接在接收缓冲上解包, 解完再前移游标
+	if (!decode(recvbuf, len, msghead, msg)) {
 		err << "failed recv: err decode msg";
 		return false;
 	}
-	if (buffer_.recvlen == len) {
-		buffer_.recvlen = 0;
-	} else {
-		memmove(buffer_.recvbuf, buffer_.recvbuf + len, buffer_.recvlen - len);
-		buffer_.recvlen -= len;
-	}
+	buffer_.recv.consume(len);
+	last_recv_len_ = len;
 	complete = true;
 	return true;
 }
 
 bool Client::encode(const Message &msghead, const Message &msg, std::string &pkg) {
+    std::string s_msgbody_pb;
+    if (!msg.SerializeToString(&s_msgbody_pb)) {
+        LOG(ERROR) << "Failed to serialize msg body for: " << msg.GetTypeName();
+        return false;
+    }
+    if (!encode(msghead, s_msgbody_pb, pkg)) {
+        return false;
+    }
+
+    // 只有真正记下来的那几条才会调 Utf8DebugString
+    AVLOG_EVERY_N(2, FLAGS_message_log_every) << "[ENCODE:" << pkg.size()
+            << ": (msghead_pb_len=" << msghead.ByteSizeLong()
+            << ", msgbody_pb_len=" << s_msgbody_pb.size() << ")]\n"
+            << msghead.Utf8DebugString() << msg.Utf8DebugString();
+    return true;
+}
+
+bool Client::encode(const Message &msghead, const std::string &s_msgbody_pb, std::string &pkg) {
     pkg.clear();
-    std::string type_name = msg.GetTypeName(); // Used for logging
-
-    if (global_frame_header_config_loaded) {
-        // Custom frame header logic
-        std::string s_msghead_pb;
-        if (!msghead.SerializeToString(&s_msghead_pb)) {
-            LOG(ERROR) << "Failed to serialize msghead for: " << type_name;
-            return false;
-        }
-        std::string s_msgbody_pb;
-        if (!msg.SerializeToString(&s_msgbody_pb)) {
-            LOG(ERROR) << "Failed to serialize msg body for: " << type_name;
-            return false;
-        }
-
-        size_t csmsghead_pb_len = s_msghead_pb.length();
-        size_t csmsgbody_pb_len = s_msgbody_pb.length();
-        size_t total_payload_len = csmsghead_pb_len + csmsgbody_pb_len;
-
-        // Pre-calculate total size of all custom frame fields for CALC_TOTAL_PACKET_LENGTH
-        size_t total_custom_header_fields_size = 0;
-        for (const auto& field_def : global_frame_header_config.fields) {
-            total_custom_header_fields_size += field_def.size_bytes;
-        }
-
-        for (const auto& field_def : global_frame_header_config.fields) {
-            uint64_t value_to_pack_numeric = 0;
-            std::string value_to_pack_string;
-            bool is_numeric_value = false;
-
-            switch (field_def.value_rule) {
-                case FrameFieldValueRule::LITERAL:
-                    if (std::holds_alternative<std::int64_t>(field_def.literal_value)) {
-                        value_to_pack_numeric = static_cast<uint64_t>(std::get<std::int64_t>(field_def.literal_value));
-                        is_numeric_value = true;
-                    } else if (std::holds_alternative<std::string>(field_def.literal_value)) {
-                        value_to_pack_string = std::get<std::string>(field_def.literal_value);
-                    } else {
-                        LOG(ERROR) << "Field " << field_def.name << ": Literal value is not set or has unexpected variant type.";
-                        return false;
-                    }
-                    break;
-                case FrameFieldValueRule::CALC_TOTAL_PACKET_LENGTH:
-                    // Value is total size of custom header + total protobuf payload size
-                    value_to_pack_numeric = total_custom_header_fields_size + total_payload_len;
-                    is_numeric_value = true;
-                    break;
-                case FrameFieldValueRule::CALC_PROTOBUF_HEAD_LENGTH:
-                    // Value is size of this specific field + CsMsgHead protobuf length
-                    // This interpretation might need refinement based on exact requirements,
-                    // e.g., if it's the length of CsMsgHead only, or CsMsgHead + some fixed offset.
-                    // The prompt said "X + CsMsgHead.ByteSize()", where X is a configured constant.
-                    // Assuming for now field_def.size_bytes IS X, or it means the field *contains* X + head_len.
-                    // Let's assume it's the length of the CsMsgHead itself for now.
-                    // A common interpretation is that this field *stores* the length of the protobuf head.
-                    value_to_pack_numeric = csmsghead_pb_len; 
-                    // If it should include its own size or other parts, adjust here.
-                    // E.g., if the rule meant "size of this field + csmsghead_pb_len", it might be:
-                    // value_to_pack_numeric = field_def.size_bytes + csmsghead_pb_len; 
-                    // This needs clarification from requirements. For now, using csmsghead_pb_len.
-                    is_numeric_value = true;
-                    break;
-                default:
-                    LOG(ERROR) << "Field " << field_def.name << ": Unknown or unsupported value_rule.";
-                    return false;
-            }
-
-            // Pack the value
-            switch (field_def.data_type) {
-                case FrameFieldDataType::UINT8:
-                    if (!is_numeric_value) { LOG(ERROR) << "Numeric value expected for UINT8 field " << field_def.name; return false; }
-                    append_uint8(pkg, static_cast<uint8_t>(value_to_pack_numeric));
-                    break;
-                case FrameFieldDataType::INT8:
-                    if (!is_numeric_value) { LOG(ERROR) << "Numeric value expected for INT8 field " << field_def.name; return false; }
-                    append_int8(pkg, static_cast<int8_t>(value_to_pack_numeric));
-                    break;
-                case FrameFieldDataType::UINT16_LE:
-                    if (!is_numeric_value) { LOG(ERROR) << "Numeric value expected for UINT16_LE field " << field_def.name; return false; }
-                    append_uint16_le(pkg, static_cast<uint16_t>(value_to_pack_numeric));
-                    break;
-                case FrameFieldDataType::UINT16_BE:
-                    if (!is_numeric_value) { LOG(ERROR) << "Numeric value expected for UINT16_BE field " << field_def.name; return false; }
-                    append_uint16_be(pkg, static_cast<uint16_t>(value_to_pack_numeric));
-                    break;
-                case FrameFieldDataType::INT16_LE:
-                    if (!is_numeric_value) { LOG(ERROR) << "Numeric value expected for INT16_LE field " << field_def.name; return false; }
-                    append_int16_le(pkg, static_cast<int16_t>(value_to_pack_numeric));
-                    break;
-                case FrameFieldDataType::INT16_BE:
-                    if (!is_numeric_value) { LOG(ERROR) << "Numeric value expected for INT16_BE field " << field_def.name; return false; }
-                    append_int16_be(pkg, static_cast<int16_t>(value_to_pack_numeric));
-                    break;
-                case FrameFieldDataType::UINT32_LE:
-                    if (!is_numeric_value) { LOG(ERROR) << "Numeric value expected for UINT32_LE field " << field_def.name; return false; }
-                    append_uint32_le(pkg, static_cast<uint32_t>(value_to_pack_numeric));
-                    break;
-                case FrameFieldDataType::UINT32_BE:
-                    if (!is_numeric_value) { LOG(ERROR) << "Numeric value expected for UINT32_BE field " << field_def.name; return false; }
-                    append_uint32_be(pkg, static_cast<uint32_t>(value_to_pack_numeric));
-                    break;
-                case FrameFieldDataType::INT32_LE:
-                     if (!is_numeric_value) { LOG(ERROR) << "Numeric value expected for INT32_LE field " << field_def.name; return false; }
-                    append_int32_le(pkg, static_cast<int32_t>(value_to_pack_numeric));
-                    break;
-                case FrameFieldDataType::INT32_BE:
-                     if (!is_numeric_value) { LOG(ERROR) << "Numeric value expected for INT32_BE field " << field_def.name; return false; }
-                    append_int32_be(pkg, static_cast<int32_t>(value_to_pack_numeric));
-                    break;
-                case FrameFieldDataType::UINT64_LE:
-                    if (!is_numeric_value) { LOG(ERROR) << "Numeric value expected for UINT64_LE field " << field_def.name; return false; }
-                    append_uint64_le(pkg, value_to_pack_numeric);
-                    break;
-                case FrameFieldDataType::UINT64_BE:
-                    if (!is_numeric_value) { LOG(ERROR) << "Numeric value expected for UINT64_BE field " << field_def.name; return false; }
-                    append_uint64_be(pkg, value_to_pack_numeric);
-                    break;
-                case FrameFieldDataType::INT64_LE:
-                    if (!is_numeric_value) { LOG(ERROR) << "Numeric value expected for INT64_LE field " << field_def.name; return false; }
-                    append_int64_le(pkg, static_cast<int64_t>(value_to_pack_numeric));
-                    break;
-                case FrameFieldDataType::INT64_BE:
-                    if (!is_numeric_value) { LOG(ERROR) << "Numeric value expected for INT64_BE field " << field_def.name; return false; }
-                    append_int64_be(pkg, static_cast<int64_t>(value_to_pack_numeric));
-                    break;
-                case FrameFieldDataType::FIXED_STRING:
-                    if (is_numeric_value) { LOG(ERROR) << "String value expected for FIXED_STRING field " << field_def.name; return false; }
-                    append_string_fixed_size(pkg, value_to_pack_string, field_def.size_bytes);
-                    break;
-                default:
-                    LOG(FATAL) << "Field " << field_def.name << ": Unimplemented data type for packing: " << static_cast<int>(field_def.data_type);
-                    return false; // Should be unreachable due to FATAL
-            }
-        }
-        // Append serialized protobuf messages
-        pkg.append(s_msghead_pb);
-        pkg.append(s_msgbody_pb);
-
-    } else {
-        // Original logic
-        int32_t csmsghead_pb_len = msghead.ByteSize(); // Original: msghead.ByteSize()
-        int32_t csmsgbody_pb_len = msg.ByteSize(); // Original: msg.ByteSize()
-        
-        // These lengths are for the original hardcoded header structure
-        int32_t fixed_head_field_len = 4; // for the headlen field itself
-        int32_t headlen_val_payload = fixed_head_field_len + csmsghead_pb_len;
-        int32_t headlen_val_network = htonl(headlen_val_payload);
-
-        // totlen includes its own 4 bytes, the headlen field's 4 bytes, 
-        // the protobuf head, and the protobuf body. Checksum added later.
-        int32_t totlen_val_payload = fixed_head_field_len + fixed_head_field_len + csmsghead_pb_len + csmsgbody_pb_len;
-        int32_t totlen_val_network = htonl(totlen_val_payload + (has_checksum_ ? 4 : 0) );
-
-
-        pkg.append(reinterpret_cast<const char*>(&totlen_val_network), sizeof(totlen_val_network));
-        pkg.append(reinterpret_cast<const char*>(&headlen_val_network), sizeof(headlen_val_network));
-
-        if (!msghead.AppendToString(&pkg)) {
-            LOG(ERROR) << "Failed encode msghead for: " << type_name;
-            return false;
-        }
-        if (!msg.AppendToString(&pkg)) {
-            LOG(ERROR) << "Failed encode msg for: " << type_name;
-            return false;
-        }
+    if (!msghead.IsInitialized()) {
+        LOG(ERROR) << "Failed encode msghead: " << msghead.InitializationErrorString();
+        return false;
     }
 
-    // Checksum logic (applied to the fully constructed pkg)
+    // Same layout as push_frame: header, CsMsgHead, body, [checksum]
+    int32_t header_len = frame_header_len();
+    int32_t head_len = static_cast<int32_t>(msghead.ByteSizeLong());
+    int32_t body_len = static_cast<int32_t>(s_msgbody_pb.size());
+    pkg.resize(header_len + head_len + body_len + (has_checksum_ ? 4 : 0));
+    char *out = &pkg[0];
+    render_frame_header(out, head_len, body_len);
+    msghead.SerializeWithCachedSizesToArray(reinterpret_cast<uint8_t *>(out + header_len));
+    memcpy(out + header_len + head_len, s_msgbody_pb.data(), body_len);
+
     if (has_checksum_) {
-        uint32_t sum = calc_checksum(pkg.c_str(), 0, pkg.size());
-        sum = htonl(sum);
-        pkg.append(reinterpret_cast<const char*>(&sum), sizeof(sum));
+        uint32_t sum = htonl(calc_checksum(out, 0, pkg.size() - 4));
+        memcpy(out + pkg.size() - 4, &sum, sizeof(sum));
     }
-
-    // VLOG(2) from original, can be adapted
-    VLOG(2) << "[ENCODE:" << pkg.size()
-            << ": (msghead_pb_len=" << msghead.ByteSize() 
-            << ", msgbody_pb_len=" << msg.ByteSize() << ")]\n"
-            << msghead.Utf8DebugString() << msg.Utf8DebugString();
     return true;
 }
 
 bool Client::decode(const std::string &pkg, Message **msghead, Message **msg) {
+	return decode(pkg.c_str(), static_cast<int32_t>(pkg.size()), msghead, msg);
+}
+
+bool Client::decode(const char *pkg, int32_t getlen, Message **msghead, Message **msg) {
 	*msghead = 0;
 	*msg = 0;
 
 	int min_totlen = 8; // sizeof(totlen) + sizeof(headlen)
 	min_totlen += has_checksum_ ? 4 : 0; // [sizeof(checksum)]
 
-	int getlen = static_cast<int>(pkg.size());
 	if (getlen < min_totlen) {
 		LOG(ERROR) << "decode err: getlen(" << getlen << ") < min(" << min_totlen << ")";
 		return false;
 	}
 	// 至此, pkg 至少有 min_totlen 那么长 (保证解包不会越界)
 
-	int32_t tlen_inpkg = ntohl(*(int32_t *)(pkg.c_str()));
-	int32_t hlen_inpkg = ntohl(*(int32_t *)(pkg.c_str()+4));
+	int32_t tlen_inpkg = ntohl(*(int32_t *)(pkg));
+	int32_t hlen_inpkg = ntohl(*(int32_t *)(pkg+4));
 
 	if (tlen_inpkg != getlen) {
 		LOG(ERROR) << "decode err: getlen(" << getlen << ") != tlen_inpkg(" << tlen_inpkg << ")"; 
@@ -424,51 +241,41 @@ bool Client::decode(const std::string &pkg, Message **msghead, Message **msg) {
 		return false;
 	}
 
-#if 0
 	// 检查校验和
 	if (has_checksum_) {
-		uint32_t sum_inpkg = ntohl(*(uint32_t *)(pkg.c_str()+tlen_inpkg-4));
-		uint32_t sum = checksum(pkg.c_str(), 0, tlen_inpkg-4);
+		uint32_t sum_inpkg;
+		memcpy(&sum_inpkg, pkg+tlen_inpkg-4, sizeof(sum_inpkg));
+		sum_inpkg = ntohl(sum_inpkg);
+		uint32_t sum = calc_checksum(pkg, 0, tlen_inpkg-4);
 		if (sum_inpkg != sum) {
 			LOG(ERROR) << "decode err: sum_inpkg(" << sum_inpkg << ") != sum(" << sum << ")";
 			return false;
 		}
 	}
-#endif
 
-	// 解析包头部分
-	std::string head_type_name = "ISeer20CSProto.cs_msg_head_t";
-	std::string type_name_field_name = "msg_type_name";
-	*msghead = PB_MASTER.create_message(head_type_name);
-	if (!(*msghead)->ParseFromArray(pkg.c_str()+8, hlen_inpkg-4)) {
+	// 解析包头部分: 直接从接收缓冲解析, 不经过 reflection 和动态类型查找
+	// head 和 body 都从本线程的 MessagePool 取, 调用者用完后 release 回去
+	MessagePool &pool = MessagePool::local();
+	static const std::string head_type_name = pbcfg::CsMsgHead::descriptor()->full_name();
+	pbcfg::CsMsgHead *head = static_cast<pbcfg::CsMsgHead *>(pool.acquire(head_type_name));
+	*msghead = head;
+	if (!head->ParseFromArray(pkg+8, hlen_inpkg-4)) {
 		LOG(ERROR) << "decode err: failed parse msghead";
-		delete *msghead;
+		pool.release(*msghead);
 		*msghead = 0;
 		return false;
 	}
+	const std::string &type_name = head->msg_type_name();
 
-	const FieldDescriptor *type_name_field_descriptor
-		= PB_MASTER.get_message_field_descriptor(*msghead, type_name_field_name);
-	if (!type_name_field_descriptor) {
-		LOG(ERROR) << "decode err: msghead has no type_name field with name: "
-			<< type_name_field_name;
-		delete *msghead;
-		*msghead = 0;
-		return false;
-	}
-	const Reflection *type_name_field_reflection = (*msghead)->GetReflection();
-	const std::string &type_name
-		= type_name_field_reflection->GetString(**msghead, type_name_field_descriptor);
-
-	*msg = PB_MASTER.create_message(type_name);
+	*msg = pool.acquire(type_name);
 	if (!(*msg)) {
 		LOG(ERROR) << "decode err: failed create_message: " << type_name;
-		delete *msghead;
+		pool.release(*msghead);
 		*msghead = 0;
 		return false;
 	}
 
-	const char *data = pkg.c_str() + 4 + hlen_inpkg;
+	const char *data = pkg + 4 + hlen_inpkg;
 	int32_t datalen = tlen_inpkg - 4 - hlen_inpkg;
 	if (has_checksum_) {
 		datalen -= 4;
@@ -476,14 +283,14 @@ bool Client::decode(const std::string &pkg, Message **msghead, Message **msg) {
 
 	if (!(*msg)->ParseFromArray(data, datalen)) {
 		LOG(ERROR) << "decode err: failed parse message: " << type_name;
-		delete *msghead;
+		pool.release(*msghead);
 		*msghead = 0;
-		delete *msg;
+		pool.release(*msg);
 		*msg = 0;
 		return false;
 	}
 
-	VLOG(2) << "[DECODE]\n"
+	AVLOG_EVERY_N(2, FLAGS_message_log_every) << "[DECODE]\n"
 		<< (*msghead)->Utf8DebugString() << (*msg)->Utf8DebugString();
 	return true;
 }
@@ -585,7 +392,7 @@ int Client::parse_sockaddr(const char *str, struct sockaddr *out, int *outlen) {
 	return 0;
 }
 
-int Client::tcp_connect(const std::string &svraddr, std::ostringstream &err) {
+int Client::tcp_connect_nonblock(const std::string &svraddr, bool *in_progress, std::ostringstream &err) {
 	struct sockaddr_in peer;
 	int peer_addrlen = sizeof(peer);
 	memset(&peer, 0, sizeof(peer));
@@ -594,16 +401,38 @@ int Client::tcp_connect(const std::string &svraddr, std::ostringstream &err) {
 		return -1;
 	}
 
+	// 指定了源端口范围时, bind 成功的端口仍可能和已有连接的四元组冲突 (connect 返回 EADDRNOTAVAIL), 换下一个端口重试
+	int attempts = (source_ && source_->port_range()) ? kSourceBindAttempts : 1;
+	for (int i = 0; ; i++) {
+		int s = new_socket(err);
+		if (s == -1) {
+			return -1;
+		}
+		*in_progress = false;
+		if (connect(s, (const sockaddr*)&peer, sizeof(peer)) == 0) {
+			return s;
+		}
+		if (errno == EINPROGRESS) {
+			*in_progress = true;
+			return s;
+		}
+		int saved_errno = errno;
+		close(s);
+		if ((saved_errno == EADDRNOTAVAIL) && (i + 1 < attempts)) {
+			continue;
+		}
+		err << "connect: " << strerror(saved_errno);
+		errno = saved_errno;
+		return -1;
+	}
+}
+
+int Client::new_socket(std::ostringstream &err) {
 	int s = socket(PF_INET, SOCK_STREAM, 0);
 	if (s == -1) {
 		err << "socket: " << strerror(errno);
 		return -1;
 	}
-	if (connect(s, (const sockaddr*)&peer, sizeof(peer)) == -1) {
-		err << "connect: " << strerror(errno);
-		close(s);
-		return -1;
-	}
 	if (set_fd_nonblock(s) == -1) {
 		err << "set_fd_nonblock: " << strerror(errno);
 		close(s);
@@ -614,15 +443,78 @@ int Client::tcp_connect(const std::string &svraddr, std::ostringstream &err) {
 		close(s);
 		return -1;
 	}
+	if (source_ && (source_->bind(s, err) == -1)) {
+		int saved_errno = errno;
+		close(s);
+		errno = saved_errno;
+		return -1;
+	}
+	return s;
+}
 
+// @return: 0: 已连上, 否则是连接失败的 errno
+static int get_socket_error(int s) {
+	int soerr = 0;
+	socklen_t len = sizeof(soerr);
+	if (getsockopt(s, SOL_SOCKET, SO_ERROR, &soerr, &len) == -1) {
+		return errno;
+	}
+	return soerr;
+}
+
+int Client::tcp_connect(const std::string &svraddr, std::ostringstream &err) {
+	bool in_progress = false;
+	int s = tcp_connect_nonblock(svraddr, &in_progress, err);
+	if (s == -1 || !in_progress) {
+		return s;
+	}
+
+	struct pollfd pfd;
+	pfd.fd = s;
+	pfd.events = POLLOUT;
+	pfd.revents = 0;
+	int n;
+	do {
+		n = poll(&pfd, 1, connect_timeout_ms_);
+	} while (n == -1 && errno == EINTR);
+	int soerr = (n == 0) ? ETIMEDOUT : ((n == -1) ? errno : get_socket_error(s));
+	if (soerr != 0) {
+		err << "connect: " << strerror(soerr);
+		close(s);
+		errno = soerr;
+		return -1;
+	}
 	return s;
 }
 
+int Client::start_connect(const std::string &svraddr, std::ostringstream &err) {
+	if (is_connected()) { return 0; }
+	bool in_progress = false;
+	connfd_ = tcp_connect_nonblock(svraddr, &in_progress, err);
+	if (connfd_ == -1) {
+		return -1;
+	}
+	return in_progress ? 1 : 0;
+}
+
+bool Client::finish_connect(std::ostringstream &err) {
+	int soerr = get_socket_error(connfd_);
+	if (soerr != 0) {
+		err << "connect: " << strerror(soerr);
+		close_connection();
+		errno = soerr;
+		return false;
+	}
+	return true;
+}
+
 int Client::net_tcp_recv(std::ostringstream &errmsg) {
 	int nread = 0;
     while(true) {
-        nread = read(connfd_, buffer_.recvbuf + buffer_.recvlen,
-				buffer_.recvbuf_len - buffer_.recvlen);
+		// 至少留出一个 block 的连续空间再读
+		char *recvbuf = buffer_.recv.writable(kBlockSize);
+        nread = read(connfd_, recvbuf, buffer_.recv.writable_size());
+		io_syscalls_++;
         if (nread == 0) { // EOF
 			errmsg << "recv meet EOF (peer shutdown), fd: " << connfd_;
 			close(connfd_);
@@ -639,22 +531,21 @@ int Client::net_tcp_recv(std::ostringstream &errmsg) {
 			connfd_ = -1;
 			return -1;
 		}
-        buffer_.recvlen += nread;
-		if (buffer_.recvlen + 128 >= buffer_.recvbuf_len) { // 满了, 扩容
-			int new_size = calc_buffer_size(buffer_.recvbuf_len + kBlockSize);
-			buffer_.recvbuf = (char *)realloc(buffer_.recvbuf, new_size);
-			buffer_.recvbuf_len = new_size;
-		}
+        buffer_.recv.commit(nread);
     }
 	return 0;
 }
 
 int Client::net_tcp_send(std::ostringstream &errmsg) {
-	if (buffer_.sendlen == 0) return 0;
-	int total_sent = 0;
-	int nwritten = 0;
-	while(true) {
-		nwritten = write(connfd_, buffer_.sendbuf + total_sent, buffer_.sendlen - total_sent);
+	struct iovec iov[kSendIovMax];
+	while(!buffer_.send.empty()) {
+		// 攒下的所有包 (连同引用的 body) 一次 sendmsg 发出; 对端已关闭时只返回 EPIPE, 不触发 SIGPIPE
+		struct msghdr msg;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = iov;
+		msg.msg_iovlen = buffer_.send.fill_iov(iov, kSendIovMax);
+		ssize_t nwritten = sendmsg(connfd_, &msg, MSG_NOSIGNAL);
+		io_syscalls_++;
 		if (nwritten == 0) { // EOF
 			errmsg << "send meet EOF??? (peer shutdown), fd: " << connfd_;
 			close(connfd_);
@@ -670,14 +561,8 @@ int Client::net_tcp_send(std::ostringstream &errmsg) {
 			connfd_ = -1;
 			return -1;
 		}
-		total_sent += nwritten;
-		if (total_sent == buffer_.sendlen) { break; }
-	}
-	if (total_sent == buffer_.sendlen) {
-		buffer_.sendlen = 0;
-	} else { // total_sent < buffer_.sendlen
-		memmove(buffer_.sendbuf, buffer_.sendbuf + total_sent, buffer_.sendlen - total_sent);
-		buffer_.sendlen -= total_sent;
+		// 已发出的部分只前移游标, 不挪动剩余数据
+		buffer_.send.consume(nwritten);
 	}
 	return 0;
 }
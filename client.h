@@ -3,69 +3,116 @@
 
 
 #include "common.h"
+#include "io_buffer.h"
+#include "send_queue.h"
+#include "checksum.h"
 
 extern const int kBlockSize;
 using google::protobuf::Message;
+class SourceBinder;
 
 
+// 超过该容量的缓冲在数据被消费完后缩回 kBlockSize
+extern const int kBufferShrinkWatermark;
+// 与 pbcfg::Group.connect_timeout 的默认值一致
+extern const int kDefaultConnectTimeoutMs;
+// 不小于这个长度的预序列化 body 在发送缓冲里只引用不拷贝, 更短的拷贝比多一段 iovec 便宜
+extern const int kSendRefMinBytes;
+
 struct Buffer {
 public:
-	Buffer() : recvlen(0), sendlen(0) {
-			recvbuf_len = kBlockSize;
-			sendbuf_len = kBlockSize;
-			recvbuf = (char *)malloc(kBlockSize);
-			sendbuf = (char *)malloc(kBlockSize);
-		}
+	Buffer()
+		: recv(kBlockSize, kBufferShrinkWatermark),
+		  send(kBlockSize, kBufferShrinkWatermark) { }
 
 	void Clear(void) {
-		recvlen = sendlen = 0;
+		recv.clear();
+		send.clear();
 	}
 
 public:
-	int32_t recvlen;
-	int32_t sendlen;
-	int32_t recvbuf_len;
-	int32_t sendbuf_len;
-	char *recvbuf;
-	char *sendbuf;
+	IoBuffer recv;
+	SendQueue send;
 };
 
 class Client {
 public:
 	virtual ~Client(); // Made virtual
-	Client(int max_pkg_len, bool has_checksum);
+	Client(int max_pkg_len, bool has_checksum, ChecksumType checksum_type = kChecksumSum32);
 
 public:
 	inline bool is_connected(void);
+	int connfd(void) const { return connfd_; }
+	// 阻塞到连上或 connect_timeout, 超时时 errno 是 ETIMEDOUT
 	virtual bool try_connect_to_peer(const std::string &svraddr, std::ostringstream &err); // Made virtual
-	inline void close_connection(void);
+	// 非阻塞 connect, 给事件循环用
+	// @return: -1: failed, 0: 已连上, 1: 正在连接 (fd 可写后调用 finish_connect)
+	int start_connect(const std::string &svraddr, std::ostringstream &err);
+	// @return false: 连接失败, 连接已关闭, errno 是失败原因
+	bool finish_connect(std::ostringstream &err);
+	void set_connect_timeout(int timeout_ms) { connect_timeout_ms_ = timeout_ms; }
+	// 之后的连接都先绑定 source 分配的源地址; NULL (默认) 由内核选
+	void set_source(SourceBinder *source) { source_ = source; }
+	virtual void close_connection(void);
+	// 连接关闭后还有没完成的异步收发 (io_uring 的完成事件还会回调这个对象), 这时还不能释放
+	virtual bool io_pending(void) const { return false; }
 	const Buffer &buffer(void) { return buffer_; }
 	void clear_buffer(void) { buffer_.Clear(); }
 
 public:
+	// 包头, CsMsgHead 和 body 都直接序列化到发送缓冲里, 不经过临时的 string
 	virtual bool send_msg(const Message &msghead, const Message &msg, std::ostringstream &err); // Made virtual
+	// @body: 已经序列化好的 body (seeto: UniqRequest::body);
+	// 不小于 kSendRefMinBytes 时只引用不拷贝, 在发出去 (或者连接关闭) 之前必须一直有效
+	virtual bool send_msg(const Message &msghead, const std::string &type_name,
+						  const std::string &body, std::ostringstream &err);
 	virtual bool recv_msg(Message **msghead, Message **msg, bool &complete, std::ostringstream &err);  // Made virtual
+	// 最近一次 recv_msg 解出的包长 (含包头)
+	int32_t last_recv_len(void) const { return last_recv_len_; }
 	bool encode(const Message &msghead, const Message &msg, std::string &pkg); 
+	bool encode(const Message &msghead, const std::string &body, std::string &pkg);
 	bool decode(const std::string &pkg, Message **msghead, Message **msg); 
+	// 从 [pkg, pkg+len) 解出一个完整的包, *msghead 是 pbcfg::CsMsgHead;
+	// 解出的消息来自 MessagePool::local(), 用完后应该 release 回去
+	bool decode(const char *pkg, int32_t len, Message **msghead, Message **msg);
 	int tcp_connect(const std::string &svraddr, std::ostringstream &err);
+	// @return: -1: failed, 否则是 fd; *in_progress: 连接还没完成
+	int tcp_connect_nonblock(const std::string &svraddr, bool *in_progress, std::ostringstream &err);
 	virtual int net_tcp_send(std::ostringstream &errmsg); // Made virtual
 	virtual int net_tcp_recv(std::ostringstream &errmsg); // Made virtual
+	// net_tcp_send/net_tcp_recv 做过的收发系统调用 (sendmsg/read) 次数, 给 bench 用;
+	// /proc 的 syscw 不算 sendmsg, 所以自己计数. UringClient 的收发在 io_uring_enter 里, 不计
+	uint64_t io_syscalls(void) const { return io_syscalls_; }
 
 
 private:
+	// 把一个包放进发送缓冲, body 是 msg 或者已经序列化好的 body (另一个为 NULL)
+	bool push_frame(const Message &msghead, const std::string &type_name,
+					const Message *msg, const std::string *body, std::ostringstream &err);
+	// 包头 (CsMsgHead 之前的部分) 的长度: 加载了帧头配置时是模板的长度, 否则是 totlen + headlen
+	int32_t frame_header_len(void) const;
+	void render_frame_header(char *out, int32_t head_len, int32_t body_len) const;
 	int parse_sockaddr(const char *str, struct sockaddr *out, int *outlen);
+	// 非阻塞, 关闭 Nagle, 绑定好源地址 (如果有) 的 socket; @return: -1: failed
+	int new_socket(std::ostringstream &err);
 	inline uint32_t calc_checksum(const char *buf, int start, int len); 
 	inline int set_fd_nonblock(int s);
 	inline int set_tcp_nodelay(int s);
-	inline int calc_buffer_size(int needsize);
 
 
-private:
+protected:
 	int connfd_;
+	Buffer buffer_;
+
+private:
 	std::string peer_addr_;
 	int32_t max_pkg_len_;
 	bool has_checksum_;
-	Buffer buffer_;
+	ChecksumType checksum_type_;
+	int connect_timeout_ms_;
+	int32_t last_recv_len_;
+	SourceBinder *source_;
+	uint64_t io_syscalls_;
 };
 
 
@@ -0,0 +1,779 @@
+#include "client_session.h"
+#include "robot.h"
+#include "timeutils.h"
+#include "message_pool.h"
+#include "async_log.h"
+#include "uring.h"
+
+
+ClientSession::~ClientSession() {
+	loop_->cancel_timer(this);
+	release_inbox();
+	if (mux_) {
+		// 共用的连接由 MuxConnection 记断开和关闭
+		mux_->detach(clientcfg_.uid());
+		return ;
+	}
+	if (latency_ && connected_) {
+		latency_->record_disconnect(peer_);
+	}
+	if (client_->is_connected()) {
+		loop_->del_fd(client_->connfd());
+		client_->close_connection();
+	}
+	delete client_;
+}
+
+ClientSession::ClientSession(const pbcfg::Group &groupcfg,
+							 const pbcfg::Client &clientcfg,
+							 EventLoop *loop,
+							 GroupLatency *latency,
+							 EventLogWriter *events,
+							 ConnectPacer *pacer,
+							 SourceBinder *source,
+							 const LoadProfile *profile,
+							 int client_index,
+							 MuxConnection *mux)
+	: groupcfg_(groupcfg),
+	  clientcfg_(clientcfg),
+	  loop_(loop),
+	  latency_(latency),
+	  trace_(events, clientcfg.uid(), LATENCY_STATS.group_index(&groupcfg)),
+	  pacer_(pacer),
+	  profile_(profile),
+	  client_index_(client_index),
+	  connect_start_(0),
+	  mux_(mux),
+	  peers_(latency ? &latency->peers() : NULL),
+	  peer_(0),
+	  connected_(false),
+	  client_(mux ? &mux->client()
+			  : NewLoopClient(loop->uring(), this, groupcfg.max_pkg_len(), groupcfg.has_checksum(),
+							  ChecksumType(groupcfg.checksum_type()))),
+	  recv_len_(0),
+	  state_(kIdle),
+	  count_(0),
+	  action_index_(0),
+	  is_timeout_(false),
+	  wait_start_(0),
+	  open_loop_(groupcfg.rate() > 0),
+	  pipelined_(groupcfg.pipeline_depth() > 0),
+	  sending_(false),
+	  interval_usec_(0),
+	  next_arrival_(0),
+	  inflight_(0),
+	  rng_((uint64_t(clientcfg.uid()) << 32) | uint32_t(clientcfg.role_time())) {
+	// TODO(zog): 通用包头设置
+	headmsg_.set_uid(clientcfg.uid());
+	headmsg_.set_role_tm(clientcfg.role_time());
+	headmsg_.set_ret(0);
+	if (!mux_) {
+		client_->set_connect_timeout(groupcfg.connect_timeout());
+		client_->set_source(source);
+	}
+	if (open_loop_) {
+		// Group 的 rate 平均分给它的每个客户端
+		interval_usec_ = 1e6 * groupcfg.client_count() / groupcfg.rate();
+	}
+}
+
+void ClientSession::start(void) {
+	loop_->hold();
+	uint64_t start = profile_->client_start(client_index_);
+	if (start > now_usec()) {
+		state_ = kWaitStart;
+		loop_->set_timer(this, start);
+		return ;
+	}
+	pace_connect();
+}
+
+void ClientSession::pace_connect(void) {
+	uint64_t now = now_usec();
+	uint64_t slot = pacer_ ? pacer_->acquire(now) : now;
+	if (slot > now) {
+		state_ = kWaitConnect;
+		loop_->set_timer(this, slot);
+		return ;
+	}
+	begin_connect();
+}
+
+void ClientSession::begin_connect(void) {
+	state_ = kConnecting;
+	connect_start_ = now_usec();
+	if (mux_) {
+		int ret = mux_->attach(this, clientcfg_.uid());
+		if (ret == -1) {
+			trace_.connect(kEventFailed, 0);
+			fail("multiplexed connection already has uid: " + std::to_string(clientcfg_.uid()));
+		} else if (ret == 0) {
+			on_connected();
+		}
+		return ;
+	}
+	peer_ = peers_ ? peers_->pick(clientcfg_.uid()) : 0;
+	std::ostringstream errmsg;
+	int ret = client_->start_connect(peer_addr(), errmsg);
+	if (ret == -1) {
+		trace_.connect(kEventFailed, now_usec() - connect_start_);
+		fail("cannot connect to peer: " + peer_addr() + ", err: " + errmsg.str());
+		return ;
+	}
+	// net_tcp_send/net_tcp_recv 都会读写到 EAGAIN 为止, 所以可以用边沿触发
+	if (loop_->add_fd(client_->connfd(), EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, this) == -1) {
+		fail(std::string("epoll add fd: ") + strerror(errno));
+		return ;
+	}
+	if (ret == 1) {
+		// 连接完成时 fd 变为可写 (seeto: on_events)
+		if (groupcfg_.connect_timeout() > 0) {
+			loop_->set_timer(this, connect_start_ + uint64_t(groupcfg_.connect_timeout()) * 1000);
+		}
+		return ;
+	}
+	on_connected();
+}
+
+void ClientSession::on_connected(void) {
+	loop_->cancel_timer(this);
+	uint64_t elapsed = now_usec() - connect_start_;
+	if (mux_) {
+		// 每次连接都是新的 Client
+		client_ = &mux_->client();
+		peer_ = mux_->peer();
+	}
+	// 多路复用时 connect 时延由 MuxConnection 按连接记, 事件日志里记的是等共用连接的时长
+	if (latency_ && !mux_) {
+		latency_->record_connect(elapsed, peer_);
+		connected_ = true;
+	}
+	trace_.connect(kEventOk, elapsed);
+	state_ = kRunning;
+	if (open_loop_) {
+		// 各客户端的起始相位错开, 免得整个 Group 同时发送
+		sending_ = true;
+		next_arrival_ = now_usec() + uint64_t(std::uniform_real_distribution<double>(0, interval_usec_)(rng_));
+		open_loop_tick();
+		return ;
+	}
+	if (pipelined_) {
+		sending_ = true;
+		pipeline_tick();
+		return ;
+	}
+	advance();
+}
+
+bool ClientSession::select_action(void) {
+	// 按时间结束时 loop_count 不再限制轮数, 所有 Action 都停止了就直接结束, 免得空转到停止时刻
+	for (int skipped = 0; skipped <= groupcfg_.action_size(); ) {
+		if (action_index_ >= groupcfg_.action_size()) {
+			action_index_ = 0;
+			count_++;
+		}
+		if (groupcfg_.action_size() == 0) {
+			return false;
+		}
+		// 闭环模式只在每一轮 Group 开始时检查, 开环/流水线模式每个 Action 都检查
+		if (((action_index_ == 0) || open_loop_ || pipelined_)
+			&& !profile_->next_loop(client_index_, count_, now_usec())) {
+			return false;
+		}
+		const pbcfg::Action &actioncfg = current_action();
+		if ((actioncfg.stop_loop_count() > 0) && (count_ >= actioncfg.stop_loop_count())) {
+			action_index_++;
+			skipped++;
+			continue;
+		}
+		return true;
+	}
+	return false;
+}
+
+void ClientSession::advance(void) {
+	int count = count_;
+	while (state_ == kRunning) {
+		if (!select_action()) {
+			finish();
+			return ;
+		}
+		if (count_ != count) {
+			// 每一轮 Group 开始前让出循环: 没有 response/min_duration/think_time 的 Action 是同步完成的,
+			// 否则按时间结束的 Group 会在一次回调里一直跑到停止时刻, 同一循环上的其他客户端都得等着
+			loop_->yield(this);
+			return ;
+		}
+
+		const pbcfg::Action &actioncfg = current_action();
+		if (!begin_action(actioncfg)) {
+			return ;
+		}
+		if (!is_action_compleated(actioncfg, recved_responses_)) {
+			return ; // 等待 response 或 timeout
+		}
+		if (!finish_action()) {
+			return ; // 等待 min_duration/think_time 或已出错
+		}
+	}
+}
+
+bool ClientSession::begin_action(const pbcfg::Action &actioncfg) {
+	std::ostringstream errmsg;
+	uint32_t seq = NextSeq(headmsg_);
+	size_t queued = client_->buffer().send.size();
+	if (!SendActionRequests(actioncfg, *client_, headmsg_, requests_strings_, errmsg)) {
+		fail(errmsg.str());
+		return false;
+	}
+	trace_.request(action_index_, seq, client_->buffer().send.size() - queued);
+	if (!flush_requests()) {
+		return false;
+	}
+	if (latency_) {
+		latency_->record_request(action_index_, peer_);
+	}
+
+	state_ = kWaitResponses;
+	is_timeout_ = false;
+	wait_start_ = now_usec();
+	recved_responses_.clear();
+	timeout_responses_.clear();
+	if (actioncfg.timeout() > 0) {
+		loop_->set_timer(this, wait_start_ + uint64_t(actioncfg.timeout()) * 1000000);
+	}
+	// 上一个 Action 之后到达的回包可能已经在接收缓冲里了
+	return dispatch_responses();
+}
+
+bool ClientSession::dispatch_responses(void) {
+	const pbcfg::Action &actioncfg = current_action();
+	std::ostringstream op_errmsg;
+	while (!is_action_compleated(actioncfg, recved_responses_)) {
+		Message *rsphead = 0, *rspbody = 0;
+		bool complete = false;
+		if (!next_response(&rsphead, &rspbody, complete, op_errmsg)) {
+			fail("recv_msg, after req:" + requests_strings_.str() + "err: " + op_errmsg.str());
+			return false;
+		}
+		if (!complete) {
+			break;
+		}
+		uint32_t rsp_seq = static_cast<pbcfg::CsMsgHead *>(rsphead)->seq();
+		if ((rsp_seq != 0) && (rsp_seq != headmsg_.seq())) {
+			// 不是当前 Action 的回包 (比如上一个 Action 在 min_duration 之后才到的回包)
+			bool late = SeqBefore(rsp_seq, headmsg_.seq());
+			if (latency_) {
+				if (late) {
+					latency_->record_late_response();
+				} else {
+					latency_->record_unmatched_response();
+				}
+			}
+			trace_.response(-1, rspbody->GetDescriptor()->full_name(), late ? kEventLate : kEventUnmatched,
+							rsp_seq, 0, last_recv_len());
+			MessagePool::local().release(rsphead);
+			MessagePool::local().release(rspbody);
+			continue;
+		}
+		uint64_t elapsed = now_usec() - wait_start_;
+		if (latency_) {
+			latency_->record_response(action_index_, rspbody->GetDescriptor()->full_name(), elapsed);
+		}
+		trace_.response(action_index_, rspbody->GetDescriptor()->full_name(), kEventOk,
+						rsp_seq, elapsed, last_recv_len());
+		recved_responses_.push_back(rspbody->GetTypeName());
+		MessagePool::local().release(rsphead);
+		MessagePool::local().release(rspbody);
+		if (is_action_compleated(actioncfg, recved_responses_)) {
+			if (latency_) {
+				latency_->record_action(action_index_, elapsed, peer_);
+			}
+			trace_.action_done(action_index_, kEventOk, headmsg_.seq(), elapsed);
+		}
+	}
+	return true;
+}
+
+// response 已收齐或已超时
+bool ClientSession::finish_action(void) {
+	loop_->cancel_timer(this);
+	const pbcfg::Action &actioncfg = current_action();
+	uint64_t min_end = wait_start_ + uint64_t(actioncfg.min_duration()) * 1000;
+	if ((actioncfg.min_duration() > 0) && (now_usec() < min_end)) {
+		state_ = kWaitMinDuration;
+		loop_->set_timer(this, min_end);
+		return false;
+	}
+	return leave_action();
+}
+
+bool ClientSession::leave_action(void) {
+	if (is_timeout_) {
+		std::ostringstream timeout_string;
+		timeout_string << "[";
+		for (int i = 0; i < (int)timeout_responses_.size(); i++) {
+			timeout_string << (i == 0 ? "" : ",") << timeout_responses_[i];
+		}
+		timeout_string << "]";
+		fail("requests: " + requests_strings_.str() + " ==> timeout_responses: " + timeout_string.str());
+		return false;
+	}
+	int32_t think_time = current_action().think_time();
+	action_index_++;
+	if (think_time > 0) {
+		state_ = kThinking;
+		loop_->set_timer(this, now_usec() + uint64_t(think_time) * 1000);
+		return false;
+	}
+	state_ = kRunning;
+	return true;
+}
+
+void ClientSession::on_events(uint32_t events) {
+	if (state_ == kConnecting) {
+		if (!(events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) return ;
+		std::ostringstream errmsg;
+		if (!client_->finish_connect(errmsg)) {
+			bool timed_out = (errno == ETIMEDOUT);
+			if (latency_ && timed_out) {
+				latency_->record_connect_timeout(peer_);
+			}
+			trace_.connect(timed_out ? kEventTimedOut : kEventFailed, now_usec() - connect_start_);
+			fail("cannot connect to peer: " + peer_addr() + ", err: " + errmsg.str());
+			return ;
+		}
+		on_connected();
+		// 同一批事件里可能已经有回包可读 (边沿触发, 不处理就不会再通知)
+	}
+	if ((state_ == kIdle) || (state_ == kDone)) return ;
+
+	std::ostringstream net_errmsg;
+	if (events & EPOLLOUT) {
+		if (client_->net_tcp_send(net_errmsg) == -1) {
+			fail("req:" + requests_strings_.str() + ", err: " + net_errmsg.str());
+			return ;
+		}
+	}
+	if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+		if (client_->net_tcp_recv(net_errmsg) == -1) {
+			fail("req:" + requests_strings_.str() + ", err: " + net_errmsg.str());
+			return ;
+		}
+	}
+	process_responses();
+}
+
+void ClientSession::process_responses(void) {
+	if (open_loop_ || pipelined_) {
+		if (!dispatch_arrival_responses()) {
+			return ;
+		}
+		if (open_loop_) {
+			open_loop_tick();
+		} else {
+			pipeline_tick();
+		}
+		return ;
+	}
+
+	// 等待 min_duration 期间到达的回包留在缓冲里, 由下一个 Action 处理 (与 RunGroupOnce 一致),
+	// 回包带 seq 时会被算作迟到的回包
+	if (state_ != kWaitResponses) return ;
+	if (!dispatch_responses()) return ;
+	if (is_action_compleated(current_action(), recved_responses_) && finish_action()) {
+		advance();
+	}
+}
+
+void ClientSession::on_mux_connected(void) {
+	if (state_ == kConnecting) {
+		on_connected();
+	}
+}
+
+bool ClientSession::deliver(Message *rsphead, Message *rspbody, int32_t recv_len) {
+	Inbound inbound;
+	inbound.head = rsphead;
+	inbound.body = rspbody;
+	inbound.len = recv_len;
+	inbox_.push_back(inbound);
+	return inbox_.size() == 1;
+}
+
+void ClientSession::on_mux_responses(void) {
+	if ((state_ == kIdle) || (state_ == kDone) || (state_ == kConnecting)) return ;
+	process_responses();
+}
+
+void ClientSession::on_mux_closed(EventStatus status, const std::string &errmsg) {
+	peer_ = mux_->peer();
+	if (state_ == kConnecting) {
+		trace_.connect(status, now_usec() - connect_start_);
+		fail("cannot connect to peer: " + peer_addr() + ", err: " + errmsg);
+		return ;
+	}
+	fail("req:" + requests_strings_.str() + ", multiplexed connection err: " + errmsg);
+}
+
+bool ClientSession::next_response(Message **rsphead, Message **rspbody, bool &complete, std::ostringstream &err) {
+	if (!mux_) {
+		return client_->recv_msg(rsphead, rspbody, complete, err);
+	}
+	complete = !inbox_.empty();
+	if (complete) {
+		*rsphead = inbox_.front().head;
+		*rspbody = inbox_.front().body;
+		recv_len_ = inbox_.front().len;
+		inbox_.pop_front();
+	}
+	return true;
+}
+
+void ClientSession::release_inbox(void) {
+	for (size_t i = 0; i < inbox_.size(); i++) {
+		MessagePool::local().release(inbox_[i].head);
+		MessagePool::local().release(inbox_[i].body);
+	}
+	inbox_.clear();
+}
+
+void ClientSession::on_timer(void) {
+	if (state_ == kWaitStart) {
+		pace_connect();
+		return ;
+	}
+	if (state_ == kWaitConnect) {
+		begin_connect();
+		return ;
+	}
+	if (state_ == kConnecting) {
+		if (latency_) {
+			latency_->record_connect_timeout(peer_);
+		}
+		trace_.connect(kEventTimedOut, now_usec() - connect_start_);
+		fail("cannot connect to peer: " + peer_addr() + ", err: connect timeout");
+		return ;
+	}
+	if (open_loop_ || pipelined_) {
+		if (state_ != kRunning) {
+			return ;
+		}
+		if (open_loop_) {
+			open_loop_tick();
+		} else {
+			pipeline_tick();
+		}
+		return ;
+	}
+	if (state_ == kWaitResponses) {
+		is_timeout_ = true;
+		if (latency_) {
+			latency_->record_timeout(action_index_, now_usec() - wait_start_, peer_);
+		}
+		trace_.action_done(action_index_, kEventTimedOut, headmsg_.seq(), now_usec() - wait_start_);
+		calc_timeout_responses(current_action(), recved_responses_, timeout_responses_);
+		if (finish_action()) {
+			advance();
+		}
+	} else if (state_ == kWaitMinDuration) {
+		if (leave_action()) {
+			advance();
+		}
+	} else if (state_ == kThinking) {
+		state_ = kRunning;
+		advance();
+	} else if (state_ == kRunning) {
+		// advance 让出循环之后
+		advance();
+	}
+}
+
+// 发出所有已到计划时刻的 Action, 清理超时的 Action, 然后把定时器设到下一个需要处理的时刻
+void ClientSession::open_loop_tick(void) {
+	uint64_t now = now_usec();
+	if (!send_due_arrivals(now)) {
+		return ;
+	}
+	expire_arrivals(now);
+	if (!sending_ && arrivals_.empty()) {
+		finish();
+		return ;
+	}
+
+	arm_arrival_timer(sending_ ? next_arrival_ : UINT64_MAX);
+}
+
+// 循环落后时一次补发所有到期的 Action, 每个 Action 的时延仍然从它自己的计划时刻算起
+bool ClientSession::send_due_arrivals(uint64_t now) {
+	bool sent = false;
+	while (sending_ && (next_arrival_ <= now)) {
+		if (!select_action()) {
+			sending_ = false;
+			break;
+		}
+		if (!push_arrival(next_arrival_)) {
+			return false;
+		}
+		next_arrival_ += next_interval();
+		sent = true;
+	}
+	if (sent && !flush_requests()) {
+		return false;
+	}
+	pop_done_arrivals();
+	return true;
+}
+
+// 清理超时的 Action, 把窗口补满, 然后把定时器设到最早的超时时刻
+// 没有 response 的 Action 不占窗口, 所以每次最多发 pipeline_depth 个, 窗口还没满就让出循环, 下一轮接着发
+void ClientSession::pipeline_tick(void) {
+	uint64_t now = now_usec();
+	expire_arrivals(now);
+	int depth = groupcfg_.pipeline_depth();
+	int pushed = 0;
+	while (sending_ && (inflight_ < depth) && (pushed < depth)) {
+		if (!select_action()) {
+			sending_ = false;
+			break;
+		}
+		if (!push_arrival(now)) {
+			return ;
+		}
+		pushed++;
+	}
+	if ((pushed > 0) && !flush_requests()) {
+		return ;
+	}
+	pop_done_arrivals();
+	if (!sending_ && arrivals_.empty()) {
+		finish();
+		return ;
+	}
+	if (sending_ && (inflight_ < depth)) {
+		loop_->yield(this);
+		return ;
+	}
+	arm_arrival_timer(UINT64_MAX);
+}
+
+bool ClientSession::push_arrival(uint64_t intended) {
+	const pbcfg::Action &actioncfg = current_action();
+	Arrival arrival;
+	arrival.seq = NextSeq(headmsg_);
+	size_t queued = client_->buffer().send.size();
+	std::ostringstream errmsg;
+	if (!SendActionRequests(actioncfg, *client_, headmsg_, requests_strings_, errmsg)) {
+		fail(errmsg.str());
+		return false;
+	}
+	trace_.request(action_index_, arrival.seq, client_->buffer().send.size() - queued);
+	arrival.intended = intended;
+	arrival.action_index = action_index_;
+	arrival.pending = (actioncfg.response_size() >= 64)
+		? ~uint64_t(0) : ((uint64_t(1) << actioncfg.response_size()) - 1);
+	arrival.timed_out = false;
+	if (arrival.pending) {
+		inflight_++;
+		if (latency_) {
+			latency_->record_request(action_index_, peer_);
+		}
+	}
+	arrivals_.push_back(arrival);
+	action_index_++;
+	return true;
+}
+
+bool ClientSession::flush_requests(void) {
+	if (mux_) {
+		// 出错时 mux 已经让所有共用连接的客户端 (包括自己) 结束了
+		return mux_->flush() == 0;
+	}
+	std::ostringstream net_errmsg;
+	if (client_->net_tcp_send(net_errmsg) == -1) {
+		fail("req:" + requests_strings_.str() + ", err: " + net_errmsg.str());
+		return false;
+	}
+	return true;
+}
+
+bool ClientSession::dispatch_arrival_responses(void) {
+	std::ostringstream op_errmsg;
+	while (true) {
+		Message *rsphead = 0, *rspbody = 0;
+		bool complete = false;
+		if (!next_response(&rsphead, &rspbody, complete, op_errmsg)) {
+			fail("recv_msg, after req:" + requests_strings_.str() + "err: " + op_errmsg.str());
+			return false;
+		}
+		if (!complete) {
+			break;
+		}
+		match_response(static_cast<pbcfg::CsMsgHead *>(rsphead)->seq(),
+					   rspbody->GetDescriptor()->full_name(), now_usec());
+		MessagePool::local().release(rsphead);
+		MessagePool::local().release(rspbody);
+	}
+	pop_done_arrivals();
+	return true;
+}
+
+// seq 不为 0 时只匹配发出该 seq 的 Action; 为 0 时同类型的回包按发送顺序匹配
+void ClientSession::match_response(uint32_t seq, const std::string &type_name, uint64_t now) {
+	if (seq == 0) {
+		for (size_t i = 0; i < arrivals_.size(); i++) {
+			if (take_response(arrivals_[i], type_name, now)) {
+				return ;
+			}
+		}
+		if (latency_) {
+			latency_->record_unmatched_response();
+		}
+		trace_.response(-1, type_name, kEventUnmatched, seq, 0, last_recv_len());
+		return ;
+	}
+	Arrival *arrival = find_arrival(seq);
+	if (arrival && take_response(*arrival, type_name, now)) {
+		return ;
+	}
+	// 已超时的, 或者已经收齐出队了的 Action 的回包都算迟到
+	bool sent = !SeqBefore(headmsg_.seq(), seq);
+	bool late = arrival ? arrival->timed_out : sent;
+	if (latency_) {
+		if (late) {
+			latency_->record_late_response();
+		} else {
+			latency_->record_unmatched_response();
+		}
+	}
+	trace_.response(arrival ? arrival->action_index : -1, type_name, late ? kEventLate : kEventUnmatched,
+					seq, 0, last_recv_len());
+}
+
+bool ClientSession::take_response(Arrival &arrival, const std::string &type_name, uint64_t now) {
+	if (!arrival.pending) {
+		return false;
+	}
+	const pbcfg::Action &actioncfg = groupcfg_.action(arrival.action_index);
+	for (int r = 0; r < actioncfg.response_size() && r < 64; r++) {
+		uint64_t bit = uint64_t(1) << r;
+		if (!(arrival.pending & bit) || (actioncfg.response(r) != type_name)) continue;
+		arrival.pending &= ~bit;
+		if (!arrival.pending) {
+			inflight_--;
+		}
+		uint64_t elapsed = (now > arrival.intended) ? (now - arrival.intended) : 0;
+		if (latency_) {
+			latency_->record_response(arrival.action_index, r, elapsed);
+			if (!arrival.pending) {
+				latency_->record_action(arrival.action_index, elapsed, peer_);
+			}
+		}
+		trace_.response(arrival.action_index, r, arrival.seq, elapsed, last_recv_len());
+		if (!arrival.pending) {
+			trace_.action_done(arrival.action_index, kEventOk, arrival.seq, elapsed);
+		}
+		return true;
+	}
+	return false;
+}
+
+ClientSession::Arrival *ClientSession::find_arrival(uint32_t seq) {
+	if (arrivals_.empty()) {
+		return NULL;
+	}
+	// 直接按与队头的 seq 差定位; seq 回绕时跳过了 0, 回绕之后的位置要再往前一个
+	uint32_t offset = seq - arrivals_.front().seq;
+	if ((offset < arrivals_.size()) && (arrivals_[offset].seq == seq)) {
+		return &arrivals_[offset];
+	}
+	if ((offset > 0) && (offset - 1 < arrivals_.size()) && (arrivals_[offset - 1].seq == seq)) {
+		return &arrivals_[offset - 1];
+	}
+	return NULL;
+}
+
+void ClientSession::expire_arrivals(uint64_t now) {
+	for (size_t i = 0; i < arrivals_.size(); i++) {
+		Arrival &arrival = arrivals_[i];
+		int32_t timeout = groupcfg_.action(arrival.action_index).timeout();
+		if (arrival.pending && (timeout > 0) && (arrival.intended + uint64_t(timeout) * 1000000 <= now)) {
+			arrival.pending = 0;
+			arrival.timed_out = true;
+			inflight_--;
+			if (latency_) {
+				latency_->record_timeout(arrival.action_index, now - arrival.intended, peer_);
+			}
+			trace_.action_done(arrival.action_index, kEventTimedOut, arrival.seq, now - arrival.intended);
+		}
+	}
+	pop_done_arrivals();
+}
+
+void ClientSession::pop_done_arrivals(void) {
+	while (!arrivals_.empty() && !arrivals_.front().pending) {
+		arrivals_.pop_front();
+	}
+}
+
+void ClientSession::arm_arrival_timer(uint64_t wakeup) {
+	for (size_t i = 0; i < arrivals_.size(); i++) {
+		const Arrival &arrival = arrivals_[i];
+		int32_t timeout = groupcfg_.action(arrival.action_index).timeout();
+		if (arrival.pending && (timeout > 0)) {
+			wakeup = std::min(wakeup, arrival.intended + uint64_t(timeout) * 1000000);
+		}
+	}
+	if (wakeup == UINT64_MAX) {
+		loop_->cancel_timer(this);
+	} else {
+		loop_->set_timer(this, wakeup);
+	}
+}
+
+uint64_t ClientSession::next_interval(void) {
+	if (groupcfg_.arrival() == pbcfg::ARRIVAL_POISSON) {
+		return uint64_t(std::exponential_distribution<double>(1.0 / interval_usec_)(rng_));
+	}
+	return uint64_t(interval_usec_);
+}
+
+void ClientSession::fail(const std::string &errmsg) {
+	ALOG(ERROR) << "Error ClientSession, Client-" << groupcfg_.name()
+		<< ":[" << clientcfg_.uid() << ", " << clientcfg_.role_time() << "]: " << errmsg;
+	if (latency_ && (state_ != kDone)) {
+		latency_->record_error(peer_);
+		// 闭环模式下正在等的那个 (超时的已经记过了), 开环/流水线模式下所有还在等的
+		if ((state_ == kWaitResponses) && !is_timeout_) {
+			latency_->record_abandoned(action_index_, 1, peer_);
+		}
+		for (size_t i = 0; i < arrivals_.size(); i++) {
+			if (arrivals_[i].pending) {
+				latency_->record_abandoned(arrivals_[i].action_index, 1, peer_);
+			}
+		}
+	}
+	finish(kEventFailed);
+}
+
+void ClientSession::finish(EventStatus status) {
+	if (state_ == kDone) return ;
+	if (state_ > kConnecting) {
+		trace_.client_stop(status);
+	}
+	loop_->cancel_timer(this);
+	if (mux_) {
+		release_inbox();
+		mux_->detach(clientcfg_.uid());
+	} else if (client_->is_connected()) {
+		loop_->del_fd(client_->connfd());
+		client_->close_connection();
+	}
+	// 连接一关闭就记断开, 连接中的客户端数在运行过程中就能降下来 (连不上的没有记过连接, 也不记断开)
+	if (latency_ && connected_) {
+		latency_->record_disconnect(peer_);
+		connected_ = false;
+	}
+	state_ = kDone;
+	loop_->release();
+}
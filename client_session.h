@@ -0,0 +1,174 @@
+#ifndef __CLIENT_SESSION_H__
+#define __CLIENT_SESSION_H__
+
+#include "common.h"
+#include "robot.pb.h"
+#include "client.h"
+#include "event_loop.h"
+#include "latency_stats.h"
+#include "event_trace.h"
+#include "connect_pacer.h"
+#include "load_profile.h"
+#include "mux_connection.h"
+#include "source_binder.h"
+#include <deque>
+#include <random>
+
+
+// ClientSession: 在 EventLoop 上以非阻塞状态机的方式执行一个 pbcfg::Client 的 Group 行为,
+// 闭环模式的语义与 RobotClientWorker + RunGroupOnce 一致:
+//   发送请求 -> 等待所有 response (或 timeout) -> 等到 min_duration -> think_time -> 下一个 Action
+// 开环模式 (groupcfg.rate() > 0) 按时刻表依次发出各个 Action 的请求, 不等之前的 response,
+// 回包按类型匹配到最早还在等它的 Action 上, 时延从计划发送时刻算起
+// 流水线模式 (groupcfg.pipeline_depth() > 0) 最多同时有 pipeline_depth 个 Action 在等 response,
+// 有空位就立刻发出下一个, 时延从实际发送时刻算起
+// 每个 Action 的请求都带上递增的 seq, 回包按 seq 对应到发出它的 Action (对端没有回填 seq 时按类型)
+// 多路复用时 (mux 不为 NULL) 不自己连接, 请求写进共用连接的发送缓冲, 回包由 MuxConnection 按 uid 投递过来
+// 有多个对端时每次连接按 Group.peer_policy 选一个 (seeto: PeerSet), 计数和时延按对端分开记
+class ClientSession : public EventHandler {
+public:
+	~ClientSession();
+	// @latency: 记录 connect/response/Action 时延, 可以为 NULL
+	// @events: 写逐请求的事件日志, 可以为 NULL (没有开启)
+	// @pacer: 该 Group 共享的连接限速器, 可以为 NULL (不限速)
+	// @source: 该 Group 共享的源地址分配器, 可以为 NULL (由内核选)
+	// @profile: 该 Group 的负载曲线, 决定启动时刻和什么时候结束; @client_index: clientcfg 在 Group 里的下标
+	// @mux: 共用的连接, NULL 表示自己连接 (多路复用时由 mux 按 pacer 排队, 绑定源地址后连接, 这里的 pacer/source 不起作用)
+	ClientSession(const pbcfg::Group &groupcfg, const pbcfg::Client &clientcfg, EventLoop *loop,
+				  GroupLatency *latency, EventLogWriter *events, ConnectPacer *pacer, SourceBinder *source,
+				  const LoadProfile *profile, int client_index, MuxConnection *mux = NULL);
+
+public:
+	// 等到负载曲线给它的启动时刻, (按 pacer 排队) 发起非阻塞连接, 连上后开始执行第一个 Action,
+	// 必须在 loop 所在线程调用
+	void start(void);
+	bool finished(void) const { return state_ == kDone; }
+	// 测试用: 下一个请求的 seq 从 seq + 1 开始 (回绕时跳过 0), 必须在 start 之前调用
+	void set_seq(uint32_t seq) { headmsg_.set_seq(seq); }
+
+	// implements EventHandler -----------------------------------------
+	void on_events(uint32_t events);
+	void on_timer(void);
+
+	// 只给 MuxConnection 调 -------------------------------------------
+	// 共用的连接建立了
+	void on_mux_connected(void);
+	// 收下发给本客户端的回包 (之后统一在 on_mux_responses 里处理); @return true: 之前没有待处理的回包
+	bool deliver(Message *rsphead, Message *rspbody, int32_t recv_len);
+	void on_mux_responses(void);
+	// 共用的连接失败或断开了, 已经 detach; @status: 还在等连接时记到事件日志的 connect 状态
+	void on_mux_closed(EventStatus status, const std::string &errmsg);
+
+private:
+	enum State {
+		kIdle,
+		kWaitStart,			// 等待负载曲线给它的启动时刻
+		kWaitConnect,		// 等待 pacer 分配的连接时刻
+		kConnecting,		// 非阻塞 connect 已发出, 等待可写或 connect_timeout
+		kRunning,			// 可以立刻开始下一个 Action
+		kWaitResponses,		// 请求已发出, 等待 response 或 timeout
+		kWaitMinDuration,	// response 已收齐 (或超时), 等待 min_duration 到期
+		kThinking,			// 等待 think_time 到期后开始下一个 Action
+		kDone,
+	};
+
+	// 开环/流水线模式下一次已发出, 还在等 response 的 Action
+	struct Arrival {
+		uint64_t intended;		// 计划发送时刻 (now_usec)
+		uint32_t seq;
+		int action_index;
+		uint64_t pending;		// 还没收到的 response 下标位图
+		bool timed_out;
+	};
+
+	// 多路复用时收到的一个回包
+	struct Inbound {
+		Message *head;
+		Message *body;
+		int32_t len;
+	};
+
+	void pace_connect(void);
+	void begin_connect(void);
+	void on_connected(void);
+	// 处理已经收到的回包, 然后推进状态机
+	void process_responses(void);
+	// 取下一个回包: 自己的连接从接收缓冲里解, 多路复用时从 inbox_ 里取
+	bool next_response(Message **rsphead, Message **rspbody, bool &complete, std::ostringstream &err);
+	// 最近一个回包的长度 (写事件日志用)
+	int32_t last_recv_len(void) const { return mux_ ? recv_len_ : client_->last_recv_len(); }
+	void release_inbox(void);
+	// 跳过已停止的 Action, 定位到下一个要执行的 Action;
+	// @return false: 所有 loop 都执行完了, 或者已经过了负载曲线给它的停止时刻
+	bool select_action(void);
+	void advance(void);
+	bool begin_action(const pbcfg::Action &actioncfg);
+	bool dispatch_responses(void);
+	bool finish_action(void);
+	bool leave_action(void);
+	// 开环/流水线模式 ---------------------------------------------------
+	void open_loop_tick(void);
+	bool send_due_arrivals(uint64_t now);
+	void pipeline_tick(void);
+	// 发出当前 Action 的请求 (只放入发送缓冲) 并登记到 arrivals_
+	bool push_arrival(uint64_t intended);
+	bool flush_requests(void);
+	bool dispatch_arrival_responses(void);
+	void match_response(uint32_t seq, const std::string &type_name, uint64_t now);
+	bool take_response(Arrival &arrival, const std::string &type_name, uint64_t now);
+	// @return: NULL: 不在等该 seq 的回包
+	Arrival *find_arrival(uint32_t seq);
+	void expire_arrivals(uint64_t now);
+	void pop_done_arrivals(void);
+	// 定时器设到 wakeup 和最早的超时时刻中较早的那个
+	void arm_arrival_timer(uint64_t wakeup);
+	uint64_t next_interval(void);
+
+	void fail(const std::string &errmsg);
+	// @status: 写到事件日志的客户端结束状态
+	void finish(EventStatus status = kEventOk);
+	const pbcfg::Action &current_action(void) const { return groupcfg_.action(action_index_); }
+	// 本客户端的连接所连的对端
+	const std::string &peer_addr(void) const { return peers_ ? peers_->addr(peer_) : groupcfg_.peer_addr(); }
+
+private:
+	const pbcfg::Group &groupcfg_;
+	const pbcfg::Client &clientcfg_;
+	EventLoop *loop_;
+	GroupLatency *latency_;
+	EventTrace trace_;
+	ConnectPacer *pacer_;
+	const LoadProfile *profile_;
+	int client_index_;
+	uint64_t connect_start_;
+	MuxConnection *mux_;
+	PeerSet *peers_;			// latency 为 NULL 时也为 NULL, 只连 peer_addr
+	int peer_;					// 连接所连的对端在 peers_ 里的下标, 多路复用时跟着 mux_
+	bool connected_;			// 已经记过 connect, 还没记断开 (多路复用时由 MuxConnection 记, 总是 false)
+	Client *client_;			// loop 用 io_uring 时是 UringClient; 多路复用时是共用的连接, 不归它管
+	std::deque<Inbound> inbox_;
+	int32_t recv_len_;
+	pbcfg::CsMsgHead headmsg_;
+
+	State state_;
+	int count_;
+	int action_index_;
+	bool is_timeout_;
+	uint64_t wait_start_;
+	std::ostringstream requests_strings_;
+	std::vector<std::string> recved_responses_;
+	std::vector<std::string> timeout_responses_;
+
+	// 开环/流水线模式
+	bool open_loop_;
+	bool pipelined_;
+	bool sending_;				// 还有没发出的 Action
+	double interval_usec_;		// 本客户端的平均发送间隔
+	uint64_t next_arrival_;
+	int inflight_;				// arrivals_ 中还在等 response 的个数
+	std::deque<Arrival> arrivals_;	// 按 seq 递增排列, 只从队头出队, 所以 seq 是连续的
+	std::mt19937_64 rng_;
+};
+
+
+#endif // __CLIENT_SESSION_H__
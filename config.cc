@@ -1,9 +1,13 @@
 #include "config.h"
 #include "flags.h"
+#include "source_binder.h"
+#include "peer_set.h"
 
 
 pbcfg::CfgRoot cfg_root;
 int kMaxTotalClientNum = 10000;
+int kMaxTotalEventClientNum = 1000000;
+int kMaxTotalCoroClientNum = 1000000;
 UniqNameMap uniq_name_map;
 
 // Define global frame header config variables
@@ -41,9 +45,100 @@ bool ValidationRobotConfigs(const pbcfg::CfgRoot &cfg) {
 			total_client_set.insert(key);
 		}
 
+		if ((groupcfg.connect_rate() < 0) || (groupcfg.connect_timeout() < 0)) {
+			LOG(ERROR) << "Config Error: Group-" << groupcfg.name() << " connect_rate(" << groupcfg.connect_rate()
+				<< ") or connect_timeout(" << groupcfg.connect_timeout() << ") < 0";
+			return false;
+		}
+
+		// 开环模式只有 epoll 引擎支持, 且每个 Action 的 response 用 64 位位图跟踪
+		if (groupcfg.rate() < 0) {
+			LOG(ERROR) << "Config Error: Group-" << groupcfg.name() << " rate(" << groupcfg.rate() << ") < 0";
+			return false;
+		}
+		if ((groupcfg.rate() > 0) && (FLAGS_engine != "epoll")) {
+			LOG(ERROR) << "Config Error: Group-" << groupcfg.name() << " has rate(" << groupcfg.rate()
+				<< "), open-loop mode needs --engine=epoll";
+			return false;
+		}
+
+		// 流水线模式同样只有 epoll 引擎支持, 且不能和开环模式一起用
+		if (groupcfg.pipeline_depth() < 0) {
+			LOG(ERROR) << "Config Error: Group-" << groupcfg.name() << " pipeline_depth("
+				<< groupcfg.pipeline_depth() << ") < 0";
+			return false;
+		}
+		if ((groupcfg.pipeline_depth() > 0) && ((FLAGS_engine != "epoll") || (groupcfg.rate() > 0))) {
+			LOG(ERROR) << "Config Error: Group-" << groupcfg.name() << " has pipeline_depth("
+				<< groupcfg.pipeline_depth() << "), pipelined mode needs --engine=epoll and rate: 0";
+			return false;
+		}
+		// 只有等 response 的 Action 占窗口, 一个都没有时窗口限制不了发送
+		if (groupcfg.pipeline_depth() > 0) {
+			bool waits = false;
+			for (int j = 0; j < groupcfg.action_size(); j++) {
+				waits = waits || (groupcfg.action(j).response_size() > 0);
+			}
+			if (!waits) {
+				LOG(ERROR) << "Config Error: Group-" << groupcfg.name() << " has pipeline_depth("
+					<< groupcfg.pipeline_depth() << "), but no action expects a response";
+				return false;
+			}
+		}
+
+		// 多路复用只有 epoll 引擎支持, 回包按 uid 分发, 所以 Group 内 uid 不能重复
+		if (groupcfg.mux_clients() < 0) {
+			LOG(ERROR) << "Config Error: Group-" << groupcfg.name() << " mux_clients("
+				<< groupcfg.mux_clients() << ") < 0";
+			return false;
+		}
+		if (groupcfg.mux_clients() > 0) {
+			if (FLAGS_engine != "epoll") {
+				LOG(ERROR) << "Config Error: Group-" << groupcfg.name() << " has mux_clients("
+					<< groupcfg.mux_clients() << "), multiplexed mode needs --engine=epoll";
+				return false;
+			}
+			std::set<uint32_t> uids;
+			for (int j = 0; j < groupcfg.client_count(); j++) {
+				if (!uids.insert(groupcfg.client(j).uid()).second) {
+					LOG(ERROR) << "Config Error: Group-" << groupcfg.name() << " has mux_clients("
+						<< groupcfg.mux_clients() << "), but uid(" << groupcfg.client(j).uid() << ") is duplicated";
+					return false;
+				}
+			}
+		}
+
+		// 源地址的 ip 和端口范围
+		std::ostringstream source_err;
+		if (!SourceBinder::validate(groupcfg.source(), source_err)) {
+			LOG(ERROR) << "Config Error: Group-" << groupcfg.name() << " " << source_err.str();
+			return false;
+		}
+
+		// 对端地址不能为空或重复
+		std::ostringstream peer_err;
+		if (!PeerSet::validate(groupcfg, peer_err)) {
+			LOG(ERROR) << "Config Error: Group-" << groupcfg.name() << " " << peer_err.str();
+			return false;
+		}
+
+		// 负载曲线的时长和台阶数
+		const pbcfg::LoadProfile &load = groupcfg.load();
+		if ((load.ramp_up() < 0) || (load.steady() < 0) || (load.ramp_down() < 0) || (load.steps() <= 0)) {
+			LOG(ERROR) << "Config Error: Group-" << groupcfg.name() << " load: ramp_up(" << load.ramp_up()
+				<< "), steady(" << load.steady() << "), ramp_down(" << load.ramp_down()
+				<< ") must be >= 0 and steps(" << load.steps() << ") > 0";
+			return false;
+		}
+
 		// 任何 Action 中的 request 不允许没有对应的 uniq_name,
 		for (int j = 0; j < groupcfg.action_size(); j++) {
 			const pbcfg::Action &action = groupcfg.action(j);
+			if (((groupcfg.rate() > 0) || (groupcfg.pipeline_depth() > 0)) && (action.response_size() > 64)) {
+				LOG(ERROR) << "Config Error: Group-" << groupcfg.name() << " action(" << j
+					<< ") expects " << action.response_size() << " responses, open-loop/pipelined mode allows 64";
+				return false;
+			}
 			for (int k = 0; k < action.request_uniq_name_size(); k++) {
 				const std::string &request_uniq_name = action.request_uniq_name(k);
 				if (uniq_name_map.count(request_uniq_name) == 0) {
@@ -55,16 +150,37 @@ bool ValidationRobotConfigs(const pbcfg::CfgRoot &cfg) {
 		}
 	}
 
-	// 总客户端数量(对应线程数量) 不能超过robot的硬限制
-	if (total_client > kMaxTotalClientNum) {
+	// 总客户端数量(thread 引擎下对应线程数量) 不能超过robot的硬限制
+	int max_total_client = kMaxTotalClientNum;
+	if (FLAGS_engine == "epoll") {
+		max_total_client = kMaxTotalEventClientNum;
+	} else if (FLAGS_engine == "coro") {
+		max_total_client = kMaxTotalCoroClientNum;
+	}
+	if (total_client > max_total_client) {
 		LOG(ERROR) << "Config Error: need too many client: " << total_client
-			<< " (> max: " << kMaxTotalClientNum << ")";
+			<< " (> max: " << max_total_client << ", engine: " << FLAGS_engine << ")";
 		return false;
 	}
 	
 	return true;
 }
 
+bool UniqRequest::compile_body(std::ostringstream &err) {
+	std::unique_ptr<Message> msg(bodymsg->New());
+	if (PB_MASTER.load_text_format_string_message(bodycfg->text(), msg.get()) == -1) {
+		err << "load text_format_string, type_name: " << type_name;
+		return false;
+	}
+	body.clear();
+	if (!msg->SerializeToString(&body)) {
+		err << "serialize, type_name: " << type_name
+			<< ", missing: " << msg->InitializationErrorString();
+		return false;
+	}
+	return true;
+}
+
 void cleanup_robot_config() {
 	for (UniqNameMapIter it = uniq_name_map.begin(); it != uniq_name_map.end(); ++it) {
 		delete it->second;
@@ -89,7 +205,30 @@ bool CollectConfigInfos(const pbcfg::CfgRoot &cfg) {
 			return false;
 		}
 
-		uniq_name_map[bodycfg.uniq_name()] = new UniqRequest(&bodycfg, bodymsg);
+		UniqRequest *uniqreq = new UniqRequest(&bodycfg, bodymsg);
+		std::ostringstream errmsg;
+		if (!uniqreq->compile_body(errmsg)) {
+			LOG(ERROR) << "Config Error: request(uniq_name:" << bodycfg.uniq_name()
+				<< ") cannot be compiled: " << errmsg.str();
+			delete uniqreq;
+			return false;
+		}
+		uniq_name_map[bodycfg.uniq_name()] = uniqreq;
+	}
+
+	// 回包类型在这里预先解析, 解包时直接命中 PbMaster 的 prototype 缓存
+	for (int i = 0; i < cfg.group_config_size(); i++) {
+		const pbcfg::Group &groupcfg = cfg.group_config(i);
+		for (int j = 0; j < groupcfg.action_size(); j++) {
+			const pbcfg::Action &action = groupcfg.action(j);
+			for (int k = 0; k < action.response_size(); k++) {
+				if (!PB_MASTER.preload_prototype(action.response(k))) {
+					LOG(WARNING) << "Config Warning: response(" << action.response(k)
+						<< ") in Group-" << groupcfg.name() << " cannot be create_message, "
+						"it will never be received";
+				}
+			}
+		}
 	}
 
 	return true;
@@ -110,6 +249,15 @@ bool init_robot_config() {
 	if (!CollectConfigInfos(cfg_root)) {
 		return false;
 	}
+	// --looptime: 没有配置负载曲线的 Group 都只有 looptime 秒的稳态, 按时间结束
+	if (FLAGS_looptime > 0) {
+		for (int i = 0; i < cfg_root.group_config_size(); i++) {
+			pbcfg::Group *groupcfg = cfg_root.mutable_group_config(i);
+			if (!groupcfg->has_load()) {
+				groupcfg->mutable_load()->set_steady(FLAGS_looptime * 1000);
+			}
+		}
+	}
 	if (!ValidationRobotConfigs(cfg_root)) {
 		return false;
 	}
@@ -16,6 +16,8 @@ typedef UniqNameMap::iterator UniqNameMapIter;
 
 extern pbcfg::CfgRoot cfg_root;
 extern int kMaxTotalClientNum;
+extern int kMaxTotalEventClientNum;
+extern int kMaxTotalCoroClientNum;
 extern UniqNameMap uniq_name_map;
 // Add with other global config declarations (like cfg_root)
 extern FrameHeaderConfig global_frame_header_config;
@@ -32,10 +34,17 @@ void cleanup_robot_config();
 struct UniqRequest {
 	~UniqRequest() { delete bodymsg; }
 	UniqRequest(const pbcfg::Body *bdcfg, const Message *bdmsg)
-		: bodycfg(bdcfg), bodymsg(bdmsg) { }
+		: bodycfg(bdcfg), bodymsg(bdmsg), type_name(bdmsg->GetTypeName()) { }
+
+	// 把 bodycfg->text() 解析并序列化成 body 线上字节, 只在加载配置时做一次
+	// @return false: text 无法解析或无法序列化
+	bool compile_body(std::ostringstream &err);
 
 	const pbcfg::Body *bodycfg;
 	const Message *bodymsg;
+	// 预编译好的请求: 发送时只需要设置包头, 然后直接拷贝 body
+	std::string type_name;
+	std::string body;
 };
 
 
@@ -0,0 +1,43 @@
+#ifndef __CONNECT_PACER_H__
+#define __CONNECT_PACER_H__
+
+#include <stdint.h>
+#include <atomic>
+#include <algorithm>
+
+
+// ConnectPacer: 一个 Group 的所有客户端共享, 把发起连接的时刻按 1/rate 的间隔排开,
+// 避免成千上万个客户端同时 connect 冲垮服务端的 accept 队列.
+// 领取时刻是无锁的, thread 引擎的客户端线程和 epoll 引擎的多个循环都可以直接调用
+class ConnectPacer {
+public:
+	// @rate: 每秒发起的连接数, <= 0 表示不限速
+	explicit ConnectPacer(double rate)
+		: interval_usec_(rate > 0 ? static_cast<uint64_t>(1e6 / rate) : 0),
+		  next_(0) { }
+
+public:
+	// 领取下一个可以发起连接的时刻 (now_usec() 的时间轴), 不早于 now
+	uint64_t acquire(uint64_t now) {
+		if (interval_usec_ == 0) {
+			return now;
+		}
+		uint64_t next = next_.load(std::memory_order_relaxed);
+		uint64_t slot;
+		do {
+			slot = std::max(next, now);
+		} while (!next_.compare_exchange_weak(next, slot + interval_usec_, std::memory_order_relaxed));
+		return slot;
+	}
+
+private:
+	ConnectPacer(const ConnectPacer &);
+	ConnectPacer &operator=(const ConnectPacer &);
+
+private:
+	uint64_t interval_usec_;
+	std::atomic<uint64_t> next_;
+};
+
+
+#endif // __CONNECT_PACER_H__
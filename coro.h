@@ -0,0 +1,120 @@
+#ifndef __CORO_H__
+#define __CORO_H__
+
+#include "common.h"
+#include <coroutine>
+#include <exception>
+#include <type_traits>
+#include <utility>
+
+
+// CoFrameStats: 本线程上协程帧占用的内存 (帧在哪个线程释放就记在哪个线程, 所以 live 可能为负)
+struct CoFrameStats {
+	int64_t live;		// 当前还没释放的字节数
+	int64_t peak;		// live 的峰值
+	uint64_t frames;	// 分配过的帧数
+
+	static CoFrameStats &local(void) {
+		static thread_local CoFrameStats stats = {0, 0, 0};
+		return stats;
+	}
+};
+
+// 所有 CoTask 的 promise 的公共部分
+class CoPromiseBase {
+public:
+	static void *operator new(size_t size) {
+		CoFrameStats &stats = CoFrameStats::local();
+		stats.live += size;
+		stats.frames++;
+		if (stats.live > stats.peak) {
+			stats.peak = stats.live;
+		}
+		return ::operator new(size);
+	}
+	static void operator delete(void *ptr, size_t size) {
+		CoFrameStats::local().live -= size;
+		::operator delete(ptr);
+	}
+
+	// 结束时直接切回 co_await 它的协程 (对称转移, 不增加调用栈深度), 没有就回到 resume() 的调用者
+	struct FinalAwaiter {
+		bool await_ready(void) noexcept { return false; }
+		template <typename Promise>
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h) noexcept {
+			std::coroutine_handle<> next = h.promise().continuation_;
+			return next ? next : std::noop_coroutine();
+		}
+		void await_resume(void) noexcept { }
+	};
+
+	std::suspend_always initial_suspend(void) noexcept { return std::suspend_always(); }
+	FinalAwaiter final_suspend(void) noexcept { return FinalAwaiter(); }
+	void unhandled_exception(void) { std::terminate(); }
+
+	std::coroutine_handle<> continuation_;
+};
+
+template <typename T>
+struct CoPromiseValue : public CoPromiseBase {
+	void return_value(T value) { value_ = std::move(value); }
+	T value_;
+};
+
+template <>
+struct CoPromiseValue<void> : public CoPromiseBase {
+	void return_void(void) { }
+};
+
+// CoTask: 惰性启动的协程, 被 co_await 时才开始执行, 结束后把结果交给 co_await 它的协程;
+// 根协程 (没有人 co_await 它) 用 start() 启动. CoTask 对象析构时销毁协程帧
+template <typename T = void>
+class CoTask {
+public:
+	struct promise_type : public CoPromiseValue<T> {
+		CoTask get_return_object(void) {
+			return CoTask(std::coroutine_handle<promise_type>::from_promise(*this));
+		}
+	};
+
+	~CoTask() {
+		if (handle_) {
+			handle_.destroy();
+		}
+	}
+	CoTask() { }
+	CoTask(CoTask &&other) noexcept : handle_(other.handle_) { other.handle_ = nullptr; }
+	CoTask &operator=(CoTask &&other) noexcept {
+		std::swap(handle_, other.handle_);
+		return *this;
+	}
+
+public:
+	bool await_ready(void) const noexcept { return false; }
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept {
+		handle_.promise().continuation_ = caller;
+		return handle_;
+	}
+	T await_resume(void) {
+		if constexpr (!std::is_void<T>::value) {
+			return std::move(handle_.promise().value_);
+		}
+	}
+
+	// 在当前线程上运行到第一次挂起 (或结束)
+	void start(void) { handle_.resume(); }
+	bool done(void) const { return !handle_ || handle_.done(); }
+	// 交给调度器恢复执行用, 协程帧仍归 CoTask 所有
+	std::coroutine_handle<> handle(void) const { return handle_; }
+
+private:
+	explicit CoTask(std::coroutine_handle<promise_type> handle) : handle_(handle) { }
+	CoTask(const CoTask &);
+	CoTask &operator=(const CoTask &);
+
+private:
+	std::coroutine_handle<promise_type> handle_;
+};
+
+
+#endif // __CORO_H__
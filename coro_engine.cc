@@ -0,0 +1,347 @@
+#include "coro_engine.h"
+#include "event_engine.h"
+#include "robot.h"
+#include "connect_pacer.h"
+#include "source_binder.h"
+#include "latency_stats.h"
+#include "event_trace.h"
+#include "message_pool.h"
+#include "async_log.h"
+#include "memutils.h"
+#include "timeutils.h"
+
+// 协程当前所在工作线程的延迟记录端
+static GroupLatency *CoLatency(const CoIo &io, int group_index) {
+	return LATENCY_STATS.recorder(io.worker()->index, group_index);
+}
+
+// 协程当前所在工作线程的事件日志, 和延迟记录端一样每次用的时候再取
+static EventTrace CoTrace(const CoIo &io, const pbcfg::Client &clientcfg, int group_index) {
+	return EventTrace(EVENT_LOG.writer(io.worker()->index), clientcfg.uid(), group_index);
+}
+
+
+CoTask<bool> CoRunGroupOnce(int count,
+							const pbcfg::Group &groupcfg,
+							const pbcfg::Client &clientcfg,
+							Client &client,
+							pbcfg::CsMsgHead &headmsg,
+							CoIo &io,
+							std::ostringstream &errmsg,
+							int group_index,
+							int peer) {
+	std::ostringstream requests_strings;
+	std::vector<std::string> recved_responses;
+	std::vector<std::string> timeout_responses;
+	std::ostringstream net_errmsg;
+	std::ostringstream op_errmsg;
+	for (int i = 0; i < groupcfg.action_size(); i++) {
+		const pbcfg::Action &actioncfg = groupcfg.action(i);
+		if ((actioncfg.stop_loop_count() > 0) && (count >= actioncfg.stop_loop_count())) {
+			// 一次执行 Group 内, 连续执行该 Action 的次数
+			continue;
+		}
+
+		uint32_t seq = NextSeq(headmsg);
+		size_t queued = client.buffer().send.size();
+		if (!SendActionRequests(actioncfg, client, headmsg, requests_strings, errmsg)) {
+			co_return false;
+		}
+		if (GroupLatency *latency = CoLatency(io, group_index)) {
+			latency->record_request(i, peer);
+		}
+		CoTrace(io, clientcfg, group_index).request(i, seq, client.buffer().send.size() - queued);
+
+		bool is_timeout = false;
+		uint64_t sent_usec = now_usec();
+		uint64_t deadline = (actioncfg.timeout() > 0) ? sent_usec + uint64_t(actioncfg.timeout()) * 1000000 : 0;
+		recved_responses.clear();
+		while (true) {
+			if ((deadline > 0) && (now_usec() >= deadline)) {
+				is_timeout = true;
+				calc_timeout_responses(actioncfg, recved_responses, timeout_responses);
+				break;
+			}
+
+			if (client.net_tcp_send(net_errmsg) == -1) {
+				errmsg << "req:" << requests_strings.str() << ", err: " << net_errmsg.str();
+				if (GroupLatency *latency = CoLatency(io, group_index)) {
+					latency->record_abandoned(i, 1, peer);
+				}
+				co_return false;
+			}
+			if (client.net_tcp_recv(net_errmsg) == -1) {
+				errmsg << "req:" << requests_strings.str() << ", err: " << net_errmsg.str();
+				if (GroupLatency *latency = CoLatency(io, group_index)) {
+					latency->record_abandoned(i, 1, peer);
+				}
+				co_return false;
+			}
+			bool action_done = false;
+			EventTrace trace = CoTrace(io, clientcfg, group_index);
+			if (!DrainActionResponses(actioncfg, i, seq, sent_usec, client, recved_responses,
+									  CoLatency(io, group_index), action_done, op_errmsg, &trace, peer)) {
+				errmsg << "recv_msg, after req:" << requests_strings.str() << "err: " << op_errmsg.str();
+				if (GroupLatency *latency = CoLatency(io, group_index)) {
+					latency->record_abandoned(i, 1, peer);
+				}
+				co_return false;
+			}
+			if (action_done) {
+				break;
+			}
+			// 挂起到 fd 有事件或超时, 然后回到循环开头重新检查; 发送缓冲没发完时还要等可写
+			uint32_t mask = EPOLLIN | EPOLLRDHUP | (client.buffer().send.empty() ? 0 : EPOLLOUT);
+			co_await io.wait(mask, deadline);
+		}
+
+		uint64_t min_end = sent_usec + uint64_t(actioncfg.min_duration()) * 1000;
+		if ((actioncfg.min_duration() > 0) && (now_usec() < min_end)) {
+			co_await io.sleep_until(min_end);
+		}
+
+		if (is_timeout) {
+			GroupLatency *latency = CoLatency(io, group_index);
+			if (latency) {
+				latency->record_timeout(i, now_usec() - sent_usec, peer);
+			}
+			CoTrace(io, clientcfg, group_index).action_done(i, kEventTimedOut, seq, now_usec() - sent_usec);
+			std::ostringstream timeout_string;
+			timeout_string << "[";
+			for (int r = 0; r < (int)timeout_responses.size(); r++) {
+				timeout_string << (r == 0 ? "" : ",") << timeout_responses[r];
+			}
+			timeout_string << "]";
+			errmsg << "requests: " << requests_strings.str() << " ==> timeout_responses: " << timeout_string.str();
+			co_return false;
+		}
+
+		if (actioncfg.think_time() > 0) {
+			co_await io.sleep_until(now_usec() + uint64_t(actioncfg.think_time()) * 1000);
+		}
+	}
+	co_return true;
+}
+
+// 一个协程客户端除协程帧以外的状态, 生命周期覆盖整个运行过程
+struct CoClient {
+	CoClient(const pbcfg::Group &group, int client_index_, CoWorker *worker,
+			 int group_index_, ConnectPacer *pacer_, SourceBinder *source_, const LoadProfile *profile_)
+		: groupcfg(group),
+		  clientcfg(group.client(client_index_)),
+		  client_index(client_index_),
+		  group_index(group_index_),
+		  pacer(pacer_),
+		  profile(profile_),
+		  peer(0),
+		  client(group.max_pkg_len(), group.has_checksum(), ChecksumType(group.checksum_type())),
+		  io(worker) {
+		client.set_connect_timeout(group.connect_timeout());
+		client.set_source(source_);
+	}
+
+	const pbcfg::Group &groupcfg;
+	const pbcfg::Client &clientcfg;
+	int client_index;
+	int group_index;
+	ConnectPacer *pacer;
+	const LoadProfile *profile;
+	int peer;				// 连接所连的对端 (seeto: PeerSet)
+	Client client;
+	CoIo io;
+	CoTask<> task;
+};
+
+// 等到负载曲线给它的启动时刻, 按 connect_rate 排队, 然后非阻塞连接, 连上后 fd 交给 io 等待
+static CoTask<bool> CoConnect(CoClient *self) {
+	uint64_t start = self->profile->client_start(self->client_index);
+	if (start > now_usec()) {
+		co_await self->io.sleep_until(start);
+	}
+	uint64_t now = now_usec();
+	uint64_t slot = self->pacer->acquire(now);
+	if (slot > now) {
+		co_await self->io.sleep_until(slot);
+	}
+
+	const pbcfg::Group &groupcfg = self->groupcfg;
+	PeerSet *peers = LATENCY_STATS.peers(self->group_index);
+	self->peer = peers ? peers->pick(self->clientcfg.uid()) : 0;
+	const std::string &peer_addr = peers ? peers->addr(self->peer) : groupcfg.peer_addr();
+	std::ostringstream errmsg;
+	uint64_t connect_start = now_usec();
+	int ret = self->client.start_connect(peer_addr, errmsg);
+	if (ret != -1) {
+		self->io.set_fd(self->client.connfd());
+	}
+	if (ret == 1) {
+		uint64_t deadline = (groupcfg.connect_timeout() > 0)
+			? connect_start + uint64_t(groupcfg.connect_timeout()) * 1000 : 0;
+		if ((co_await self->io.wait(EPOLLOUT, deadline)) == 0) {
+			self->io.set_fd(-1);
+			self->client.close_connection();
+			errno = ETIMEDOUT;
+			errmsg << "connect timeout";
+			ret = -1;
+		} else if (!self->client.finish_connect(errmsg)) {
+			ret = -1;
+		}
+	}
+	if (ret == -1) {
+		self->io.set_fd(-1);
+		bool timed_out = (errno == ETIMEDOUT);
+		GroupLatency *latency = CoLatency(self->io, self->group_index);
+		if (latency && timed_out) {
+			latency->record_connect_timeout(self->peer);
+		}
+		if (latency) {
+			latency->record_error(self->peer);
+		}
+		CoTrace(self->io, self->clientcfg, self->group_index)
+			.connect(timed_out ? kEventTimedOut : kEventFailed, now_usec() - connect_start);
+		ALOG(ERROR) << "Error CoConnect, Client-" << groupcfg.name()
+			<< ":[" << self->clientcfg.uid() << ", " << self->clientcfg.role_time() << "]"
+			", cannot connect to peer: " << peer_addr << ", err: " << errmsg.str();
+		co_return false;
+	}
+	GroupLatency *latency = CoLatency(self->io, self->group_index);
+	uint64_t elapsed = now_usec() - connect_start;
+	if (latency) {
+		latency->record_connect(elapsed, self->peer);
+	}
+	CoTrace(self->io, self->clientcfg, self->group_index).connect(kEventOk, elapsed);
+	co_return true;
+}
+
+// 与 RobotClientWorker 相同的流程: 连接, 执行 loop_count 次 Group, 出错就结束
+static CoTask<> CoRobotClient(CoClient *self) {
+	if (co_await CoConnect(self)) {
+		const pbcfg::Group &groupcfg = self->groupcfg;
+		const pbcfg::Client &clientcfg = self->clientcfg;
+		// TODO(zog): 通用包头设置
+		pbcfg::CsMsgHead headmsg;
+		headmsg.set_uid(clientcfg.uid());
+		headmsg.set_role_tm(clientcfg.role_time());
+		headmsg.set_ret(0);
+
+		std::ostringstream errmsg;
+		EventStatus stop_status = kEventOk;
+		for (int count = 0; self->profile->next_loop(self->client_index, count, now_usec()); count++) {
+			if (!co_await CoRunGroupOnce(count, groupcfg, clientcfg, self->client, headmsg, self->io,
+										 errmsg, self->group_index, self->peer)) {
+				if (GroupLatency *latency = CoLatency(self->io, self->group_index)) {
+					latency->record_error(self->peer);
+				}
+				stop_status = kEventFailed;
+				ALOG(ERROR) << "Error CoRunGroupOnce, Client-" << groupcfg.name()
+					<< ":[" << clientcfg.uid() << ", " << clientcfg.role_time() << "]: " << errmsg.str();
+				break;
+			}
+		}
+		if (GroupLatency *latency = CoLatency(self->io, self->group_index)) {
+			latency->record_disconnect(self->peer);
+		}
+		CoTrace(self->io, clientcfg, self->group_index).client_stop(stop_status);
+		self->io.set_fd(-1);
+		self->client.close_connection();
+	}
+	self->io.worker()->sched->root_finished();
+}
+
+// RunRobotsOnCoroutines 的上下文
+struct CoEngine {
+	const pbcfg::CfgRoot *cfg;
+	CoScheduler sched;
+	std::vector<ConnectPacer *> pacers;				// 每个 Group 一个, 同一个 Group 的客户端共享
+	std::vector<SourceBinder *> sources;			// 同上
+	std::vector<std::vector<CoClient *> > clients;	// 每个工作线程创建的客户端
+};
+
+// 所有 Group 的客户端依次编号, 第 k 个由 k % 工作线程数 的线程创建 (内存分配在该线程所在的节点上) 并启动
+static void CoWorkerStart(CoWorker *worker, void *arg) {
+	CoEngine *engine = static_cast<CoEngine *>(arg);
+	int worker_num = engine->sched.worker_num();
+	std::vector<CoClient *> &clients = engine->clients[worker->index];
+	int base = 0;
+	for (int g = 0; g < engine->cfg->group_config_size(); g++) {
+		const pbcfg::Group &groupcfg = engine->cfg->group_config(g);
+		int first = ((worker->index - base) % worker_num + worker_num) % worker_num;
+		for (int c = first; c < groupcfg.client_count(); c += worker_num) {
+			CoClient *client = new CoClient(groupcfg, c, worker, g, engine->pacers[g], engine->sources[g],
+											LATENCY_STATS.profile(g));
+			client->task = CoRobotClient(client);
+			engine->sched.spawn(&client->io, client->task);
+			clients.push_back(client);
+		}
+		base += groupcfg.client_count();
+	}
+}
+
+static void CoWorkerExit(CoWorker *worker, void *arg) {
+	MessagePool::local().flush_stats();
+}
+
+void RunRobotsOnCoroutines(const pbcfg::CfgRoot &cfg, int worker_num, bool pin, bool numa_aware) {
+	int total_client = 0;
+	for (int i = 0; i < cfg.group_config_size(); i++) {
+		total_client += cfg.group_config(i).client_count();
+	}
+	raise_nofile_limit(total_client + 1024);
+	uint64_t base_rss = rss_bytes();
+
+	CoEngine engine;
+	engine.cfg = &cfg;
+	std::ostringstream errmsg;
+	if (!engine.sched.init(worker_num, pin, numa_aware, errmsg)) {
+		LOG(ERROR) << "Error RunRobotsOnCoroutines, init scheduler: " << errmsg.str();
+		return ;
+	}
+	worker_num = engine.sched.worker_num();
+	engine.clients.resize(worker_num);
+
+	// 每个工作线程一组直方图, 记录时不跨线程
+	LATENCY_STATS.init(cfg, worker_num);
+	if (!EVENT_LOG.start(cfg, worker_num, errmsg)) {
+		LOG(ERROR) << "Error RunRobotsOnCoroutines, event log disabled: " << errmsg.str();
+	}
+	for (int i = 0; i < cfg.group_config_size(); i++) {
+		const pbcfg::Group &groupcfg = cfg.group_config(i);
+		engine.pacers.push_back(new ConnectPacer(groupcfg.connect_rate()));
+		engine.sources.push_back(new SourceBinder(groupcfg.source()));
+		LOG(ERROR) << "Group-" << groupcfg.name() << " started, clients: " << groupcfg.client_count();
+	}
+
+	// wait for all workers finish (all clients compleate all actions or error)
+	LATENCY_STATS.start(now_usec());
+	if (!engine.sched.run(&CoWorkerStart, &CoWorkerExit, &engine)) {
+		LOG(ERROR) << "Error RunRobotsOnCoroutines, scheduler stopped before all clients finished";
+	}
+
+	int64_t frame_peak = 0;
+	uint64_t frames = 0;
+	for (int i = 0; i < worker_num; i++) {
+		const CoWorker *worker = engine.sched.worker(i);
+		frame_peak += worker->frame_stats.peak;
+		frames += worker->frame_stats.frames;
+		LOG(ERROR) << "Coroutine worker-" << i << " (cpu " << worker->cpu << ", node " << worker->node << "): "
+			<< "clients: " << engine.clients[i].size() << ", resumed: " << worker->resumed
+			<< ", stolen: " << worker->stolen;
+	}
+	LOG(ERROR) << "Coroutine frames: " << frames << " allocated, peak " << frame_peak / 1024 << " KB"
+		<< " (" << (total_client > 0 ? frame_peak / total_client : 0) << " bytes per client)";
+	log_memory_per_client("coro", base_rss, total_client);
+
+	for (size_t i = 0; i < engine.clients.size(); i++) {
+		for (size_t c = 0; c < engine.clients[i].size(); c++) {
+			delete engine.clients[i][c];
+		}
+	}
+	for (size_t i = 0; i < engine.pacers.size(); i++) {
+		delete engine.pacers[i];
+		delete engine.sources[i];
+	}
+	LOG(ERROR) << "RunRobotsOnCoroutines finished!";
+	MessagePool::log_stats();
+	LATENCY_STATS.log_report();
+	EVENT_LOG.stop();
+}
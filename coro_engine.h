@@ -0,0 +1,25 @@
+#ifndef __CORO_ENGINE_H__
+#define __CORO_ENGINE_H__
+
+#include "common.h"
+#include "robot.pb.h"
+#include "client.h"
+#include "coro_scheduler.h"
+
+
+// RunGroupOnce 的协程版本, 语义完全一样 (发送请求 -> 等待所有 response 或 timeout -> min_duration -> think_time),
+// 只是等待回包/超时/min_duration/think_time 时挂起协程 (co_await io), 而不是阻塞线程或轮询;
+// client 的连接 fd 必须已经 io.set_fd(); 协程可能在挂起时被别的工作线程偷走,
+// 所以延迟记到当前工作线程的 LATENCY_STATS.recorder(worker, group_index) 上, group_index 为 -1 时不记;
+// @peer: 连接所连的对端 (seeto: PeerSet), 计数和 Action 时延按它分开记
+CoTask<bool> CoRunGroupOnce(int count, const pbcfg::Group &groupcfg, const pbcfg::Client &clientcfg,
+							Client &client, pbcfg::CsMsgHead &headmsg, CoIo &io,
+							std::ostringstream &errmsg, int group_index, int peer = 0);
+
+// 用 CoScheduler 的 worker_num 个工作线程 (每个线程一个 EventLoop 和运行队列, 空闲时偷别的线程的协程)
+// 运行所有 Group 的所有客户端, 每个客户端是一个协程, 只占协程帧和收发缓冲 (几 KB), 不再占用线程栈;
+// worker_num <= 0 时每个 CPU 核一个; pin: 每个工作线程绑一个核; numa_aware: 不跨 NUMA 节点偷协程
+void RunRobotsOnCoroutines(const pbcfg::CfgRoot &cfg, int worker_num, bool pin, bool numa_aware);
+
+
+#endif // __CORO_ENGINE_H__
@@ -0,0 +1,336 @@
+#include "coro_scheduler.h"
+#include "robot.h"
+#include <algorithm>
+#include <dirent.h>
+#include <fstream>
+#include <map>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+
+
+CoIo::~CoIo() {
+	loop()->cancel_timer(this);
+}
+
+EventLoop *CoIo::loop(void) const {
+	return &worker_->loop;
+}
+
+void CoIo::WaitAwaiter::await_suspend(std::coroutine_handle<> h) {
+	CoIo *io = io_;
+	EventLoop *loop = io->loop();
+	io->waiter_ = h;
+	io->events_ = 0;
+	bool waiting = false;
+	if (mask_ && (io->fd_ >= 0)) {
+		uint32_t events = mask_ | EPOLLONESHOT;
+		int ret = io->registered_ ? loop->mod_fd(io->fd_, events, io) : loop->add_fd(io->fd_, events, io);
+		if (ret == -1) {
+			// 当成 fd 出错立刻唤醒, 调用者接下来的 send/recv 会拿到具体的错误
+			LOG(ERROR) << "CoIo wait fd: " << io->fd_ << ", epoll_ctl: " << strerror(errno);
+			io->events_ = EPOLLERR;
+			io->wake();
+			return ;
+		}
+		io->registered_ = true;
+		io->armed_ = true;
+		waiting = true;
+	}
+	if (deadline_usec_ > 0) {
+		loop->set_timer(io, deadline_usec_);
+		waiting = true;
+	}
+	if (!waiting) {
+		// 进了运行队列就可能马上被别的线程偷走并恢复, 之后不能再碰 io
+		io->wake();
+	}
+}
+
+void CoIo::set_fd(int fd) {
+	if (registered_) {
+		loop()->del_fd(fd_);
+	}
+	registered_ = false;
+	armed_ = false;
+	fd_ = fd;
+}
+
+void CoIo::on_events(uint32_t events) {
+	if (!armed_) {
+		return ;
+	}
+	armed_ = false;
+	events_ = events;
+	wake();
+}
+
+void CoIo::on_timer(void) {
+	if (armed_) {
+		// EPOLLONESHOT 还没触发, 摘掉免得之后不等的时候收到事件
+		loop()->del_fd(fd_);
+		registered_ = false;
+		armed_ = false;
+	}
+	events_ = 0;
+	wake();
+}
+
+void CoIo::wake(void) {
+	loop()->cancel_timer(this);
+	std::lock_guard<std::mutex> guard(worker_->runq_lock);
+	worker_->runq.push_back(this);
+	worker_->runq_size.store(static_cast<int>(worker_->runq.size()), std::memory_order_relaxed);
+}
+
+void CoIo::migrate(CoWorker *thief) {
+	if (registered_) {
+		loop()->del_fd(fd_);
+		registered_ = false;
+	}
+	worker_ = thief;
+}
+
+void CoIo::resume(void) {
+	std::coroutine_handle<> h = waiter_;
+	waiter_ = nullptr;
+	h.resume();
+}
+
+
+CoScheduler::~CoScheduler() {
+	for (size_t i = 0; i < workers_.size(); i++) {
+		delete workers_[i];
+	}
+}
+
+bool CoScheduler::init(int worker_num, bool pin, bool numa_aware, std::ostringstream &err) {
+	std::vector<std::pair<int, int> > node_cpus;
+	if (!GetCpuTopology(node_cpus, err)) {
+		return false;
+	}
+	numa_aware_ = numa_aware;
+	if (worker_num <= 0) {
+		worker_num = static_cast<int>(node_cpus.size());
+	}
+	// 按 (节点, CPU) 顺序分配, 工作线程比核少时先排满前面的节点
+	for (int i = 0; i < worker_num; i++) {
+		const std::pair<int, int> &node_cpu = node_cpus[i % node_cpus.size()];
+		CoWorker *worker = new CoWorker(this, i, pin ? node_cpu.second : -1, node_cpu.first);
+		workers_.push_back(worker);
+		if (!worker->loop.init(err)) {
+			err << " (worker-" << i << ")";
+			return false;
+		}
+	}
+	return true;
+}
+
+void CoScheduler::spawn(CoIo *io, const CoTask<> &task) {
+	live_.fetch_add(1, std::memory_order_acq_rel);
+	io->waiter_ = task.handle();
+	io->wake();
+}
+
+bool CoScheduler::run(WorkerFunc on_start, WorkerFunc on_exit, void *arg) {
+	on_start_ = on_start;
+	on_exit_ = on_exit;
+	arg_ = arg;
+	failed_ = false;
+	// 每个工作线程执行完 on_start 之前都算一个 live, 免得别的线程以为所有协程都结束了
+	live_.fetch_add(static_cast<int64_t>(workers_.size()), std::memory_order_acq_rel);
+
+	GThreadPool *thread_pool = CreateThreadsPool(workers_.size(), &CoScheduler::worker_main, gpointer(this));
+	for (size_t i = 0; i < workers_.size(); i++) {
+		g_thread_pool_push(thread_pool, gpointer(workers_[i]), NULL);
+	}
+	g_thread_pool_free(thread_pool, FALSE, TRUE);
+	thread_pool = NULL;
+	return !failed_;
+}
+
+uint64_t CoScheduler::total_resumed(void) const {
+	uint64_t total = 0;
+	for (size_t i = 0; i < workers_.size(); i++) {
+		total += workers_[i]->resumed;
+	}
+	return total;
+}
+
+uint64_t CoScheduler::total_stolen(void) const {
+	uint64_t total = 0;
+	for (size_t i = 0; i < workers_.size(); i++) {
+		total += workers_[i]->stolen;
+	}
+	return total;
+}
+
+void CoScheduler::worker_main(gpointer data, gpointer user_data) {
+	CoScheduler *sched = static_cast<CoScheduler *>(user_data);
+	sched->schedule(static_cast<CoWorker *>(data));
+}
+
+void CoScheduler::schedule(CoWorker *worker) {
+	if (worker->cpu >= 0) {
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(worker->cpu, &set);
+		int ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+		if (ret != 0) {
+			LOG(ERROR) << "CoScheduler worker-" << worker->index << " cannot pin to cpu " << worker->cpu
+				<< ": " << strerror(ret);
+		}
+	}
+	if (on_start_) {
+		on_start_(worker, arg_);
+	}
+	live_.fetch_sub(1, std::memory_order_acq_rel);
+
+	std::vector<CoIo *> batch;
+	batch.reserve(kCoRunBatch);
+	while ((live_.load(std::memory_order_acquire) > 0) && !failed_.load(std::memory_order_relaxed)) {
+		{
+			std::lock_guard<std::mutex> guard(worker->runq_lock);
+			size_t n = std::min(worker->runq.size(), size_t(kCoRunBatch));
+			batch.assign(worker->runq.begin(), worker->runq.begin() + n);
+			worker->runq.erase(worker->runq.begin(), worker->runq.begin() + n);
+			worker->runq_size.store(static_cast<int>(worker->runq.size()), std::memory_order_relaxed);
+		}
+		if (batch.empty()) {
+			worker->stolen += steal(worker, batch);
+		}
+		for (size_t i = 0; i < batch.size(); i++) {
+			worker->resumed++;
+			batch[i]->resume();
+		}
+		batch.clear();
+
+		int timeout = (worker->runq_size.load(std::memory_order_relaxed) > 0) ? 0 : kCoIdlePollMs;
+		if (worker->loop.poll(timeout) == -1) {
+			LOG(ERROR) << "CoScheduler worker-" << worker->index << " stopped by poll error";
+			failed_ = true;
+			break;
+		}
+	}
+
+	if (on_exit_) {
+		on_exit_(worker, arg_);
+	}
+	worker->frame_stats = CoFrameStats::local();
+}
+
+int CoScheduler::steal(CoWorker *thief, std::vector<CoIo *> &batch) {
+	int n = static_cast<int>(workers_.size());
+	// 第一轮只看同一 NUMA 节点的, 第二轮看其它节点的 (numa_aware 时没有第二轮)
+	for (int pass = 0; pass < 2; pass++) {
+		if ((pass == 1) && numa_aware_) {
+			break;
+		}
+		for (int k = 1; k < n; k++) {
+			CoWorker *victim = workers_[(thief->index + k) % n];
+			if (((victim->node == thief->node) ? 0 : 1) != pass) {
+				continue;
+			}
+			// 只剩一个的不偷, 它马上就会被自己的线程执行
+			if (victim->runq_size.load(std::memory_order_relaxed) < 2) {
+				continue;
+			}
+			{
+				std::lock_guard<std::mutex> guard(victim->runq_lock);
+				size_t take = victim->runq.size() / 2;
+				for (size_t i = 0; i < take; i++) {
+					batch.push_back(victim->runq.back());
+					victim->runq.pop_back();
+				}
+				victim->runq_size.store(static_cast<int>(victim->runq.size()), std::memory_order_relaxed);
+			}
+			if (!batch.empty()) {
+				for (size_t i = 0; i < batch.size(); i++) {
+					batch[i]->migrate(thief);
+				}
+				return static_cast<int>(batch.size());
+			}
+		}
+	}
+	return 0;
+}
+
+
+bool ParseCpuList(const std::string &text, std::vector<int> &cpus) {
+	size_t pos = 0;
+	while (pos < text.size()) {
+		size_t end = text.find(',', pos);
+		if (end == std::string::npos) {
+			end = text.size();
+		}
+		std::string item = text.substr(pos, end - pos);
+		pos = end + 1;
+		// 去掉首尾空白 (文件末尾有换行)
+		size_t first = item.find_first_not_of(" \t\r\n");
+		if (first == std::string::npos) {
+			continue;
+		}
+		item = item.substr(first, item.find_last_not_of(" \t\r\n") - first + 1);
+
+		char *tail = NULL;
+		long lo = strtol(item.c_str(), &tail, 10);
+		long hi = lo;
+		if (*tail == '-') {
+			hi = strtol(tail + 1, &tail, 10);
+		}
+		if ((tail == item.c_str()) || (*tail != '\0') || (lo < 0) || (hi < lo)) {
+			return false;
+		}
+		for (long cpu = lo; cpu <= hi; cpu++) {
+			cpus.push_back(static_cast<int>(cpu));
+		}
+	}
+	return true;
+}
+
+bool GetCpuTopology(std::vector<std::pair<int, int> > &node_cpus, std::ostringstream &err) {
+	cpu_set_t allowed;
+	CPU_ZERO(&allowed);
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) == -1) {
+		err << "sched_getaffinity: " << strerror(errno);
+		return false;
+	}
+
+	std::map<int, int> cpu_node;
+	const char *node_dir = "/sys/devices/system/node";
+	DIR *dir = opendir(node_dir);
+	if (dir) {
+		struct dirent *entry = NULL;
+		while ((entry = readdir(dir)) != NULL) {
+			int node = -1;
+			char tail = 0;
+			if (sscanf(entry->d_name, "node%d%c", &node, &tail) != 1) {
+				continue;
+			}
+			std::ifstream fin((std::string(node_dir) + "/" + entry->d_name + "/cpulist").c_str());
+			std::string text;
+			std::vector<int> cpus;
+			if (!std::getline(fin, text) || !ParseCpuList(text, cpus)) {
+				continue;
+			}
+			for (size_t i = 0; i < cpus.size(); i++) {
+				cpu_node[cpus[i]] = node;
+			}
+		}
+		closedir(dir);
+	}
+
+	node_cpus.clear();
+	for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if (CPU_ISSET(cpu, &allowed)) {
+			std::map<int, int>::const_iterator it = cpu_node.find(cpu);
+			node_cpus.push_back(std::make_pair(it == cpu_node.end() ? 0 : it->second, cpu));
+		}
+	}
+	if (node_cpus.empty()) {
+		err << "no cpu available";
+		return false;
+	}
+	std::sort(node_cpus.begin(), node_cpus.end());
+	return true;
+}
@@ -0,0 +1,158 @@
+#ifndef __CORO_SCHEDULER_H__
+#define __CORO_SCHEDULER_H__
+
+#include "common.h"
+#include "coro.h"
+#include "event_loop.h"
+#include <atomic>
+#include <deque>
+#include <mutex>
+
+class CoWorker;
+class CoScheduler;
+
+// 工作线程没有可运行的协程时, 每次 epoll_wait 最多等这么久, 然后去别的线程偷协程
+const int kCoIdlePollMs = 1;
+// 工作线程每次从自己的运行队列头部最多取这么多个协程, 剩下的留给其它线程偷
+const int kCoRunBatch = 32;
+
+
+// CoIo: 协程的等待点, 关注一个 fd 的事件, 并带一个定时器; 同一时刻只有一个协程在等它.
+// fd 以 EPOLLONESHOT 水平触发挂在所属工作线程的 EventLoop 上, 每次 wait 重新打开,
+// 事件或定时器到达后把 CoIo 放进所属工作线程的运行队列, 由工作线程恢复协程 (而不是在回调里直接恢复);
+// 在运行队列里的 CoIo 可能被别的工作线程偷走, 之后就属于那个线程
+class CoIo : public EventHandler {
+public:
+	~CoIo();
+	explicit CoIo(CoWorker *worker)
+		: worker_(worker), fd_(-1), registered_(false), armed_(false), events_(0) { }
+
+public:
+	class WaitAwaiter {
+	public:
+		WaitAwaiter(CoIo *io, uint32_t mask, uint64_t deadline_usec)
+			: io_(io), mask_(mask), deadline_usec_(deadline_usec) { }
+		bool await_ready(void) const { return false; }
+		void await_suspend(std::coroutine_handle<> h);
+		uint32_t await_resume(void) const { return io_->events_; }
+
+	private:
+		CoIo *io_;
+		uint32_t mask_;
+		uint64_t deadline_usec_;
+	};
+
+	// co_await 的结果是到达的事件 (fd 已经就绪时立刻返回), 0 表示 deadline 到了;
+	// mask 和 deadline 都是 0 时只是让出 CPU, 排到运行队列末尾
+	// @deadline_usec: now_usec() 的时间轴, 0 表示不限时
+	WaitAwaiter wait(uint32_t mask, uint64_t deadline_usec) { return WaitAwaiter(this, mask, deadline_usec); }
+	WaitAwaiter sleep_until(uint64_t deadline_usec) { return WaitAwaiter(this, 0, deadline_usec); }
+	WaitAwaiter yield(void) { return WaitAwaiter(this, 0, 0); }
+
+	// wait 关注的 fd, -1 表示没有; 关闭 fd 之前必须先 set_fd(-1)
+	void set_fd(int fd);
+	CoWorker *worker(void) const { return worker_; }
+	EventLoop *loop(void) const;
+
+	// implements EventHandler -----------------------------------------
+	void on_events(uint32_t events);
+	void on_timer(void);
+
+private:
+	friend class CoScheduler;
+	// 放进所属工作线程的运行队列, 只在所属线程上调用
+	void wake(void);
+	// 被 thief 偷走, 只对运行队列里的 CoIo 调用 (这时它既没有挂 fd 事件也没有定时器)
+	void migrate(CoWorker *thief);
+	void resume(void);
+
+private:
+	CoWorker *worker_;
+	int fd_;
+	bool registered_;		// fd_ 已经加进 worker_ 的 epoll
+	bool armed_;			// 正在等 fd_ 的事件
+	uint32_t events_;		// 最近一次唤醒时的事件
+	std::coroutine_handle<> waiter_;
+};
+
+// CoWorker: 一个工作线程, 有自己的 EventLoop 和运行队列, 可以绑定到一个 CPU 核
+class CoWorker {
+public:
+	CoWorker(CoScheduler *sched, int index, int cpu, int node)
+		: sched(sched), index(index), cpu(cpu), node(node), runq_size(0), resumed(0), stolen(0) {
+		memset(&frame_stats, 0, sizeof(frame_stats));
+	}
+
+	CoScheduler *const sched;
+	const int index;
+	const int cpu;			// 绑定的 CPU, -1 表示不绑定
+	const int node;			// CPU 所在的 NUMA 节点
+	EventLoop loop;
+
+	std::mutex runq_lock;
+	std::deque<CoIo *> runq;		// 可以恢复执行的协程
+	std::atomic<int> runq_size;		// runq.size(), 偷协程时不加锁先看一眼
+
+	// 以下只由本线程修改, 运行结束后读
+	uint64_t resumed;			// 恢复执行的次数
+	uint64_t stolen;			// 从别的线程偷来的协程数
+	CoFrameStats frame_stats;	// 工作线程结束时的协程帧统计
+};
+
+// CoScheduler: 每个工作线程 (通常每个核一个, 可以绑核) 一个运行队列, 空闲的线程从别的线程的队列尾部
+// 偷一半协程过来, 先偷同一 NUMA 节点的; 工作线程按节点依次排到核上, numa_aware 时不跨节点偷
+class CoScheduler {
+public:
+	~CoScheduler();
+	CoScheduler()
+		: numa_aware_(false), live_(0), failed_(false),
+		  on_start_(NULL), on_exit_(NULL), arg_(NULL) { }
+
+	// 在工作线程上回调: on_start 在进入调度循环之前 (可以在这里创建并 spawn 协程, 内存就分配在本地节点上),
+	// on_exit 在所有根协程结束之后
+	typedef void (*WorkerFunc)(CoWorker *worker, void *arg);
+
+public:
+	// @worker_num: <= 0 时每个可用的 CPU 核一个; @pin: 每个工作线程绑定到一个核
+	bool init(int worker_num, bool pin, bool numa_aware, std::ostringstream &err);
+
+	int worker_num(void) const { return static_cast<int>(workers_.size()); }
+	CoWorker *worker(int index) const { return workers_[index]; }
+
+	// 把根协程 task 放进 io 所属工作线程的运行队列, 根协程结束时必须调用 root_finished();
+	// 只能在 run() 之前或者在 io 所属的工作线程上调用
+	void spawn(CoIo *io, const CoTask<> &task);
+	void root_finished(void) { live_.fetch_sub(1, std::memory_order_acq_rel); }
+
+	// 运行到所有根协程都结束为止; @on_start, @on_exit: 可以为 NULL
+	// @return: false: 某个工作线程出错提前退出
+	bool run(WorkerFunc on_start, WorkerFunc on_exit, void *arg);
+
+	// 所有工作线程恢复执行的次数和偷协程的次数, run() 结束后调用
+	uint64_t total_resumed(void) const;
+	uint64_t total_stolen(void) const;
+
+private:
+	static void worker_main(gpointer data, gpointer user_data);
+	void schedule(CoWorker *worker);
+	// 偷到的放进 batch; @return: 偷到的个数
+	int steal(CoWorker *thief, std::vector<CoIo *> &batch);
+
+private:
+	bool numa_aware_;
+	std::vector<CoWorker *> workers_;
+	std::atomic<int64_t> live_;		// 还没结束的根协程, 再加上还没执行完 on_start 的工作线程
+	std::atomic<bool> failed_;
+	WorkerFunc on_start_;
+	WorkerFunc on_exit_;
+	void *arg_;
+};
+
+// 可用的 CPU 和它们所在的 NUMA 节点, 按 (节点, CPU) 排序; 没有 NUMA 信息时都在节点 0
+// @return: false: 取不到本进程可用的 CPU
+bool GetCpuTopology(std::vector<std::pair<int, int> > &node_cpus, std::ostringstream &err);
+// 解析 /sys 下的 cpulist 格式, 例如 "0-3,8,10-11"
+bool ParseCpuList(const std::string &text, std::vector<int> &cpus);
+
+
+#endif // __CORO_SCHEDULER_H__
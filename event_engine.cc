@@ -0,0 +1,159 @@
+#include "event_engine.h"
+#include "event_loop.h"
+#include "client_session.h"
+#include "mux_connection.h"
+#include "source_binder.h"
+#include "robot.h"
+#include "message_pool.h"
+#include "latency_stats.h"
+#include "event_trace.h"
+#include "memutils.h"
+#include "timeutils.h"
+#include "flags.h"
+
+
+// 每个 epoll 线程的上下文
+struct LoopContext {
+	EventLoop loop;
+	std::vector<ClientSession *> sessions;
+	std::vector<MuxConnection *> muxes;	// 在 sessions 之后释放
+};
+
+void raise_nofile_limit(rlim_t need) {
+	struct rlimit rl;
+	if (getrlimit(RLIMIT_NOFILE, &rl) == -1) {
+		return ;
+	}
+	if (rl.rlim_cur >= need) {
+		return ;
+	}
+	rl.rlim_cur = (rl.rlim_max == RLIM_INFINITY || rl.rlim_max > need) ? need : rl.rlim_max;
+	if (setrlimit(RLIMIT_NOFILE, &rl) == -1) {
+		LOG(WARNING) << "setrlimit(RLIMIT_NOFILE, " << rl.rlim_cur << "): " << strerror(errno);
+	}
+	if (rl.rlim_cur < need) {
+		LOG(WARNING) << "RLIMIT_NOFILE(" << rl.rlim_cur << ") < needed fds(" << need << ")";
+	}
+}
+
+void EventLoopWorker(gpointer data, gpointer user_data) {
+	LoopContext *ctx = (LoopContext *)data;
+	for (size_t i = 0; i < ctx->sessions.size(); i++) {
+		ctx->sessions[i]->start();
+	}
+	ctx->loop.run();
+	MessagePool::local().flush_stats();
+}
+
+void RunRobotsOnEventLoops(const pbcfg::CfgRoot &cfg, int loop_num) {
+	int total_client = 0;
+	int total_conn = 0;
+	for (int i = 0; i < cfg.group_config_size(); i++) {
+		const pbcfg::Group &groupcfg = cfg.group_config(i);
+		total_client += groupcfg.client_count();
+		// 多路复用时每个循环最多多出一条没坐满的连接
+		int mux = groupcfg.mux_clients();
+		total_conn += (mux > 0) ? ((groupcfg.client_count() + mux - 1) / mux + loop_num) : groupcfg.client_count();
+	}
+	raise_nofile_limit(total_conn + 1024);
+	uint64_t base_rss = rss_bytes();
+
+	std::vector<LoopContext *> contexts;
+	for (int i = 0; i < loop_num; i++) {
+		LoopContext *ctx = new LoopContext;
+		std::ostringstream errmsg;
+		if (!ctx->loop.init(errmsg)) {
+			LOG(ERROR) << "Error RunRobotsOnEventLoops, init loop-" << i << ": " << errmsg.str();
+			delete ctx;
+			for (size_t c = 0; c < contexts.size(); c++) {
+				delete contexts[c];
+			}
+			return ;
+		}
+		if ((FLAGS_io_backend == "uring") && !ctx->loop.enable_uring(errmsg)) {
+			LOG(ERROR) << "loop-" << i << " cannot use io_uring, falling back to epoll: " << errmsg.str();
+		}
+		contexts.push_back(ctx);
+	}
+
+	// 每个循环一组直方图, 记录时不跨线程
+	LATENCY_STATS.init(cfg, loop_num);
+	std::ostringstream errmsg;
+	if (!EVENT_LOG.start(cfg, loop_num, errmsg)) {
+		LOG(ERROR) << "Error RunRobotsOnEventLoops, event log disabled: " << errmsg.str();
+	}
+
+	// 所有 Group 的客户端轮流分配到各个循环上, 同一个 Group 的客户端共享一个连接限速器;
+	// 多路复用时同一个循环上的客户端每 mux_clients 个共用一条连接
+	std::vector<ConnectPacer *> pacers;
+	std::vector<SourceBinder *> sources;
+	int next = 0;
+	for (int i = 0; i < cfg.group_config_size(); i++) {
+		const pbcfg::Group &groupcfg = cfg.group_config(i);
+		pacers.push_back(new ConnectPacer(groupcfg.connect_rate()));
+		sources.push_back(new SourceBinder(groupcfg.source()));
+		// PEER_HASH_UID 时共用一条连接的客户端必须属于同一个对端, 所以每个 (循环, 对端) 各自凑满一条连接
+		const PeerSet *peers = LATENCY_STATS.peers(i);
+		int lanes = (peers->policy() == pbcfg::PEER_HASH_UID) ? peers->size() : 1;
+		std::vector<MuxConnection *> filling(contexts.size() * lanes, NULL);	// 每个 (循环, 对端) 上最后一条连接
+		std::vector<int> seats(contexts.size() * lanes, 0);						// 以及它已有的客户端数
+		int conns = 0;
+		for (int c = 0; c < groupcfg.client_count(); c++) {
+			int loop_index = next++ % contexts.size();
+			LoopContext *ctx = contexts[loop_index];
+			MuxConnection *mux = NULL;
+			if (groupcfg.mux_clients() > 0) {
+				int lane = (lanes > 1) ? peers->hash(groupcfg.client(c).uid()) : 0;
+				int k = loop_index * lanes + lane;
+				if ((filling[k] == NULL) || (seats[k] == groupcfg.mux_clients())) {
+					filling[k] = new MuxConnection(groupcfg, &ctx->loop, LATENCY_STATS.recorder(loop_index, i),
+												   pacers.back(), sources.back(), (lanes > 1) ? lane : -1);
+					ctx->muxes.push_back(filling[k]);
+					seats[k] = 0;
+					conns++;
+				}
+				mux = filling[k];
+				seats[k]++;
+			} else {
+				conns++;
+			}
+			ctx->sessions.push_back(new ClientSession(groupcfg, groupcfg.client(c), &ctx->loop,
+													  LATENCY_STATS.recorder(loop_index, i),
+													  EVENT_LOG.writer(loop_index), mux ? NULL : pacers.back(),
+													  mux ? NULL : sources.back(),
+													  LATENCY_STATS.profile(i), c, mux));
+		}
+		LOG(ERROR) << "Group-" << groupcfg.name() << " started, clients: " << groupcfg.client_count()
+			<< ", peers: " << peers->size()
+			<< ", connections: " << conns;
+	}
+
+	LATENCY_STATS.start(now_usec());
+	GThreadPool *thread_pool = CreateThreadsPool(contexts.size(), &EventLoopWorker);
+	for (size_t i = 0; i < contexts.size(); i++) {
+		g_thread_pool_push(thread_pool, gpointer(contexts[i]), NULL);
+	}
+
+	// wait for all loops finish (all sessions compleate all actions or error)
+	g_thread_pool_free(thread_pool, FALSE, TRUE);
+	thread_pool = NULL;
+	log_memory_per_client("epoll", base_rss, total_client);
+
+	for (size_t i = 0; i < contexts.size(); i++) {
+		for (size_t s = 0; s < contexts[i]->sessions.size(); s++) {
+			delete contexts[i]->sessions[s];
+		}
+		for (size_t m = 0; m < contexts[i]->muxes.size(); m++) {
+			delete contexts[i]->muxes[m];
+		}
+		delete contexts[i];
+	}
+	for (size_t i = 0; i < pacers.size(); i++) {
+		delete pacers[i];
+		delete sources[i];
+	}
+	LOG(ERROR) << "RunRobotsOnEventLoops finished!";
+	MessagePool::log_stats();
+	LATENCY_STATS.log_report();
+	EVENT_LOG.stop();
+}
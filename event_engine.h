@@ -0,0 +1,17 @@
+#ifndef __EVENT_ENGINE_H__
+#define __EVENT_ENGINE_H__
+
+#include "common.h"
+#include "robot.pb.h"
+#include <sys/resource.h>
+
+
+// 用 loop_num 个 epoll 循环 (每个循环一个线程) 驱动所有 Group 的所有客户端,
+// 每个客户端是一个非阻塞的 ClientSession 状态机, 不再占用独立线程
+void RunRobotsOnEventLoops(const pbcfg::CfgRoot &cfg, int loop_num);
+
+// 每个连接都要占一个 fd, 尽量把软限制提到 need (不超过硬限制)
+void raise_nofile_limit(rlim_t need);
+
+
+#endif // __EVENT_ENGINE_H__
@@ -0,0 +1,107 @@
+#include "event_log.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+bool EventLogWriter::open(const std::string &path, uint32_t writer_index, uint64_t capacity,
+						  uint64_t start_usec, uint64_t start_unix_usec, std::ostringstream &err) {
+	close();
+	if (capacity == 0) {
+		err << "event log capacity is 0";
+		return false;
+	}
+	int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd == -1) {
+		err << "open " << path << ": " << strerror(errno);
+		return false;
+	}
+	// 稀疏文件, 只有写到的页才真正占用空间
+	size_t size = kEventLogHeaderSize + capacity * sizeof(EventRecord);
+	if (ftruncate(fd, size) == -1) {
+		err << "ftruncate " << path << ": " << strerror(errno);
+		::close(fd);
+		return false;
+	}
+	void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (addr == MAP_FAILED) {
+		err << "mmap " << path << " (" << size << " bytes): " << strerror(errno);
+		return false;
+	}
+	header_ = static_cast<EventLogHeader *>(addr);
+	header_->magic = kEventLogMagic;
+	header_->version = kEventLogVersion;
+	header_->record_size = sizeof(EventRecord);
+	header_->writer_index = writer_index;
+	header_->capacity = capacity;
+	header_->start_usec = start_usec;
+	header_->start_unix_usec = start_unix_usec;
+	header_->pid = getpid();
+	header_->appended.store(0, std::memory_order_relaxed);
+	records_ = reinterpret_cast<EventRecord *>(static_cast<char *>(addr) + kEventLogHeaderSize);
+	capacity_ = capacity;
+	map_size_ = size;
+	return true;
+}
+
+void EventLogWriter::close(void) {
+	if (!header_) {
+		return ;
+	}
+	munmap(header_, map_size_);
+	header_ = NULL;
+	records_ = NULL;
+	capacity_ = 0;
+	map_size_ = 0;
+}
+
+bool ReadEventLog(const std::string &path, EventLogHeader &header, std::vector<EventRecord> &records,
+				  std::ostringstream &err) {
+	int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd == -1) {
+		err << "open " << path << ": " << strerror(errno);
+		return false;
+	}
+	struct stat st;
+	if ((fstat(fd, &st) == -1) || (size_t(st.st_size) < kEventLogHeaderSize)) {
+		err << path << ": not an event log";
+		::close(fd);
+		return false;
+	}
+	void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (addr == MAP_FAILED) {
+		err << "mmap " << path << ": " << strerror(errno);
+		return false;
+	}
+	const EventLogHeader *file_header = static_cast<const EventLogHeader *>(addr);
+	bool ok = (file_header->magic == kEventLogMagic) && (file_header->version == kEventLogVersion)
+		&& (file_header->record_size == sizeof(EventRecord))
+		&& (kEventLogHeaderSize + file_header->capacity * sizeof(EventRecord) <= size_t(st.st_size));
+	if (!ok) {
+		err << path << ": not an event log, or version " << file_header->version
+			<< " (expect " << kEventLogVersion << ")";
+		munmap(addr, st.st_size);
+		return false;
+	}
+	memcpy(static_cast<void *>(&header), file_header, sizeof(header));
+
+	const EventRecord *file_records
+		= reinterpret_cast<const EventRecord *>(static_cast<const char *>(addr) + kEventLogHeaderSize);
+	uint64_t capacity = file_header->capacity;
+	uint64_t appended = file_header->appended.load(std::memory_order_relaxed);
+	uint64_t first = (appended > capacity) ? appended - capacity : 0;
+	records.reserve(records.size() + (appended - first));
+	for (uint64_t n = first; n < appended; n++) {
+		const EventRecord &record = file_records[n % capacity];
+		if (record.usec != 0) {
+			records.push_back(record);
+		}
+	}
+	munmap(addr, st.st_size);
+	return true;
+}
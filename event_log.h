@@ -0,0 +1,101 @@
+#ifndef __EVENT_LOG_H__
+#define __EVENT_LOG_H__
+
+#include <atomic>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <stdint.h>
+
+// 二进制事件日志的文件格式, robot 写, robot_events 读; 改了布局必须改 kEventLogVersion
+const uint32_t kEventLogMagic = 0x56454252;		// "RBEV"
+const uint32_t kEventLogVersion = 1;
+// 文件头占一页, 记录从这里开始
+const size_t kEventLogHeaderSize = 4096;
+// 没有对应的消息类型/Action
+const uint16_t kEventNoType = 0xffff;
+const uint16_t kEventNoAction = 0xffff;
+
+enum EventKind {
+	kEventConnect = 1,			// latency: connect 耗时
+	kEventRequest = 2,			// 一个 Action 的请求发出, type: 第一个请求的类型, bytes: 所有请求的字节数
+	kEventResponse = 3,			// 收到一个回包, latency: 距请求发出, bytes: 包长
+	kEventAction = 4,			// 一个 Action 结束 (收齐或超时), latency: 距请求发出
+	kEventClientStop = 5,		// 客户端结束
+};
+
+enum EventStatus {
+	kEventOk = 0,
+	kEventTimedOut = 1,			// connect/Action 超时
+	kEventFailed = 2,			// connect 失败, 或客户端因为出错结束
+	kEventLate = 3,				// 已超时的更早请求的回包
+	kEventUnmatched = 4,		// seq 没有发出过, 或类型不是请求在等的回包
+};
+
+// 一条事件, 定长 32 字节
+struct EventRecord {
+	uint64_t usec;				// now_usec() 的时间轴 (单调时钟), 0 表示这一条还没写完
+	uint32_t client;			// CsMsgHead.uid
+	uint32_t seq;				// CsMsgHead.seq, 0 表示无
+	uint32_t latency;			// 微秒, 超过 UINT32_MAX 的记成 UINT32_MAX
+	uint32_t bytes;
+	uint16_t type;				// 消息类型 id (见 .meta 文件), kEventNoType 表示无
+	uint16_t group;
+	uint16_t action;			// kEventNoAction 表示无
+	uint8_t kind;				// EventKind
+	uint8_t status;				// EventStatus
+};
+
+// 文件头, 后面跟 capacity 条记录 (环形, 写满后覆盖最旧的)
+struct EventLogHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t record_size;		// sizeof(EventRecord)
+	uint32_t writer_index;
+	uint64_t capacity;			// 记录条数
+	uint64_t start_usec;		// 和 start_unix_usec 是同一时刻, 用来把 usec 换成墙上时间
+	uint64_t start_unix_usec;
+	int32_t pid;
+	uint32_t reserved0;
+	std::atomic<uint64_t> appended;		// 已分配出去的记录数, 超过 capacity 说明回绕了
+};
+
+// EventLogWriter: 一个 mmap 的事件日志文件, 整个文件一次映射好, 追加只是一次 relaxed fetch_add 加一次拷贝,
+// 不加锁, 不分配内存, 不做系统调用; 同一个文件也可以有多个线程同时追加 (各自拿到不同的位置).
+// 页由内核在 munmap/进程退出后写回, 进程崩溃时已写的记录也不会丢
+class EventLogWriter {
+public:
+	~EventLogWriter() { close(); }
+	EventLogWriter() : header_(NULL), records_(NULL), capacity_(0), map_size_(0) { }
+
+public:
+	// 创建 (或覆盖) path, 最多容纳 capacity 条记录
+	bool open(const std::string &path, uint32_t writer_index, uint64_t capacity,
+			  uint64_t start_usec, uint64_t start_unix_usec, std::ostringstream &err);
+	void close(void);
+	bool opened(void) const { return header_ != NULL; }
+
+	void append(const EventRecord &record) {
+		uint64_t n = header_->appended.fetch_add(1, std::memory_order_relaxed);
+		records_[n % capacity_] = record;
+	}
+	uint64_t appended(void) const { return header_->appended.load(std::memory_order_relaxed); }
+
+private:
+	EventLogWriter(const EventLogWriter &);
+	EventLogWriter &operator=(const EventLogWriter &);
+
+private:
+	EventLogHeader *header_;
+	EventRecord *records_;
+	uint64_t capacity_;
+	size_t map_size_;
+};
+
+// 读出一个事件日志文件里的所有记录, 回绕过的从最旧的开始; 跳过还没写完的记录
+// @return: false: 文件不是事件日志, 或版本不对
+bool ReadEventLog(const std::string &path, EventLogHeader &header, std::vector<EventRecord> &records,
+				  std::ostringstream &err);
+
+
+#endif // __EVENT_LOG_H__
@@ -0,0 +1,138 @@
+#include "event_loop.h"
+#include "timeutils.h"
+#include "uring.h"
+
+const int kMaxEventsPerWait = 1024;
+
+
+EventLoop::~EventLoop() {
+	delete uring_;
+	uring_ = NULL;
+	if (epfd_ >= 0) {
+		close(epfd_);
+		epfd_ = -1;
+	}
+}
+
+EventLoop::EventLoop()
+	: epfd_(-1),
+	  uring_(NULL),
+	  waits_(0),
+	  holds_(0),
+	  timers_(now_usec() / 1000),
+	  events_(kMaxEventsPerWait) { }
+
+bool EventLoop::init(std::ostringstream &err) {
+	epfd_ = epoll_create1(EPOLL_CLOEXEC);
+	if (epfd_ == -1) {
+		err << "epoll_create1: " << strerror(errno);
+		return false;
+	}
+	return true;
+}
+
+bool EventLoop::enable_uring(std::ostringstream &err) {
+	UringRing *ring = new UringRing();
+	if (!ring->init(err)) {
+		delete ring;
+		return false;
+	}
+	uring_ = ring;
+	return true;
+}
+
+int EventLoop::add_fd(int fd, uint32_t events, EventHandler *handler) {
+	if (uring_) {
+		uring_->poll_fd(fd, events, handler);
+		return 0;
+	}
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = events;
+	ev.data.ptr = handler;
+	return epoll_ctl(epfd_, EPOLL_CTL_ADD, fd, &ev);
+}
+
+int EventLoop::mod_fd(int fd, uint32_t events, EventHandler *handler) {
+	if (uring_) {
+		errno = ENOTSUP;
+		return -1;
+	}
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = events;
+	ev.data.ptr = handler;
+	return epoll_ctl(epfd_, EPOLL_CTL_MOD, fd, &ev);
+}
+
+int EventLoop::del_fd(int fd) {
+	if (uring_) {
+		uring_->cancel_fd(fd, false);
+		return 0;
+	}
+	return epoll_ctl(epfd_, EPOLL_CTL_DEL, fd, NULL);
+}
+
+void EventLoop::set_timer(EventHandler *handler, uint64_t deadline_usec) {
+	timers_.add(&handler->timer_node_, (deadline_usec + 999) / 1000);
+}
+
+void EventLoop::yield(EventHandler *handler) {
+	timers_.add(&handler->timer_node_, 0);
+}
+
+void EventLoop::cancel_timer(EventHandler *handler) {
+	timers_.remove(&handler->timer_node_);
+}
+
+int EventLoop::calc_wait_timeout(uint64_t now) {
+	return timers_.next_timeout(now / 1000);
+}
+
+void EventLoop::fire_timer(TimerNode *node, void *arg) {
+	static_cast<EventHandler *>(node->owner)->on_timer();
+}
+
+void EventLoop::expire_timers(uint64_t now) {
+	timers_.advance(now / 1000, fire_timer, this);
+}
+
+void EventLoop::run(void) {
+	while (holds_ > 0) {
+		if (poll(-1) == -1) {
+			break;
+		}
+	}
+}
+
+int EventLoop::poll(int max_timeout_ms) {
+	int timeout = calc_wait_timeout(now_usec());
+	if ((max_timeout_ms >= 0) && ((timeout < 0) || (timeout > max_timeout_ms))) {
+		timeout = max_timeout_ms;
+	}
+	if (uring_) {
+		int n = uring_->submit_and_wait(timeout);
+		if (n != -1) {
+			expire_timers(now_usec());
+		}
+		return n;
+	}
+	waits_++;
+	int n = epoll_wait(epfd_, &events_[0], static_cast<int>(events_.size()), timeout);
+	if (n == -1) {
+		if (errno == EINTR) { return 0; }
+		LOG(ERROR) << "epoll_wait meet error(" << errno << "): " << strerror(errno);
+		return -1;
+	}
+	for (int i = 0; i < n; i++) {
+		EventHandler *handler = static_cast<EventHandler *>(events_[i].data.ptr);
+		handler->on_events(events_[i].events);
+	}
+	expire_timers(now_usec());
+	return n;
+}
+
+uint64_t EventLoop::waits(void) const {
+	// submit_and_wait 在已经有完成事件时不进内核
+	return uring_ ? uring_->enters() : waits_;
+}
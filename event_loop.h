@@ -0,0 +1,80 @@
+#ifndef __EVENT_LOOP_H__
+#define __EVENT_LOOP_H__
+
+#include "common.h"
+#include "timer_wheel.h"
+#include <sys/epoll.h>
+
+class EventLoop;
+class UringRing;
+
+// EventHandler: 挂在 EventLoop 上的对象, 可以关注一个 fd 的事件, 同时最多有一个定时器
+class EventHandler {
+public:
+	virtual ~EventHandler() { }
+	EventHandler() { timer_node_.owner = this; }
+
+public:
+	// @events: epoll_event.events
+	virtual void on_events(uint32_t events) = 0;
+	virtual void on_timer(void) = 0;
+
+private:
+	friend class EventLoop;
+	TimerNode timer_node_;
+};
+
+// EventLoop: 单线程的 epoll 循环, 所有挂在它上面的 handler 都只在 run() 的线程里被回调.
+// enable_uring 之后改用 io_uring: 连接的收发由 UringClient 在 ring 上完成, add_fd 只用来等 connect 完成
+// (一次性的, 不支持 mod_fd), 等待事件和提交收发是同一次 io_uring_enter
+class EventLoop {
+public:
+	~EventLoop();
+	EventLoop();
+
+public:
+	bool init(std::ostringstream &err);
+	// 在 init 之后, 添加任何 fd 之前调用; @return false: 内核不支持, 继续用 epoll
+	bool enable_uring(std::ostringstream &err);
+	// NULL: 用的是 epoll
+	UringRing *uring(void) const { return uring_; }
+	// @return: -1: failed, 0: succ
+	int add_fd(int fd, uint32_t events, EventHandler *handler);
+	// @return: -1: failed, 0: succ
+	int mod_fd(int fd, uint32_t events, EventHandler *handler);
+	// @return: -1: failed, 0: succ
+	int del_fd(int fd);
+	// 重复设置会覆盖上一次的定时器; @deadline_usec: now_usec() 的时间轴,
+	// 定时器是毫秒精度的, 向上取整到毫秒 (只会晚于 deadline 不到 1ms, 不会提前)
+	void set_timer(EventHandler *handler, uint64_t deadline_usec);
+	void cancel_timer(EventHandler *handler);
+	// 让出循环: 覆盖 handler 的定时器, 先回调完这一轮其他 handler 的事件, 下一轮不等待就回调它的 on_timer
+	void yield(EventHandler *handler);
+
+	// 每个还没结束的 handler 都 hold() 一次, 结束时 release(),
+	// run() 一直运行到没有任何 hold 为止
+	void hold(void) { holds_++; }
+	void release(void) { holds_--; }
+	void run(void);
+	// 只跑一轮: 等待事件 (最多等到下一个定时器, 且不超过 max_timeout_ms, -1 表示不限),
+	// 回调所有到达的事件和到期的定时器; @return: -1: epoll_wait 出错, 否则是事件个数
+	int poll(int max_timeout_ms);
+	// 等待事件的系统调用次数 (epoll_wait 或 io_uring_enter), 给 bench 用
+	uint64_t waits(void) const;
+
+private:
+	int calc_wait_timeout(uint64_t now);
+	void expire_timers(uint64_t now);
+	static void fire_timer(TimerNode *node, void *arg);
+
+private:
+	int epfd_;
+	UringRing *uring_;
+	uint64_t waits_;
+	int holds_;
+	TimerWheel timers_;
+	std::vector<struct epoll_event> events_;
+};
+
+
+#endif // __EVENT_LOOP_H__
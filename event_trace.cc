@@ -0,0 +1,147 @@
+#include "event_trace.h"
+#include "config.h"
+
+
+void EventLog::configure(const std::string &prefix, int capacity_mb) {
+	prefix_ = prefix;
+	capacity_ = uint64_t(std::max(1, capacity_mb)) * 1024 * 1024 / sizeof(EventRecord);
+}
+
+uint16_t EventLog::add_type(const std::string &type_name) {
+	std::map<std::string, uint16_t>::const_iterator it = type_ids_.find(type_name);
+	if (it != type_ids_.end()) {
+		return it->second;
+	}
+	if (types_.size() >= kEventNoType) {
+		return kEventNoType;
+	}
+	uint16_t id = static_cast<uint16_t>(types_.size());
+	types_.push_back(type_name);
+	type_ids_[type_name] = id;
+	return id;
+}
+
+uint16_t EventLog::type_id(const std::string &type_name) const {
+	std::map<std::string, uint16_t>::const_iterator it = type_ids_.find(type_name);
+	return (it == type_ids_.end()) ? kEventNoType : it->second;
+}
+
+bool EventLog::start(const pbcfg::CfgRoot &cfg, int writer_num, std::ostringstream &err) {
+	stop();
+	if (prefix_.empty()) {
+		return true;
+	}
+	types_.clear();
+	type_ids_.clear();
+	groups_.clear();
+	request_types_.assign(cfg.group_config_size(), std::vector<uint16_t>());
+	response_types_.assign(cfg.group_config_size(), std::vector<std::vector<uint16_t> >());
+	for (int g = 0; g < cfg.group_config_size(); g++) {
+		const pbcfg::Group &groupcfg = cfg.group_config(g);
+		groups_.push_back(&groupcfg);
+		for (int a = 0; a < groupcfg.action_size(); a++) {
+			const pbcfg::Action &actioncfg = groupcfg.action(a);
+			uint16_t request = kEventNoType;
+			if (actioncfg.request_uniq_name_size() > 0) {
+				UniqNameMapIter it = uniq_name_map.find(actioncfg.request_uniq_name(0));
+				request = add_type((it != uniq_name_map.end() && it->second)
+					? it->second->type_name : actioncfg.request_uniq_name(0));
+			}
+			request_types_[g].push_back(request);
+			response_types_[g].push_back(std::vector<uint16_t>());
+			for (int r = 0; r < actioncfg.response_size(); r++) {
+				response_types_[g][a].push_back(add_type(actioncfg.response(r)));
+			}
+		}
+	}
+
+	uint64_t start_usec = now_usec();
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	uint64_t start_unix_usec = uint64_t(tv.tv_sec) * 1000000 + tv.tv_usec;
+	if (!write_meta(cfg, start_usec, start_unix_usec, err)) {
+		return false;
+	}
+	for (int i = 0; i < writer_num; i++) {
+		std::ostringstream path;
+		path << prefix_ << "." << i << ".bin";
+		EventLogWriter *writer = new EventLogWriter();
+		writers_.push_back(writer);
+		if (!writer->open(path.str(), i, capacity_, start_usec, start_unix_usec, err)) {
+			stop();
+			return false;
+		}
+	}
+	LOG(ERROR) << "Event log: " << prefix_ << ".{0.." << (writer_num - 1) << "}.bin, "
+		<< capacity_ << " records per file";
+	return true;
+}
+
+bool EventLog::write_meta(const pbcfg::CfgRoot &cfg, uint64_t start_usec, uint64_t start_unix_usec,
+						  std::ostringstream &err) const {
+	std::string path = prefix_ + ".meta";
+	std::ofstream fout(path.c_str(), std::ios::out | std::ios::trunc);
+	if (!fout) {
+		err << "cannot write " << path;
+		return false;
+	}
+	// 一行一项, 名字在最后, 可以带空格
+	fout << "version " << kEventLogVersion << "\n"
+		<< "start " << start_usec << " " << start_unix_usec << "\n";
+	for (int g = 0; g < cfg.group_config_size(); g++) {
+		const pbcfg::Group &groupcfg = cfg.group_config(g);
+		fout << "group " << g << " " << groupcfg.name() << "\n";
+		for (int a = 0; a < groupcfg.action_size(); a++) {
+			uint16_t request = request_types_[g][a];
+			fout << "action " << g << " " << a << " "
+				<< (request == kEventNoType ? std::string("-") : types_[request]) << "\n";
+		}
+	}
+	for (size_t t = 0; t < types_.size(); t++) {
+		fout << "type " << t << " " << types_[t] << "\n";
+	}
+	fout.close();
+	if (!fout) {
+		err << "cannot write " << path;
+		return false;
+	}
+	return true;
+}
+
+void EventLog::stop(void) {
+	if (writers_.empty()) {
+		return ;
+	}
+	uint64_t total = 0, dropped = 0;
+	for (size_t i = 0; i < writers_.size(); i++) {
+		if (writers_[i]->opened()) {
+			uint64_t appended = writers_[i]->appended();
+			total += appended;
+			dropped += (appended > capacity_) ? appended - capacity_ : 0;
+		}
+		delete writers_[i];
+	}
+	writers_.clear();
+	LOG(ERROR) << "Event log: " << total << " events, " << dropped << " overwritten (file full)";
+}
+
+
+void EventTrace::response_slow(int action, const std::string &type_name, EventStatus status,
+							   uint32_t seq, uint64_t latency, uint64_t bytes) const {
+	if (status == kEventOk) {
+		// 在 Action 等的回包里找, 和 GroupLatency::record_response 的规则一样
+		status = kEventUnmatched;
+		if (action < 0) {
+			emit(kEventResponse, status, action, EVENT_LOG.type_id(type_name), seq, latency, bytes);
+			return ;
+		}
+		const pbcfg::Action &actioncfg = EVENT_LOG.group_config(group).action(action);
+		for (int r = 0; r < actioncfg.response_size(); r++) {
+			if (actioncfg.response(r) == type_name) {
+				response(action, r, seq, latency, bytes);
+				return ;
+			}
+		}
+	}
+	emit(kEventResponse, status, action, EVENT_LOG.type_id(type_name), seq, latency, bytes);
+}
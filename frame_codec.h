@@ -0,0 +1,26 @@
+#ifndef FRAME_CODEC_H_
+#define FRAME_CODEC_H_
+
+#include "frame_config_types.h"
+#include <string>
+#include <cstddef>
+
+// Renders the frame header by walking every field definition and switching on its
+// value rule and data type. This is the reference encoder; the send path uses the
+// compiled template below, and the two must produce identical bytes.
+// @return false: a field has a value that does not match its data type
+bool render_frame_header_fields(const FrameHeaderConfig& config,
+                                size_t csmsghead_pb_len, size_t csmsgbody_pb_len,
+                                std::string& out);
+
+// Compiles config.fields into tpl: literal fields are rendered into tpl.bytes once,
+// CALC_* fields become patch slots.
+// @return false: a field has a value that does not match its data type
+bool compile_frame_header_template(const FrameHeaderConfig& config, FrameHeaderTemplate& tpl);
+
+// Writes tpl.bytes.size() bytes to out: one memcpy plus one store per patch slot.
+void render_frame_header_template(const FrameHeaderTemplate& tpl,
+                                  size_t csmsghead_pb_len, size_t csmsgbody_pb_len,
+                                  char* out);
+
+#endif // FRAME_CODEC_H_
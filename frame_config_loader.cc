@@ -1,4 +1,5 @@
 #include "frame_config_loader.h"
+#include "frame_codec.h"
 #include <fstream>  // For checking file existence (optional good practice)
 #include <iostream> // For error messages
 #include <stdexcept> // Added as std::runtime_error is used
@@ -168,5 +169,10 @@ FrameHeaderConfig FrameConfigLoader::load_config(const std::string& filepath) {
         }
         config_data.fields.push_back(field_def);
     }
+
+    // Compile once here so encoding never walks the field list
+    if (!compile_frame_header_template(config_data, config_data.header_template)) {
+        throw std::runtime_error("Failed to compile frame header template from: " + filepath);
+    }
     return config_data;
 }
@@ -58,10 +58,26 @@ struct FrameFieldDef {
     // std::string checksum_algorithm;             // e.g., "CRC32", "SUM8"
 };
 
+// A CALC_* field compiled into a slot of the header template
+struct FramePatchSlot {
+    int offset;                     // Byte offset of the field within the header
+    int width;                      // 1, 2, 4 or 8 bytes
+    bool big_endian;
+    FrameFieldValueRule value_rule; // Which computed length is stored here
+};
+
+// The header with all literal fields pre-rendered; encoding copies `bytes` and
+// stores the computed lengths into `patches`.
+struct FrameHeaderTemplate {
+    std::string bytes;
+    std::vector<FramePatchSlot> patches;
+};
+
 // Represents the overall configuration for a frame header (and potentially trailer)
 struct FrameHeaderConfig {
     std::vector<FrameFieldDef> fields; // Ordered list of fields in the header
     // std::vector<FrameFieldDef> trailer_fields; // For future use if trailers are needed
+    FrameHeaderTemplate header_template; // Compiled from fields by FrameConfigLoader::load_config
 };
 
 #endif // FRAME_CONFIG_TYPES_H_
@@ -0,0 +1,101 @@
+#ifndef __IO_BUFFER_H__
+#define __IO_BUFFER_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// IoBuffer: 带读写游标的连续缓冲
+//   [0, head_)      已消费
+//   [head_, tail_)  待处理数据 (readable)
+//   [tail_, cap_)   空闲 (writable)
+// 消费数据只前移 head_, 数据被消费完时两个游标归零, 都不拷贝;
+// 只有在尾部空间不够写时才把剩余的不完整数据挪到开头 (或扩容).
+// 扩容后的缓冲在数据被消费完且容量超过 shrink_watermark 时缩回初始大小.
+class IoBuffer {
+public:
+	~IoBuffer() { free(data_); }
+	IoBuffer(int32_t init_cap, int32_t shrink_watermark)
+		: data_((char *)malloc(init_cap)), cap_(init_cap), head_(0), tail_(0),
+		  init_cap_(init_cap), shrink_watermark_(shrink_watermark) { }
+
+public:
+	char *readable(void) const { return data_ + head_; }
+	int32_t size(void) const { return tail_ - head_; }
+	bool empty(void) const { return head_ == tail_; }
+	int32_t capacity(void) const { return cap_; }
+
+	// 前移读游标
+	void consume(int32_t n) {
+		head_ += n;
+		if (head_ == tail_) {
+			head_ = tail_ = 0;
+			if (cap_ > shrink_watermark_) {
+				shrink();
+			}
+		}
+	}
+
+	// 保证尾部至少有 need 字节连续空闲空间, 返回写指针; 写完后调用 commit()
+	char *writable(int32_t need) {
+		if (cap_ - tail_ < need) {
+			make_room(need);
+		}
+		return data_ + tail_;
+	}
+	int32_t writable_size(void) const { return cap_ - tail_; }
+	void commit(int32_t n) { tail_ += n; }
+
+	void append(const char *data, int32_t len) {
+		memcpy(writable(len), data, len);
+		commit(len);
+	}
+
+	void clear(void) {
+		head_ = tail_ = 0;
+	}
+
+private:
+	IoBuffer(const IoBuffer &);
+	IoBuffer &operator=(const IoBuffer &);
+
+	void make_room(int32_t need) {
+		int32_t live = size();
+		// 剩余数据 (通常是半个包) 挪到开头就够用了
+		if (live + need <= cap_) {
+			memmove(data_, data_ + head_, live);
+			head_ = 0;
+			tail_ = live;
+			return ;
+		}
+		int32_t new_cap = cap_;
+		while (new_cap < live + need) {
+			new_cap *= 2;
+		}
+		char *new_data = (char *)malloc(new_cap);
+		memcpy(new_data, data_ + head_, live);
+		free(data_);
+		data_ = new_data;
+		cap_ = new_cap;
+		head_ = 0;
+		tail_ = live;
+	}
+
+	void shrink(void) {
+		free(data_);
+		data_ = (char *)malloc(init_cap_);
+		cap_ = init_cap_;
+	}
+
+private:
+	char *data_;
+	int32_t cap_;
+	int32_t head_;
+	int32_t tail_;
+	int32_t init_cap_;
+	int32_t shrink_watermark_;
+};
+
+
+#endif // __IO_BUFFER_H__
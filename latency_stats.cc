@@ -0,0 +1,689 @@
+#include "latency_stats.h"
+#include <math.h>
+
+
+int LatencySnapshot::bucket_index(uint64_t value) {
+	if (value < uint64_t(kSubBucketCount)) {
+		return static_cast<int>(value);
+	}
+	if (value > kMaxValue) {
+		value = kMaxValue;
+	}
+	int exponent = 63 - __builtin_clzll(value);
+	int shift = exponent - kSubBucketBits;
+	int sub = static_cast<int>((value >> shift) & (kSubBucketCount - 1));
+	return kSubBucketCount + shift * kSubBucketCount + sub;
+}
+
+uint64_t LatencySnapshot::bucket_upper(int index) {
+	if (index < kSubBucketCount) {
+		return index;
+	}
+	int shift = (index - kSubBucketCount) / kSubBucketCount;
+	int sub = (index - kSubBucketCount) % kSubBucketCount;
+	uint64_t lower = uint64_t(kSubBucketCount + sub) << shift;
+	return lower + (uint64_t(1) << shift) - 1;
+}
+
+void LatencySnapshot::record(uint64_t value, uint64_t n) {
+	add_bucket(bucket_index(value), n);
+	set_max(value);
+}
+
+void LatencySnapshot::add_bucket(int index, uint64_t n) {
+	counts_[index] += n;
+	total_ += n;
+}
+
+void LatencySnapshot::merge(const LatencySnapshot &other) {
+	for (int i = 0; i < kBucketCount; i++) {
+		counts_[i] += other.counts_[i];
+	}
+	total_ += other.total_;
+	set_max(other.max_);
+}
+
+void LatencySnapshot::subtract(const LatencySnapshot &earlier) {
+	uint64_t top = 0;
+	total_ = 0;
+	for (int i = 0; i < kBucketCount; i++) {
+		counts_[i] = (counts_[i] > earlier.counts_[i]) ? (counts_[i] - earlier.counts_[i]) : 0;
+		if (counts_[i] > 0) {
+			total_ += counts_[i];
+			top = bucket_upper(i);
+		}
+	}
+	max_ = std::min(max_, top);
+}
+
+uint64_t LatencySnapshot::sum(void) const {
+	uint64_t total = 0;
+	for (int i = 0; i < kBucketCount; i++) {
+		if (counts_[i] > 0) {
+			total += counts_[i] * std::min(bucket_upper(i), max_);
+		}
+	}
+	return total;
+}
+
+uint64_t LatencySnapshot::value_at_percentile(double percentile) const {
+	if (total_ == 0) {
+		return 0;
+	}
+	uint64_t rank = static_cast<uint64_t>(ceil(percentile / 100.0 * total_));
+	if (rank == 0) {
+		rank = 1;
+	}
+	uint64_t seen = 0;
+	for (int i = 0; i < kBucketCount; i++) {
+		seen += counts_[i];
+		if (seen >= rank) {
+			return std::min(bucket_upper(i), max_);
+		}
+	}
+	return max_;
+}
+
+
+LatencyHistogram::LatencyHistogram() : max_(0) {
+	for (int i = 0; i < LatencySnapshot::kBucketCount; i++) {
+		counts_[i].store(0, std::memory_order_relaxed);
+	}
+}
+
+void LatencyHistogram::record(uint64_t value) {
+	counts_[LatencySnapshot::bucket_index(value)].fetch_add(1, std::memory_order_relaxed);
+	uint64_t max = max_.load(std::memory_order_relaxed);
+	while (value > max && !max_.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+	}
+}
+
+void LatencyHistogram::add_to(LatencySnapshot &out) const {
+	for (int i = 0; i < LatencySnapshot::kBucketCount; i++) {
+		uint64_t n = counts_[i].load(std::memory_order_relaxed);
+		if (n > 0) {
+			out.add_bucket(i, n);
+		}
+	}
+	out.set_max(max_.load(std::memory_order_relaxed));
+}
+
+
+GroupLatency::~GroupLatency() {
+	delete [] histograms_;
+	delete [] timeouts_;
+	delete [] peer_stats_;
+	delete own_peers_;
+}
+
+GroupLatency::GroupLatency(const pbcfg::Group &groupcfg, const LoadProfile *profile, PeerSet *peers)
+	: groupcfg_(groupcfg),
+	  profile_(profile),
+	  peers_(peers),
+	  own_peers_(peers ? NULL : new PeerSet(groupcfg)),
+	  peer_stats_(0),
+	  phase_num_((profile && profile->phased()) ? kLoadPhaseNum : 1),
+	  slot_num_(0),
+	  histograms_(0),
+	  timeouts_(0),
+	  connect_timeouts_(0),
+	  late_responses_(0),
+	  unmatched_responses_(0),
+	  requests_(0),
+	  completed_(0),
+	  abandoned_(0),
+	  errors_(0),
+	  connects_(0),
+	  disconnects_(0) {
+	int total = 0;
+	for (int a = 0; a < groupcfg.action_size(); a++) {
+		offsets_.push_back(total);
+		total += 1 + groupcfg.action(a).response_size();
+	}
+	slot_num_ = total;
+	histograms_ = new LatencyHistogram[total * phase_num_];
+	timeouts_ = new std::atomic<uint64_t>[groupcfg.action_size() * phase_num_];
+	for (int a = 0; a < groupcfg.action_size() * phase_num_; a++) {
+		timeouts_[a].store(0, std::memory_order_relaxed);
+	}
+	if (own_peers_) {
+		peers_ = own_peers_;
+	}
+	if (peers_->size() > 1) {
+		peer_stats_ = new PeerLatency[peers_->size()];
+	}
+}
+
+uint64_t GroupLatency::timeouts(int action_index, int phase) const {
+	uint64_t total = 0;
+	for (int p = 0; p < phase_num_; p++) {
+		if ((phase == -1) || (phase == p)) {
+			total += timeouts_[p * groupcfg_.action_size() + action_index].load(std::memory_order_relaxed);
+		}
+	}
+	return total;
+}
+
+void GroupLatency::record_response(int action_index, const std::string &type_name, uint64_t usec) {
+	const pbcfg::Action &actioncfg = groupcfg_.action(action_index);
+	for (int r = 0; r < actioncfg.response_size(); r++) {
+		if (actioncfg.response(r) == type_name) {
+			histograms_[slot_index(phase_of(usec), action_index, 1 + r)].record(usec);
+			return ;
+		}
+	}
+}
+
+void GroupLatency::record_action(int action_index, uint64_t usec, int peer) {
+	histograms_[slot_index(phase_of(usec), action_index, 0)].record(usec);
+	completed_.fetch_add(1, std::memory_order_relaxed);
+	if (peer_stats_) {
+		peer_stats_[peer].action.record(usec);
+		peer_stats_[peer].completed.fetch_add(1, std::memory_order_relaxed);
+		if (groupcfg_.action(action_index).response_size() > 0) {
+			peers_->end_request(peer);
+		}
+	}
+}
+
+void GroupLatency::record_timeout(int action_index, uint64_t usec, int peer) {
+	timeouts_[phase_of(usec) * groupcfg_.action_size() + action_index].fetch_add(1, std::memory_order_relaxed);
+	if (peer_stats_) {
+		peer_stats_[peer].timeouts.fetch_add(1, std::memory_order_relaxed);
+		peers_->end_request(peer);
+	}
+}
+
+
+void LatencyStats::init(const pbcfg::CfgRoot &cfg, int recorder_num) {
+	std::lock_guard<std::mutex> guard(lock_);
+	reset();
+	for (int g = 0; g < cfg.group_config_size(); g++) {
+		groups_.push_back(&cfg.group_config(g));
+		profiles_.push_back(new LoadProfile(cfg.group_config(g)));
+		peers_.push_back(new PeerSet(cfg.group_config(g)));
+	}
+	recorders_.resize(recorder_num);
+	for (int i = 0; i < recorder_num; i++) {
+		for (size_t g = 0; g < groups_.size(); g++) {
+			recorders_[i].push_back(new GroupLatency(*groups_[g], profiles_[g], peers_[g]));
+		}
+	}
+	sample_completed_.assign(groups_.size(), 0);
+	throughput_.assign(groups_.size(), 0);
+}
+
+void LatencyStats::start(uint64_t now) {
+	for (size_t g = 0; g < profiles_.size(); g++) {
+		profiles_[g]->start(now);
+	}
+}
+
+const LoadProfile *LatencyStats::profile(int group_index) const {
+	if ((group_index < 0) || (group_index >= static_cast<int>(profiles_.size()))) {
+		return NULL;
+	}
+	return profiles_[group_index];
+}
+
+PeerSet *LatencyStats::peers(int group_index) const {
+	if ((group_index < 0) || (group_index >= static_cast<int>(peers_.size()))) {
+		return NULL;
+	}
+	return peers_[group_index];
+}
+
+void LatencyStats::clear(void) {
+	std::lock_guard<std::mutex> guard(lock_);
+	reset();
+}
+
+void LatencyStats::reset(void) {
+	for (size_t i = 0; i < recorders_.size(); i++) {
+		for (size_t g = 0; g < recorders_[i].size(); g++) {
+			delete recorders_[i][g];
+		}
+	}
+	recorders_.clear();
+	for (size_t g = 0; g < profiles_.size(); g++) {
+		delete profiles_[g];
+		delete peers_[g];
+	}
+	profiles_.clear();
+	peers_.clear();
+	groups_.clear();
+	sample_usec_ = 0;
+	sample_completed_.clear();
+	throughput_.clear();
+}
+
+int LatencyStats::group_index(const pbcfg::Group *groupcfg) const {
+	for (size_t g = 0; g < groups_.size(); g++) {
+		if (groups_[g] == groupcfg) {
+			return static_cast<int>(g);
+		}
+	}
+	return -1;
+}
+
+GroupLatency *LatencyStats::recorder(int recorder_index, int group_index) {
+	if (recorders_.empty() || group_index < 0) {
+		return NULL;
+	}
+	return recorders_[recorder_index % recorders_.size()][group_index];
+}
+
+void LatencyStats::merge(int group_index, int action_index, int slot, LatencySnapshot &out, int phase) const {
+	for (size_t i = 0; i < recorders_.size(); i++) {
+		const GroupLatency *recorder = recorders_[i][group_index];
+		for (int p = 0; p < recorder->phase_num(); p++) {
+			if ((phase == -1) || (phase == p)) {
+				recorder->histogram(action_index, slot, p).add_to(out);
+			}
+		}
+	}
+}
+
+uint64_t LatencyStats::timeouts(int group_index, int action_index, int phase) const {
+	uint64_t total = 0;
+	for (size_t i = 0; i < recorders_.size(); i++) {
+		total += recorders_[i][group_index]->timeouts(action_index, phase);
+	}
+	return total;
+}
+
+void LatencyStats::merge_connect(int group_index, LatencySnapshot &out) const {
+	for (size_t i = 0; i < recorders_.size(); i++) {
+		recorders_[i][group_index]->connect_histogram().add_to(out);
+	}
+}
+
+uint64_t LatencyStats::connect_timeouts(int group_index) const {
+	uint64_t total = 0;
+	for (size_t i = 0; i < recorders_.size(); i++) {
+		total += recorders_[i][group_index]->connect_timeouts();
+	}
+	return total;
+}
+
+uint64_t LatencyStats::late_responses(int group_index) const {
+	uint64_t total = 0;
+	for (size_t i = 0; i < recorders_.size(); i++) {
+		total += recorders_[i][group_index]->late_responses();
+	}
+	return total;
+}
+
+uint64_t LatencyStats::unmatched_responses(int group_index) const {
+	uint64_t total = 0;
+	for (size_t i = 0; i < recorders_.size(); i++) {
+		total += recorders_[i][group_index]->unmatched_responses();
+	}
+	return total;
+}
+
+void LatencyStats::counters(int group_index, GroupCounters &out) const {
+	const pbcfg::Group &groupcfg = *groups_[group_index];
+	for (size_t i = 0; i < recorders_.size(); i++) {
+		const GroupLatency *recorder = recorders_[i][group_index];
+		out.connects += recorder->connects();
+		out.disconnects += recorder->disconnects();
+		out.connect_timeouts += recorder->connect_timeouts();
+		out.requests += recorder->requests();
+		out.completed += recorder->completed();
+		out.abandoned += recorder->abandoned();
+		out.errors += recorder->errors();
+		out.late_responses += recorder->late_responses();
+		out.unmatched_responses += recorder->unmatched_responses();
+		for (int a = 0; a < groupcfg.action_size(); a++) {
+			out.timeouts += recorder->timeouts(a);
+		}
+	}
+}
+
+void LatencyStats::peer_summaries(int group_index, std::vector<PeerSummary> &out) const {
+	out.clear();
+	const PeerSet &peers = *peers_[group_index];
+	if (peers.size() == 1) {
+		return ;
+	}
+	out.resize(peers.size());
+	for (int p = 0; p < peers.size(); p++) {
+		PeerSummary &summary = out[p];
+		summary.addr = peers.addr(p);
+		for (size_t i = 0; i < recorders_.size(); i++) {
+			const PeerLatency *stats = recorders_[i][group_index]->peer_stats(p);
+			summary.counters.connects += stats->connects.load(std::memory_order_relaxed);
+			summary.counters.disconnects += stats->disconnects.load(std::memory_order_relaxed);
+			summary.counters.connect_timeouts += stats->connect_timeouts.load(std::memory_order_relaxed);
+			summary.counters.requests += stats->requests.load(std::memory_order_relaxed);
+			summary.counters.completed += stats->completed.load(std::memory_order_relaxed);
+			summary.counters.timeouts += stats->timeouts.load(std::memory_order_relaxed);
+			summary.counters.abandoned += stats->abandoned.load(std::memory_order_relaxed);
+			summary.counters.errors += stats->errors.load(std::memory_order_relaxed);
+			stats->connect.add_to(summary.connect);
+			stats->action.add_to(summary.latency);
+		}
+	}
+}
+
+// 报告的一行
+static void report_row(std::ostringstream &report, const std::string &key,
+					   const LatencySnapshot &snapshot, bool with_timeouts, uint64_t timeouts) {
+	report << std::left << std::setw(48) << key << std::right
+		<< std::setw(10) << snapshot.count()
+		<< std::setw(10) << snapshot.value_at_percentile(50)
+		<< std::setw(10) << snapshot.value_at_percentile(90)
+		<< std::setw(10) << snapshot.value_at_percentile(99)
+		<< std::setw(10) << snapshot.value_at_percentile(99.9)
+		<< std::setw(10) << snapshot.max();
+	if (with_timeouts) {
+		report << std::setw(10) << timeouts;
+	}
+	report << "\n";
+}
+
+void LatencyStats::log_report(void) const {
+	if (recorders_.empty()) {
+		return ;
+	}
+	std::ostringstream report;
+	report << "Latency report (usec):\n" << std::left
+		<< std::setw(48) << "group/action/response" << std::right
+		<< std::setw(10) << "count" << std::setw(10) << "p50" << std::setw(10) << "p90"
+		<< std::setw(10) << "p99" << std::setw(10) << "p99.9" << std::setw(10) << "max"
+		<< std::setw(10) << "timeouts" << "\n";
+	for (size_t g = 0; g < groups_.size(); g++) {
+		const pbcfg::Group &groupcfg = *groups_[g];
+		LatencySnapshot connect;
+		merge_connect(g, connect);
+		uint64_t connect_timeout_num = connect_timeouts(g);
+		if (connect.count() > 0 || connect_timeout_num > 0) {
+			report_row(report, groupcfg.name() + "/(connect)", connect, true, connect_timeout_num);
+		}
+		// 不分阶段时只有一份, 记在 phase 0 上, 行尾不加阶段名
+		bool phased = profiles_[g]->phased();
+		int phase_num = phased ? kLoadPhaseNum : 1;
+		for (int a = 0; a < groupcfg.action_size(); a++) {
+			const pbcfg::Action &actioncfg = groupcfg.action(a);
+			for (int slot = 0; slot <= actioncfg.response_size(); slot++) {
+				for (int p = 0; p < phase_num; p++) {
+					uint64_t action_timeouts = timeouts(g, a, p);
+					LatencySnapshot snapshot;
+					merge(g, a, slot, snapshot, p);
+					if ((snapshot.count() == 0) && (slot != 0 || action_timeouts == 0)) {
+						continue;
+					}
+					std::ostringstream key;
+					key << groupcfg.name() << "/#" << a << "/"
+						<< (slot == 0 ? std::string("(action)") : actioncfg.response(slot - 1));
+					if (phased) {
+						key << " [" << LoadPhaseName(p) << "]";
+					}
+					report_row(report, key.str(), snapshot, slot == 0, action_timeouts);
+				}
+			}
+		}
+		// 只有次数, 没有时延
+		uint64_t late = late_responses(g);
+		uint64_t unmatched = unmatched_responses(g);
+		if (late > 0) {
+			report << std::left << std::setw(48) << groupcfg.name() + "/(late responses)"
+				<< std::right << std::setw(10) << late << "\n";
+		}
+		if (unmatched > 0) {
+			report << std::left << std::setw(48) << groupcfg.name() + "/(unmatched responses)"
+				<< std::right << std::setw(10) << unmatched << "\n";
+		}
+	}
+	LOG(ERROR) << report.str();
+
+	// 按对端分开的计数和时延, 用来看各个节点的负载是否均衡, 有没有偏慢的节点
+	std::ostringstream peer_report;
+	for (size_t g = 0; g < groups_.size(); g++) {
+		std::vector<PeerSummary> peers;
+		peer_summaries(g, peers);
+		for (size_t p = 0; p < peers.size(); p++) {
+			const PeerSummary &peer = peers[p];
+			if (peer_report.tellp() == 0) {
+				peer_report << "Peer report (usec):\n" << std::left
+					<< std::setw(48) << "group/peer" << std::right
+					<< std::setw(10) << "connects" << std::setw(10) << "conn_p99" << std::setw(10) << "conn_tmo"
+					<< std::setw(10) << "errors" << std::setw(10) << "requests" << std::setw(10) << "completed"
+					<< std::setw(10) << "timeouts" << std::setw(10) << "p50" << std::setw(10) << "p99"
+					<< std::setw(10) << "max" << "\n";
+			}
+			peer_report << std::left << std::setw(48) << groups_[g]->name() + "/" + peer.addr << std::right
+				<< std::setw(10) << peer.counters.connects
+				<< std::setw(10) << peer.connect.value_at_percentile(99)
+				<< std::setw(10) << peer.counters.connect_timeouts
+				<< std::setw(10) << peer.counters.errors
+				<< std::setw(10) << peer.counters.requests
+				<< std::setw(10) << peer.counters.completed
+				<< std::setw(10) << peer.counters.timeouts
+				<< std::setw(10) << peer.latency.value_at_percentile(50)
+				<< std::setw(10) << peer.latency.value_at_percentile(99)
+				<< std::setw(10) << peer.latency.max() << "\n";
+		}
+	}
+	if (peer_report.tellp() > 0) {
+		LOG(ERROR) << peer_report.str();
+	}
+}
+
+void LatencyStats::sample_throughput(uint64_t now) {
+	std::lock_guard<std::mutex> guard(lock_);
+	for (size_t g = 0; g < groups_.size(); g++) {
+		uint64_t completed = 0;
+		for (size_t i = 0; i < recorders_.size(); i++) {
+			completed += recorders_[i][g]->completed();
+		}
+		if ((sample_usec_ > 0) && (now > sample_usec_)) {
+			throughput_[g] = double(completed - sample_completed_[g]) * 1000000 / (now - sample_usec_);
+		}
+		sample_completed_[g] = completed;
+	}
+	sample_usec_ = now;
+}
+
+void LatencyStats::summarize(std::vector<GroupSummary> &out) const {
+	std::lock_guard<std::mutex> guard(lock_);
+	out.resize(groups_.size());
+	for (size_t g = 0; g < groups_.size(); g++) {
+		const pbcfg::Group &groupcfg = *groups_[g];
+		GroupSummary &summary = out[g];
+		summary.name = groupcfg.name();
+		summary.counters = GroupCounters();
+		counters(g, summary.counters);
+		summary.latency = LatencySnapshot();
+		for (int a = 0; a < groupcfg.action_size(); a++) {
+			merge(g, a, 0, summary.latency);
+		}
+	}
+}
+
+// Prometheus 标签值里的 \, " 和换行要转义
+static std::string prom_label(const std::string &value) {
+	std::string out;
+	for (size_t i = 0; i < value.size(); i++) {
+		switch (value[i]) {
+		case '\\': out += "\\\\"; break;
+		case '"': out += "\\\""; break;
+		case '\n': out += "\\n"; break;
+		default: out += value[i]; break;
+		}
+	}
+	return out;
+}
+
+static void prom_header(std::ostream &out, const char *name, const char *type, const char *help) {
+	out << "# HELP " << name << " " << help << "\n# TYPE " << name << " " << type << "\n";
+}
+
+// 一个 summary 的所有样本: 分位, _sum, _count; @labels: 不带花括号, 不为空
+static void prom_summary(std::ostream &out, const char *name, const std::string &labels,
+						 const LatencySnapshot &snapshot) {
+	static const char *quantiles[] = {"0.5", "0.9", "0.99", "0.999"};
+	static const double percentiles[] = {50, 90, 99, 99.9};
+	for (int q = 0; q < 4; q++) {
+		out << name << "{" << labels << ",quantile=\"" << quantiles[q] << "\"} "
+			<< snapshot.value_at_percentile(percentiles[q]) << "\n";
+	}
+	out << name << "_sum{" << labels << "} " << snapshot.sum() << "\n";
+	out << name << "_count{" << labels << "} " << snapshot.count() << "\n";
+}
+
+void LatencyStats::write_prometheus(std::ostream &out) const {
+	std::lock_guard<std::mutex> guard(lock_);
+	if (recorders_.empty()) {
+		return ;
+	}
+	std::vector<GroupCounters> counts(groups_.size());
+	std::vector<std::string> group_labels(groups_.size());
+	for (size_t g = 0; g < groups_.size(); g++) {
+		counters(g, counts[g]);
+		group_labels[g] = "group=\"" + prom_label(groups_[g]->name()) + "\"";
+	}
+
+	// 每个 Group 一个值的指标; 同一个指标的样本必须连在一起
+	struct GroupMetric {
+		const char *name;
+		const char *type;
+		const char *help;
+		uint64_t GroupCounters::*field;
+	};
+	static const GroupMetric metrics[] = {
+		{"robot_connects_total", "counter", "Connections established.", &GroupCounters::connects},
+		{"robot_connect_timeouts_total", "counter", "Connections that hit connect_timeout.",
+			&GroupCounters::connect_timeouts},
+		{"robot_requests_total", "counter", "Actions sent that wait for responses.", &GroupCounters::requests},
+		{"robot_actions_completed_total", "counter", "Actions whose responses all arrived.",
+			&GroupCounters::completed},
+		{"robot_errors_total", "counter", "Clients stopped by an error.", &GroupCounters::errors},
+		{"robot_abandoned_requests_total", "counter", "Requests still waiting when their client stopped.",
+			&GroupCounters::abandoned},
+		{"robot_late_responses_total", "counter", "Responses to requests that already timed out.",
+			&GroupCounters::late_responses},
+		{"robot_unmatched_responses_total", "counter", "Responses that match no request sent.",
+			&GroupCounters::unmatched_responses},
+	};
+	for (size_t m = 0; m < sizeof(metrics) / sizeof(metrics[0]); m++) {
+		prom_header(out, metrics[m].name, metrics[m].type, metrics[m].help);
+		for (size_t g = 0; g < groups_.size(); g++) {
+			out << metrics[m].name << "{" << group_labels[g] << "} " << counts[g].*metrics[m].field << "\n";
+		}
+	}
+	prom_header(out, "robot_connected_clients", "gauge", "Clients currently connected.");
+	for (size_t g = 0; g < groups_.size(); g++) {
+		out << "robot_connected_clients{" << group_labels[g] << "} " << counts[g].connected() << "\n";
+	}
+	prom_header(out, "robot_inflight_requests", "gauge", "Requests sent and still waiting for responses.");
+	for (size_t g = 0; g < groups_.size(); g++) {
+		out << "robot_inflight_requests{" << group_labels[g] << "} " << counts[g].in_flight() << "\n";
+	}
+	prom_header(out, "robot_throughput", "gauge", "Actions completed per second over the last sample.");
+	for (size_t g = 0; g < groups_.size(); g++) {
+		out << "robot_throughput{" << group_labels[g] << "} " << throughput_[g] << "\n";
+	}
+
+	prom_header(out, "robot_timeouts_total", "counter", "Actions that timed out.");
+	for (size_t g = 0; g < groups_.size(); g++) {
+		for (int a = 0; a < groups_[g]->action_size(); a++) {
+			out << "robot_timeouts_total{" << group_labels[g] << ",action=\"" << a << "\"} "
+				<< timeouts(g, a) << "\n";
+		}
+	}
+
+	prom_header(out, "robot_connect_latency_usec", "summary", "Time from connect to connected, in microseconds.");
+	for (size_t g = 0; g < groups_.size(); g++) {
+		LatencySnapshot connect;
+		merge_connect(g, connect);
+		prom_summary(out, "robot_connect_latency_usec", group_labels[g], connect);
+	}
+
+	// 维度和 log_report 相同: (group, action, response), 分阶段的 Group 再加 phase
+	prom_header(out, "robot_latency_usec", "summary",
+				"Action (response=\"(action)\") and response latency, in microseconds.");
+	for (size_t g = 0; g < groups_.size(); g++) {
+		const pbcfg::Group &groupcfg = *groups_[g];
+		bool phased = profiles_[g]->phased();
+		int phase_num = phased ? kLoadPhaseNum : 1;
+		for (int a = 0; a < groupcfg.action_size(); a++) {
+			const pbcfg::Action &actioncfg = groupcfg.action(a);
+			for (int slot = 0; slot <= actioncfg.response_size(); slot++) {
+				for (int p = 0; p < phase_num; p++) {
+					LatencySnapshot snapshot;
+					merge(g, a, slot, snapshot, p);
+					std::ostringstream labels;
+					labels << group_labels[g] << ",action=\"" << a << "\",response=\""
+						<< prom_label(slot == 0 ? std::string("(action)") : actioncfg.response(slot - 1)) << "\"";
+					if (phased) {
+						labels << ",phase=\"" << LoadPhaseName(p) << "\"";
+					}
+					prom_summary(out, "robot_latency_usec", labels.str(), snapshot);
+				}
+			}
+		}
+	}
+
+	// 有多个对端的 Group 按 (group, peer) 再出一份计数和时延
+	std::vector<std::vector<PeerSummary> > peers(groups_.size());
+	std::vector<std::vector<std::string> > peer_labels(groups_.size());
+	bool has_peers = false;
+	for (size_t g = 0; g < groups_.size(); g++) {
+		peer_summaries(g, peers[g]);
+		for (size_t p = 0; p < peers[g].size(); p++) {
+			peer_labels[g].push_back(group_labels[g] + ",peer=\"" + prom_label(peers[g][p].addr) + "\"");
+		}
+		has_peers = has_peers || !peers[g].empty();
+	}
+	if (!has_peers) {
+		return ;
+	}
+	static const GroupMetric peer_metrics[] = {
+		{"robot_peer_connects_total", "counter", "Connections established to the peer.", &GroupCounters::connects},
+		{"robot_peer_connect_timeouts_total", "counter", "Connections to the peer that hit connect_timeout.",
+			&GroupCounters::connect_timeouts},
+		{"robot_peer_requests_total", "counter", "Actions sent to the peer that wait for responses.",
+			&GroupCounters::requests},
+		{"robot_peer_actions_completed_total", "counter", "Actions on the peer whose responses all arrived.",
+			&GroupCounters::completed},
+		{"robot_peer_timeouts_total", "counter", "Actions on the peer that timed out.", &GroupCounters::timeouts},
+		{"robot_peer_errors_total", "counter", "Clients on the peer stopped by an error.", &GroupCounters::errors},
+	};
+	for (size_t m = 0; m < sizeof(peer_metrics) / sizeof(peer_metrics[0]); m++) {
+		prom_header(out, peer_metrics[m].name, peer_metrics[m].type, peer_metrics[m].help);
+		for (size_t g = 0; g < groups_.size(); g++) {
+			for (size_t p = 0; p < peers[g].size(); p++) {
+				out << peer_metrics[m].name << "{" << peer_labels[g][p] << "} "
+					<< peers[g][p].counters.*peer_metrics[m].field << "\n";
+			}
+		}
+	}
+	prom_header(out, "robot_peer_connected_clients", "gauge", "Connections to the peer currently open.");
+	for (size_t g = 0; g < groups_.size(); g++) {
+		for (size_t p = 0; p < peers[g].size(); p++) {
+			out << "robot_peer_connected_clients{" << peer_labels[g][p] << "} " << peers[g][p].counters.connected() << "\n";
+		}
+	}
+	prom_header(out, "robot_peer_inflight_requests", "gauge", "Requests sent to the peer and still waiting.");
+	for (size_t g = 0; g < groups_.size(); g++) {
+		for (size_t p = 0; p < peers[g].size(); p++) {
+			out << "robot_peer_inflight_requests{" << peer_labels[g][p] << "} " << peers[g][p].counters.in_flight() << "\n";
+		}
+	}
+	prom_header(out, "robot_peer_connect_latency_usec", "summary",
+				"Time from connect to connected per peer, in microseconds.");
+	for (size_t g = 0; g < groups_.size(); g++) {
+		for (size_t p = 0; p < peers[g].size(); p++) {
+			prom_summary(out, "robot_peer_connect_latency_usec", peer_labels[g][p], peers[g][p].connect);
+		}
+	}
+	prom_header(out, "robot_peer_latency_usec", "summary",
+				"Action latency per peer (all actions), in microseconds.");
+	for (size_t g = 0; g < groups_.size(); g++) {
+		for (size_t p = 0; p < peers[g].size(); p++) {
+			prom_summary(out, "robot_peer_latency_usec", peer_labels[g][p], peers[g][p].latency);
+		}
+	}
+}
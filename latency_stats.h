@@ -0,0 +1,337 @@
+#ifndef __LATENCY_STATS_H__
+#define __LATENCY_STATS_H__
+
+#include "common.h"
+#include "robot.pb.h"
+#include "load_profile.h"
+#include "peer_set.h"
+#include "timeutils.h"
+#include <atomic>
+#include <mutex>
+
+
+// LatencySnapshot: 普通 (非原子) 的 HDR 直方图, 用于合并和出报告
+// 桶的划分: [0, 64) 每个值一个桶; 之后每个 2 的幂区间 [2^e, 2^(e+1)) 再均分成 64 个桶,
+// 所以任何值的相对误差都不超过 1/64; 超过 kMaxValue 的值记在最后一个桶里
+class LatencySnapshot {
+public:
+	static const int kSubBucketBits = 6;
+	static const int kSubBucketCount = 1 << kSubBucketBits;
+	static const int kMaxExponent = 31;
+	static const uint64_t kMaxValue = (uint64_t(1) << (kMaxExponent + 1)) - 1;
+	static const int kBucketCount = kSubBucketCount * (kMaxExponent - kSubBucketBits + 2);
+
+	LatencySnapshot() : counts_(kBucketCount, 0), total_(0), max_(0) { }
+
+public:
+	static int bucket_index(uint64_t value);
+	// 落在该桶里的最大值
+	static uint64_t bucket_upper(int index);
+
+	void record(uint64_t value, uint64_t n = 1);
+	void merge(const LatencySnapshot &other);
+	// 减掉同一组直方图更早的一份快照, 得到这段时间内的分布; max 只能取到最高的非空桶的上界
+	void subtract(const LatencySnapshot &earlier);
+	void add_bucket(int index, uint64_t n);
+	void set_max(uint64_t max) { if (max > max_) max_ = max; }
+
+	uint64_t count(void) const { return total_; }
+	uint64_t max(void) const { return max_; }
+	// 所有值的和, 按每个桶的上界 (不超过 max) 估算, 偏大不超过 1/64
+	uint64_t sum(void) const;
+	// @percentile: (0, 100], 返回该分位所在桶的上界 (不超过 max)
+	uint64_t value_at_percentile(double percentile) const;
+
+private:
+	std::vector<uint64_t> counts_;
+	uint64_t total_;
+	uint64_t max_;
+};
+
+// LatencyHistogram: 记录端用的直方图, 桶计数都是原子的,
+// 记录时只有一次 relaxed fetch_add, 不分配内存; 其他线程随时可以无锁读出快照
+class LatencyHistogram {
+public:
+	LatencyHistogram();
+
+public:
+	void record(uint64_t value);
+	// 把当前计数累加到 out
+	void add_to(LatencySnapshot &out) const;
+
+private:
+	LatencyHistogram(const LatencyHistogram &);
+	LatencyHistogram &operator=(const LatencyHistogram &);
+
+private:
+	std::atomic<uint64_t> counts_[LatencySnapshot::kBucketCount];
+	std::atomic<uint64_t> max_;
+};
+
+// PeerLatency: 一个对端上的计数和 Action 完成时长 (所有 Action, 所有阶段合在一起), 用来找出偏慢的节点
+struct PeerLatency {
+	PeerLatency()
+		: connects(0), disconnects(0), connect_timeouts(0), requests(0),
+		  completed(0), timeouts(0), abandoned(0), errors(0) { }
+
+	LatencyHistogram action;
+	LatencyHistogram connect;
+	std::atomic<uint64_t> connects;
+	std::atomic<uint64_t> disconnects;
+	std::atomic<uint64_t> connect_timeouts;
+	std::atomic<uint64_t> requests;
+	std::atomic<uint64_t> completed;
+	std::atomic<uint64_t> timeouts;
+	std::atomic<uint64_t> abandoned;
+	std::atomic<uint64_t> errors;
+};
+
+// GroupLatency: 一个 Group 的所有直方图, 启动前按配置一次分配好
+//   每个 Action: [0] 从发出请求到收齐所有 response 的时长, [1 + r] 第 r 个 response 的时延
+//   另外单独记录 connect 的时长 (从调用 connect 到连上), 用来单独衡量服务端的 accept 能力
+// 负载曲线有 ramp_up/ramp_down 时, Action/response 的直方图和超时次数按请求发出时的阶段 (LoadPhase) 各有一份
+// Group 有多个对端时, 计数和 connect/Action 时延再按对端 (PeerSet 的下标, @peer 参数) 各记一份
+class GroupLatency {
+public:
+	~GroupLatency();
+	// @profile: 可以为 NULL (不分阶段)
+	// @peers: 该 Group 共享的对端列表, NULL 时按配置自己建一个
+	explicit GroupLatency(const pbcfg::Group &groupcfg, const LoadProfile *profile = NULL,
+						  PeerSet *peers = NULL);
+
+public:
+	// 给新连接选对端 (seeto: PeerSet::pick)
+	PeerSet &peers(void) { return *peers_; }
+
+	// @type_name: 不在 action.response 里的回包被忽略
+	void record_response(int action_index, const std::string &type_name, uint64_t usec);
+	// @response_index: action.response 的下标
+	void record_response(int action_index, int response_index, uint64_t usec) {
+		histograms_[slot_index(phase_of(usec), action_index, 1 + response_index)].record(usec);
+	}
+	void record_action(int action_index, uint64_t usec, int peer = 0);
+	// 以下计数都是 relaxed 原子加, thread 引擎的多个客户端线程会同时记到同一个 GroupLatency 上 (seeto: LatencyStats)
+	// 一个 Action 的请求发出, 之后以 record_action/record_timeout/record_abandoned 之一结束;
+	// 没有 response 的 Action 不等回包, 不算在内
+	void record_request(int action_index, int peer = 0) {
+		if (groupcfg_.action(action_index).response_size() > 0) {
+			requests_.fetch_add(1, std::memory_order_relaxed);
+			if (peer_stats_) {
+				peer_stats_[peer].requests.fetch_add(1, std::memory_order_relaxed);
+				peers_->begin_request(peer);
+			}
+		}
+	}
+	// 客户端出错结束时还没等到回包的请求
+	void record_abandoned(int action_index, uint64_t n = 1, int peer = 0) {
+		if (groupcfg_.action(action_index).response_size() > 0) {
+			abandoned_.fetch_add(n, std::memory_order_relaxed);
+			if (peer_stats_) {
+				peer_stats_[peer].abandoned.fetch_add(n, std::memory_order_relaxed);
+				peers_->end_request(peer, n);
+			}
+		}
+	}
+	// 客户端因为出错 (连不上, 收发/解码失败, 超时) 提前结束
+	void record_error(int peer = 0) {
+		errors_.fetch_add(1, std::memory_order_relaxed);
+		if (peer_stats_) {
+			peer_stats_[peer].errors.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+	void record_disconnect(int peer = 0) {
+		disconnects_.fetch_add(1, std::memory_order_relaxed);
+		if (peer_stats_) {
+			peer_stats_[peer].disconnects.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+	uint64_t requests(void) const { return requests_.load(std::memory_order_relaxed); }
+	uint64_t completed(void) const { return completed_.load(std::memory_order_relaxed); }
+	uint64_t abandoned(void) const { return abandoned_.load(std::memory_order_relaxed); }
+	uint64_t errors(void) const { return errors_.load(std::memory_order_relaxed); }
+	uint64_t connects(void) const { return connects_.load(std::memory_order_relaxed); }
+	uint64_t disconnects(void) const { return disconnects_.load(std::memory_order_relaxed); }
+	// @usec: 请求发出到超时的耗时, 超时按请求发出时所在的阶段统计 (和 record_action 一样)
+	void record_timeout(int action_index, uint64_t usec, int peer = 0);
+	// @phase: -1 表示所有阶段的总和
+	uint64_t timeouts(int action_index, int phase = -1) const;
+
+	// 按 seq 对不上的回包: late 是已发出的更早的 (比如已超时的) 请求的回包,
+	// unmatched 是 seq 没有发出过, 或类型不是该请求在等的回包
+	void record_late_response(void) { late_responses_.fetch_add(1, std::memory_order_relaxed); }
+	void record_unmatched_response(void) { unmatched_responses_.fetch_add(1, std::memory_order_relaxed); }
+	uint64_t late_responses(void) const { return late_responses_.load(std::memory_order_relaxed); }
+	uint64_t unmatched_responses(void) const { return unmatched_responses_.load(std::memory_order_relaxed); }
+
+	void record_connect(uint64_t usec, int peer = 0) {
+		connect_.record(usec);
+		connects_.fetch_add(1, std::memory_order_relaxed);
+		if (peer_stats_) {
+			peer_stats_[peer].connect.record(usec);
+			peer_stats_[peer].connects.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+	void record_connect_timeout(int peer = 0) {
+		connect_timeouts_.fetch_add(1, std::memory_order_relaxed);
+		if (peer_stats_) {
+			peer_stats_[peer].connect_timeouts.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+	const LatencyHistogram &connect_histogram(void) const { return connect_; }
+	uint64_t connect_timeouts(void) const { return connect_timeouts_.load(std::memory_order_relaxed); }
+
+	// 只有一个对端时为 NULL (不分对端统计); @peer: 0 ~ peers().size() - 1
+	const PeerLatency *peer_stats(int peer) const { return peer_stats_ ? &peer_stats_[peer] : NULL; }
+
+	// 分阶段时为 kLoadPhaseNum, 否则为 1 (只有 phase 0)
+	int phase_num(void) const { return phase_num_; }
+	// @slot: 0: Action 完成时长, 1 + r: 第 r 个 response; @phase: 0 ~ phase_num() - 1
+	const LatencyHistogram &histogram(int action_index, int slot, int phase = 0) const {
+		return histograms_[slot_index(phase, action_index, slot)];
+	}
+
+private:
+	GroupLatency(const GroupLatency &);
+	GroupLatency &operator=(const GroupLatency &);
+
+	// 耗时 usec 的请求是在哪个阶段发出的
+	int phase_of(uint64_t usec) const {
+		return (phase_num_ == 1) ? 0 : profile_->phase(now_usec() - usec);
+	}
+	int slot_index(int phase, int action_index, int slot) const {
+		return phase * slot_num_ + offsets_[action_index] + slot;
+	}
+
+private:
+	const pbcfg::Group &groupcfg_;
+	const LoadProfile *profile_;
+	PeerSet *peers_;
+	PeerSet *own_peers_;		// 构造时没有给 peers 才有
+	PeerLatency *peer_stats_;	// 每个对端一个, 只有一个对端时为 NULL
+	int phase_num_;
+	int slot_num_;			// 每个阶段的直方图个数
+	std::vector<int> offsets_;
+	LatencyHistogram *histograms_;
+	std::atomic<uint64_t> *timeouts_;
+	LatencyHistogram connect_;
+	std::atomic<uint64_t> connect_timeouts_;
+	std::atomic<uint64_t> late_responses_;
+	std::atomic<uint64_t> unmatched_responses_;
+	std::atomic<uint64_t> requests_;
+	std::atomic<uint64_t> completed_;
+	std::atomic<uint64_t> abandoned_;
+	std::atomic<uint64_t> errors_;
+	std::atomic<uint64_t> connects_;
+	std::atomic<uint64_t> disconnects_;
+};
+
+// 一个 Group 在所有记录端上的计数之和
+struct GroupCounters {
+	GroupCounters() { memset(this, 0, sizeof(*this)); }
+
+	// 已连上还没断开的客户端
+	uint64_t connected(void) const { return (connects > disconnects) ? (connects - disconnects) : 0; }
+	// 已发出还没结束的请求
+	uint64_t in_flight(void) const {
+		uint64_t done = completed + timeouts + abandoned;
+		return (requests > done) ? (requests - done) : 0;
+	}
+
+	uint64_t connects;
+	uint64_t disconnects;
+	uint64_t connect_timeouts;
+	uint64_t requests;
+	uint64_t completed;
+	uint64_t timeouts;
+	uint64_t abandoned;
+	uint64_t errors;
+	uint64_t late_responses;
+	uint64_t unmatched_responses;
+};
+
+// 一个 Group 的计数, 和所有 Action 完成时长 (所有阶段) 合并后的直方图
+struct GroupSummary {
+	std::string name;
+	GroupCounters counters;
+	LatencySnapshot latency;
+};
+
+// 一个对端在所有记录端上的计数 (没有迟到/对不上的回包), connect 时长和 Action 完成时长
+struct PeerSummary {
+	std::string addr;
+	GroupCounters counters;
+	LatencySnapshot connect;
+	LatencySnapshot latency;
+};
+
+// LatencyStats: 每个记录端一组 GroupLatency, 只在结束时 (或需要中间报告时) 合并.
+// epoll 引擎的每个循环, coro 引擎的每个 worker 各自独占一个记录端, 记录路径上线程之间不共享缓存行;
+// thread 引擎每个客户端一个线程, 按 client 下标共享 kThreadEngineLatencyShards 个记录端,
+// 同一分片上的线程同时记录时会争抢同一批原子计数和直方图桶的缓存行 (只是 relaxed 原子加, 不加锁);
+// 统计服务 (StatsServer) 的线程随时会来读, 它和 init/clear 之间用 lock_ 互斥, 记录路径不加锁
+class LatencyStats {
+public:
+	~LatencyStats() { clear(); }
+	LatencyStats() : sample_usec_(0) { }
+
+public:
+	// 为每个记录端分配所有 Group 的直方图, 必须在任何工作线程开始前调用
+	void init(const pbcfg::CfgRoot &cfg, int recorder_num);
+	void clear(void);
+	// 所有 Group 的负载曲线从 now 开始计时, init 之后, 任何客户端开始之前调用
+	void start(uint64_t now);
+	// @return: NULL: 没有 init 过
+	const LoadProfile *profile(int group_index) const;
+	// 该 Group 所有客户端共享的对端列表; @return: NULL: 没有 init 过
+	PeerSet *peers(int group_index) const;
+
+	int recorder_num(void) const { return static_cast<int>(recorders_.size()); }
+	// @return: -1: 不是 init 时的 Group
+	int group_index(const pbcfg::Group *groupcfg) const;
+	// @return: NULL: 没有 init 过
+	GroupLatency *recorder(int recorder_index, int group_index);
+
+	// 合并所有记录端上该 key 的直方图; @phase: -1 表示所有阶段
+	void merge(int group_index, int action_index, int slot, LatencySnapshot &out, int phase = -1) const;
+	uint64_t timeouts(int group_index, int action_index, int phase = -1) const;
+	void merge_connect(int group_index, LatencySnapshot &out) const;
+	uint64_t connect_timeouts(int group_index) const;
+	uint64_t late_responses(int group_index) const;
+	uint64_t unmatched_responses(int group_index) const;
+	void counters(int group_index, GroupCounters &out) const;
+	// 每个对端一个 PeerSummary; 只有一个对端的 Group 为空
+	void peer_summaries(int group_index, std::vector<PeerSummary> &out) const;
+	// 每个 Group 的 connect 和每个 (group, action, response) 一行:
+	// count, p50/p90/p99/p99.9/max (微秒), connect 和 Action 行带超时次数;
+	// 有迟到/对不上的回包时每个 Group 再各加一行次数; 分阶段的 Group 每个阶段各一行;
+	// 有多个对端的 Group 再按对端各出一行连接/请求计数和 connect/Action 时延
+	void log_report(void) const;
+
+	// 记下各 Group 到 now 为止完成的 Action 数, 和上一次采样比较得出吞吐 (每秒完成的 Action 数)
+	void sample_throughput(uint64_t now);
+	// 每个 Group 一个 GroupSummary; 没有 init 过时为空
+	void summarize(std::vector<GroupSummary> &out) const;
+	// Prometheus 文本格式 (0.0.4) 的实时统计: 连接/请求/出错/超时计数, 进行中的请求和连接数,
+	// 吞吐, 以及和 log_report 相同维度的时延分位 (summary, 微秒); 有多个对端的 Group 另有带 peer 标签的
+	// 对端指标; 没有 init 过时什么也不输出
+	void write_prometheus(std::ostream &out) const;
+
+private:
+	// clear 的实现, 调用者持有 lock_
+	void reset(void);
+
+private:
+	mutable std::mutex lock_;
+	std::vector<const pbcfg::Group *> groups_;
+	std::vector<LoadProfile *> profiles_;
+	std::vector<PeerSet *> peers_;
+	std::vector<std::vector<GroupLatency *> > recorders_;
+	uint64_t sample_usec_;					// 上一次 sample_throughput 的时刻, 0 表示还没有采样过
+	std::vector<uint64_t> sample_completed_;
+	std::vector<double> throughput_;
+};
+typedef singleton_default<LatencyStats> LatencyStats_Singleton;
+#define LATENCY_STATS (LatencyStats_Singleton::instance())
+
+
+#endif // __LATENCY_STATS_H__
@@ -0,0 +1,80 @@
+#include "load_profile.h"
+
+
+const char *LoadPhaseName(int phase) {
+	switch (phase) {
+	case kPhaseRampUp: return "ramp_up";
+	case kPhaseSteady: return "steady";
+	case kPhaseRampDown: return "ramp_down";
+	default: return "unknown";
+	}
+}
+
+LoadProfile::LoadProfile(const pbcfg::Group &groupcfg)
+	: client_count_(groupcfg.client_count()),
+	  loop_count_(groupcfg.loop_count()),
+	  ramp_up_(uint64_t(std::max(0, groupcfg.load().ramp_up())) * 1000),
+	  steady_(uint64_t(std::max(0, groupcfg.load().steady())) * 1000),
+	  ramp_down_(uint64_t(std::max(0, groupcfg.load().ramp_down())) * 1000),
+	  step_(groupcfg.load().shape() == pbcfg::RAMP_STEP),
+	  steps_(std::max(1, groupcfg.load().steps())),
+	  start_usec_(0) {
+}
+
+uint64_t LoadProfile::ramp_offset(int client_index, uint64_t duration, bool down) const {
+	if ((duration == 0) || (client_count_ <= 0)) {
+		return down ? duration : 0;
+	}
+	// 线性: 第 i 个在 duration * i / N 启动; 台阶: 第 i 个属于第 i * steps / N 批
+	uint64_t num = 0, den = 0;
+	if (step_) {
+		num = uint64_t(client_index) * steps_ / client_count_;
+		den = steps_;
+	} else {
+		num = client_index;
+		den = client_count_;
+	}
+	// 下降按逆序: 最后启动的那一批最先停止
+	return down ? duration * (den - num) / den : duration * num / den;
+}
+
+uint64_t LoadProfile::client_start(int client_index) const {
+	return start_usec_ + ramp_offset(client_index, ramp_up_, false);
+}
+
+uint64_t LoadProfile::client_stop(int client_index) const {
+	if (!time_bounded()) {
+		return UINT64_MAX;
+	}
+	return start_usec_ + ramp_up_ + steady_ + ramp_offset(client_index, ramp_down_, true);
+}
+
+bool LoadProfile::next_loop(int client_index, int count, uint64_t now) const {
+	if (loop_count_ <= 0) {
+		return false;
+	}
+	if (time_bounded()) {
+		return now < client_stop(client_index);
+	}
+	return count < loop_count_;
+}
+
+int LoadProfile::phase(uint64_t now) const {
+	if ((ramp_up_ > 0) && (now < start_usec_ + ramp_up_)) {
+		return kPhaseRampUp;
+	}
+	if (!time_bounded() || (now < start_usec_ + ramp_up_ + steady_)) {
+		return kPhaseSteady;
+	}
+	return (ramp_down_ > 0) ? kPhaseRampDown : kPhaseSteady;
+}
+
+int LoadProfile::active_clients(uint64_t now) const {
+	int active = 0;
+	for (int i = 0; i < client_count_; i++) {
+		if ((client_start(i) <= now) && (now < client_stop(i))) {
+			active++;
+		}
+	}
+	return active;
+}
@@ -0,0 +1,59 @@
+#ifndef __LOAD_PROFILE_H__
+#define __LOAD_PROFILE_H__
+
+#include "common.h"
+#include "robot.pb.h"
+
+
+// 负载曲线的阶段, 没有 ramp_up/ramp_down 的 Group 只有 kPhaseSteady
+enum LoadPhase {
+	kPhaseRampUp = 0,
+	kPhaseSteady = 1,
+	kPhaseRampDown = 2,
+	kLoadPhaseNum = 3,
+};
+const char *LoadPhaseName(int phase);
+
+// LoadProfile: 一个 Group 的负载曲线 (pbcfg::Group.load), 决定每个客户端的启动/停止时刻和当前所处的阶段;
+// 所有时刻都是 now_usec() 的时间轴, 从 start() 开始计时, start() 之后只读, 各线程可以直接调用
+class LoadProfile {
+public:
+	explicit LoadProfile(const pbcfg::Group &groupcfg);
+
+public:
+	void start(uint64_t now) { start_usec_ = now; }
+
+	// 设置了 load: 按时间结束, 不看 loop_count
+	bool time_bounded(void) const { return (ramp_up_ + steady_ + ramp_down_) > 0; }
+	// 有 ramp_up/ramp_down: 时延按阶段分开统计
+	bool phased(void) const { return (ramp_up_ > 0) || (ramp_down_ > 0); }
+
+	// 第 client_index 个客户端的启动时刻, 从 0 号开始依次启动
+	uint64_t client_start(int client_index) const;
+	// 第 client_index 个客户端的停止时刻, 后启动的先停止; 不是 time_bounded 时为 UINT64_MAX
+	uint64_t client_stop(int client_index) const;
+	// 客户端执行完 count 轮之后, 在 now 时刻是否还要开始下一轮 (或下一个 Action)
+	bool next_loop(int client_index, int count, uint64_t now) const;
+
+	// @return: LoadPhase, start() 之前算作 kPhaseRampUp (没有 ramp_up 时是 kPhaseSteady)
+	int phase(uint64_t now) const;
+	// now 时刻应该活跃的客户端数
+	int active_clients(uint64_t now) const;
+
+private:
+	// 第 client_index 个客户端在长为 duration 的爬升 (或下降) 过程中的偏移, 下降时按逆序
+	uint64_t ramp_offset(int client_index, uint64_t duration, bool down) const;
+
+private:
+	int client_count_;
+	int loop_count_;
+	uint64_t ramp_up_;		// 微秒
+	uint64_t steady_;
+	uint64_t ramp_down_;
+	bool step_;
+	int steps_;
+	uint64_t start_usec_;
+};
+
+
+#endif // __LOAD_PROFILE_H__
@@ -6,6 +6,11 @@
 #include "robot.h"
 #include "robot.pb.h"
 #include "frame_config_loader.h" // Added include
+#include "event_engine.h"
+#include "coro_engine.h"
+#include "stats_server.h"
+#include "event_trace.h"
+#include "async_log.h"
 
 
 int main(int argc, char **argv) {
@@ -34,8 +39,38 @@ int main(int argc, char **argv) {
 	if (!init_robot_config()) {
 		return -1;
 	}
-	RunRobots(cfg_root);
+	StatsServer stats_server;
+	if (!FLAGS_stats_listen.empty()) {
+		std::ostringstream err;
+		if (!stats_server.start(FLAGS_stats_listen, err)) {
+			LOG(ERROR) << "Error starting stats server: " << err.str();
+			return -1;
+		}
+	}
+	ShmStatsPublisher shm_stats;
+	if (FLAGS_shm_stats) {
+		std::ostringstream err;
+		if (!shm_stats.start(ShmStatsSegment::path_of(getpid()), err)) {
+			LOG(ERROR) << "Error publishing stats to shared memory: " << err.str();
+			return -1;
+		}
+	}
+	if (FLAGS_async_log) {
+		ASYNC_LOG.start();
+	}
+	// 各个引擎在开始运行时创建事件日志文件
+	EVENT_LOG.configure(FLAGS_event_log, FLAGS_event_log_mb);
+	if (FLAGS_engine == "epoll") {
+		RunRobotsOnEventLoops(cfg_root, FLAGS_event_loops);
+	} else if (FLAGS_engine == "coro") {
+		RunRobotsOnCoroutines(cfg_root, FLAGS_coro_workers, FLAGS_pin_workers, FLAGS_numa_aware);
+	} else {
+		RunRobots(cfg_root);
+	}
 
+	ASYNC_LOG.stop();
+	shm_stats.stop();
+	stats_server.stop();
 	cleanup_robot_config();
 	return 0;
 }
@@ -0,0 +1,45 @@
+#ifndef __MEMUTILS_H__
+#define __MEMUTILS_H__
+
+#include "common.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+
+// 当前的常驻内存 (字节), 读不到时返回 0
+inline uint64_t rss_bytes(void) {
+	FILE *fp = fopen("/proc/self/statm", "r");
+	if (!fp) {
+		return 0;
+	}
+	unsigned long size = 0, resident = 0;
+	int n = fscanf(fp, "%lu %lu", &size, &resident);
+	fclose(fp);
+	return (n == 2) ? uint64_t(resident) * sysconf(_SC_PAGESIZE) : 0;
+}
+
+// 进程启动以来常驻内存的峰值 (字节)
+inline uint64_t peak_rss_bytes(void) {
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) == -1) {
+		return 0;
+	}
+	return uint64_t(usage.ru_maxrss) * 1024;
+}
+
+// 运行结束时报告每个客户端平均占用的内存: (常驻内存峰值 - 创建客户端之前的常驻内存) / 客户端数
+// @base_rss: 创建客户端之前的 rss_bytes()
+inline void log_memory_per_client(const char *engine, uint64_t base_rss, int clients) {
+	uint64_t peak = peak_rss_bytes();
+	if ((clients <= 0) || (peak <= base_rss)) {
+		return ;
+	}
+	LOG(ERROR) << "Memory (" << engine << " engine): clients: " << clients
+		<< ", peak rss: " << peak / 1024 << " KB (base " << base_rss / 1024 << " KB)"
+		<< ", memory per client: " << (peak - base_rss) / clients << " bytes";
+}
+
+
+#endif // __MEMUTILS_H__
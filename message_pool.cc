@@ -0,0 +1,69 @@
+#include "message_pool.h"
+#include "pb_master.h"
+#include "flags.h"
+#include <atomic>
+
+// 每种类型最多缓存的空闲消息数
+const size_t kMaxFreeMessagesPerType = 64;
+
+static std::atomic<uint64_t> total_acquired(0);
+static std::atomic<uint64_t> total_created(0);
+
+
+MessagePool::~MessagePool() {
+	for (FreeLists::iterator it = free_lists_.begin(); it != free_lists_.end(); ++it) {
+		for (size_t i = 0; i < it->second.size(); i++) {
+			delete it->second[i];
+		}
+	}
+	free_lists_.clear();
+}
+
+MessagePool &MessagePool::local(void) {
+	static thread_local MessagePool pool;
+	return pool;
+}
+
+Message *MessagePool::acquire(const std::string &type_name) {
+	acquired_++;
+	const Message *prototype = PB_MASTER.get_prototype(type_name);
+	if (FLAGS_message_pool && prototype) {
+		FreeLists::iterator it = free_lists_.find(prototype->GetDescriptor());
+		if (it != free_lists_.end() && !it->second.empty()) {
+			Message *msg = it->second.back();
+			it->second.pop_back();
+			return msg;
+		}
+	}
+	created_++;
+	return prototype ? prototype->New() : NULL;
+}
+
+void MessagePool::release(Message *msg) {
+	if (!msg) return ;
+	if (!FLAGS_message_pool) {
+		delete msg;
+		return ;
+	}
+	std::vector<Message *> &free_list = free_lists_[msg->GetDescriptor()];
+	if (free_list.size() >= kMaxFreeMessagesPerType) {
+		delete msg;
+		return ;
+	}
+	free_list.push_back(msg);
+}
+
+void MessagePool::flush_stats(void) {
+	total_acquired += acquired_;
+	total_created += created_;
+	acquired_ = created_ = 0;
+}
+
+void MessagePool::log_stats(void) {
+	uint64_t acquired = total_acquired.load();
+	uint64_t created = total_created.load();
+	LOG(ERROR) << "Decode messages: " << acquired << ", message objects created: " << created
+		<< " (" << std::fixed << std::setprecision(4)
+		<< (acquired ? double(created) / acquired : 0.0) << " per message"
+		<< (FLAGS_message_pool ? "" : ", --message_pool=false") << ")";
+}
@@ -0,0 +1,45 @@
+#ifndef __MESSAGE_POOL_H__
+#define __MESSAGE_POOL_H__
+
+#include "common.h"
+#include <unordered_map>
+
+using google::protobuf::Message;
+
+
+// MessagePool: 每个线程一个, 按类型缓存解包用的 Message 对象.
+// 回包解析 (ParseFromArray) 前会 Clear, 所以归还的对象可以直接复用,
+// 而且 Clear 会保留字符串/子消息/repeated 字段已分配的空间, 稳定后解包几乎不再分配内存.
+class MessagePool {
+public:
+	~MessagePool();
+	MessagePool() : acquired_(0), created_(0) { }
+
+public:
+	// 当前线程的 pool
+	static MessagePool &local(void);
+
+	// @return: 0: 无法创建该类型的消息
+	Message *acquire(const std::string &type_name);
+	// 归还 acquire() 得到的消息 (也可以是任何堆上创建的消息), msg 可以为 0
+	void release(Message *msg);
+
+	// 本线程还没 flush 的计数; created 只是 pool 没命中时新建的消息对象,
+	// 不含解包 (ParseFromArray) 时字符串/repeated 字段/子消息自己的内存分配
+	uint64_t acquired(void) const { return acquired_; }
+	uint64_t created(void) const { return created_; }
+	// 把本线程的计数累加到全局计数, 每个 worker 结束时调用
+	void flush_stats(void);
+	// 打印全局计数: 解包消息数, 新建的消息对象数, 平均每个消息新建的对象数
+	static void log_stats(void);
+
+private:
+	// 按 descriptor 指针区分类型, 归还时不用构造类型名字符串
+	typedef std::unordered_map<const google::protobuf::Descriptor *, std::vector<Message *> > FreeLists;
+	FreeLists free_lists_;
+	uint64_t acquired_;
+	uint64_t created_;
+};
+
+
+#endif // __MESSAGE_POOL_H__
@@ -0,0 +1,261 @@
+#include "mux_connection.h"
+#include "client_session.h"
+#include "message_pool.h"
+#include "timeutils.h"
+#include "async_log.h"
+#include "uring.h"
+
+
+MuxConnection::~MuxConnection() {
+	loop_->cancel_timer(this);
+	close();
+	delete client_;
+	for (size_t i = 0; i < retired_.size(); i++) {
+		delete retired_[i];
+	}
+}
+
+MuxConnection::MuxConnection(const pbcfg::Group &groupcfg, EventLoop *loop,
+							 GroupLatency *latency, ConnectPacer *pacer, SourceBinder *source, int peer)
+	: groupcfg_(groupcfg),
+	  loop_(loop),
+	  latency_(latency),
+	  pacer_(pacer),
+	  peers_(latency ? &latency->peers() : NULL),
+	  fixed_peer_(peer),
+	  peer_((peer >= 0) ? peer : 0),
+	  source_(source),
+	  client_(NewLoopClient(loop->uring(), this, groupcfg.max_pkg_len(), groupcfg.has_checksum(),
+						    ChecksumType(groupcfg.checksum_type()))),
+	  used_(false),
+	  state_(kIdle),
+	  connect_start_(0) {
+	client_->set_connect_timeout(groupcfg.connect_timeout());
+	client_->set_source(source);
+}
+
+int MuxConnection::attach(ClientSession *session, uint32_t uid) {
+	if (!sessions_.insert(std::make_pair(uid, session)).second) {
+		return -1;
+	}
+	if (state_ == kConnected) {
+		return 0;
+	}
+	waiting_.push_back(uid);
+	if (state_ == kIdle) {
+		pace_connect();
+	}
+	return 1;
+}
+
+void MuxConnection::detach(uint32_t uid) {
+	if (sessions_.erase(uid) == 0) {
+		return ;
+	}
+	for (size_t i = 0; i < waiting_.size(); i++) {
+		if (waiting_[i] == uid) {
+			waiting_.erase(waiting_.begin() + i);
+			break;
+		}
+	}
+	if (sessions_.empty()) {
+		close();
+	}
+}
+
+int MuxConnection::flush(void) {
+	if (state_ != kConnected) {
+		return 0;
+	}
+	std::ostringstream errmsg;
+	if (client_->net_tcp_send(errmsg) == -1) {
+		close_all(kEventFailed, errmsg.str());
+		return -1;
+	}
+	return 0;
+}
+
+void MuxConnection::pace_connect(void) {
+	uint64_t now = now_usec();
+	uint64_t slot = pacer_ ? pacer_->acquire(now) : now;
+	if (slot > now) {
+		state_ = kWaitConnect;
+		loop_->set_timer(this, slot);
+		return ;
+	}
+	begin_connect();
+}
+
+void MuxConnection::begin_connect(void) {
+	state_ = kConnecting;
+	connect_start_ = now_usec();
+	if (used_) {
+		renew_client();
+	}
+	used_ = true;
+	if ((fixed_peer_ < 0) && peers_) {
+		peer_ = peers_->pick(waiting_.empty() ? 0 : waiting_[0]);
+	}
+	std::ostringstream errmsg;
+	int ret = client_->start_connect(peer_addr(), errmsg);
+	if (ret == -1) {
+		close_all(kEventFailed, errmsg.str());
+		return ;
+	}
+	if (loop_->add_fd(client_->connfd(), EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, this) == -1) {
+		close_all(kEventFailed, std::string("epoll add fd: ") + strerror(errno));
+		return ;
+	}
+	if (ret == 1) {
+		if (groupcfg_.connect_timeout() > 0) {
+			loop_->set_timer(this, connect_start_ + uint64_t(groupcfg_.connect_timeout()) * 1000);
+		}
+		return ;
+	}
+	on_connected();
+}
+
+void MuxConnection::on_connected(void) {
+	loop_->cancel_timer(this);
+	state_ = kConnected;
+	if (latency_) {
+		latency_->record_connect(now_usec() - connect_start_, peer_);
+	}
+	// 回调里 session 可能结束并 detach, 所以先取出等待列表, 每次都重新查 uid
+	std::vector<uint32_t> waiting;
+	waiting.swap(waiting_);
+	for (size_t i = 0; (i < waiting.size()) && (state_ == kConnected); i++) {
+		std::unordered_map<uint32_t, ClientSession *>::iterator it = sessions_.find(waiting[i]);
+		if (it != sessions_.end()) {
+			it->second->on_mux_connected();
+		}
+	}
+}
+
+void MuxConnection::on_events(uint32_t events) {
+	if (state_ == kConnecting) {
+		if (!(events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) return ;
+		std::ostringstream errmsg;
+		if (!client_->finish_connect(errmsg)) {
+			bool timed_out = (errno == ETIMEDOUT);
+			if (latency_ && timed_out) {
+				latency_->record_connect_timeout(peer_);
+			}
+			close_all(timed_out ? kEventTimedOut : kEventFailed, errmsg.str());
+			return ;
+		}
+		on_connected();
+	}
+	if (state_ != kConnected) return ;
+
+	std::ostringstream net_errmsg;
+	if (events & EPOLLOUT) {
+		if (client_->net_tcp_send(net_errmsg) == -1) {
+			close_all(kEventFailed, net_errmsg.str());
+			return ;
+		}
+	}
+	if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+		if (client_->net_tcp_recv(net_errmsg) == -1) {
+			close_all(kEventFailed, net_errmsg.str());
+			return ;
+		}
+	}
+	dispatch_responses();
+}
+
+bool MuxConnection::dispatch_responses(void) {
+	std::ostringstream op_errmsg;
+	while (true) {
+		Message *rsphead = 0, *rspbody = 0;
+		bool complete = false;
+		if (!client_->recv_msg(&rsphead, &rspbody, complete, op_errmsg)) {
+			close_all(kEventFailed, "recv_msg: " + op_errmsg.str());
+			return false;
+		}
+		if (!complete) {
+			break;
+		}
+		uint32_t uid = static_cast<pbcfg::CsMsgHead *>(rsphead)->uid();
+		std::unordered_map<uint32_t, ClientSession *>::iterator it = sessions_.find(uid);
+		if (it == sessions_.end()) {
+			// 已经结束了的 session 的回包, 或者对端没有回填 uid
+			if (latency_) {
+				latency_->record_unmatched_response();
+			}
+			MessagePool::local().release(rsphead);
+			MessagePool::local().release(rspbody);
+			continue;
+		}
+		if (it->second->deliver(rsphead, rspbody, client_->last_recv_len())) {
+			ready_.push_back(uid);
+		}
+	}
+
+	std::vector<uint32_t> ready;
+	ready.swap(ready_);
+	for (size_t i = 0; (i < ready.size()) && (state_ == kConnected); i++) {
+		std::unordered_map<uint32_t, ClientSession *>::iterator it = sessions_.find(ready[i]);
+		if (it != sessions_.end()) {
+			it->second->on_mux_responses();
+		}
+	}
+	return state_ == kConnected;
+}
+
+void MuxConnection::on_timer(void) {
+	if (state_ == kWaitConnect) {
+		begin_connect();
+		return ;
+	}
+	if (state_ == kConnecting) {
+		if (latency_) {
+			latency_->record_connect_timeout(peer_);
+		}
+		close_all(kEventTimedOut, "connect timeout");
+	}
+}
+
+void MuxConnection::close_all(EventStatus status, const std::string &errmsg) {
+	ALOG(ERROR) << "Error MuxConnection, Group-" << groupcfg_.name() << ": peer: " << peer_addr()
+		<< ", sessions: " << sessions_.size() << ", err: " << errmsg;
+	close();
+	std::unordered_map<uint32_t, ClientSession *> sessions;
+	sessions.swap(sessions_);
+	waiting_.clear();
+	ready_.clear();
+	for (std::unordered_map<uint32_t, ClientSession *>::iterator it = sessions.begin(); it != sessions.end(); ++it) {
+		it->second->on_mux_closed(status, errmsg);
+	}
+}
+
+void MuxConnection::close(void) {
+	loop_->cancel_timer(this);
+	if (latency_ && (state_ == kConnected)) {
+		latency_->record_disconnect(peer_);
+	}
+	if (client_->is_connected()) {
+		loop_->del_fd(client_->connfd());
+		client_->close_connection();
+	}
+	// 没发出去的请求不能留给下一条连接
+	client_->clear_buffer();
+	state_ = kIdle;
+}
+
+void MuxConnection::renew_client(void) {
+	size_t kept = 0;
+	for (size_t i = 0; i < retired_.size(); i++) {
+		if (retired_[i]->io_pending()) {
+			retired_[kept++] = retired_[i];
+		} else {
+			delete retired_[i];
+		}
+	}
+	retired_.resize(kept);
+	retired_.push_back(client_);
+	client_ = NewLoopClient(loop_->uring(), this, groupcfg_.max_pkg_len(), groupcfg_.has_checksum(),
+							ChecksumType(groupcfg_.checksum_type()));
+	client_->set_connect_timeout(groupcfg_.connect_timeout());
+	client_->set_source(source_);
+}
@@ -0,0 +1,91 @@
+#ifndef __MUX_CONNECTION_H__
+#define __MUX_CONNECTION_H__
+
+#include "common.h"
+#include "robot.pb.h"
+#include "client.h"
+#include "event_loop.h"
+#include "latency_stats.h"
+#include "connect_pacer.h"
+#include "event_log.h"
+#include "source_binder.h"
+#include <unordered_map>
+
+class ClientSession;
+
+
+// MuxConnection: 同一个 loop 上同一个 Group 的若干个 ClientSession 共用的一条连接 (seeto: Group.mux_clients).
+// 第一个 session 要连接时才 (按 pacer 排队) 发起连接, 最后一个 session 离开时关闭;
+// 各 session 的请求都直接写进共用的发送缓冲, 收到的回包按包头的 uid 交给对应的 session;
+// 连接失败或断开时所有 session 都通过 on_mux_closed 结束, 之后再来的 session 会重新发起连接;
+// 每次连接都用一个新的 Client (UringClient 关闭后不能再连, 旧连接的完成事件还可能回调它)
+class MuxConnection : public EventHandler {
+public:
+	~MuxConnection();
+	// @latency: 记录连接的 connect 时延和断开, 以及找不到 uid 的回包, 可以为 NULL
+	// @pacer: 该 Group 共享的连接限速器, 可以为 NULL (不限速)
+	// @source: 该 Group 共享的源地址分配器, 可以为 NULL (由内核选)
+	// @peer: 固定连这个对端 (PEER_HASH_UID 时按 uid 分好了组); -1 表示每次连接按 peer_policy 选
+	MuxConnection(const pbcfg::Group &groupcfg, EventLoop *loop, GroupLatency *latency,
+				  ConnectPacer *pacer, SourceBinder *source, int peer = -1);
+
+public:
+	// session 开始使用这条连接, 回包按 uid 交给它;
+	// @return: -1: uid 已经有别的 session 在用, 0: 连接已建立, 1: 等连上后回调 session->on_mux_connected()
+	int attach(ClientSession *session, uint32_t uid);
+	// session 结束, 不再收回包; 没有 session 时关闭连接
+	void detach(uint32_t uid);
+
+	// 当前的连接, 只用来 send_msg 和看发送缓冲; 重新连接后是另一个对象, session 应在连上后再取
+	Client &client(void) { return *client_; }
+	// 发出共用的发送缓冲; @return: -1: 连接已断开, 所有 session 都已经被 on_mux_closed 结束了
+	int flush(void);
+	int sessions(void) const { return static_cast<int>(sessions_.size()); }
+	// 当前 (或最近一次) 连接的对端在 PeerSet 里的下标
+	int peer(void) const { return peer_; }
+
+	// implements EventHandler -----------------------------------------
+	void on_events(uint32_t events);
+	void on_timer(void);
+
+private:
+	enum State {
+		kIdle,
+		kWaitConnect,		// 等待 pacer 分配的连接时刻
+		kConnecting,		// 非阻塞 connect 已发出, 等待可写或 connect_timeout
+		kConnected,
+	};
+
+	void pace_connect(void);
+	void begin_connect(void);
+	void on_connected(void);
+	// 把接收缓冲里的回包分给各 session, 再让收到回包的 session 处理
+	bool dispatch_responses(void);
+	// @status: 还在等连接的 session 记到事件日志的 connect 状态
+	void close_all(EventStatus status, const std::string &errmsg);
+	void close(void);
+	// 换一个新的 Client 给下一次连接, 旧的等它没有在途的收发后再释放
+	void renew_client(void);
+	const std::string &peer_addr(void) const { return peers_ ? peers_->addr(peer_) : groupcfg_.peer_addr(); }
+
+private:
+	const pbcfg::Group &groupcfg_;
+	EventLoop *loop_;
+	GroupLatency *latency_;
+	ConnectPacer *pacer_;
+	PeerSet *peers_;			// latency 为 NULL 时也为 NULL, 只连 peer_addr
+	int fixed_peer_;
+	int peer_;
+	SourceBinder *source_;
+	Client *client_;			// loop 用 io_uring 时是 UringClient
+	bool used_;					// client_ 已经发起过连接
+	std::vector<Client *> retired_;	// 之前的连接用过的 Client
+	State state_;
+	uint64_t connect_start_;
+	std::unordered_map<uint32_t, ClientSession *> sessions_;	// uid -> session
+	std::vector<uint32_t> waiting_;	// 等连接建立的 session 的 uid
+	std::vector<uint32_t> ready_;	// 本轮收到回包的 session 的 uid
+};
+
+
+#endif // __MUX_CONNECTION_H__
@@ -101,24 +101,68 @@ const FieldDescriptor *PbMaster::get_message_field_descriptor(
 	return message_descriptor->FindFieldByName(field_name);
 }
 
+PbMaster::~PbMaster() {
+	delete prototypes_.load();
+	for (size_t i = 0; i < retired_prototypes_.size(); i++) {
+		delete retired_prototypes_[i];
+	}
+	retired_prototypes_.clear();
+}
+
+PbMaster::PbMaster()
+	: importer_(&src_tree_, &err_collector_),
+	  prototypes_(new PrototypeMap) { }
+
 Message *PbMaster::create_message(const std::string &type_name) {
-	Message *message = NULL;
+	const Message *prototype = get_prototype(type_name);
+	if (!prototype) {
+		return NULL;
+	}
+	return prototype->New();
+}
+
+const Message *PbMaster::get_prototype(const std::string &type_name) {
+	const PrototypeMap *prototypes = prototypes_.load(std::memory_order_acquire);
+	PrototypeMap::const_iterator it = prototypes->find(type_name);
+	if (it != prototypes->end()) {
+		return it->second;
+	}
+	return resolve_prototype(type_name);
+}
+
+bool PbMaster::preload_prototype(const std::string &type_name) {
+	return get_prototype(type_name) != NULL;
+}
+
+const Message *PbMaster::resolve_prototype(const std::string &type_name) {
+	std::lock_guard<std::mutex> guard(prototypes_mutex_);
+	const PrototypeMap *prototypes = prototypes_.load(std::memory_order_relaxed);
+	PrototypeMap::const_iterator it = prototypes->find(type_name);
+	if (it != prototypes->end()) {
+		return it->second; // 其他线程刚插入
+	}
+
+	const Message *prototype = NULL;
 	const Descriptor *descriptor =
 		DescriptorPool::generated_pool()->FindMessageTypeByName(type_name);
 	if (descriptor) {
-		const Message *prototype =
-			MessageFactory::generated_factory()->GetPrototype(descriptor);
-		if (prototype) {
-			message = prototype->New();
-		}
+		prototype = MessageFactory::generated_factory()->GetPrototype(descriptor);
 	} else {
 		descriptor = importer_.pool()->FindMessageTypeByName(type_name);
-		static DynamicMessageFactory *dynamicMessageFactory = new DynamicMessageFactory();
-		if(descriptor){
-			message = dynamicMessageFactory->GetPrototype(descriptor)->New();
+		if (descriptor) {
+			prototype = dynamic_factory_.GetPrototype(descriptor);
 		}
 	}
-	return message;
+	// 找不到的类型不缓存: 之后 import 的 proto 里可能会有
+	if (!prototype) {
+		return NULL;
+	}
+
+	PrototypeMap *updated = new PrototypeMap(*prototypes);
+	(*updated)[type_name] = prototype;
+	prototypes_.store(updated, std::memory_order_release);
+	retired_prototypes_.push_back(prototypes);
+	return prototype;
 }
 
 Message *PbMaster::make_text_format_message(const std::string &data_fullpath,
@@ -13,6 +13,9 @@ extern "C" {
 
 // STL include files
 #include <memory>
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
 
 // protobuf common include files
 #include <google/protobuf/descriptor.h>
@@ -56,12 +59,18 @@ public:
 
 class PbMaster {
 public:
-	~PbMaster() { }
-	PbMaster() : importer_(&src_tree_, &err_collector_) { }
+	~PbMaster();
+	PbMaster();
 
 public: // interface
 	// @return: 0: failed, !0: message
 	Message *create_message(const std::string &type_name);
+	// @return: NULL: 两个 pool 里都找不到 type_name
+	// 读路径无锁: 命中缓存时不查 descriptor pool, 也不碰 DynamicMessageFactory 的锁
+	const Message *get_prototype(const std::string &type_name);
+	// 配置加载时预先解析并缓存, 之后解包时不会再有插入
+	// @return false: 找不到 type_name
+	bool preload_prototype(const std::string &type_name);
 	// @return: NULL: failed
 	Message *make_text_format_message(const std::string &data_fullpath,
 									  const std::string &type_name);
@@ -85,10 +94,21 @@ public: // interface
 	const FieldDescriptor *get_message_field_descriptor(Message *message, const std::string &field_name);
 
 
+private:
+	typedef std::unordered_map<std::string, const Message *> PrototypeMap;
+	// 在两个 pool 里查找并插入缓存, 加锁 (每种类型只会发生一次)
+	const Message *resolve_prototype(const std::string &type_name);
+
 private:
 	Importer importer_;
 	PbConfErrorCollector err_collector_;
 	DiskSourceTree src_tree_;
+	google::protobuf::DynamicMessageFactory dynamic_factory_;
+
+	// 只读快照: 插入时复制一份新表再原子替换, 旧表可能还有线程在读, 留到析构时释放
+	std::atomic<const PrototypeMap *> prototypes_;
+	std::vector<const PrototypeMap *> retired_prototypes_;
+	std::mutex prototypes_mutex_;
 };
 typedef singleton_default<PbMaster> PbMaster_Singleton;
 #define PB_MASTER (protobuf_master::PbMaster_Singleton::instance())
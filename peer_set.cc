@@ -0,0 +1,94 @@
+#include "peer_set.h"
+#include <algorithm>
+#include <set>
+
+
+// FNV-1a, 再用 splitmix64 的终结步打散, 相近的输入 (比如连续的 uid) 也能均匀地落在环上
+static uint64_t peer_hash(const void *data, size_t len) {
+	const unsigned char *p = static_cast<const unsigned char *>(data);
+	uint64_t h = 14695981039346656037ULL;
+	for (size_t i = 0; i < len; i++) {
+		h = (h ^ p[i]) * 1099511628211ULL;
+	}
+	h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+	return h ^ (h >> 31);
+}
+
+
+PeerSet::PeerSet(const pbcfg::Group &groupcfg)
+	: policy_(groupcfg.peer_policy()),
+	  outstanding_(1 + groupcfg.peer_size()),
+	  next_(0) {
+	addrs_.push_back(groupcfg.peer_addr());
+	for (int i = 0; i < groupcfg.peer_size(); i++) {
+		addrs_.push_back(groupcfg.peer(i));
+	}
+	// 虚拟节点按地址 (而不是下标) 哈希, 增删一个对端不影响其他对端在环上的位置
+	for (size_t p = 0; p < addrs_.size(); p++) {
+		for (int v = 0; v < kPeerVirtualNodes; v++) {
+			std::string key = addrs_[p] + "#" + std::to_string(v);
+			ring_.push_back(std::make_pair(peer_hash(key.data(), key.size()), static_cast<int>(p)));
+		}
+	}
+	std::sort(ring_.begin(), ring_.end());
+}
+
+bool PeerSet::validate(const pbcfg::Group &groupcfg, std::ostringstream &err) {
+	std::set<std::string> seen;
+	seen.insert(groupcfg.peer_addr());
+	if (groupcfg.peer_addr().empty()) {
+		err << "empty peer_addr";
+		return false;
+	}
+	for (int i = 0; i < groupcfg.peer_size(); i++) {
+		if (groupcfg.peer(i).empty()) {
+			err << "empty peer #" << i;
+			return false;
+		}
+		if (!seen.insert(groupcfg.peer(i)).second) {
+			err << "duplicated peer: " << groupcfg.peer(i);
+			return false;
+		}
+	}
+	return true;
+}
+
+int PeerSet::pick(uint32_t uid) {
+	int n = size();
+	if (n == 1) {
+		return 0;
+	}
+	if (policy_ == pbcfg::PEER_HASH_UID) {
+		return hash(uid);
+	}
+	int start = static_cast<int>(next_.fetch_add(1, std::memory_order_relaxed) % n);
+	if (policy_ != pbcfg::PEER_LEAST_OUTSTANDING) {
+		return start;
+	}
+	// 从轮到的对端开始找, 一样多时取先找到的, 所以都空闲时 (比如刚启动) 和轮询一样
+	int best = start;
+	uint64_t least = outstanding(start);
+	for (int i = 1; (i < n) && (least > 0); i++) {
+		int peer = (start + i) % n;
+		uint64_t num = outstanding(peer);
+		if (num < least) {
+			best = peer;
+			least = num;
+		}
+	}
+	return best;
+}
+
+int PeerSet::hash(uint32_t uid) const {
+	uint64_t h = peer_hash(&uid, sizeof(uid));
+	std::vector<std::pair<uint64_t, int> >::const_iterator it
+		= std::lower_bound(ring_.begin(), ring_.end(), std::make_pair(h, 0));
+	return (it == ring_.end()) ? ring_.front().second : it->second;
+}
+
+uint64_t PeerSet::outstanding(int peer) const {
+	// 结束和发出记在不同的线程上时可能短暂地减到负数
+	int64_t n = outstanding_[peer].n.load(std::memory_order_relaxed);
+	return (n > 0) ? uint64_t(n) : 0;
+}
@@ -0,0 +1,63 @@
+#ifndef __PEER_SET_H__
+#define __PEER_SET_H__
+
+#include "common.h"
+#include "robot.pb.h"
+#include <atomic>
+
+// PEER_HASH_UID 的哈希环上每个对端的虚拟节点数, 越多各对端分到的 uid 越均匀
+const int kPeerVirtualNodes = 160;
+
+
+// PeerSet: 一个 Group 的对端列表 (Group.peer_addr + Group.peer), 所有引擎的所有客户端共享,
+// 每条新连接按 Group.peer_policy 选一个对端 (seeto: PeerPolicy); 选择是无锁的.
+// PEER_LEAST_OUTSTANDING 时按对端记还在等回包的请求数, 由 GroupLatency 在请求发出和结束时更新
+class PeerSet {
+public:
+	explicit PeerSet(const pbcfg::Group &groupcfg);
+
+public:
+	// @return false: 有空的或重复的地址
+	static bool validate(const pbcfg::Group &groupcfg, std::ostringstream &err);
+
+	int size(void) const { return static_cast<int>(addrs_.size()); }
+	const std::string &addr(int peer) const { return addrs_[peer]; }
+	pbcfg::PeerPolicy policy(void) const { return policy_; }
+	// 给一条新连接选对端; @uid: 连接上的客户端的 uid, 只有 PEER_HASH_UID 用到
+	int pick(uint32_t uid);
+	// uid 在哈希环上所在的对端, 和 policy 无关
+	int hash(uint32_t uid) const;
+
+	// 一个等回包的请求发出/结束 (完成, 超时或放弃); 只有 PEER_LEAST_OUTSTANDING 时才计数
+	void begin_request(int peer) {
+		if (policy_ == pbcfg::PEER_LEAST_OUTSTANDING) {
+			outstanding_[peer].n.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+	void end_request(int peer, uint64_t n = 1) {
+		if (policy_ == pbcfg::PEER_LEAST_OUTSTANDING) {
+			outstanding_[peer].n.fetch_sub(int64_t(n), std::memory_order_relaxed);
+		}
+	}
+	uint64_t outstanding(int peer) const;
+
+private:
+	PeerSet(const PeerSet &);
+	PeerSet &operator=(const PeerSet &);
+
+	// 每个对端的计数独占一个缓存行, 不同循环的记录不会互相争抢
+	struct alignas(64) Outstanding {
+		Outstanding() : n(0) { }
+		std::atomic<int64_t> n;
+	};
+
+private:
+	std::vector<std::string> addrs_;
+	pbcfg::PeerPolicy policy_;
+	std::vector<std::pair<uint64_t, int> > ring_;	// (哈希值, 对端), 按哈希值排序
+	std::vector<Outstanding> outstanding_;
+	std::atomic<uint64_t> next_;
+};
+
+
+#endif // __PEER_SET_H__
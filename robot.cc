@@ -2,6 +2,18 @@
 #include "config.h"
 #include "flags.h"
 #include "client.h"
+#include "message_pool.h"
+#include "latency_stats.h"
+#include "event_trace.h"
+#include "async_log.h"
+#include "connect_pacer.h"
+#include "source_binder.h"
+#include "timeutils.h"
+#include "memutils.h"
+
+// thread 引擎的客户端线程按 client 下标分到这么多组直方图和计数上, 同一组上的线程之间有缓存行争用;
+// 每组都有所有 Group 的全部直方图, 不能每个线程一组 (客户端线程可以有上万个)
+const int kThreadEngineLatencyShards = 16;
 
 void calc_timeout_responses(const pbcfg::Action &actioncfg,
 							const std::vector<std::string> &recved_responses,
@@ -29,16 +41,121 @@ bool is_action_compleated(const pbcfg::Action &actioncfg,
 	return timeout_responses.empty();
 }
 
+uint32_t NextSeq(pbcfg::CsMsgHead &headmsg) {
+	uint32_t seq = headmsg.seq() + 1;
+	if (seq == 0) {
+		seq = 1;
+	}
+	headmsg.set_seq(seq);
+	return seq;
+}
+
+bool SendActionRequests(const pbcfg::Action &actioncfg,
+						Client &client,
+						pbcfg::CsMsgHead &headmsg,
+						std::ostringstream &requests_strings,
+						std::ostringstream &errmsg) {
+	std::ostringstream op_errmsg;
+	requests_strings.str("");
+	requests_strings << "[";
+	for (int r = 0; r < actioncfg.request_uniq_name_size(); r++) {
+		const std::string &uniq_name = actioncfg.request_uniq_name(r);
+		const UniqRequest *uniqreq = uniq_name_map[uniq_name];
+		// body 已在加载配置时预编译 (seeto: CollectConfigInfos)
+		const std::string &type_name = uniqreq->type_name;
+		headmsg.set_msg_type_name(type_name);
+		if (!client.send_msg(headmsg, type_name, uniqreq->body, op_errmsg)) {
+			errmsg << "send_msg: " << type_name << ", err: " << op_errmsg.str();
+			return false;
+		}
+		if (r == 0) {
+			requests_strings << type_name;
+		} else {
+			requests_strings << "," << type_name;
+		}
+	}
+	requests_strings << "]";
+	return true;
+}
+
+bool DrainActionResponses(const pbcfg::Action &actioncfg,
+						  int action_index,
+						  uint32_t seq,
+						  uint64_t sent_usec,
+						  Client &client,
+						  std::vector<std::string> &recved_responses,
+						  GroupLatency *latency,
+						  bool &action_done,
+						  std::ostringstream &errmsg,
+						  const EventTrace *trace,
+						  int peer) {
+	action_done = false;
+	while (true) {
+		Message *rsphead = 0, *rspbody = 0;
+		bool complete = false;
+		if (!client.recv_msg(&rsphead, &rspbody, complete, errmsg)) {
+			return false;
+		}
+		if (!complete) {
+			return true;
+		}
+		uint32_t rsp_seq = static_cast<pbcfg::CsMsgHead *>(rsphead)->seq();
+		if ((rsp_seq != 0) && (rsp_seq != seq)) {
+			// 不是当前 Action 的回包 (比如之前请求的迟到回包), 不能算在当前 Action 上
+			bool late = SeqBefore(rsp_seq, seq);
+			if (latency) {
+				if (late) {
+					latency->record_late_response();
+				} else {
+					latency->record_unmatched_response();
+				}
+			}
+			if (trace) {
+				trace->response(action_index, rspbody->GetDescriptor()->full_name(),
+								late ? kEventLate : kEventUnmatched, rsp_seq, 0, client.last_recv_len());
+			}
+			MessagePool::local().release(rsphead);
+			MessagePool::local().release(rspbody);
+			continue;
+		}
+		uint64_t elapsed = now_usec() - sent_usec;
+		if (latency) {
+			latency->record_response(action_index, rspbody->GetDescriptor()->full_name(), elapsed);
+		}
+		if (trace) {
+			trace->response(action_index, rspbody->GetDescriptor()->full_name(), kEventOk,
+							rsp_seq, elapsed, client.last_recv_len());
+		}
+		recved_responses.push_back(rspbody->GetTypeName());
+
+		// TODO(zog): log response
+		MessagePool::local().release(rsphead);
+		MessagePool::local().release(rspbody);
+
+		if (is_action_compleated(actioncfg, recved_responses)) {
+			if (latency) {
+				latency->record_action(action_index, elapsed, peer);
+			}
+			if (trace) {
+				trace->action_done(action_index, kEventOk, seq, elapsed);
+			}
+			action_done = true;
+			return true;
+		}
+	}
+}
+
 bool RunGroupOnce(int count,
 				  const pbcfg::Group &groupcfg,
 				  const pbcfg::Client &clientcfg,
 				  Client &client,
 				  pbcfg::CsMsgHead &headmsg,
-				  std::ostringstream &errmsg) {
-	bool complete = false;
+				  std::ostringstream &errmsg,
+				  GroupLatency *latency,
+				  const EventTrace *trace,
+				  int peer) {
 	bool is_timeout = false;
-	time_t wait_start = 0;
-	Message *rsphead = 0, *rspbody = 0;
+	uint64_t sent_usec = 0;
 	std::ostringstream requests_strings;
 	std::vector<std::string> recved_responses;
 	std::vector<std::string> timeout_responses;
@@ -47,49 +164,33 @@ bool RunGroupOnce(int count,
 	for (int i = 0; i < groupcfg.action_size(); i++) {
 		const pbcfg::Action &actioncfg = groupcfg.action(i);
 
-LOG(ERROR) << "Client: [" << clientcfg.uid() << "," << clientcfg.role_time()
-<< "], req: " << actioncfg.request_uniq_name(0) << ", count: " << count
-<< ", stop_loop: " << actioncfg.stop_loop_count() << ", min_duration: " << actioncfg.min_duration();
+		// 每个客户端每 N 个 Action 记一次
+		ALOG_EVERY_N(ERROR, FLAGS_action_log_every) << "Client: [" << clientcfg.uid() << "," << clientcfg.role_time()
+			<< "], req: " << actioncfg.request_uniq_name(0) << ", count: " << count
+			<< ", stop_loop: " << actioncfg.stop_loop_count() << ", min_duration: " << actioncfg.min_duration();
 
 		if ((actioncfg.stop_loop_count() > 0) && (count >= actioncfg.stop_loop_count())) {
 			// 一次执行 Group 内, 连续执行该 Action 的次数
 			continue;
 		}
 
-		requests_strings.str("");
-		requests_strings << "[";
-		for (int r = 0; r < actioncfg.request_uniq_name_size(); r++) {
-			const std::string &uniq_name = actioncfg.request_uniq_name(r);
-			const UniqRequest *uniqreq = uniq_name_map[uniq_name];
-			const pbcfg::Body *bodycfg = uniqreq->bodycfg;
-			Message *bodymsg = uniqreq->bodymsg->New();
-			if (PB_MASTER.load_text_format_string_message(bodycfg->text(), bodymsg) == -1) {
-				errmsg << "load text_format_string, type_name: " << bodymsg->GetTypeName();
-				delete bodymsg;
-				return false;
-			}
-			std::string type_name = bodymsg->GetTypeName();
-			headmsg.set_msg_type_name(type_name);
-			if (!client.send_msg(headmsg, *bodymsg, op_errmsg)) {
-				errmsg << "send_msg: " << type_name << ", err: " << op_errmsg.str();
-				delete bodymsg;
-				return false;
-			}
-			if (r == 0) {
-				requests_strings << type_name;
-			} else {
-				requests_strings << "," << type_name;
-			}
-			delete bodymsg;
+		uint32_t seq = NextSeq(headmsg);
+		size_t queued = client.buffer().send.size();
+		if (!SendActionRequests(actioncfg, client, headmsg, requests_strings, errmsg)) {
+			return false;
+		}
+		if (latency) {
+			latency->record_request(i, peer);
+		}
+		if (trace) {
+			trace->request(i, seq, client.buffer().send.size() - queued);
 		}
-		requests_strings << "]";
 
-		complete = false;
 		is_timeout = false;
-		wait_start = time(0);
+		sent_usec = now_usec();
 		recved_responses.clear();
 		while(true) {
-			if ((actioncfg.timeout() > 0) && (time(0) - wait_start > actioncfg.timeout())) {
+			if ((actioncfg.timeout() > 0) && (now_usec() - sent_usec >= uint64_t(actioncfg.timeout()) * 1000000)) {
 				is_timeout = true;
 				calc_timeout_responses(actioncfg, recved_responses, timeout_responses);
 				break;
@@ -97,46 +198,49 @@ LOG(ERROR) << "Client: [" << clientcfg.uid() << "," << clientcfg.role_time()
 
 			if (client.net_tcp_send(net_errmsg) == -1) {
 				errmsg << "req:" << requests_strings.str() << ", err: " << net_errmsg.str();
+				if (latency) {
+					latency->record_abandoned(i, 1, peer);
+				}
 				return false;
 			}
 			if (client.net_tcp_recv(net_errmsg) == -1) {
 				errmsg << "req:" << requests_strings.str() << ", err: " << net_errmsg.str();
+				if (latency) {
+					latency->record_abandoned(i, 1, peer);
+				}
 				return false;
 			}
-			if (!client.recv_msg(&rsphead, &rspbody, complete, op_errmsg)) {
+			// 一次 net_tcp_recv 读到的所有完整回包在这里一次处理完,
+			// 而不是每个回包都要再绕一圈轮询 (和 usleep)
+			bool action_done = false;
+			if (!DrainActionResponses(actioncfg, i, seq, sent_usec, client, recved_responses,
+									  latency, action_done, op_errmsg, trace, peer)) {
 				errmsg << "recv_msg, after req:" << requests_strings.str() << "err: " << op_errmsg.str();
+				if (latency) {
+					latency->record_abandoned(i, 1, peer);
+				}
 				return false;
 			}
-			if (!complete) {
-				usleep(10000);
-				continue;
-			}
-			recved_responses.push_back(rspbody->GetTypeName());
-//LOG(ERROR) << "complate: " << rspbody->GetTypeName();
-//if (rspbody->GetTypeName() == "ISeer20Comm.ack_errcode_t") {
-//	LOG(ERROR) << rsphead->Utf8DebugString();
-//	LOG(ERROR) << rspbody->Utf8DebugString();
-//}
-
-			// TODO(zog): log response
-			delete rsphead;
-			delete rspbody;
-			rsphead = 0;
-			rspbody = 0;
-
-			if (is_action_compleated(actioncfg, recved_responses)) {
+			if (action_done) {
 				break;
 			}
+			usleep(10000);
 		}
 
-		// 如果设置了最少等待时长, 则必须等到时间
-		int32_t dur = (time(0) - wait_start) * 1000;
-		if ((actioncfg.min_duration() > 0) && (dur < actioncfg.min_duration())) {
-			int32_t usleepdur = (actioncfg.min_duration() - dur) * 1000;
-			usleep(usleepdur);
+		// 如果设置了最少等待时长, 则必须等到时间 (毫秒精度, 与 epoll 引擎一致)
+		uint64_t min_end = sent_usec + uint64_t(actioncfg.min_duration()) * 1000;
+		uint64_t now = now_usec();
+		if ((actioncfg.min_duration() > 0) && (now < min_end)) {
+			usleep(min_end - now);
 		}
 
 		if (is_timeout) {
+			if (latency) {
+				latency->record_timeout(i, now_usec() - sent_usec, peer);
+			}
+			if (trace) {
+				trace->action_done(i, kEventTimedOut, seq, now_usec() - sent_usec);
+			}
 			std::ostringstream timeout_string;
 			for (int i = 0; i < (int)timeout_responses.size(); i++) {
 				if (i == 0) {
@@ -149,24 +253,78 @@ LOG(ERROR) << "Client: [" << clientcfg.uid() << "," << clientcfg.role_time()
 			errmsg << "requests: " << requests_strings.str() << " ==> timeout_responses: " << timeout_string.str();
 			return false;
 		}
+
+		if (actioncfg.think_time() > 0) {
+			usleep(uint64_t(actioncfg.think_time()) * 1000);
+		}
 	}
 	return true;
 }
 
+// 一个 Group 的所有客户端线程共享
+struct GroupContext {
+	GroupContext(const pbcfg::Group *cfg)
+		: groupcfg(cfg),
+		  pacer(cfg->connect_rate()),
+		  source(cfg->source()),
+		  profile(LATENCY_STATS.profile(LATENCY_STATS.group_index(cfg))),
+		  peers(LATENCY_STATS.peers(LATENCY_STATS.group_index(cfg))) { }
+	const pbcfg::Group *groupcfg;
+	ConnectPacer pacer;
+	SourceBinder source;
+	const LoadProfile *profile;
+	PeerSet *peers;
+};
+
 void RobotClientWorker(gpointer data, gpointer user_data) {
-	const pbcfg::Group *groupcfg = (const pbcfg::Group *)user_data;
+	GroupContext *groupctx = (GroupContext *)user_data;
+	const pbcfg::Group *groupcfg = groupctx->groupcfg;
 	int client_index = GLIB_POINTER_TO_INT(data) - 1;
 	const pbcfg::Client &clientcfg = groupcfg->client(client_index);
 	//LOG(ERROR) << "Client-" << groupcfg->name() << ":" << clientcfg.uid() << " started";
-	
+	int group_index = LATENCY_STATS.group_index(groupcfg);
+	GroupLatency *latency = LATENCY_STATS.recorder(client_index, group_index);
+	EventTrace trace(EVENT_LOG.writer(client_index), clientcfg.uid(), group_index);
+	const LoadProfile *profile = groupctx->profile;
+
+	// 等到负载曲线给它的启动时刻, 再按 connect_rate 排队发起连接
+	uint64_t now = now_usec();
+	uint64_t start = profile->client_start(client_index);
+	if (start > now) {
+		usleep(start - now);
+		now = now_usec();
+	}
+	uint64_t slot = groupctx->pacer.acquire(now);
+	if (slot > now) {
+		usleep(slot - now);
+	}
+
 	std::ostringstream errmsg;
-	Client client(groupcfg->max_pkg_len(), groupcfg->has_checksum());
-	if (!client.try_connect_to_peer(groupcfg->peer_addr(), errmsg)) {
-		LOG(ERROR) << "Error RobotClientWorker, Client-" << groupcfg->name()
+	Client client(groupcfg->max_pkg_len(), groupcfg->has_checksum(),
+		ChecksumType(groupcfg->checksum_type()));
+	client.set_connect_timeout(groupcfg->connect_timeout());
+	client.set_source(&groupctx->source);
+	int peer = groupctx->peers->pick(clientcfg.uid());
+	const std::string &peer_addr = groupctx->peers->addr(peer);
+	uint64_t connect_start = now_usec();
+	if (!client.try_connect_to_peer(peer_addr, errmsg)) {
+		bool timed_out = (errno == ETIMEDOUT);
+		if (latency && timed_out) {
+			latency->record_connect_timeout(peer);
+		}
+		if (latency) {
+			latency->record_error(peer);
+		}
+		trace.connect(timed_out ? kEventTimedOut : kEventFailed, now_usec() - connect_start);
+		ALOG(ERROR) << "Error RobotClientWorker, Client-" << groupcfg->name()
 			<< ":[" << clientcfg.uid() << ", " << clientcfg.role_time() << "]"
-			", cannot connect to peer: " << groupcfg->peer_addr() << ", err: " << errmsg.str();
+			", cannot connect to peer: " << peer_addr << ", err: " << errmsg.str();
 		return ;
 	}
+	if (latency) {
+		latency->record_connect(now_usec() - connect_start, peer);
+	}
+	trace.connect(kEventOk, now_usec() - connect_start);
 
 	// TODO(zog): 通用包头设置
 	pbcfg::CsMsgHead headmsg;
@@ -175,15 +333,25 @@ void RobotClientWorker(gpointer data, gpointer user_data) {
 	headmsg.set_ret(0);
 
 	int count = 0;
-	while (count < groupcfg->loop_count()) {
+	EventStatus stop_status = kEventOk;
+	while (profile->next_loop(client_index, count, now_usec())) {
 		// TODO(zog): prepare (支持用shell或代码构造测试环境, eg: 把相关服的uid的所在地图都设置成10001)
-		if (!RunGroupOnce(count, *groupcfg, clientcfg, client, headmsg, errmsg)) {
-			LOG(ERROR) << "Error RunGroupOnce, Client-" << groupcfg->name()
+		if (!RunGroupOnce(count, *groupcfg, clientcfg, client, headmsg, errmsg, latency, &trace, peer)) {
+			if (latency) {
+				latency->record_error(peer);
+			}
+			stop_status = kEventFailed;
+			ALOG(ERROR) << "Error RunGroupOnce, Client-" << groupcfg->name()
 				<< ":[" << clientcfg.uid() << ", " << clientcfg.role_time() << "]: " << errmsg.str();
-			return ;
+			break;
 		}
 		count++;
 	}
+	if (latency) {
+		latency->record_disconnect(peer);
+	}
+	trace.client_stop(stop_status);
+	MessagePool::local().flush_stats();
 
 	//LOG(ERROR) << "Client-" << groupcfg->name() << ":" << clientcfg.role_time() << " finished"; 
 }
@@ -193,8 +361,9 @@ void RobotGroupWorker(gpointer data, gpointer user_data) {
 	LOG(ERROR) << "Group-" << groupcfg->name() << " started";
 
 	// start robot threads
+	GroupContext groupctx(groupcfg);
 	GThreadPool *thread_pool
-		= CreateThreadsPool(groupcfg->client_count(), &RobotClientWorker, gpointer(groupcfg));
+		= CreateThreadsPool(groupcfg->client_count(), &RobotClientWorker, gpointer(&groupctx));
 	for (int i = 0; i < groupcfg->client_count(); i++) {
 		g_thread_pool_push(thread_pool, GLIB_INT_TO_POINTER(i+1), NULL);
 	}
@@ -206,6 +375,18 @@ LOG(ERROR) << "Group-" << groupcfg->name() << " finished!";
 }
 
 void RunRobots(const pbcfg::CfgRoot &cfg) {
+	LATENCY_STATS.init(cfg, kThreadEngineLatencyShards);
+	std::ostringstream errmsg;
+	if (!EVENT_LOG.start(cfg, kThreadEngineLatencyShards, errmsg)) {
+		LOG(ERROR) << "Error RunRobots, event log disabled: " << errmsg.str();
+	}
+	LATENCY_STATS.start(now_usec());
+	uint64_t base_rss = rss_bytes();
+	int total_client = 0;
+	for (int i = 0; i < cfg.group_config_size(); i++) {
+		total_client += cfg.group_config(i).client_count();
+	}
+
 	// start robot group threads
 	GThreadPool *thread_pool = CreateThreadsPool(cfg.group_config_size(), &RobotGroupWorker);
 	for (int i = 0; i < cfg.group_config_size(); i++) {
@@ -217,6 +398,10 @@ void RunRobots(const pbcfg::CfgRoot &cfg) {
 	g_thread_pool_free(thread_pool, FALSE, TRUE);
 	thread_pool = NULL;
 	LOG(ERROR) << "RunRobots finished!";
+	log_memory_per_client("thread", base_rss, total_client);
+	MessagePool::log_stats();
+	LATENCY_STATS.log_report();
+	EVENT_LOG.stop();
 }
 
 // GThreadPool *g_thread_pool_new (
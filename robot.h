@@ -10,5 +10,32 @@ void RobotGroupWorker(gpointer data, gpointer user_data);
 void RunRobots(const pbcfg::CfgRoot &cfg);
 GThreadPool *CreateThreadsPool(uint32_t max_threads, threadpool_func_t fn, gpointer user_data=0);
 
+void calc_timeout_responses(const pbcfg::Action &actioncfg,
+							const std::vector<std::string> &recved_responses,
+							std::vector<std::string> &timeout_responses);
+bool is_action_compleated(const pbcfg::Action &actioncfg,
+						  const std::vector<std::string> &recved_responses);
+// 按配置顺序组包发送 actioncfg 中的所有请求 (只是放入发送缓冲), requests_strings 返回 "[type1,type2]"
+bool SendActionRequests(const pbcfg::Action &actioncfg, Client &client, pbcfg::CsMsgHead &headmsg,
+						std::ostringstream &requests_strings, std::ostringstream &errmsg);
+
+// 给 headmsg 分配下一个 seq 并返回, 同一个 Action 的所有请求共用一个 seq;
+// 跳过 0, 回包的 seq 为 0 表示对端没有回填 seq, 只能按类型匹配
+uint32_t NextSeq(pbcfg::CsMsgHead &headmsg);
+// 在 seq 回绕的情况下判断 a 是否比 b 更早发出
+inline bool SeqBefore(uint32_t a, uint32_t b) { return int32_t(a - b) < 0; }
+
+class GroupLatency;
+struct EventTrace;
+// 解出接收缓冲里所有完整的回包, 直到收齐 actioncfg 的所有 response (action_done) 或缓冲里没有完整的包;
+// seq 对不上的回包计为迟到/对不上并丢弃, 其余的记下时延 (从 sent_usec 算起) 并加入 recved_responses
+// @trace: 写事件日志, 可以为 NULL; @peer: 连接所连的对端 (seeto: PeerSet), Action 时延按它分开记
+// @return false: 解包失败
+bool DrainActionResponses(const pbcfg::Action &actioncfg, int action_index, uint32_t seq, uint64_t sent_usec,
+						  Client &client, std::vector<std::string> &recved_responses,
+						  GroupLatency *latency, bool &action_done, std::ostringstream &errmsg,
+						  const EventTrace *trace = NULL, int peer = 0);
 // Declaration for RunGroupOnce - assumed signature based on test
-bool RunGroupOnce(int groupid, const pbcfg::Group &config, const pbcfg::Client &client_cfg, Client &client, pbcfg::CsMsgHead &head, std::ostringstream &err_msg);
+// @latency: 记录 response/Action 时延, 可以为 NULL; @trace: 写事件日志, 可以为 NULL; @peer: 连接所连的对端
+bool RunGroupOnce(int groupid, const pbcfg::Group &config, const pbcfg::Client &client_cfg, Client &client, pbcfg::CsMsgHead &head, std::ostringstream &err_msg,
+				  GroupLatency *latency = NULL, const EventTrace *trace = NULL, int peer = 0);
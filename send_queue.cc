@@ -0,0 +1,67 @@
+#include "send_queue.h"
+#include <algorithm>
+
+
+void SendQueue::append_ref(const char *data, size_t len) {
+	if (len == 0) return ;
+	Ref ref;
+	ref.inline_before = buf_.size() - attached_;
+	ref.data = data;
+	ref.len = len;
+	refs_.push_back(ref);
+	attached_ = buf_.size();
+	ref_bytes_ += len;
+}
+
+int SendQueue::fill_iov(struct iovec *iov, int max) const {
+	int n = 0;
+	const char *p = buf_.readable();
+	for (size_t i = 0; (i < refs_.size()) && (n < max); i++) {
+		const Ref &ref = refs_[i];
+		if (ref.inline_before > 0) {
+			iov[n].iov_base = const_cast<char *>(p);
+			iov[n].iov_len = ref.inline_before;
+			p += ref.inline_before;
+			if (++n == max) return n;
+		}
+		iov[n].iov_base = const_cast<char *>(ref.data);
+		iov[n].iov_len = ref.len;
+		n++;
+	}
+	int32_t rest = buf_.size() - attached_;
+	if ((rest > 0) && (n < max)) {
+		iov[n].iov_base = const_cast<char *>(p);
+		iov[n].iov_len = rest;
+		n++;
+	}
+	return n;
+}
+
+void SendQueue::consume(size_t n) {
+	while ((n > 0) && !refs_.empty()) {
+		Ref &ref = refs_.front();
+		int32_t inline_part = static_cast<int32_t>(std::min(n, size_t(ref.inline_before)));
+		buf_.consume(inline_part);
+		ref.inline_before -= inline_part;
+		attached_ -= inline_part;
+		n -= inline_part;
+		size_t ref_part = std::min(n, ref.len);
+		ref.data += ref_part;
+		ref.len -= ref_part;
+		ref_bytes_ -= ref_part;
+		n -= ref_part;
+		if ((ref.inline_before == 0) && (ref.len == 0)) {
+			refs_.pop_front();
+		}
+	}
+	if (n > 0) {
+		buf_.consume(static_cast<int32_t>(n));
+	}
+}
+
+void SendQueue::clear(void) {
+	buf_.clear();
+	refs_.clear();
+	attached_ = 0;
+	ref_bytes_ = 0;
+}
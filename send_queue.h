@@ -0,0 +1,59 @@
+#ifndef __SEND_QUEUE_H__
+#define __SEND_QUEUE_H__
+
+#include "io_buffer.h"
+#include <sys/uio.h>
+#include <deque>
+
+// 一次 writev 最多带多少段; 发送队列里引用的 body 多于这个数时分几次写
+const int kSendIovMax = 64;
+
+
+// SendQueue: 发送缓冲, 待发的数据是按顺序排列的若干段:
+//   直接写在 IoBuffer 里的字节 (包头, CsMsgHead, 小的 body, 校验和), 和
+//   引用的外部数据 (预先序列化好, 一直有效的大 body, 不拷贝).
+// 发送时把所有段放进一个 writev, 一次系统调用发出所有攒下的包
+class SendQueue {
+public:
+	SendQueue(int32_t init_cap, int32_t shrink_watermark)
+		: buf_(init_cap, shrink_watermark), attached_(0), ref_bytes_(0) { }
+
+public:
+	// 所有段加起来还没发出的字节数
+	size_t size(void) const { return size_t(buf_.size()) + ref_bytes_; }
+	bool empty(void) const { return buf_.empty() && refs_.empty(); }
+	// 引用的外部数据段数
+	size_t refs(void) const { return refs_.size(); }
+
+	// 在队尾留出至少 need 字节连续空间直接写, 写完后 commit
+	char *reserve(int32_t need) { return buf_.writable(need); }
+	void commit(int32_t n) { buf_.commit(n); }
+	void append(const char *data, int32_t len) { buf_.append(data, len); }
+	// 在队尾引用 [data, data+len), 不拷贝; 发完 (或 clear) 之前 data 必须一直有效
+	void append_ref(const char *data, size_t len);
+
+	// 从队头开始依次填 iov, 最多 max 段; @return: 填了几段
+	int fill_iov(struct iovec *iov, int max) const;
+	// 前移 n 字节 (已经发出去的)
+	void consume(size_t n);
+	void clear(void);
+
+private:
+	SendQueue(const SendQueue &);
+	SendQueue &operator=(const SendQueue &);
+
+	struct Ref {
+		int32_t inline_before;	// 排在这段前面的 buf_ 里的字节数 (从上一段引用之后算起)
+		const char *data;
+		size_t len;
+	};
+
+private:
+	IoBuffer buf_;
+	std::deque<Ref> refs_;
+	int32_t attached_;			// buf_ 中排在最后一段引用之前的字节数, 即所有 inline_before 之和
+	size_t ref_bytes_;
+};
+
+
+#endif // __SEND_QUEUE_H__
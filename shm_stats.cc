@@ -0,0 +1,117 @@
+#include "shm_stats.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+std::string ShmStatsSegment::path_of(int pid) {
+	std::ostringstream path;
+	path << "/dev/shm/robot." << pid;
+	return path.str();
+}
+
+bool ShmStatsSegment::create(const std::string &path, std::ostringstream &err) {
+	close();
+	int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd == -1) {
+		err << "open " << path << ": " << strerror(errno);
+		return false;
+	}
+	if (ftruncate(fd, sizeof(ShmStatsRegion)) == -1) {
+		err << "ftruncate " << path << ": " << strerror(errno);
+		::close(fd);
+		unlink(path.c_str());
+		return false;
+	}
+	void *addr = mmap(NULL, sizeof(ShmStatsRegion), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (addr == MAP_FAILED) {
+		err << "mmap " << path << ": " << strerror(errno);
+		unlink(path.c_str());
+		return false;
+	}
+	// 新文件全是 0: seq 为 0 (偶数), group_num 为 0; 最后才写 magic, 读者看到 magic 时头部已经完整
+	region_ = static_cast<ShmStatsRegion *>(addr);
+	region_->version = kShmStatsVersion;
+	region_->size = sizeof(ShmStatsRegion);
+	region_->pid = getpid();
+	std::atomic_thread_fence(std::memory_order_release);
+	region_->magic = kShmStatsMagic;
+	path_ = path;
+	owner_ = true;
+	return true;
+}
+
+bool ShmStatsSegment::attach(const std::string &path, std::ostringstream &err) {
+	close();
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd == -1) {
+		err << "open " << path << ": " << strerror(errno);
+		return false;
+	}
+	struct stat st;
+	if ((fstat(fd, &st) == -1) || (st.st_size != off_t(sizeof(ShmStatsRegion)))) {
+		err << path << ": not a robot stats segment (size " << st.st_size << ")";
+		::close(fd);
+		return false;
+	}
+	void *addr = mmap(NULL, sizeof(ShmStatsRegion), PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (addr == MAP_FAILED) {
+		err << "mmap " << path << ": " << strerror(errno);
+		return false;
+	}
+	const ShmStatsRegion *region = static_cast<const ShmStatsRegion *>(addr);
+	if ((region->magic != kShmStatsMagic) || (region->version != kShmStatsVersion)
+		|| (region->size != sizeof(ShmStatsRegion))) {
+		err << path << ": magic/version mismatch (version " << region->version
+			<< ", expect " << kShmStatsVersion << ")";
+		munmap(addr, sizeof(ShmStatsRegion));
+		return false;
+	}
+	region_ = const_cast<ShmStatsRegion *>(region);
+	path_ = path;
+	owner_ = false;
+	return true;
+}
+
+void ShmStatsSegment::close(void) {
+	if (!region_) {
+		return ;
+	}
+	munmap(region_, sizeof(ShmStatsRegion));
+	region_ = NULL;
+	if (owner_) {
+		unlink(path_.c_str());
+	}
+	path_.clear();
+	owner_ = false;
+}
+
+void ShmStatsSegment::write(const ShmStatsData &data) {
+	uint64_t seq = region_->seq.load(std::memory_order_relaxed);
+	region_->seq.store(seq + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	memcpy(&region_->data, &data, sizeof(data));
+	region_->seq.store(seq + 2, std::memory_order_release);
+}
+
+bool ShmStatsSegment::read(ShmStatsData &out) const {
+	for (int i = 0; i < kShmStatsReadRetries; i++) {
+		uint64_t before = region_->seq.load(std::memory_order_acquire);
+		if (before & 1) {
+			sched_yield();
+			continue;
+		}
+		memcpy(&out, &region_->data, sizeof(out));
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (region_->seq.load(std::memory_order_relaxed) == before) {
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,99 @@
+#ifndef __SHM_STATS_H__
+#define __SHM_STATS_H__
+
+#include <atomic>
+#include <string>
+#include <sstream>
+#include <stdint.h>
+
+// 共享内存统计区的格式, robot 写, robot_top 读; 改了布局必须改 kShmStatsVersion
+const uint32_t kShmStatsMagic = 0x544f4252;		// "RBOT"
+const uint32_t kShmStatsVersion = 1;
+const int kShmStatsMaxGroups = 64;
+const int kShmStatsNameLen = 64;
+// 读者遇到写者正在写时的重试次数, 写者每次只写几 KB, 通常一次就能读到
+const int kShmStatsReadRetries = 1000;
+
+
+// 时延分位, 微秒
+struct ShmLatency {
+	uint64_t count;
+	uint64_t p50;
+	uint64_t p90;
+	uint64_t p99;
+	uint64_t p999;
+	uint64_t max;
+};
+
+// 一个 Group 的累计计数 (含义同 GroupCounters) 和所有 Action 完成时长合并后的分位
+struct ShmGroupStats {
+	char name[kShmStatsNameLen];		// 截断, 总是以 '\0' 结尾
+	uint64_t connects;
+	uint64_t disconnects;
+	uint64_t connect_timeouts;
+	uint64_t requests;
+	uint64_t completed;
+	uint64_t timeouts;
+	uint64_t abandoned;
+	uint64_t errors;
+	uint64_t connected;
+	uint64_t in_flight;
+	ShmLatency total;					// 从开始到现在
+	ShmLatency recent;					// 上一次发布以来
+};
+
+// 一次发布的全部内容
+struct ShmStatsData {
+	uint64_t start_usec;				// now_usec() 的时间轴, 开始发布的时刻
+	uint64_t update_usec;				// 本次发布的时刻
+	uint64_t publish_count;
+	int32_t group_num;					// 超过 kShmStatsMaxGroups 的 Group 不发布
+	int32_t group_total;
+	ShmGroupStats groups[kShmStatsMaxGroups];
+};
+
+// 映射到 /dev/shm 的整个文件; data 由 seq 保护 (seqlock): 写者写之前把 seq 加成奇数, 写完加成偶数,
+// 读者拷贝前后 seq 相同且为偶数才算读到了一致的内容, 读者不会阻塞写者
+struct ShmStatsRegion {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size;						// sizeof(ShmStatsRegion)
+	int32_t pid;
+	std::atomic<uint64_t> seq;
+	ShmStatsData data;
+};
+
+// ShmStatsSegment: 共享内存统计区的一端, 写者 create, 读者 attach (只读映射)
+class ShmStatsSegment {
+public:
+	~ShmStatsSegment() { close(); }
+	ShmStatsSegment() : region_(NULL), owner_(false) { }
+
+public:
+	// /dev/shm/robot.<pid>
+	static std::string path_of(int pid);
+
+	// 创建 (或覆盖) path 并映射, close 时删除文件
+	bool create(const std::string &path, std::ostringstream &err);
+	bool attach(const std::string &path, std::ostringstream &err);
+	void close(void);
+	bool attached(void) const { return region_ != NULL; }
+	int pid(void) const { return region_ ? region_->pid : -1; }
+
+	// 只能有一个写者
+	void write(const ShmStatsData &data);
+	// @return: false: 重试 kShmStatsReadRetries 次都没读到一致的内容
+	bool read(ShmStatsData &out) const;
+
+private:
+	ShmStatsSegment(const ShmStatsSegment &);
+	ShmStatsSegment &operator=(const ShmStatsSegment &);
+
+private:
+	ShmStatsRegion *region_;
+	std::string path_;
+	bool owner_;
+};
+
+
+#endif // __SHM_STATS_H__
@@ -0,0 +1,103 @@
+#include "source_binder.h"
+#include <arpa/inet.h>
+
+#ifndef IP_BIND_ADDRESS_NO_PORT
+#define IP_BIND_ADDRESS_NO_PORT 24
+#endif
+
+
+SourceBinder::SourceBinder(const pbcfg::SourceAddress &cfg)
+	: port_min_(cfg.port_min()),
+	  port_num_((cfg.port_max() > 0) ? (cfg.port_max() - cfg.port_min() + 1) : 0),
+	  next_(0) {
+	for (int i = 0; i < cfg.ip_size(); i++) {
+		struct in_addr ip;
+		if (inet_pton(AF_INET, cfg.ip(i).c_str(), &ip) == 1) {
+			ips_.push_back(ip);
+		}
+	}
+}
+
+bool SourceBinder::validate(const pbcfg::SourceAddress &cfg, std::ostringstream &err) {
+	for (int i = 0; i < cfg.ip_size(); i++) {
+		struct in_addr ip;
+		if (inet_pton(AF_INET, cfg.ip(i).c_str(), &ip) != 1) {
+			err << "invalid source ip: " << cfg.ip(i);
+			return false;
+		}
+	}
+	if ((cfg.port_min() == 0) && (cfg.port_max() == 0)) {
+		return true;
+	}
+	if ((cfg.port_min() <= 0) || (cfg.port_max() > 65535) || (cfg.port_min() > cfg.port_max())) {
+		err << "invalid source port range: [" << cfg.port_min() << ", " << cfg.port_max() << "]";
+		return false;
+	}
+	return true;
+}
+
+int SourceBinder::bind(int s, std::ostringstream &err) {
+	if (empty()) {
+		return 0;
+	}
+	struct in_addr any;
+	any.s_addr = htonl(INADDR_ANY);
+	int one = 1;
+	if (port_num_ == 0) {
+		// 端口推迟到 connect 时按四元组选, 否则 bind 时就要占住一个端口, 源 IP 再多也只有一份端口
+		// (内核不支持时 bind 退化为立刻选端口, 仍然可用)
+		setsockopt(s, IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &one, sizeof(one));
+		uint64_t k = next_.fetch_add(1, std::memory_order_relaxed);
+		if (bind_one(s, ips_[k % ips_.size()], 0) == -1) {
+			err << "bind source " << describe() << ": " << strerror(errno);
+			return -1;
+		}
+		return 0;
+	}
+
+	// TIME_WAIT 中的端口也可以再用
+	if (setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) == -1) {
+		err << "setsockopt(SO_REUSEADDR): " << strerror(errno);
+		return -1;
+	}
+	size_t ip_num = ips_.empty() ? 1 : ips_.size();
+	uint64_t attempts = std::min(uint64_t(kSourceBindAttempts), uint64_t(port_num_) * ip_num);
+	for (uint64_t i = 0; i < attempts; i++) {
+		uint64_t k = next_.fetch_add(1, std::memory_order_relaxed);
+		const struct in_addr &ip = ips_.empty() ? any : ips_[k % ip_num];
+		if (bind_one(s, ip, port_min_ + int((k / ip_num) % port_num_)) == 0) {
+			return 0;
+		}
+		if (errno != EADDRINUSE) {
+			break;
+		}
+	}
+	int saved_errno = errno;
+	err << "bind source " << describe() << ": " << strerror(errno);
+	errno = saved_errno;
+	return -1;
+}
+
+int SourceBinder::bind_one(int s, const struct in_addr &ip, int port) {
+	struct sockaddr_in local;
+	memset(&local, 0, sizeof(local));
+	local.sin_family = AF_INET;
+	local.sin_addr = ip;
+	local.sin_port = htons(port);
+	return ::bind(s, (const struct sockaddr *)&local, sizeof(local));
+}
+
+std::string SourceBinder::describe(void) const {
+	std::ostringstream out;
+	if (ips_.empty()) {
+		out << "0.0.0.0";
+	}
+	for (size_t i = 0; i < ips_.size(); i++) {
+		char buf[INET_ADDRSTRLEN];
+		out << (i == 0 ? "" : ",") << inet_ntop(AF_INET, &ips_[i], buf, sizeof(buf));
+	}
+	if (port_num_ > 0) {
+		out << " ports " << port_min_ << "-" << (port_min_ + port_num_ - 1);
+	}
+	return out.str();
+}
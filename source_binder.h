@@ -0,0 +1,48 @@
+#ifndef __SOURCE_BINDER_H__
+#define __SOURCE_BINDER_H__
+
+#include "common.h"
+#include "robot.pb.h"
+#include <netinet/in.h>
+#include <atomic>
+
+// 指定了端口范围时, 一次 bind 最多试多少个 (被占用的) 端口
+const int kSourceBindAttempts = 64;
+
+
+// SourceBinder: 一个 Group 的所有客户端共享, 按 pbcfg::SourceAddress 给新建的 socket 绑定源地址,
+// 连接按发起的顺序轮流分到各个源 IP 上; 指定了端口范围时每个 IP 在范围内依次取端口.
+// 分配是无锁的, thread 引擎的客户端线程, epoll 引擎的多个循环和 coro 引擎的工作线程都可以直接调用
+class SourceBinder {
+public:
+	// @cfg: 已经 validate 过
+	explicit SourceBinder(const pbcfg::SourceAddress &cfg);
+
+public:
+	// @return false: 有解析不了的 ip, 或端口范围不对
+	static bool validate(const pbcfg::SourceAddress &cfg, std::ostringstream &err);
+
+	// 没有配置源地址, 不用绑定
+	bool empty(void) const { return ips_.empty() && (port_num_ == 0); }
+	// 指定了端口范围 (bind 成功的端口 connect 时仍可能和已有连接冲突, 调用者应换一个重试)
+	bool port_range(void) const { return port_num_ > 0; }
+	// 在 connect 之前调用; @return: -1: failed (errno 是失败原因), 0: succ
+	int bind(int s, std::ostringstream &err);
+	// 用于日志, 例如 "127.0.0.2,127.0.0.3 ports 20000-29999"
+	std::string describe(void) const;
+
+private:
+	SourceBinder(const SourceBinder &);
+	SourceBinder &operator=(const SourceBinder &);
+
+	int bind_one(int s, const struct in_addr &ip, int port);
+
+private:
+	std::vector<struct in_addr> ips_;	// 为空时绑定 INADDR_ANY
+	int port_min_;
+	int port_num_;						// 0: 端口由内核选
+	std::atomic<uint64_t> next_;
+};
+
+
+#endif // __SOURCE_BINDER_H__
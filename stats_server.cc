@@ -0,0 +1,260 @@
+#include "stats_server.h"
+#include "latency_stats.h"
+#include "timeutils.h"
+#include <poll.h>
+#include <sys/un.h>
+
+
+bool StatsServer::start(const std::string &listen, std::ostringstream &err) {
+	int fd = -1;
+	if (listen.compare(0, 5, "unix:") == 0) {
+		std::string path = listen.substr(5);
+		struct sockaddr_un addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		if (path.empty() || (path.size() >= sizeof(addr.sun_path))) {
+			err << "bad unix socket path: " << path;
+			return false;
+		}
+		memcpy(addr.sun_path, path.c_str(), path.size());
+		// 上次没有正常退出留下的 socket 文件
+		struct stat st;
+		if ((stat(path.c_str(), &st) == 0) && S_ISSOCK(st.st_mode)) {
+			unlink(path.c_str());
+		}
+		fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if ((fd == -1) || (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1)) {
+			err << "bind " << listen << ": " << strerror(errno);
+			if (fd != -1) close(fd);
+			return false;
+		}
+		unix_path_ = path;
+	} else {
+		size_t colon = listen.rfind(':');
+		std::string host = (colon == std::string::npos) ? std::string() : listen.substr(0, colon);
+		int port = atoi(listen.c_str() + (colon == std::string::npos ? 0 : colon + 1));
+		struct sockaddr_in addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(port);
+		if ((colon == std::string::npos) || (port <= 0) || (port > 65535)
+			|| (inet_pton(AF_INET, host.empty() ? "127.0.0.1" : host.c_str(), &addr.sin_addr) != 1)) {
+			err << "bad stats listen address: " << listen << " (host:port, :port or unix:/path)";
+			return false;
+		}
+		fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		int on = 1;
+		if (fd != -1) {
+			setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+		}
+		if ((fd == -1) || (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1)) {
+			err << "bind " << listen << ": " << strerror(errno);
+			if (fd != -1) close(fd);
+			return false;
+		}
+	}
+	if (::listen(fd, 16) == -1) {
+		err << "listen " << listen << ": " << strerror(errno);
+		close(fd);
+		return false;
+	}
+
+	listen_fd_ = fd;
+	stopping_ = false;
+	thread_ = g_thread_new("stats_server", &StatsServer::serve_main, this);
+	LOG(ERROR) << "Stats server listening on " << listen;
+	return true;
+}
+
+void StatsServer::stop(void) {
+	if (!thread_) {
+		return ;
+	}
+	stopping_ = true;
+	g_thread_join(thread_);
+	thread_ = NULL;
+	close(listen_fd_);
+	listen_fd_ = -1;
+	if (!unix_path_.empty()) {
+		unlink(unix_path_.c_str());
+		unix_path_.clear();
+	}
+}
+
+gpointer StatsServer::serve_main(gpointer data) {
+	static_cast<StatsServer *>(data)->serve();
+	return NULL;
+}
+
+void StatsServer::serve(void) {
+	uint64_t next_sample = 0;
+	while (!stopping_.load()) {
+		uint64_t now = now_usec();
+		if (now >= next_sample) {
+			LATENCY_STATS.sample_throughput(now);
+			next_sample = now + kStatsSampleUsec;
+		}
+		struct pollfd pfd;
+		pfd.fd = listen_fd_;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		int ret = poll(&pfd, 1, kStatsPollMs);
+		if (ret == -1 && errno != EINTR) {
+			LOG(ERROR) << "Stats server poll: " << strerror(errno);
+			break;
+		}
+		if (ret <= 0) {
+			continue;
+		}
+		int fd = accept4(listen_fd_, NULL, NULL, SOCK_CLOEXEC);
+		if (fd == -1) {
+			continue;
+		}
+		handle(fd);
+	}
+}
+
+void StatsServer::handle(int fd) {
+	struct timeval tv;
+	tv.tv_sec = kStatsRequestTimeoutMs / 1000;
+	tv.tv_usec = (kStatsRequestTimeoutMs % 1000) * 1000;
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+	// 只看请求头, 读到空行 (或超时, 对端关闭) 为止
+	std::string request;
+	char buf[1024];
+	while ((request.size() < kStatsMaxRequest) && (request.find("\r\n\r\n") == std::string::npos)) {
+		ssize_t n = recv(fd, buf, sizeof(buf), 0);
+		if (n <= 0) {
+			break;
+		}
+		request.append(buf, n);
+	}
+
+	std::string response = respond(request);
+	size_t sent = 0;
+	while (sent < response.size()) {
+		ssize_t n = send(fd, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+		if (n <= 0) {
+			break;
+		}
+		sent += n;
+	}
+	close(fd);
+}
+
+std::string StatsServer::respond(const std::string &request) {
+	std::string line = request.substr(0, request.find("\r\n"));
+	std::istringstream fields(line);
+	std::string method, path;
+	fields >> method >> path;
+	// 去掉查询串
+	path = path.substr(0, path.find('?'));
+
+	std::string status = "200 OK";
+	std::ostringstream body;
+	if (method != "GET") {
+		status = "405 Method Not Allowed";
+		body << "only GET is supported\n";
+	} else if ((path != "/metrics") && (path != "/")) {
+		status = "404 Not Found";
+		body << "try /metrics\n";
+	} else {
+		LATENCY_STATS.write_prometheus(body);
+	}
+
+	std::ostringstream response;
+	response << "HTTP/1.0 " << status << "\r\n"
+		<< "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+		<< "Content-Length: " << body.str().size() << "\r\n"
+		<< "Connection: close\r\n\r\n"
+		<< body.str();
+	return response.str();
+}
+
+
+bool ShmStatsPublisher::start(const std::string &path, std::ostringstream &err) {
+	if (!segment_.create(path, err)) {
+		return false;
+	}
+	start_usec_ = now_usec();
+	publish_count_ = 0;
+	last_.clear();
+	stopping_ = false;
+	thread_ = g_thread_new("shm_stats", &ShmStatsPublisher::publish_main, this);
+	LOG(ERROR) << "Publishing stats to " << path;
+	return true;
+}
+
+void ShmStatsPublisher::stop(void) {
+	if (!thread_) {
+		return ;
+	}
+	stopping_ = true;
+	g_thread_join(thread_);
+	thread_ = NULL;
+	segment_.close();
+}
+
+gpointer ShmStatsPublisher::publish_main(gpointer data) {
+	ShmStatsPublisher *self = static_cast<ShmStatsPublisher *>(data);
+	uint64_t next = 0;
+	while (!self->stopping_.load()) {
+		uint64_t now = now_usec();
+		if (now >= next) {
+			self->publish(now);
+			next = now + kShmStatsPublishUsec;
+		}
+		usleep(kStatsPollMs * 1000);
+	}
+	self->publish(now_usec());
+	return NULL;
+}
+
+// 从直方图取分位
+static void fill_latency(const LatencySnapshot &snapshot, ShmLatency &out) {
+	out.count = snapshot.count();
+	out.p50 = snapshot.value_at_percentile(50);
+	out.p90 = snapshot.value_at_percentile(90);
+	out.p99 = snapshot.value_at_percentile(99);
+	out.p999 = snapshot.value_at_percentile(99.9);
+	out.max = snapshot.max();
+}
+
+void ShmStatsPublisher::publish(uint64_t now) {
+	LATENCY_STATS.summarize(summaries_);
+	// LATENCY_STATS 重新 init 过 (Group 变了) 时 recent 从头算
+	if (last_.size() != summaries_.size()) {
+		last_.assign(summaries_.size(), LatencySnapshot());
+	}
+
+	ShmStatsData &data = data_;
+	memset(&data, 0, sizeof(data));
+	data.start_usec = start_usec_;
+	data.update_usec = now;
+	data.publish_count = ++publish_count_;
+	data.group_total = static_cast<int32_t>(summaries_.size());
+	data.group_num = std::min(data.group_total, int32_t(kShmStatsMaxGroups));
+	for (int g = 0; g < data.group_num; g++) {
+		const GroupSummary &summary = summaries_[g];
+		ShmGroupStats &out = data.groups[g];
+		strncpy(out.name, summary.name.c_str(), sizeof(out.name) - 1);
+		out.connects = summary.counters.connects;
+		out.disconnects = summary.counters.disconnects;
+		out.connect_timeouts = summary.counters.connect_timeouts;
+		out.requests = summary.counters.requests;
+		out.completed = summary.counters.completed;
+		out.timeouts = summary.counters.timeouts;
+		out.abandoned = summary.counters.abandoned;
+		out.errors = summary.counters.errors;
+		out.connected = summary.counters.connected();
+		out.in_flight = summary.counters.in_flight();
+		fill_latency(summary.latency, out.total);
+		LatencySnapshot recent = summary.latency;
+		recent.subtract(last_[g]);
+		fill_latency(recent, out.recent);
+		last_[g] = summary.latency;
+	}
+	segment_.write(data);
+}
@@ -0,0 +1,78 @@
+#ifndef __STATS_SERVER_H__
+#define __STATS_SERVER_H__
+
+#include "common.h"
+#include "shm_stats.h"
+#include "latency_stats.h"
+#include <atomic>
+
+// 统计服务线程每次 poll 最多等这么久, 用来检查 stop() 和按时采样吞吐
+const int kStatsPollMs = 200;
+// 吞吐的采样间隔
+const uint64_t kStatsSampleUsec = 1000000;
+// 一个 HTTP 请求头最多读这么多, 最多等这么久
+const size_t kStatsMaxRequest = 8192;
+const int kStatsRequestTimeoutMs = 1000;
+// 共享内存统计区的发布间隔
+const uint64_t kShmStatsPublishUsec = 500000;
+
+
+// StatsServer: 可选的内嵌统计服务, 长时间压测时不用等进程结束就能看到结果;
+// 在本地 TCP 端口或 Unix socket 上回应 HTTP GET /metrics, 内容是 LATENCY_STATS 的 Prometheus 文本格式.
+// 单独一个线程, 抓取时才合并各工作线程的计数, 不给记录路径增加任何竞争
+class StatsServer {
+public:
+	~StatsServer() { stop(); }
+	StatsServer() : listen_fd_(-1), thread_(NULL), stopping_(false) { }
+
+public:
+	// @listen: "host:port" (IPv4), ":port" (只监听 127.0.0.1) 或 "unix:/path"
+	bool start(const std::string &listen, std::ostringstream &err);
+	void stop(void);
+
+	// 处理一个请求: @request 是请求行和请求头, 结果是完整的 HTTP 响应
+	static std::string respond(const std::string &request);
+
+private:
+	static gpointer serve_main(gpointer data);
+	void serve(void);
+	// 读请求, 写响应, 然后关闭 fd
+	void handle(int fd);
+
+private:
+	int listen_fd_;
+	std::string unix_path_;		// 监听的 Unix socket, 停止时删除
+	GThread *thread_;
+	std::atomic<bool> stopping_;
+};
+
+// ShmStatsPublisher: 定期把 LATENCY_STATS 的计数和分位写进共享内存统计区 (ShmStatsSegment),
+// 给不能开监听端口的机器上的 robot_top 看; 读者只读映射, 不和 robot 有任何交互
+class ShmStatsPublisher {
+public:
+	~ShmStatsPublisher() { stop(); }
+	ShmStatsPublisher() : thread_(NULL), stopping_(false), start_usec_(0), publish_count_(0) { }
+
+public:
+	// @path: 通常是 ShmStatsSegment::path_of(getpid())
+	bool start(const std::string &path, std::ostringstream &err);
+	// 最后发布一次, 然后删除统计区
+	void stop(void);
+private:
+	// 发布一次, 只在发布线程上调用
+	void publish(uint64_t now);
+	static gpointer publish_main(gpointer data);
+
+private:
+	ShmStatsSegment segment_;
+	GThread *thread_;
+	std::atomic<bool> stopping_;
+	uint64_t start_usec_;
+	uint64_t publish_count_;
+	std::vector<GroupSummary> summaries_;
+	std::vector<LatencySnapshot> last_;		// 上一次发布时的直方图, 用来算 recent
+	ShmStatsData data_;						// 写进统计区之前先在这里拼好, 十几 KB, 不放在栈上
+};
+
+
+#endif // __STATS_SERVER_H__
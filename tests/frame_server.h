@@ -0,0 +1,106 @@
+#ifndef TESTS_FRAME_SERVER_H_
+#define TESTS_FRAME_SERVER_H_
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Loopback server for tests that drive real connections. By default it echoes every complete
+// frame back unchanged. Before the first reply it can write one extra frame (for example a response
+// for a uid nobody owns), or it can close the first connection it accepts instead of replying.
+// A Responder replaces the echo: it gets every complete frame of a connection (index counts from 0
+// per connection) and returns the bytes to write back, possibly none. It runs on the connection's
+// server thread, so it may sleep to delay a reply.
+class FrameServer {
+public:
+    typedef std::function<std::string(int index, const std::string &frame)> Responder;
+
+    explicit FrameServer(const std::string &stray = "", bool close_on_first = false,
+                         Responder responder = Responder())
+        : listenfd_(socket(AF_INET, SOCK_STREAM, 0)), stray_(stray), close_on_first_(close_on_first),
+          responder_(responder), accepted_(0) {
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr);
+        bind(listenfd_, (struct sockaddr *)&addr, sizeof(addr));
+        listen(listenfd_, 64);
+        getsockname(listenfd_, (struct sockaddr *)&addr, &len);
+        addr_ = "127.0.0.1:" + std::to_string(ntohs(addr.sin_port));
+        acceptor_ = std::thread(&FrameServer::accept_loop, this);
+    }
+    ~FrameServer() {
+        shutdown(listenfd_, SHUT_RDWR);
+        close(listenfd_);
+        acceptor_.join();
+        for (size_t i = 0; i < conns_.size(); i++) {
+            conns_[i].join();
+        }
+    }
+
+    const std::string &addr() const { return addr_; }
+    int accepted() const { return accepted_.load(); }
+
+private:
+    void accept_loop() {
+        int fd;
+        while ((fd = accept(listenfd_, NULL, NULL)) >= 0) {
+            bool close_it = (accepted_++ == 0) && close_on_first_;
+            conns_.push_back(std::thread(&FrameServer::serve, this, fd, close_it));
+        }
+    }
+
+    void serve(int fd, bool close_it) {
+        std::string buf, out = stray_;
+        char tmp[65536];
+        ssize_t n;
+        int index = 0;
+        while ((n = read(fd, tmp, sizeof(tmp))) > 0) {
+            if (close_it) {
+                break;
+            }
+            buf.append(tmp, n);
+            while (buf.size() >= 4) {
+                uint32_t len;
+                memcpy(&len, buf.data(), sizeof(len));
+                len = ntohl(len);
+                if (buf.size() < len) {
+                    break;
+                }
+                if (responder_) {
+                    out += responder_(index++, buf.substr(0, len));
+                } else {
+                    out.append(buf, 0, len);
+                }
+                buf.erase(0, len);
+            }
+            if (out.empty()) {
+                continue;
+            }
+            if (write(fd, out.data(), out.size()) != ssize_t(out.size())) {
+                break;
+            }
+            out.clear();
+        }
+        close(fd);
+    }
+
+    int listenfd_;
+    std::string addr_;
+    std::string stray_;
+    bool close_on_first_;
+    Responder responder_;
+    std::atomic<int> accepted_;
+    std::thread acceptor_;
+    std::vector<std::thread> conns_;
+};
+
+#endif // TESTS_FRAME_SERVER_H_
@@ -14,6 +14,7 @@ public:
     MockClient() : Client(8192, false) {} // Default if no specific args needed for mock
 
     MOCK_METHOD(bool, send_msg, (const google::protobuf::Message &msghead, const google::protobuf::Message &msg, std::ostringstream &err), (override));
+    MOCK_METHOD(bool, send_msg, (const google::protobuf::Message &msghead, const std::string &type_name, const std::string &body, std::ostringstream &err), (override));
     MOCK_METHOD(int, net_tcp_send, (std::ostringstream &errmsg), (override));
     MOCK_METHOD(int, net_tcp_recv, (std::ostringstream &errmsg), (override));
     MOCK_METHOD(bool, recv_msg, (google::protobuf::Message **msghead, google::protobuf::Message **msg, bool &complete, std::ostringstream &err), (override));
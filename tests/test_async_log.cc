@@ -0,0 +1,134 @@
+#include "gtest/gtest.h"
+#include "async_log.h"
+#include <thread>
+
+namespace {
+
+std::mutex sink_lock;
+std::vector<std::string> sink_lines;
+
+void CollectLine(const char *, int, int, const std::string &text) {
+    std::lock_guard<std::mutex> guard(sink_lock);
+    sink_lines.push_back(text);
+}
+
+// Counts how many times a log statement formatted its arguments.
+struct Formatted {
+    explicit Formatted(int *count_) : count(count_) { }
+    int *count;
+};
+
+std::ostream &operator<<(std::ostream &out, const Formatted &formatted) {
+    (*formatted.count)++;
+    return out << "x";
+}
+
+} // namespace
+
+TEST(AsyncLogTest, EveryNFormatsOnlySampledLines) {
+    int formatted = 0;
+    for (int i = 0; i < 100; i++) {
+        ALOG_EVERY_N(INFO, 10) << Formatted(&formatted);
+    }
+    EXPECT_EQ(formatted, 10);
+
+    int never = 0, always = 0;
+    for (int i = 0; i < 5; i++) {
+        ALOG_EVERY_N(INFO, 0) << Formatted(&never);
+        ALOG_EVERY_N(INFO, 1) << Formatted(&always);
+    }
+    EXPECT_EQ(never, 0);
+    EXPECT_EQ(always, 5);
+}
+
+TEST(AsyncLogTest, EveryNCountsPerThread) {
+    std::atomic<int> formatted(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.push_back(std::thread([&formatted]() {
+            int local = 0;
+            for (int i = 0; i < 20; i++) {
+                ALOG_EVERY_N(INFO, 10) << Formatted(&local);
+            }
+            formatted += local;
+        }));
+    }
+    for (size_t t = 0; t < threads.size(); t++) {
+        threads[t].join();
+    }
+    EXPECT_EQ(formatted.load(), 8);
+}
+
+TEST(AsyncLogTest, EverySecIsRateLimited) {
+    int formatted = 0;
+    for (int i = 0; i < 1000; i++) {
+        ALOG_EVERY_SEC(INFO, 60) << Formatted(&formatted);
+    }
+    EXPECT_EQ(formatted, 1);
+
+    std::atomic<uint64_t> last(0);
+    EXPECT_TRUE(AsyncLogRateLimit(last, 0));
+    EXPECT_TRUE(AsyncLogRateLimit(last, 0));
+    EXPECT_FALSE(AsyncLogRateLimit(last, 60000000));
+}
+
+TEST(AsyncLogTest, QueueDropsWhenFull) {
+    AsyncLogQueue *queue = new AsyncLogQueue();
+    for (uint32_t i = 0; i < kAsyncLogQueueSize + 10; i++) {
+        std::string text = "line " + std::to_string(i);
+        EXPECT_EQ(queue->push("f.cc", 1, google::GLOG_INFO, text), i < kAsyncLogQueueSize);
+    }
+    EXPECT_EQ(queue->dropped(), 10u);
+
+    AsyncLogQueue::Record record;
+    ASSERT_TRUE(queue->pop(record));
+    EXPECT_EQ(record.text, "line 0");
+    EXPECT_EQ(record.line, 1);
+    std::string text = "again";
+    EXPECT_TRUE(queue->push("f.cc", 2, google::GLOG_INFO, text));
+    uint32_t popped = 1;
+    while (queue->pop(record)) {
+        popped++;
+    }
+    EXPECT_EQ(popped, kAsyncLogQueueSize + 1);
+    EXPECT_EQ(record.text, "again");
+    delete queue;
+}
+
+TEST(AsyncLogTest, WriterThreadWritesEveryThreadsLines) {
+    sink_lines.clear();
+    ASYNC_LOG.start(&CollectLine);
+    ASSERT_TRUE(ASYNC_LOG.running());
+    uint64_t written = ASYNC_LOG.written();
+    const int kThreads = 4, kLines = 200;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; t++) {
+        threads.push_back(std::thread([t]() {
+            for (int i = 0; i < kLines; i++) {
+                ALOG(ERROR) << "thread " << t << " line " << i;
+                if (i % 50 == 0) {
+                    usleep(kAsyncLogFlushMs * 1000);
+                }
+            }
+        }));
+    }
+    for (size_t t = 0; t < threads.size(); t++) {
+        threads[t].join();
+    }
+    ASYNC_LOG.stop();
+    EXPECT_FALSE(ASYNC_LOG.running());
+
+    // Queues of finished threads are written out and freed before stop() returns.
+    uint64_t dropped = ASYNC_LOG.dropped();
+    EXPECT_EQ(ASYNC_LOG.written() - written + dropped, uint64_t(kThreads * kLines));
+    EXPECT_EQ(sink_lines.size() + dropped, size_t(kThreads * kLines));
+    // Lines of one thread keep their order.
+    int next = 0;
+    for (size_t i = 0; i < sink_lines.size(); i++) {
+        if (sink_lines[i].compare(0, 9, "thread 0 ") == 0) {
+            int line = atoi(sink_lines[i].c_str() + 14);
+            EXPECT_GE(line, next);
+            next = line + 1;
+        }
+    }
+}
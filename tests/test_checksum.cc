@@ -0,0 +1,77 @@
+#include "gtest/gtest.h"
+#include "checksum.h"
+#include <string>
+#include <vector>
+
+namespace {
+
+std::string PseudoRandomBytes(size_t len) {
+    std::string bytes(len, '\0');
+    uint32_t x = 2463534242u;
+    for (size_t i = 0; i < len; i++) {
+        x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+        bytes[i] = static_cast<char>(x);
+    }
+    return bytes;
+}
+
+} // namespace
+
+TEST(ChecksumTest, Crc32cKnownVectors) {
+    EXPECT_EQ(crc32c_scalar("123456789", 9), 0xE3069283u);
+    EXPECT_EQ(crc32c_scalar("", 0), 0u);
+    std::string zeros(32, '\0');
+    EXPECT_EQ(crc32c_scalar(zeros.data(), zeros.size()), 0x8A9136AAu);
+    EXPECT_EQ(calc_checksum(kChecksumCrc32c, "123456789", 9), 0xE3069283u);
+}
+
+TEST(ChecksumTest, Crc32cHardwareMatchesScalar) {
+    if (!crc32c_hw_available()) {
+        GTEST_SKIP() << "no SSE4.2 crc32 instruction";
+    }
+    std::string bytes = PseudoRandomBytes(4099);
+    // Every length and misalignment hits a different mix of 8/4/1-byte steps.
+    for (size_t offset = 0; offset < 8; offset++) {
+        for (size_t len = 0; len + offset <= 300; len++) {
+            ASSERT_EQ(crc32c_hw(bytes.data() + offset, len), crc32c_scalar(bytes.data() + offset, len))
+                << "offset " << offset << ", len " << len;
+        }
+    }
+    EXPECT_EQ(crc32c_hw(bytes.data(), bytes.size()), crc32c_scalar(bytes.data(), bytes.size()));
+}
+
+TEST(ChecksumTest, Sum32AddsUnsignedBytes) {
+    const char bytes[] = { '\x01', '\xff', '\x80', '\x02' };
+    EXPECT_EQ(checksum_sum32_scalar(bytes, sizeof(bytes)), 0x01u + 0xffu + 0x80u + 0x02u);
+    EXPECT_EQ(calc_checksum(kChecksumSum32, bytes, sizeof(bytes)), 0x01u + 0xffu + 0x80u + 0x02u);
+}
+
+TEST(ChecksumTest, Sum32SimdMatchesScalar) {
+    std::string bytes = PseudoRandomBytes(70000);
+    for (size_t offset = 0; offset < 16; offset++) {
+        for (size_t len = 0; len + offset <= 100; len++) {
+            ASSERT_EQ(checksum_sum32_simd(bytes.data() + offset, len),
+                      checksum_sum32_scalar(bytes.data() + offset, len));
+        }
+    }
+    EXPECT_EQ(checksum_sum32_simd(bytes.data(), bytes.size()),
+              checksum_sum32_scalar(bytes.data(), bytes.size()));
+}
+
+TEST(ChecksumTest, ExtendMatchesOneShot) {
+    std::string data;
+    for (int i = 0; i < 1000; i++) {
+        data += static_cast<char>(i * 131 + 7);
+    }
+    const ChecksumType types[] = { kChecksumSum32, kChecksumCrc32c };
+    const size_t splits[] = { 0, 1, 7, 8, 13, 500, 999, 1000 };
+    for (size_t t = 0; t < sizeof(types) / sizeof(types[0]); t++) {
+        uint32_t whole = calc_checksum(types[t], data.data(), data.size());
+        for (size_t i = 0; i < sizeof(splits) / sizeof(splits[0]); i++) {
+            size_t k = splits[i];
+            uint32_t first = calc_checksum(types[t], data.data(), k);
+            EXPECT_EQ(calc_checksum_extend(types[t], first, data.data() + k, data.size() - k), whole)
+                << "type " << types[t] << ", split at " << k;
+        }
+    }
+}
@@ -0,0 +1,74 @@
+#include "gtest/gtest.h"
+#include "client.h"
+#include "robot.pb.h"
+#include <memory>
+#include <string>
+
+class ClientCodecTest : public ::testing::Test {
+protected:
+    Client client{8192, false};
+    pbcfg::CsMsgHead head;
+    pbcfg::Client body;
+
+    void SetUp() override {
+        head.set_msg_type_name("pbcfg.Client");
+        head.set_uid(1001);
+        head.set_role_tm(77);
+        head.set_ret(0);
+        body.set_uid(42);
+        body.set_role_time(7);
+    }
+};
+
+TEST_F(ClientCodecTest, DecodesFromBufferSpan) {
+    std::string pkg;
+    ASSERT_TRUE(client.encode(head, body, pkg));
+
+    // Two frames back to back, as they would sit in the receive buffer.
+    std::string stream = pkg + pkg;
+    google::protobuf::Message *rsphead = nullptr, *rspbody = nullptr;
+    ASSERT_TRUE(client.decode(stream.data() + pkg.size(), static_cast<int32_t>(pkg.size()), &rsphead, &rspbody));
+    std::unique_ptr<google::protobuf::Message> head_owner(rsphead), body_owner(rspbody);
+
+    const pbcfg::CsMsgHead *decoded_head = dynamic_cast<const pbcfg::CsMsgHead *>(rsphead);
+    ASSERT_NE(decoded_head, nullptr);
+    EXPECT_EQ(decoded_head->uid(), 1001u);
+    EXPECT_EQ(decoded_head->msg_type_name(), "pbcfg.Client");
+    ASSERT_EQ(rspbody->GetTypeName(), "pbcfg.Client");
+    EXPECT_EQ(rspbody->SerializeAsString(), body.SerializeAsString());
+}
+
+TEST_F(ClientCodecTest, RejectsLengthMismatch) {
+    std::string pkg;
+    ASSERT_TRUE(client.encode(head, body, pkg));
+
+    google::protobuf::Message *rsphead = nullptr, *rspbody = nullptr;
+    EXPECT_FALSE(client.decode(pkg.data(), static_cast<int32_t>(pkg.size()) - 1, &rsphead, &rspbody));
+    EXPECT_EQ(rsphead, nullptr);
+    EXPECT_EQ(rspbody, nullptr);
+}
+
+TEST_F(ClientCodecTest, VerifiesChecksumOnDecode) {
+    const ChecksumType types[] = { kChecksumSum32, kChecksumCrc32c };
+    for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+        Client checked(8192, true, types[i]);
+        std::string pkg;
+        ASSERT_TRUE(checked.encode(head, body, pkg));
+        uint32_t trailer;
+        memcpy(&trailer, pkg.data() + pkg.size() - 4, sizeof(trailer));
+        EXPECT_EQ(ntohl(trailer), calc_checksum(types[i], pkg.data(), pkg.size() - 4));
+
+        google::protobuf::Message *rsphead = nullptr, *rspbody = nullptr;
+        ASSERT_TRUE(checked.decode(pkg, &rsphead, &rspbody));
+        std::unique_ptr<google::protobuf::Message> head_owner(rsphead), body_owner(rspbody);
+        EXPECT_EQ(rspbody->SerializeAsString(), body.SerializeAsString());
+
+        // Flip one payload byte: the frame is still well-formed but must be rejected.
+        std::string corrupted = pkg;
+        corrupted[corrupted.size() - 5] ^= 0x01;
+        google::protobuf::Message *badhead = nullptr, *badbody = nullptr;
+        EXPECT_FALSE(checked.decode(corrupted, &badhead, &badbody));
+        EXPECT_EQ(badhead, nullptr);
+        EXPECT_EQ(badbody, nullptr);
+    }
+}
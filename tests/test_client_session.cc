@@ -0,0 +1,365 @@
+#include "gtest/gtest.h"
+#include "client_session.h"
+#include "config.h"
+#include "message_pool.h"
+#include "timeutils.h"
+#include "frame_server.h"
+#include <mutex>
+
+namespace {
+
+const char kUniqName[] = "session_test_req";
+
+// Re-encodes a request frame with another seq (0: as if the peer did not echo the seq back).
+std::string WithSeq(const std::string &frame, uint32_t seq) {
+    Client codec(8192, false);
+    Message *head = NULL, *body = NULL;
+    std::string out;
+    if (codec.decode(frame, &head, &body)) {
+        static_cast<pbcfg::CsMsgHead *>(head)->set_seq(seq);
+        codec.encode(*head, *body, out);
+    }
+    delete head;
+    delete body;
+    return out;
+}
+
+// When the server got each frame; filled on the server thread, read after the run.
+class FrameTimes {
+public:
+    void add() {
+        std::lock_guard<std::mutex> guard(mutex_);
+        times_.push_back(now_usec());
+    }
+    std::vector<uint64_t> get() {
+        std::lock_guard<std::mutex> guard(mutex_);
+        return times_;
+    }
+
+private:
+    std::mutex mutex_;
+    std::vector<uint64_t> times_;
+};
+
+// A loopback port with nobody listening on it.
+std::string ClosedPort() {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    getsockname(fd, (struct sockaddr *)&addr, &len);
+    close(fd);
+    return "127.0.0.1:" + std::to_string(ntohs(addr.sin_port));
+}
+
+// Blocks the loop it runs on for a while when its timer fires, like a slow callback would.
+class Staller : public EventHandler {
+public:
+    explicit Staller(uint64_t usec) : usec_(usec) { }
+    void on_events(uint32_t) override { }
+    void on_timer() override { usleep(usec_); }
+
+private:
+    uint64_t usec_;
+};
+
+// Re-arms itself every millisecond and counts how often the loop got around to it.
+class Ticker : public EventHandler {
+public:
+    explicit Ticker(EventLoop *loop) : loop_(loop), ticks(0) { loop_->set_timer(this, now_usec() + 1000); }
+    ~Ticker() { loop_->cancel_timer(this); }
+    void on_events(uint32_t) override { }
+    void on_timer() override {
+        ticks++;
+        loop_->set_timer(this, now_usec() + 1000);
+    }
+
+private:
+    EventLoop *loop_;
+
+public:
+    int ticks;
+};
+
+class ClientSessionTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        std::ostringstream err;
+        ASSERT_TRUE(loop.init(err)) << err.str();
+        body.set_uniq_name(kUniqName);
+        body.set_type_name("pbcfg.Client");
+        body.set_text("uid: 7 role_time: 9");
+        UniqRequest *req = new UniqRequest(&body, new pbcfg::Client);
+        ASSERT_TRUE(req->compile_body(err)) << err.str();
+        uniq_name_map[kUniqName] = req;
+
+        group.set_name("session");
+        group.set_max_pkg_len(8192);
+        group.set_has_checksum(false);
+        group.set_loop_count(1);
+        pbcfg::Client *client = group.add_client();
+        client->set_uid(100);
+        client->set_role_time(1);
+        group.set_client_count(1);
+    }
+    void TearDown() override {
+        delete uniq_name_map[kUniqName];
+        uniq_name_map.erase(kUniqName);
+    }
+
+    // An Action that sends one request and waits for the echoed pbcfg.Client for up to timeout seconds.
+    pbcfg::Action *AddAction(int timeout) {
+        pbcfg::Action *action = group.add_action();
+        action->add_request_uniq_name(kUniqName);
+        action->add_response("pbcfg.Client");
+        action->set_timeout(timeout);
+        return action;
+    }
+
+    // Runs the group's only client against addr on its own connection until it is done.
+    // @seq: the first request carries seq + 1
+    void Run(const std::string &addr, uint32_t seq = 0) {
+        group.set_peer_addr(addr);
+        LoadProfile profile(group);
+        profile.start(now_usec());
+        latency.reset(new GroupLatency(group));
+        ClientSession session(group, group.client(0), &loop, latency.get(), NULL, NULL, NULL, &profile, 0);
+        session.set_seq(seq);
+        session.start();
+        loop.run();
+        EXPECT_TRUE(session.finished());
+    }
+
+    EventLoop loop;
+    pbcfg::Body body;
+    pbcfg::Group group;
+    std::unique_ptr<GroupLatency> latency;
+};
+
+} // namespace
+
+TEST_F(ClientSessionTest, WaitsForResponsesAndMinDurationBeforeNextAction) {
+    AddAction(5)->set_min_duration(100);
+    AddAction(5);
+    FrameTimes times;
+    FrameServer server("", false, [&times](int, const std::string &frame) {
+        times.add();
+        return frame;
+    });
+    Run(server.addr());
+
+    std::vector<uint64_t> sent = times.get();
+    ASSERT_EQ(sent.size(), 2u);
+    // The second request only goes out once the first Action's min_duration is over.
+    EXPECT_GE(sent[1] - sent[0], 100000u);
+    EXPECT_EQ(latency->requests(), 2u);
+    EXPECT_EQ(latency->completed(), 2u);
+    EXPECT_EQ(latency->errors(), 0u);
+    EXPECT_EQ(latency->connects(), 1u);
+    EXPECT_EQ(latency->disconnects(), 1u);
+}
+
+TEST_F(ClientSessionTest, ActionTimeoutEndsClient) {
+    AddAction(1);
+    group.set_loop_count(3);
+    FrameServer server("", false, [](int, const std::string &) { return std::string(); });
+    Run(server.addr());
+
+    EXPECT_EQ(latency->requests(), 1u);
+    EXPECT_EQ(latency->timeouts(0), 1u);
+    EXPECT_EQ(latency->completed(), 0u);
+    EXPECT_EQ(latency->abandoned(), 0u);
+    EXPECT_EQ(latency->errors(), 1u);
+    EXPECT_EQ(latency->disconnects(), 1u);
+}
+
+TEST_F(ClientSessionTest, ConnectFailureEndsClient) {
+    AddAction(5);
+    Run(ClosedPort());
+
+    EXPECT_EQ(latency->connects(), 0u);
+    EXPECT_EQ(latency->disconnects(), 0u);
+    EXPECT_EQ(latency->requests(), 0u);
+    EXPECT_EQ(latency->errors(), 1u);
+}
+
+TEST_F(ClientSessionTest, ResponseDuringMinDurationGoesToNextAction) {
+    AddAction(5)->set_min_duration(100);
+    AddAction(5);
+    // The first request gets its echo, a duplicate of it, and a response without seq; the second
+    // request gets nothing. All three arrive while the first Action waits out its min_duration.
+    FrameServer server("", false, [](int index, const std::string &frame) {
+        return (index == 0) ? frame + frame + WithSeq(frame, 0) : std::string();
+    });
+    uint64_t start = now_usec();
+    Run(server.addr());
+
+    // The duplicate is late for the second Action, the response without seq completes it.
+    EXPECT_LT(now_usec() - start, 5000000u);
+    EXPECT_EQ(latency->late_responses(), 1u);
+    EXPECT_EQ(latency->unmatched_responses(), 0u);
+    EXPECT_EQ(latency->completed(), 2u);
+    EXPECT_EQ(latency->timeouts(0) + latency->timeouts(1), 0u);
+    EXPECT_EQ(latency->errors(), 0u);
+}
+
+TEST_F(ClientSessionTest, SynchronousActionsYieldToLoop) {
+    // No response, min_duration or think_time: every Action completes as soon as it is sent.
+    group.add_action()->add_request_uniq_name(kUniqName);
+    group.mutable_load()->set_steady(300);
+    std::atomic<int> frames(0);
+    FrameServer server("", false, [&frames](int, const std::string &) {
+        frames++;
+        return std::string();
+    });
+    Ticker ticker(&loop);
+    Run(server.addr());
+
+    EXPECT_GT(frames.load(), 0);
+    EXPECT_GE(ticker.ticks, 100);
+    EXPECT_EQ(latency->errors(), 0u);
+}
+
+TEST_F(ClientSessionTest, OpenLoopTimeoutKeepsRunningAndLateResponseIsLate) {
+    AddAction(1);
+    group.set_rate(20);
+    group.set_loop_count(30);
+    // The reply to the first request is held back until the 26th request, 1.25s later, which is
+    // after the first request timed out.
+    std::string held;
+    FrameServer server("", false, [&held](int index, const std::string &frame) {
+        if (index == 0) {
+            held = frame;
+            return std::string();
+        }
+        return (index == 25) ? held + frame : frame;
+    });
+    Run(server.addr());
+
+    EXPECT_EQ(latency->requests(), 30u);
+    EXPECT_EQ(latency->timeouts(0), 1u);
+    EXPECT_EQ(latency->late_responses(), 1u);
+    EXPECT_EQ(latency->completed(), 29u);
+    EXPECT_EQ(latency->errors(), 0u);
+}
+
+TEST_F(ClientSessionTest, OpenLoopCatchesUpAfterLateTimerAndMeasuresFromIntendedTime) {
+    AddAction(5);
+    group.set_rate(100);
+    group.set_loop_count(60);
+    FrameTimes times;
+    FrameServer server("", false, [&times](int, const std::string &frame) {
+        times.add();
+        return frame;
+    });
+    // 100ms into the run the loop is blocked for 300ms, so about 30 arrivals are overdue at once.
+    Staller staller(300000);
+    loop.set_timer(&staller, now_usec() + 100000);
+    Run(server.addr());
+
+    EXPECT_EQ(latency->completed(), 60u);
+    EXPECT_EQ(latency->errors(), 0u);
+    // Every overdue arrival goes out in the one late timer callback.
+    std::vector<uint64_t> sent = times.get();
+    ASSERT_EQ(sent.size(), 60u);
+    size_t burst = 0;
+    for (size_t i = 0, j = 0; j < sent.size(); j++) {
+        while (sent[j] - sent[i] > 5000) {
+            i++;
+        }
+        burst = std::max(burst, j - i + 1);
+    }
+    EXPECT_GE(burst, 20u);
+    // The server echoes at once, but the overdue arrivals count from when they should have gone out.
+    LatencySnapshot snapshot;
+    latency->histogram(0, 0).add_to(snapshot);
+    EXPECT_EQ(snapshot.count(), 60u);
+    EXPECT_GE(snapshot.max(), 200000u);
+    EXPECT_LT(snapshot.value_at_percentile(50), 100000u);
+}
+
+TEST_F(ClientSessionTest, PipelineKeepsWindowFull) {
+    AddAction(2);
+    group.set_pipeline_depth(4);
+    group.set_loop_count(20);
+    // Replies only once four requests are outstanding, so the client must keep four in flight.
+    std::string held;
+    FrameServer server("", false, [&held](int index, const std::string &frame) {
+        held += frame;
+        std::string out;
+        if (index % 4 == 3) {
+            out.swap(held);
+        }
+        return out;
+    });
+    Run(server.addr());
+
+    EXPECT_EQ(latency->requests(), 20u);
+    EXPECT_EQ(latency->completed(), 20u);
+    EXPECT_EQ(latency->timeouts(0), 0u);
+    EXPECT_EQ(latency->errors(), 0u);
+}
+
+TEST_F(ClientSessionTest, PipelineMatchesOutOfOrderRepliesAcrossSeqWrap) {
+    AddAction(2);
+    group.set_pipeline_depth(4);
+    group.set_loop_count(12);
+    // Each window of four is answered newest first; the first window is seq 0xfffffffe, 0xffffffff,
+    // 1, 2 (0 is skipped), so the newer ones sit one slot before their offset from the oldest.
+    std::vector<std::string> held;
+    FrameServer server("", false, [&held](int, const std::string &frame) {
+        held.push_back(frame);
+        std::string out;
+        if (held.size() == 4) {
+            for (size_t i = held.size(); i > 0; i--) {
+                out += held[i - 1];
+            }
+            held.clear();
+        }
+        return out;
+    });
+    Run(server.addr(), 0xfffffffd);
+
+    EXPECT_EQ(latency->completed(), 12u);
+    EXPECT_EQ(latency->late_responses(), 0u);
+    EXPECT_EQ(latency->unmatched_responses(), 0u);
+    EXPECT_EQ(latency->timeouts(0), 0u);
+    EXPECT_EQ(latency->errors(), 0u);
+}
+
+TEST_F(ClientSessionTest, PipelineTimeoutFreesItsSlot) {
+    AddAction(1);
+    group.set_pipeline_depth(2);
+    group.set_loop_count(6);
+    // The first request is never answered; the others flow through the second slot meanwhile.
+    FrameServer server("", false, [](int index, const std::string &frame) {
+        return (index == 0) ? std::string() : frame;
+    });
+    Run(server.addr());
+
+    EXPECT_EQ(latency->requests(), 6u);
+    EXPECT_EQ(latency->completed(), 5u);
+    EXPECT_EQ(latency->timeouts(0), 1u);
+    EXPECT_EQ(latency->errors(), 0u);
+}
+
+TEST_F(ClientSessionTest, PipelineWithoutResponsesYieldsToLoop) {
+    group.add_action()->add_request_uniq_name(kUniqName);
+    group.set_pipeline_depth(4);
+    group.mutable_load()->set_steady(300);
+    std::atomic<int> frames(0);
+    FrameServer server("", false, [&frames](int, const std::string &) {
+        frames++;
+        return std::string();
+    });
+    // Nothing ever occupies the window; the client must still let the rest of the loop run.
+    Ticker ticker(&loop);
+    Run(server.addr());
+
+    EXPECT_GT(frames.load(), 0);
+    EXPECT_GE(ticker.ticks, 100);
+    EXPECT_EQ(latency->errors(), 0u);
+}
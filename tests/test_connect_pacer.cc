@@ -0,0 +1,45 @@
+#include "gtest/gtest.h"
+#include "connect_pacer.h"
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+TEST(ConnectPacerTest, UnlimitedReturnsNow) {
+    ConnectPacer pacer(0);
+    EXPECT_EQ(pacer.acquire(100), 100u);
+    EXPECT_EQ(pacer.acquire(100), 100u);
+}
+
+TEST(ConnectPacerTest, SpacesSlotsByInterval) {
+    ConnectPacer pacer(1000); // one connect per 1000 usec
+    EXPECT_EQ(pacer.acquire(5000), 5000u);
+    EXPECT_EQ(pacer.acquire(5000), 6000u);
+    EXPECT_EQ(pacer.acquire(5100), 7000u);
+    // An idle pacer does not bank slots in the past.
+    EXPECT_EQ(pacer.acquire(20000), 20000u);
+}
+
+TEST(ConnectPacerTest, ConcurrentAcquireGetsDistinctSlots) {
+    ConnectPacer pacer(1e6); // 1 usec interval
+    const int kThreads = 8, kPerThread = 1000;
+    std::vector<std::vector<uint64_t> > slots(kThreads);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; t++) {
+        threads.push_back(std::thread([&, t]() {
+            for (int i = 0; i < kPerThread; i++) {
+                slots[t].push_back(pacer.acquire(0));
+            }
+        }));
+    }
+    for (size_t i = 0; i < threads.size(); i++) {
+        threads[i].join();
+    }
+    std::vector<uint64_t> all;
+    for (int t = 0; t < kThreads; t++) {
+        all.insert(all.end(), slots[t].begin(), slots[t].end());
+    }
+    std::sort(all.begin(), all.end());
+    for (size_t i = 0; i < all.size(); i++) {
+        EXPECT_EQ(all[i], i);
+    }
+}
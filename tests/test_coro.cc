@@ -0,0 +1,180 @@
+#include "gtest/gtest.h"
+#include "coro_scheduler.h"
+#include "timeutils.h"
+#include <algorithm>
+#include <atomic>
+#include <sched.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+CoTask<int> Add(int a, int b) {
+    co_return a + b;
+}
+
+CoTask<int> SumTo(int n) {
+    int total = 0;
+    for (int i = 1; i <= n; i++) {
+        total = co_await Add(total, i);
+    }
+    co_return total;
+}
+
+CoTask<> StoreSum(int n, int *out) {
+    *out = co_await SumTo(n);
+}
+
+// Waits for the fd to become readable (or the deadline), records what happened, then finishes.
+CoTask<> WaitReadable(CoIo *io, uint64_t deadline, std::vector<uint32_t> *results) {
+    uint32_t events = co_await io->wait(EPOLLIN, deadline);
+    results->push_back(events);
+    io->worker()->sched->root_finished();
+}
+
+CoTask<> SleepTwice(CoIo *io, std::vector<uint64_t> *wakeups) {
+    uint64_t start = now_usec();
+    co_await io->sleep_until(start + 20000);
+    wakeups->push_back(now_usec() - start);
+    co_await io->sleep_until(start + 40000);
+    wakeups->push_back(now_usec() - start);
+    io->worker()->sched->root_finished();
+}
+
+// Burns a little CPU between yields and counts how many distinct workers resumed it.
+CoTask<> BusyYield(CoIo *io, int rounds, std::atomic<int> *moved) {
+    CoWorker *first = io->worker();
+    for (int i = 0; i < rounds; i++) {
+        uint64_t until = now_usec() + 200;
+        while (now_usec() < until) { }
+        co_await io->yield();
+    }
+    if (io->worker() != first) {
+        moved->fetch_add(1);
+    }
+    io->worker()->sched->root_finished();
+}
+
+} // namespace
+
+TEST(CoTaskTest, NestedTasksRunToCompletionWithoutScheduler) {
+    int sum = 0;
+    uint64_t frames_before = CoFrameStats::local().frames;
+    CoTask<> task = StoreSum(100, &sum);
+    EXPECT_FALSE(task.done()); // Tasks are lazy.
+    task.start();
+    EXPECT_TRUE(task.done());
+    EXPECT_EQ(sum, 5050);
+    // One frame for StoreSum, one for SumTo and one per Add call.
+    EXPECT_EQ(CoFrameStats::local().frames - frames_before, 102u);
+}
+
+TEST(CoIoTest, ResumesOnReadableEvent) {
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds), 0);
+    CoScheduler sched;
+    std::ostringstream err;
+    ASSERT_TRUE(sched.init(1, false, false, err)) << err.str();
+    CoIo io(sched.worker(0));
+    io.set_fd(fds[0]);
+
+    std::vector<uint32_t> results;
+    CoTask<> task = WaitReadable(&io, now_usec() + 5000000, &results);
+    sched.spawn(&io, task);
+    ASSERT_EQ(write(fds[1], "x", 1), 1);
+    EXPECT_TRUE(sched.run(NULL, NULL, NULL));
+    ASSERT_EQ(results.size(), 1u);
+    EXPECT_TRUE(results[0] & EPOLLIN);
+    EXPECT_TRUE(task.done());
+    io.set_fd(-1);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+TEST(CoIoTest, ReturnsZeroOnDeadline) {
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds), 0);
+    CoScheduler sched;
+    std::ostringstream err;
+    ASSERT_TRUE(sched.init(1, false, false, err)) << err.str();
+    CoIo io(sched.worker(0));
+    io.set_fd(fds[0]);
+
+    std::vector<uint32_t> results;
+    uint64_t start = now_usec();
+    CoTask<> task = WaitReadable(&io, start + 30000, &results);
+    sched.spawn(&io, task);
+    EXPECT_TRUE(sched.run(NULL, NULL, NULL));
+    ASSERT_EQ(results.size(), 1u);
+    EXPECT_EQ(results[0], 0u);
+    EXPECT_GE(now_usec() - start, 30000u);
+    io.set_fd(-1);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+TEST(CoIoTest, SleepUntilIsNeverEarly) {
+    CoScheduler sched;
+    std::ostringstream err;
+    ASSERT_TRUE(sched.init(1, true, false, err)) << err.str();
+    CoIo io(sched.worker(0));
+
+    std::vector<uint64_t> wakeups;
+    CoTask<> task = SleepTwice(&io, &wakeups);
+    sched.spawn(&io, task);
+    EXPECT_TRUE(sched.run(NULL, NULL, NULL));
+    ASSERT_EQ(wakeups.size(), 2u);
+    EXPECT_GE(wakeups[0], 20000u);
+    EXPECT_GE(wakeups[1], 40000u);
+    EXPECT_LT(wakeups[1], 200000u);
+}
+
+TEST(CoSchedulerTest, IdleWorkersStealFromBusyOnes) {
+    CoScheduler sched;
+    std::ostringstream err;
+    ASSERT_TRUE(sched.init(4, false, false, err)) << err.str();
+
+    // Everything starts on worker 0; the other three have to steal to get any work.
+    const int kTasks = 64;
+    std::atomic<int> moved(0);
+    std::vector<CoIo *> ios;
+    std::vector<CoTask<> > tasks;
+    for (int i = 0; i < kTasks; i++) {
+        ios.push_back(new CoIo(sched.worker(0)));
+        tasks.push_back(BusyYield(ios.back(), 20, &moved));
+        sched.spawn(ios.back(), tasks.back());
+    }
+    EXPECT_TRUE(sched.run(NULL, NULL, NULL));
+    for (int i = 0; i < kTasks; i++) {
+        EXPECT_TRUE(tasks[i].done());
+    }
+    EXPECT_GT(sched.total_stolen(), 0u);
+    EXPECT_GT(moved.load(), 0);
+    EXPECT_EQ(sched.total_resumed(), uint64_t(kTasks) * 21);
+    tasks.clear();
+    for (int i = 0; i < kTasks; i++) {
+        delete ios[i];
+    }
+}
+
+TEST(CoSchedulerTest, ParsesCpuList) {
+    std::vector<int> cpus;
+    EXPECT_TRUE(ParseCpuList("0-3,8,10-11\n", cpus));
+    EXPECT_EQ(cpus, std::vector<int>({0, 1, 2, 3, 8, 10, 11}));
+    cpus.clear();
+    EXPECT_TRUE(ParseCpuList("\n", cpus));
+    EXPECT_TRUE(cpus.empty());
+    EXPECT_FALSE(ParseCpuList("3-1", cpus));
+    EXPECT_FALSE(ParseCpuList("a", cpus));
+}
+
+TEST(CoSchedulerTest, CpuTopologyCoversAffinity) {
+    std::vector<std::pair<int, int> > node_cpus;
+    std::ostringstream err;
+    ASSERT_TRUE(GetCpuTopology(node_cpus, err)) << err.str();
+    cpu_set_t allowed;
+    ASSERT_EQ(sched_getaffinity(0, sizeof(allowed), &allowed), 0);
+    EXPECT_EQ(int(node_cpus.size()), CPU_COUNT(&allowed));
+    EXPECT_TRUE(std::is_sorted(node_cpus.begin(), node_cpus.end()));
+}
@@ -0,0 +1,183 @@
+#include "gtest/gtest.h"
+#include "event_log.h"
+#include "event_trace.h"
+#include <fstream>
+#include <thread>
+
+namespace {
+
+std::string TestPath(const char *name) {
+    return std::string("/tmp/robot_event_test.") + name + "." + std::to_string(getpid());
+}
+
+EventRecord Record(uint64_t usec, uint32_t seq) {
+    EventRecord record;
+    memset(&record, 0, sizeof(record));
+    record.usec = usec;
+    record.seq = seq;
+    record.kind = kEventRequest;
+    return record;
+}
+
+} // namespace
+
+TEST(EventLogTest, ReaderSeesWhatWriterAppended) {
+    std::string path = TestPath("rw");
+    EventLogWriter writer;
+    std::ostringstream err;
+    ASSERT_TRUE(writer.open(path, 3, 16, 100, 200, err)) << err.str();
+    for (uint32_t i = 1; i <= 5; i++) {
+        writer.append(Record(1000 + i, i));
+    }
+    EXPECT_EQ(writer.appended(), 5u);
+
+    // Readable while the writer still has it mapped, and after it is closed.
+    EventLogHeader header;
+    std::vector<EventRecord> records;
+    ASSERT_TRUE(ReadEventLog(path, header, records, err)) << err.str();
+    EXPECT_EQ(records.size(), 5u);
+    writer.close();
+    records.clear();
+    ASSERT_TRUE(ReadEventLog(path, header, records, err)) << err.str();
+    EXPECT_EQ(header.writer_index, 3u);
+    EXPECT_EQ(header.capacity, 16u);
+    EXPECT_EQ(header.start_usec, 100u);
+    EXPECT_EQ(header.start_unix_usec, 200u);
+    EXPECT_EQ(header.pid, getpid());
+    ASSERT_EQ(records.size(), 5u);
+    EXPECT_EQ(records[0].seq, 1u);
+    EXPECT_EQ(records[4].usec, 1005u);
+    unlink(path.c_str());
+}
+
+TEST(EventLogTest, RingKeepsTheNewestRecords) {
+    std::string path = TestPath("ring");
+    EventLogWriter writer;
+    std::ostringstream err;
+    ASSERT_TRUE(writer.open(path, 0, 4, 0, 0, err)) << err.str();
+    for (uint32_t i = 1; i <= 10; i++) {
+        writer.append(Record(i, i));
+    }
+    writer.close();
+
+    EventLogHeader header;
+    std::vector<EventRecord> records;
+    ASSERT_TRUE(ReadEventLog(path, header, records, err)) << err.str();
+    EXPECT_EQ(header.appended.load(), 10u);
+    ASSERT_EQ(records.size(), 4u);
+    for (uint32_t i = 0; i < 4; i++) {
+        EXPECT_EQ(records[i].seq, 7 + i);
+    }
+    unlink(path.c_str());
+}
+
+TEST(EventLogTest, ConcurrentAppendsAreAllKept) {
+    std::string path = TestPath("mt");
+    EventLogWriter writer;
+    std::ostringstream err;
+    const int kThreads = 4, kPerThread = 10000;
+    ASSERT_TRUE(writer.open(path, 0, kThreads * kPerThread, 0, 0, err)) << err.str();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; t++) {
+        threads.push_back(std::thread([&writer, t]() {
+            for (int i = 1; i <= kPerThread; i++) {
+                EventRecord record = Record(i, i);
+                record.client = t;
+                writer.append(record);
+            }
+        }));
+    }
+    for (size_t t = 0; t < threads.size(); t++) {
+        threads[t].join();
+    }
+    writer.close();
+
+    EventLogHeader header;
+    std::vector<EventRecord> records;
+    ASSERT_TRUE(ReadEventLog(path, header, records, err)) << err.str();
+    ASSERT_EQ(records.size(), size_t(kThreads * kPerThread));
+    std::vector<uint64_t> sums(kThreads, 0);
+    for (size_t i = 0; i < records.size(); i++) {
+        ASSERT_LT(records[i].client, uint32_t(kThreads));
+        sums[records[i].client] += records[i].seq;
+    }
+    for (int t = 0; t < kThreads; t++) {
+        EXPECT_EQ(sums[t], uint64_t(kPerThread) * (kPerThread + 1) / 2);
+    }
+    unlink(path.c_str());
+}
+
+TEST(EventLogTest, ReaderRejectsOtherFiles) {
+    std::string path = TestPath("bad");
+    std::ofstream(path.c_str()) << std::string(8192, 'x');
+    EventLogHeader header;
+    std::vector<EventRecord> records;
+    std::ostringstream err;
+    EXPECT_FALSE(ReadEventLog(path, header, records, err));
+    unlink(path.c_str());
+}
+
+TEST(EventLogTest, TraceWritesMetaAndTypedEvents) {
+    pbcfg::CfgRoot cfg;
+    pbcfg::Group *group = cfg.add_group_config();
+    group->set_name("login group");
+    pbcfg::Action *action = group->add_action();
+    action->add_request_uniq_name("NoSuchRequest");
+    action->add_response("pbcfg.Client");
+    action->add_response("google.protobuf.Empty");
+
+    std::string prefix = TestPath("trace");
+    EVENT_LOG.configure(prefix, 1);
+    std::ostringstream err;
+    ASSERT_TRUE(EVENT_LOG.start(cfg, 2, err)) << err.str();
+    // Request types fall back to the uniq name when it is not a loaded request.
+    EXPECT_EQ(EVENT_LOG.request_type(0, 0), EVENT_LOG.type_id("NoSuchRequest"));
+    EXPECT_EQ(EVENT_LOG.response_type(0, 0, 1), EVENT_LOG.type_id("google.protobuf.Empty"));
+    EXPECT_EQ(EVENT_LOG.type_id("pbcfg.Other"), kEventNoType);
+    EXPECT_EQ(EVENT_LOG.writer(3), EVENT_LOG.writer(1));
+    EXPECT_EQ(EventTrace(EVENT_LOG.writer(0), 7, -1).writer, (EventLogWriter *)NULL);
+
+    EventTrace trace(EVENT_LOG.writer(1), 10001, 0);
+    trace.connect(kEventOk, 50);
+    trace.request(0, 5, 64);
+    trace.response(0, "google.protobuf.Empty", kEventOk, 5, 300, 20);
+    trace.response(0, "pbcfg.Other", kEventOk, 5, 310, 20);
+    trace.response(-1, "pbcfg.Client", kEventLate, 4, 0, 20);
+    trace.action_done(0, kEventTimedOut, 5, 1000);
+    trace.client_stop(kEventFailed);
+    EVENT_LOG.stop();
+    EVENT_LOG.configure("", 1);
+
+    std::ifstream meta((prefix + ".meta").c_str());
+    std::string text((std::istreambuf_iterator<char>(meta)), std::istreambuf_iterator<char>());
+    EXPECT_NE(text.find("group 0 login group\n"), std::string::npos);
+    EXPECT_NE(text.find("action 0 0 NoSuchRequest\n"), std::string::npos);
+    EXPECT_NE(text.find("type 2 google.protobuf.Empty\n"), std::string::npos);
+
+    EventLogHeader header;
+    std::vector<EventRecord> records;
+    ASSERT_TRUE(ReadEventLog(prefix + ".0.bin", header, records, err)) << err.str();
+    EXPECT_TRUE(records.empty());
+    ASSERT_TRUE(ReadEventLog(prefix + ".1.bin", header, records, err)) << err.str();
+    ASSERT_EQ(records.size(), 7u);
+    EXPECT_EQ(records[0].kind, kEventConnect);
+    EXPECT_EQ(records[0].client, 10001u);
+    EXPECT_EQ(records[0].action, kEventNoAction);
+    EXPECT_EQ(records[1].kind, kEventRequest);
+    EXPECT_EQ(records[1].bytes, 64u);
+    EXPECT_EQ(records[2].status, kEventOk);
+    EXPECT_EQ(records[2].type, 2);
+    EXPECT_EQ(records[2].latency, 300u);
+    // Not a response the action waits for.
+    EXPECT_EQ(records[3].status, kEventUnmatched);
+    EXPECT_EQ(records[3].type, kEventNoType);
+    EXPECT_EQ(records[4].status, kEventLate);
+    EXPECT_EQ(records[4].type, 1);
+    EXPECT_EQ(records[5].kind, kEventAction);
+    EXPECT_EQ(records[5].status, kEventTimedOut);
+    EXPECT_EQ(records[6].kind, kEventClientStop);
+    EXPECT_EQ(records[6].status, kEventFailed);
+    unlink((prefix + ".meta").c_str());
+    unlink((prefix + ".0.bin").c_str());
+    unlink((prefix + ".1.bin").c_str());
+}
@@ -0,0 +1,84 @@
+#include "gtest/gtest.h"
+#include "frame_codec.h"
+#include "frame_config_types.h"
+#include <string>
+
+namespace {
+
+FrameFieldDef MakeField(const std::string& name, int size, FrameFieldDataType type,
+                        FrameFieldValueRule rule, std::int64_t literal = 0) {
+    FrameFieldDef field_def;
+    field_def.name = name;
+    field_def.size_bytes = size;
+    field_def.data_type = type;
+    field_def.value_rule = rule;
+    field_def.literal_value = literal;
+    return field_def;
+}
+
+// Renders the header both ways and checks they agree.
+void ExpectTemplateMatchesFields(const FrameHeaderConfig& config, size_t head_len, size_t body_len) {
+    FrameHeaderTemplate tpl;
+    ASSERT_TRUE(compile_frame_header_template(config, tpl));
+
+    std::string walked;
+    ASSERT_TRUE(render_frame_header_fields(config, head_len, body_len, walked));
+
+    std::string patched(tpl.bytes.size(), '\xff');
+    render_frame_header_template(tpl, head_len, body_len, &patched[0]);
+    EXPECT_EQ(walked, patched);
+}
+
+} // namespace
+
+TEST(FrameCodecTest, DefaultLayout) {
+    FrameHeaderConfig config;
+    config.fields.push_back(MakeField("total", 4, FrameFieldDataType::UINT32_BE,
+                                      FrameFieldValueRule::CALC_TOTAL_PACKET_LENGTH));
+    config.fields.push_back(MakeField("head", 4, FrameFieldDataType::UINT32_BE,
+                                      FrameFieldValueRule::CALC_PROTOBUF_HEAD_LENGTH));
+
+    FrameHeaderTemplate tpl;
+    ASSERT_TRUE(compile_frame_header_template(config, tpl));
+    ASSERT_EQ(tpl.bytes.size(), 8u);
+    ASSERT_EQ(tpl.patches.size(), 2u);
+    EXPECT_EQ(tpl.patches[1].offset, 4);
+
+    char out[8];
+    render_frame_header_template(tpl, 10, 20, out);
+    EXPECT_EQ(std::string(out, 8), std::string("\x00\x00\x00\x26\x00\x00\x00\x0a", 8));
+
+    ExpectTemplateMatchesFields(config, 10, 20);
+}
+
+TEST(FrameCodecTest, MixedLiteralsAndEndianness) {
+    FrameHeaderConfig config;
+    config.fields.push_back(MakeField("magic", 2, FrameFieldDataType::UINT16_BE,
+                                      FrameFieldValueRule::LITERAL, 0xCAFE));
+    config.fields.push_back(MakeField("version", 1, FrameFieldDataType::UINT8,
+                                      FrameFieldValueRule::LITERAL, 3));
+    FrameFieldDef tag = MakeField("tag", 6, FrameFieldDataType::FIXED_STRING, FrameFieldValueRule::LITERAL);
+    tag.literal_value = std::string("ABC");
+    config.fields.push_back(tag);
+    config.fields.push_back(MakeField("total_le", 4, FrameFieldDataType::UINT32_LE,
+                                      FrameFieldValueRule::CALC_TOTAL_PACKET_LENGTH));
+    config.fields.push_back(MakeField("head16", 2, FrameFieldDataType::INT16_LE,
+                                      FrameFieldValueRule::CALC_PROTOBUF_HEAD_LENGTH));
+    config.fields.push_back(MakeField("seq", 8, FrameFieldDataType::INT64_BE,
+                                      FrameFieldValueRule::LITERAL, -2));
+    config.fields.push_back(MakeField("total64", 8, FrameFieldDataType::UINT64_BE,
+                                      FrameFieldValueRule::CALC_TOTAL_PACKET_LENGTH));
+
+    ExpectTemplateMatchesFields(config, 0, 0);
+    ExpectTemplateMatchesFields(config, 300, 70000);
+}
+
+TEST(FrameCodecTest, RejectsStringForNumericField) {
+    FrameHeaderConfig config;
+    FrameFieldDef bad = MakeField("magic", 4, FrameFieldDataType::UINT32_BE, FrameFieldValueRule::LITERAL);
+    bad.literal_value = std::string("oops");
+    config.fields.push_back(bad);
+
+    FrameHeaderTemplate tpl;
+    EXPECT_FALSE(compile_frame_header_template(config, tpl));
+}
@@ -0,0 +1,51 @@
+#include "gtest/gtest.h"
+#include "io_buffer.h"
+#include <string>
+
+TEST(IoBufferTest, ConsumeAdvancesCursorWithoutCopy) {
+    IoBuffer buf(64, 256);
+    buf.append("aaaabbbbcccc", 12);
+    const char *start = buf.readable();
+
+    buf.consume(4);
+    EXPECT_EQ(buf.size(), 8);
+    EXPECT_EQ(buf.readable(), start + 4); // no memmove, the cursor just moved
+    EXPECT_EQ(std::string(buf.readable(), 4), "bbbb");
+
+    buf.consume(8);
+    EXPECT_TRUE(buf.empty());
+    EXPECT_EQ(buf.readable(), start); // cursors reset once drained
+}
+
+TEST(IoBufferTest, CompactsPartialFrameWhenTailIsFull) {
+    IoBuffer buf(16, 256);
+    buf.append("0123456789ABCDEF", 16);
+    buf.consume(12);
+
+    // Only the 4 live bytes are moved to the front to make room.
+    buf.append("xyz", 3);
+    EXPECT_EQ(buf.capacity(), 16);
+    EXPECT_EQ(std::string(buf.readable(), buf.size()), "CDEFxyz");
+}
+
+TEST(IoBufferTest, GrowsAndShrinksAboveWatermark) {
+    IoBuffer buf(16, 32);
+    std::string big(100, 'z');
+    buf.append(big.data(), big.size());
+    EXPECT_GE(buf.capacity(), 100);
+    EXPECT_EQ(std::string(buf.readable(), buf.size()), big);
+
+    buf.consume(50);
+    EXPECT_GE(buf.capacity(), 100); // still holds data
+    buf.consume(50);
+    EXPECT_EQ(buf.capacity(), 16); // drained above the watermark: back to initial size
+}
+
+TEST(IoBufferTest, WritableAndCommit) {
+    IoBuffer buf(8, 64);
+    char *p = buf.writable(20);
+    EXPECT_GE(buf.writable_size(), 20);
+    memcpy(p, "hello", 5);
+    buf.commit(5);
+    EXPECT_EQ(std::string(buf.readable(), buf.size()), "hello");
+}
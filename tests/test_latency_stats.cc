@@ -0,0 +1,140 @@
+#include "gtest/gtest.h"
+#include "latency_stats.h"
+#include <thread>
+#include <vector>
+
+TEST(LatencySnapshotTest, BucketsBoundRelativeError) {
+    for (uint64_t v = 0; v < 64; v++) {
+        EXPECT_EQ(LatencySnapshot::bucket_upper(LatencySnapshot::bucket_index(v)), v);
+    }
+    const uint64_t samples[] = { 64, 65, 127, 128, 1000, 4095, 123456, 9999999, LatencySnapshot::kMaxValue };
+    for (size_t i = 0; i < sizeof(samples) / sizeof(samples[0]); i++) {
+        uint64_t v = samples[i];
+        uint64_t upper = LatencySnapshot::bucket_upper(LatencySnapshot::bucket_index(v));
+        EXPECT_GE(upper, v);
+        EXPECT_LE(upper - v, v / LatencySnapshot::kSubBucketCount) << v;
+    }
+    EXPECT_EQ(LatencySnapshot::bucket_index(LatencySnapshot::kMaxValue + 12345),
+              LatencySnapshot::kBucketCount - 1);
+}
+
+TEST(LatencySnapshotTest, Percentiles) {
+    LatencySnapshot snapshot;
+    for (uint64_t v = 1; v <= 1000; v++) {
+        snapshot.record(v);
+    }
+    EXPECT_EQ(snapshot.count(), 1000u);
+    EXPECT_EQ(snapshot.max(), 1000u);
+    EXPECT_NEAR(double(snapshot.value_at_percentile(50)), 500.0, 500.0 / 64);
+    EXPECT_NEAR(double(snapshot.value_at_percentile(99)), 990.0, 990.0 / 64);
+    EXPECT_EQ(snapshot.value_at_percentile(100), 1000u);
+    EXPECT_EQ(LatencySnapshot().value_at_percentile(50), 0u);
+}
+
+class LatencyStatsTest : public ::testing::Test {
+protected:
+    pbcfg::CfgRoot cfg;
+
+    void SetUp() override {
+        pbcfg::Group *group = cfg.add_group_config();
+        group->set_name("g1");
+        group->set_peer_addr("127.0.0.1:1");
+        group->set_max_pkg_len(1024);
+        group->set_has_checksum(false);
+        group->set_client_count(1);
+        pbcfg::Action *action = group->add_action();
+        action->add_response("pbcfg.Client");
+        action->add_response("pbcfg.Body");
+        LATENCY_STATS.init(cfg, 4);
+    }
+    void TearDown() override {
+        LATENCY_STATS.clear();
+    }
+};
+
+TEST_F(LatencyStatsTest, MergesAcrossRecorders) {
+    const pbcfg::Group *group = &cfg.group_config(0);
+    ASSERT_EQ(LATENCY_STATS.group_index(group), 0);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < LATENCY_STATS.recorder_num(); t++) {
+        threads.push_back(std::thread([t]() {
+            GroupLatency *latency = LATENCY_STATS.recorder(t, 0);
+            for (int n = 0; n < 1000; n++) {
+                latency->record_response(0, "pbcfg.Client", 100 + t);
+                latency->record_response(0, "pbcfg.Unexpected", 1);
+                latency->record_action(0, 200 + t);
+            }
+        }));
+    }
+    for (size_t i = 0; i < threads.size(); i++) {
+        threads[i].join();
+    }
+
+    LatencySnapshot action, client, body;
+    LATENCY_STATS.merge(0, 0, 0, action);
+    LATENCY_STATS.merge(0, 0, 1, client);
+    LATENCY_STATS.merge(0, 0, 2, body);
+    EXPECT_EQ(action.count(), 4000u);
+    EXPECT_EQ(action.max(), 203u);
+    EXPECT_EQ(client.count(), 4000u);
+    EXPECT_EQ(client.value_at_percentile(50), 101u);
+    EXPECT_EQ(body.count(), 0u);
+}
+
+TEST_F(LatencyStatsTest, SplitsCountersByPeer) {
+    std::vector<PeerSummary> peers;
+    LATENCY_STATS.peer_summaries(0, peers);
+    EXPECT_TRUE(peers.empty()); // a single peer is not reported separately
+
+    cfg.mutable_group_config(0)->add_peer("127.0.0.1:2");
+    LATENCY_STATS.init(cfg, 2);
+    PeerSet *peer_set = LATENCY_STATS.peers(0);
+    ASSERT_EQ(peer_set->size(), 2);
+    GroupLatency *first = LATENCY_STATS.recorder(0, 0);
+    GroupLatency *second = LATENCY_STATS.recorder(1, 0);
+    first->record_connect(50, 0);
+    second->record_connect(70, 1);
+    second->record_connect_timeout(1);
+    first->record_request(0, 0);
+    first->record_action(0, 100, 0);
+    second->record_request(0, 1);
+    second->record_request(0, 1);
+    second->record_action(0, 900, 1);
+
+    LATENCY_STATS.peer_summaries(0, peers);
+    ASSERT_EQ(peers.size(), 2u);
+    EXPECT_EQ(peers[0].addr, "127.0.0.1:1");
+    EXPECT_EQ(peers[1].addr, "127.0.0.1:2");
+    EXPECT_EQ(peers[0].counters.connects, 1u);
+    EXPECT_EQ(peers[1].counters.connect_timeouts, 1u);
+    EXPECT_EQ(peers[1].connect.max(), 70u);
+    EXPECT_EQ(peers[0].counters.in_flight(), 0u);
+    EXPECT_EQ(peers[1].counters.in_flight(), 1u);
+    EXPECT_EQ(peers[0].latency.max(), 100u);
+    EXPECT_EQ(peers[1].latency.max(), 900u);
+
+    // The group totals still cover every peer.
+    GroupCounters counters;
+    LATENCY_STATS.counters(0, counters);
+    EXPECT_EQ(counters.connects, 2u);
+    EXPECT_EQ(counters.requests, 3u);
+
+    std::ostringstream out;
+    LATENCY_STATS.write_prometheus(out);
+    EXPECT_NE(out.str().find("robot_peer_requests_total{group=\"g1\",peer=\"127.0.0.1:2\"} 2"), std::string::npos)
+        << out.str();
+    EXPECT_NE(out.str().find("robot_peer_inflight_requests{group=\"g1\",peer=\"127.0.0.1:2\"} 1"), std::string::npos);
+}
+
+TEST(GroupCountersTest, GaugesNeverWrap) {
+    GroupCounters counters;
+    counters.connects = 2;
+    counters.disconnects = 3;
+    counters.requests = 1;
+    counters.completed = 2;
+    EXPECT_EQ(counters.connected(), 0u);
+    EXPECT_EQ(counters.in_flight(), 0u);
+    counters.connects = 5;
+    EXPECT_EQ(counters.connected(), 2u);
+}
@@ -0,0 +1,132 @@
+#include "gtest/gtest.h"
+#include "load_profile.h"
+#include "latency_stats.h"
+
+namespace {
+
+pbcfg::Group MakeGroup(int clients, int ramp_up_ms, int steady_ms, int ramp_down_ms) {
+    pbcfg::Group group;
+    group.set_name("g1");
+    group.set_peer_addr("127.0.0.1:1");
+    group.set_max_pkg_len(1024);
+    group.set_has_checksum(false);
+    group.set_client_count(clients);
+    group.add_action()->add_response("pbcfg.Client");
+    if (ramp_up_ms || steady_ms || ramp_down_ms) {
+        group.mutable_load()->set_ramp_up(ramp_up_ms);
+        group.mutable_load()->set_steady(steady_ms);
+        group.mutable_load()->set_ramp_down(ramp_down_ms);
+    }
+    return group;
+}
+
+} // namespace
+
+TEST(LoadProfileTest, WithoutLoadRunsLoopCount) {
+    pbcfg::Group group = MakeGroup(10, 0, 0, 0);
+    group.set_loop_count(3);
+    LoadProfile profile(group);
+    profile.start(1000);
+    EXPECT_FALSE(profile.time_bounded());
+    EXPECT_FALSE(profile.phased());
+    EXPECT_EQ(profile.client_start(9), 1000u);
+    EXPECT_EQ(profile.client_stop(9), UINT64_MAX);
+    EXPECT_TRUE(profile.next_loop(0, 2, UINT64_MAX - 1));
+    EXPECT_FALSE(profile.next_loop(0, 3, 1000));
+    EXPECT_EQ(profile.phase(0), kPhaseSteady);
+
+    group.set_loop_count(0);
+    EXPECT_FALSE(LoadProfile(group).next_loop(0, 0, 0));
+}
+
+TEST(LoadProfileTest, LinearRampStartsAndStopsInReverseOrder) {
+    pbcfg::Group group = MakeGroup(4, 400, 1000, 200);
+    LoadProfile profile(group);
+    const uint64_t t0 = 1000000;
+    profile.start(t0);
+    EXPECT_TRUE(profile.time_bounded());
+    EXPECT_TRUE(profile.phased());
+
+    // Ramp-up: client i starts at 400ms * i / 4.
+    EXPECT_EQ(profile.client_start(0), t0);
+    EXPECT_EQ(profile.client_start(1), t0 + 100000);
+    EXPECT_EQ(profile.client_start(3), t0 + 300000);
+    // Ramp-down: the last client to start is the first to stop.
+    EXPECT_EQ(profile.client_stop(3), t0 + 1400000 + 50000);
+    EXPECT_EQ(profile.client_stop(0), t0 + 1400000 + 200000);
+
+    EXPECT_EQ(profile.active_clients(t0), 1);
+    EXPECT_EQ(profile.active_clients(t0 + 350000), 4);
+    EXPECT_EQ(profile.active_clients(t0 + 1500000), 2);
+    EXPECT_EQ(profile.active_clients(t0 + 1600000), 0);
+
+    // Time-bounded: loop_count no longer limits the run.
+    EXPECT_TRUE(profile.next_loop(0, 1000, t0 + 1599999));
+    EXPECT_FALSE(profile.next_loop(0, 0, t0 + 1600000));
+
+    EXPECT_EQ(profile.phase(t0 + 399999), kPhaseRampUp);
+    EXPECT_EQ(profile.phase(t0 + 400000), kPhaseSteady);
+    EXPECT_EQ(profile.phase(t0 + 1400000), kPhaseRampDown);
+}
+
+TEST(LoadProfileTest, StepRampStartsClientsInBatches) {
+    pbcfg::Group group = MakeGroup(8, 400, 0, 400);
+    group.mutable_load()->set_shape(pbcfg::RAMP_STEP);
+    group.mutable_load()->set_steps(2);
+    LoadProfile profile(group);
+    profile.start(0);
+    for (int i = 0; i < 4; i++) {
+        EXPECT_EQ(profile.client_start(i), 0u) << i;
+        EXPECT_EQ(profile.client_stop(i), 800000u) << i;
+    }
+    for (int i = 4; i < 8; i++) {
+        EXPECT_EQ(profile.client_start(i), 200000u) << i;
+        EXPECT_EQ(profile.client_stop(i), 600000u) << i;
+    }
+    EXPECT_EQ(profile.active_clients(100000), 4);
+    EXPECT_EQ(profile.active_clients(300000), 8);
+    EXPECT_EQ(profile.active_clients(700000), 4);
+}
+
+TEST(LoadProfileTest, SteadyOnlyIsTimeBoundedButNotPhased) {
+    LoadProfile profile(MakeGroup(2, 0, 500, 0));
+    profile.start(0);
+    EXPECT_TRUE(profile.time_bounded());
+    EXPECT_FALSE(profile.phased());
+    EXPECT_EQ(profile.client_start(1), 0u);
+    EXPECT_EQ(profile.client_stop(1), 500000u);
+    EXPECT_EQ(profile.phase(600000), kPhaseSteady);
+}
+
+TEST(LoadProfileTest, LatencyIsTaggedByPhase) {
+    pbcfg::CfgRoot cfg;
+    *cfg.add_group_config() = MakeGroup(1, 60000, 60000, 0);
+    LATENCY_STATS.init(cfg, 1);
+    GroupLatency *latency = LATENCY_STATS.recorder(0, 0);
+    ASSERT_EQ(latency->phase_num(), int(kLoadPhaseNum));
+
+    // Started just now: everything sent is warm-up traffic.
+    LATENCY_STATS.start(now_usec());
+    latency->record_action(0, 10);
+    latency->record_timeout(0, 10);
+    // Started 90s ago: past the 60s ramp-up, in the steady state.
+    LATENCY_STATS.start(now_usec() - 90000000);
+    latency->record_action(0, 20);
+    latency->record_action(0, 30);
+    latency->record_timeout(0, 20);
+    // Timed out now, but sent 40s ago during ramp-up: counted where it was sent.
+    latency->record_timeout(0, 40000000);
+
+    LatencySnapshot ramp_up, steady, all;
+    LATENCY_STATS.merge(0, 0, 0, ramp_up, kPhaseRampUp);
+    LATENCY_STATS.merge(0, 0, 0, steady, kPhaseSteady);
+    LATENCY_STATS.merge(0, 0, 0, all);
+    EXPECT_EQ(ramp_up.count(), 1u);
+    EXPECT_EQ(steady.count(), 2u);
+    EXPECT_EQ(steady.max(), 30u);
+    EXPECT_EQ(all.count(), 3u);
+    EXPECT_EQ(LATENCY_STATS.timeouts(0, 0, kPhaseRampUp), 2u);
+    EXPECT_EQ(LATENCY_STATS.timeouts(0, 0, kPhaseSteady), 1u);
+    EXPECT_EQ(LATENCY_STATS.timeouts(0, 0), 3u);
+    LATENCY_STATS.clear();
+}
@@ -0,0 +1,129 @@
+#include "gtest/gtest.h"
+#include "message_pool.h"
+#include "flags.h"
+#include "robot.pb.h"
+#include "client.h"
+#include <new>
+
+namespace {
+
+// Heap allocations made by this thread while counting is on (seeto: operator new below)
+thread_local bool g_count_allocs = false;
+thread_local uint64_t g_allocs = 0;
+
+// A frame whose body has strings and repeated fields, so parsing it needs more than the message object.
+std::string ActionFrame(Client &codec) {
+    pbcfg::CsMsgHead head;
+    head.set_msg_type_name("pbcfg.Action");
+    head.set_uid(7);
+    head.set_role_tm(9);
+    head.set_ret(0);
+    head.set_seq(1);
+    pbcfg::Action body;
+    body.add_request_uniq_name("a request name longer than the small string buffer");
+    body.add_request_uniq_name("another request name longer than the small string buffer");
+    body.add_response("pbcfg.SomeResponseTypeWithALongName");
+    body.set_timeout(3);
+    std::string pkg;
+    codec.encode(head, body, pkg);
+    return pkg;
+}
+
+// Heap allocations made while decoding pkg count times, releasing both messages to this thread's pool
+uint64_t CountDecodeAllocations(Client &codec, const std::string &pkg, int count) {
+    g_allocs = 0;
+    g_count_allocs = true;
+    for (int i = 0; i < count; i++) {
+        Message *head = NULL, *body = NULL;
+        codec.decode(pkg, &head, &body);
+        MessagePool::local().release(head);
+        MessagePool::local().release(body);
+    }
+    g_count_allocs = false;
+    return g_allocs;
+}
+
+} // namespace
+
+void *operator new(size_t size) {
+    if (g_count_allocs) {
+        g_allocs++;
+    }
+    void *p = malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+// Out of line, so the compiler does not pair the inlined free() with a new-expression and warn
+__attribute__((noinline)) static void FreeMemory(void *p) { free(p); }
+
+void operator delete(void *p) noexcept { FreeMemory(p); }
+void operator delete(void *p, size_t) noexcept { FreeMemory(p); }
+
+TEST(MessagePoolTest, ReusesReleasedMessage) {
+    MessagePool pool;
+    Message *first = pool.acquire("pbcfg.CsMsgHead");
+    ASSERT_TRUE(first != NULL);
+    pool.release(first);
+
+    Message *second = pool.acquire("pbcfg.CsMsgHead");
+    EXPECT_EQ(second, first);
+    EXPECT_EQ(pool.acquired(), 2u);
+    EXPECT_EQ(pool.created(), 1u);
+    pool.release(second);
+}
+
+TEST(MessagePoolTest, KeepsFreeListsPerType) {
+    MessagePool pool;
+    Message *head = pool.acquire("pbcfg.CsMsgHead");
+    ASSERT_TRUE(head != NULL);
+    pool.release(head);
+
+    Message *other = pool.acquire("pbcfg.Client");
+    ASSERT_TRUE(other != NULL);
+    EXPECT_NE(other, head);
+    EXPECT_EQ(other->GetTypeName(), "pbcfg.Client");
+    pool.release(other);
+}
+
+TEST(MessagePoolTest, UnknownTypeReturnsNull) {
+    MessagePool pool;
+    EXPECT_TRUE(pool.acquire("pbcfg.NoSuchMessage") == NULL);
+    pool.release(NULL);
+}
+
+TEST(MessagePoolTest, DisabledPoolAllocatesEveryTime) {
+    FLAGS_message_pool = false;
+    MessagePool pool;
+    Message *first = pool.acquire("pbcfg.CsMsgHead");
+    pool.release(first);
+    Message *second = pool.acquire("pbcfg.CsMsgHead");
+    ASSERT_TRUE(second != NULL);
+    pool.release(second);
+    FLAGS_message_pool = true;
+
+    EXPECT_EQ(pool.acquired(), 2u);
+    EXPECT_EQ(pool.created(), 2u);
+}
+
+TEST(MessagePoolTest, WarmPoolDecodesWithoutAllocating) {
+    Client codec(8192, false);
+    std::string pkg = ActionFrame(codec);
+    Message *head = NULL, *body = NULL;
+    ASSERT_TRUE(codec.decode(pkg, &head, &body));
+    EXPECT_EQ(body->GetTypeName(), "pbcfg.Action");
+    MessagePool::local().release(head);
+    MessagePool::local().release(body);
+
+    // Reused messages keep the space of their strings and repeated fields, so decoding the same
+    // shape again touches the allocator not even once.
+    EXPECT_EQ(CountDecodeAllocations(codec, pkg, 100), 0u);
+
+    FLAGS_message_pool = false;
+    uint64_t allocs = CountDecodeAllocations(codec, pkg, 100);
+    FLAGS_message_pool = true;
+    // Without the pool every decode creates both messages and everything inside the body.
+    EXPECT_GE(allocs, 100u * 5);
+}
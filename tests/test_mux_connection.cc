@@ -0,0 +1,154 @@
+#include "gtest/gtest.h"
+#include "mux_connection.h"
+#include "client_session.h"
+#include "config.h"
+#include "message_pool.h"
+#include "frame_server.h"
+
+namespace {
+
+const char kUniqName[] = "mux_test_req";
+
+class MuxConnectionTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        std::ostringstream err;
+        ASSERT_TRUE(loop.init(err)) << err.str();
+        body.set_uniq_name(kUniqName);
+        body.set_type_name("pbcfg.Client");
+        body.set_text("uid: 7 role_time: 9");
+        UniqRequest *req = new UniqRequest(&body, new pbcfg::Client);
+        ASSERT_TRUE(req->compile_body(err)) << err.str();
+        uniq_name_map[kUniqName] = req;
+
+        group.set_name("mux");
+        group.set_max_pkg_len(8192);
+        group.set_has_checksum(false);
+        group.set_loop_count(5);
+        group.set_mux_clients(kClients);
+        pbcfg::Action *action = group.add_action();
+        action->add_request_uniq_name(kUniqName);
+        action->add_response("pbcfg.Client");
+        action->set_timeout(5);
+        for (int i = 0; i < kClients; i++) {
+            pbcfg::Client *client = group.add_client();
+            client->set_uid(100 + i);
+            client->set_role_time(1);
+        }
+        group.set_client_count(kClients);
+    }
+    void TearDown() override {
+        delete uniq_name_map[kUniqName];
+        uniq_name_map.erase(kUniqName);
+    }
+
+    // Runs every client of the group over one shared connection to addr until all are done.
+    void Run(const std::string &addr) {
+        group.set_peer_addr(addr);
+        latency.reset(new GroupLatency(group));
+        MuxConnection mux(group, &loop, latency.get(), NULL, NULL);
+        RunOn(mux);
+    }
+
+    // Starts a fresh set of sessions for every client on mux and runs the loop until all are done.
+    void RunOn(MuxConnection &mux) {
+        LoadProfile profile(group);
+        std::vector<ClientSession *> sessions;
+        for (int i = 0; i < kClients; i++) {
+            sessions.push_back(new ClientSession(group, group.client(i), &loop, latency.get(), NULL, NULL, NULL,
+                                                 &profile, i, &mux));
+        }
+        for (int i = 0; i < kClients; i++) {
+            sessions[i]->start();
+        }
+        loop.run();
+        // On io_uring the close of the shared connection is only queued; submit it so the server sees it.
+        loop.poll(0);
+        for (int i = 0; i < kClients; i++) {
+            EXPECT_TRUE(sessions[i]->finished());
+            delete sessions[i];
+        }
+        EXPECT_EQ(mux.sessions(), 0);
+    }
+
+    // The peer closes the first shared connection; the next sessions reconnect through the same mux.
+    void ExpectReconnectAfterClose() {
+        FrameServer server("", true);
+        group.set_peer_addr(server.addr());
+        latency.reset(new GroupLatency(group));
+        MuxConnection mux(group, &loop, latency.get(), NULL, NULL);
+        RunOn(mux);
+        EXPECT_EQ(latency->errors(), uint64_t(kClients));
+        EXPECT_EQ(latency->completed(), 0u);
+
+        RunOn(mux);
+        EXPECT_EQ(server.accepted(), 2);
+        EXPECT_EQ(latency->connects(), 2u);
+        EXPECT_EQ(latency->disconnects(), 2u);
+        EXPECT_EQ(latency->errors(), uint64_t(kClients));
+        EXPECT_EQ(latency->completed(), uint64_t(kClients * group.loop_count()));
+    }
+
+    static const int kClients = 4;
+    EventLoop loop;
+    pbcfg::Body body;
+    pbcfg::Group group;
+    std::unique_ptr<GroupLatency> latency;
+};
+
+} // namespace
+
+TEST_F(MuxConnectionTest, ClientsShareOneConnection) {
+    FrameServer server;
+    Run(server.addr());
+    EXPECT_EQ(server.accepted(), 1);
+    EXPECT_EQ(latency->connects(), 1u);
+    EXPECT_EQ(latency->disconnects(), 1u);
+    EXPECT_EQ(latency->errors(), 0u);
+    EXPECT_EQ(latency->requests(), uint64_t(kClients * group.loop_count()));
+    EXPECT_EQ(latency->completed(), latency->requests());
+    EXPECT_EQ(latency->unmatched_responses(), 0u);
+}
+
+TEST_F(MuxConnectionTest, DropsResponsesForUnknownUid) {
+    pbcfg::CsMsgHead head;
+    head.set_msg_type_name("pbcfg.Client");
+    head.set_uid(4242);
+    head.set_role_tm(1);
+    head.set_ret(0);
+    head.set_seq(1);
+    pbcfg::Client stray_body;
+    stray_body.set_uid(4242);
+    stray_body.set_role_time(1);
+    Client codec(8192, false);
+    std::string stray;
+    ASSERT_TRUE(codec.encode(head, stray_body, stray));
+
+    FrameServer server(stray);
+    Run(server.addr());
+    EXPECT_EQ(latency->unmatched_responses(), 1u);
+    EXPECT_EQ(latency->errors(), 0u);
+    EXPECT_EQ(latency->completed(), uint64_t(kClients * group.loop_count()));
+}
+
+TEST_F(MuxConnectionTest, PeerCloseEndsEveryClient) {
+    FrameServer server("", true);
+    Run(server.addr());
+    EXPECT_EQ(server.accepted(), 1);
+    EXPECT_EQ(latency->connects(), 1u);
+    EXPECT_EQ(latency->disconnects(), 1u);
+    EXPECT_EQ(latency->errors(), uint64_t(kClients));
+    EXPECT_EQ(latency->completed(), 0u);
+}
+
+TEST_F(MuxConnectionTest, ReconnectsAfterPeerClose) {
+    ExpectReconnectAfterClose();
+}
+
+TEST_F(MuxConnectionTest, ReconnectsAfterPeerCloseOnUring) {
+    std::ostringstream err;
+    if (!loop.enable_uring(err)) {
+        GTEST_SKIP() << "io_uring not available: " << err.str();
+    }
+    ExpectReconnectAfterClose();
+}
@@ -0,0 +1,48 @@
+#include "gtest/gtest.h"
+#include "pb_master.h"
+#include "robot.pb.h"
+#include <memory>
+#include <thread>
+#include <vector>
+
+using protobuf_master::Message;
+
+TEST(PbMasterPrototypeTest, CachesResolvedPrototype) {
+    const Message *first = PB_MASTER.get_prototype("pbcfg.Action");
+    ASSERT_TRUE(first != NULL);
+    EXPECT_EQ(first, &pbcfg::Action::default_instance());
+    EXPECT_EQ(PB_MASTER.get_prototype("pbcfg.Action"), first);
+
+    std::unique_ptr<Message> msg(PB_MASTER.create_message("pbcfg.Action"));
+    ASSERT_TRUE(msg.get() != NULL);
+    EXPECT_EQ(msg->GetTypeName(), "pbcfg.Action");
+}
+
+TEST(PbMasterPrototypeTest, UnknownTypeIsNotCached) {
+    EXPECT_FALSE(PB_MASTER.preload_prototype("pbcfg.NoSuchMessage"));
+    EXPECT_TRUE(PB_MASTER.get_prototype("pbcfg.NoSuchMessage") == NULL);
+    EXPECT_TRUE(PB_MASTER.create_message("pbcfg.NoSuchMessage") == NULL);
+}
+
+TEST(PbMasterPrototypeTest, ConcurrentLookupsAgree) {
+    const char *types[] = { "pbcfg.Body", "pbcfg.Group", "pbcfg.CfgRoot", "pbcfg.Client" };
+    const int kThreads = 8;
+    std::vector<const Message *> seen(kThreads * 4);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; t++) {
+        threads.push_back(std::thread([&, t]() {
+            for (int i = 0; i < 4; i++) {
+                seen[t * 4 + i] = PB_MASTER.get_prototype(types[(t + i) % 4]);
+            }
+        }));
+    }
+    for (size_t i = 0; i < threads.size(); i++) {
+        threads[i].join();
+    }
+    for (int t = 0; t < kThreads; t++) {
+        for (int i = 0; i < 4; i++) {
+            ASSERT_TRUE(seen[t * 4 + i] != NULL);
+            EXPECT_EQ(seen[t * 4 + i]->GetTypeName(), types[(t + i) % 4]);
+        }
+    }
+}
@@ -0,0 +1,101 @@
+#include "gtest/gtest.h"
+#include "peer_set.h"
+#include <map>
+
+namespace {
+
+pbcfg::Group Peers(int num, pbcfg::PeerPolicy policy) {
+    pbcfg::Group group;
+    group.set_peer_addr("10.0.0.1:8000");
+    for (int i = 1; i < num; i++) {
+        group.add_peer("10.0.0." + std::to_string(1 + i) + ":8000");
+    }
+    group.set_peer_policy(policy);
+    return group;
+}
+
+} // namespace
+
+TEST(PeerSetTest, ValidatesAddresses) {
+    std::ostringstream err;
+    EXPECT_TRUE(PeerSet::validate(Peers(3, pbcfg::PEER_ROUND_ROBIN), err));
+    pbcfg::Group duplicated = Peers(2, pbcfg::PEER_ROUND_ROBIN);
+    duplicated.add_peer("10.0.0.1:8000");
+    EXPECT_FALSE(PeerSet::validate(duplicated, err));
+    pbcfg::Group empty = Peers(2, pbcfg::PEER_ROUND_ROBIN);
+    empty.add_peer("");
+    EXPECT_FALSE(PeerSet::validate(empty, err));
+}
+
+TEST(PeerSetTest, SinglePeerAlwaysPicksPeerAddr) {
+    PeerSet peers(Peers(1, pbcfg::PEER_LEAST_OUTSTANDING));
+    ASSERT_EQ(peers.size(), 1);
+    EXPECT_EQ(peers.addr(0), "10.0.0.1:8000");
+    for (uint32_t uid = 0; uid < 10; uid++) {
+        EXPECT_EQ(peers.pick(uid), 0);
+    }
+}
+
+TEST(PeerSetTest, RoundRobinCyclesPeers) {
+    PeerSet peers(Peers(3, pbcfg::PEER_ROUND_ROBIN));
+    ASSERT_EQ(peers.size(), 3);
+    EXPECT_EQ(peers.addr(2), "10.0.0.3:8000");
+    for (int i = 0; i < 9; i++) {
+        EXPECT_EQ(peers.pick(7), i % 3);
+    }
+}
+
+TEST(PeerSetTest, HashUidIsStableAndBalanced) {
+    const int kUids = 30000;
+    PeerSet peers(Peers(4, pbcfg::PEER_HASH_UID));
+    std::vector<int> counts(4, 0);
+    for (uint32_t uid = 0; uid < kUids; uid++) {
+        int peer = peers.pick(uid);
+        EXPECT_EQ(peers.pick(uid), peer);
+        counts[peer]++;
+    }
+    for (int p = 0; p < 4; p++) {
+        EXPECT_GT(counts[p], kUids / 4 * 3 / 4) << p;
+        EXPECT_LT(counts[p], kUids / 4 * 5 / 4) << p;
+    }
+
+    // Adding a fifth peer only moves the uids it takes over.
+    PeerSet grown(Peers(5, pbcfg::PEER_HASH_UID));
+    int moved = 0;
+    for (uint32_t uid = 0; uid < kUids; uid++) {
+        int peer = grown.hash(uid);
+        if (peer != peers.hash(uid)) {
+            EXPECT_EQ(peer, 4);
+            moved++;
+        }
+    }
+    EXPECT_GT(moved, kUids / 5 * 3 / 4);
+    EXPECT_LT(moved, kUids / 5 * 5 / 4);
+}
+
+TEST(PeerSetTest, LeastOutstandingAvoidsBusyPeers) {
+    PeerSet peers(Peers(3, pbcfg::PEER_LEAST_OUTSTANDING));
+    // Idle peers are taken in turn.
+    EXPECT_EQ(peers.pick(0), 0);
+    EXPECT_EQ(peers.pick(0), 1);
+    EXPECT_EQ(peers.pick(0), 2);
+
+    peers.begin_request(0);
+    peers.begin_request(0);
+    peers.begin_request(2);
+    for (int i = 0; i < 6; i++) {
+        EXPECT_EQ(peers.pick(0), 1);
+    }
+    peers.begin_request(1);
+    peers.begin_request(1);
+    peers.begin_request(1);
+    EXPECT_EQ(peers.pick(0), 2);
+    peers.end_request(0, 2);
+    EXPECT_EQ(peers.outstanding(0), 0u);
+    EXPECT_EQ(peers.pick(0), 0);
+
+    // Other policies do not count.
+    PeerSet round_robin(Peers(2, pbcfg::PEER_ROUND_ROBIN));
+    round_robin.begin_request(1);
+    EXPECT_EQ(round_robin.outstanding(1), 0u);
+}
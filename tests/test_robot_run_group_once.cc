@@ -4,6 +4,7 @@
 #include "config.h"        // Adjust path
 #include "pb_master.h"     // Adjust path
 #include "robot.pb.h"      // Adjusted path for generated protobuf header
+#include "latency_stats.h"
 #include "mock_client.h"
 #include <sstream>
 
@@ -102,7 +103,7 @@ TEST_F(RunGroupOnceTest, BasicSuccessPath) {
     // EXPECT_CALL(mock_client, try_connect_to_peer(group_config.peer_addr(), _))
     //    .WillOnce(Return(true)); // Removed as per instruction
 
-    EXPECT_CALL(mock_client, send_msg(_, _, _))
+    EXPECT_CALL(mock_client, send_msg(_, _, _, _))
         .WillOnce(Return(true));
 
     // net_tcp_send might be called multiple times if the send buffer isn't cleared.
@@ -146,4 +147,104 @@ TEST_F(RunGroupOnceTest, BasicSuccessPath) {
     ASSERT_TRUE(error_stream.str().empty()) << "Error stream from RunGroupOnce was not empty: " << error_stream.str();
 }
 
+TEST_F(RunGroupOnceTest, SendsPreSerializedBody) {
+    using ::testing::_;
+    using ::testing::Eq;
+    using ::testing::Return;
+    using ::testing::Invoke;
+
+    // Replace the request with a body that has real content, compiled the same way
+    // CollectConfigInfos does at config load.
+    static pbcfg::Body client_body_cfg;
+    client_body_cfg.set_uniq_name("TestRequest1");
+    client_body_cfg.set_type_name("pbcfg.Client");
+    client_body_cfg.set_text("uid: 42 role_time: 7");
+    delete test_uniq_req;
+    test_uniq_req = new UniqRequest(&client_body_cfg, PB_MASTER.create_message("pbcfg.Client"));
+    std::ostringstream compile_err;
+    ASSERT_TRUE(test_uniq_req->compile_body(compile_err)) << compile_err.str();
+    uniq_name_map["TestRequest1"] = test_uniq_req;
+
+    pbcfg::Client expected;
+    expected.set_uid(42);
+    expected.set_role_time(7);
+    std::string expected_body;
+    ASSERT_TRUE(expected.SerializeToString(&expected_body));
+    EXPECT_EQ(test_uniq_req->body, expected_body);
+
+    EXPECT_CALL(mock_client, send_msg(_, Eq("pbcfg.Client"), Eq(expected_body), _))
+        .WillOnce(Invoke([&](const google::protobuf::Message& head, const std::string&,
+                             const std::string&, std::ostringstream&) {
+            // The per-client head is stamped with the cached type name.
+            EXPECT_EQ(static_cast<const pbcfg::CsMsgHead&>(head).msg_type_name(), "pbcfg.Client");
+            return true;
+        }));
+    EXPECT_CALL(mock_client, net_tcp_send(_)).WillOnce(Return(0));
+    EXPECT_CALL(mock_client, net_tcp_recv(_)).WillOnce(Return(0));
+    EXPECT_CALL(mock_client, recv_msg(_, _, _, _))
+        .WillOnce(Invoke([&](google::protobuf::Message** head, google::protobuf::Message** body,
+                             bool& complete, std::ostringstream&) {
+            *head = PB_MASTER.create_message("pbcfg.CsMsgHead");
+            *body = PB_MASTER.create_message("google.protobuf.Empty");
+            complete = true;
+            return true;
+        }));
+
+    bool result = RunGroupOnce(0, group_config, client_config_proto, mock_client, head_message, error_stream);
+    ASSERT_TRUE(result) << "RunGroupOnce failed: " << error_stream.str();
+}
+
+TEST_F(RunGroupOnceTest, SkipsResponsesWithOtherSeq) {
+    using ::testing::_;
+    using ::testing::Return;
+    using ::testing::Invoke;
+
+    head_message.set_seq(41);
+    uint32_t sent_seq = 0;
+    EXPECT_CALL(mock_client, send_msg(_, _, _, _))
+        .WillOnce(Invoke([&](const google::protobuf::Message& head, const std::string&,
+                             const std::string&, std::ostringstream&) {
+            sent_seq = static_cast<const pbcfg::CsMsgHead&>(head).seq();
+            return true;
+        }));
+    EXPECT_CALL(mock_client, net_tcp_send(_)).WillOnce(Return(0));
+    EXPECT_CALL(mock_client, net_tcp_recv(_)).WillOnce(Return(0));
+    // A late response to an earlier request, one with a seq never sent, then the real one.
+    const uint32_t seqs[] = {41, 99, 42};
+    int call = 0;
+    EXPECT_CALL(mock_client, recv_msg(_, _, _, _))
+        .Times(3)
+        .WillRepeatedly(Invoke([&](google::protobuf::Message** head, google::protobuf::Message** body,
+                                   bool& complete, std::ostringstream&) {
+            pbcfg::CsMsgHead* rsp_head = static_cast<pbcfg::CsMsgHead*>(PB_MASTER.create_message("pbcfg.CsMsgHead"));
+            rsp_head->set_seq(seqs[call++]);
+            *head = rsp_head;
+            *body = PB_MASTER.create_message("google.protobuf.Empty");
+            complete = true;
+            return true;
+        }));
+
+    GroupLatency latency(group_config);
+    bool result = RunGroupOnce(0, group_config, client_config_proto, mock_client, head_message, error_stream,
+                               &latency);
+    ASSERT_TRUE(result) << "RunGroupOnce failed: " << error_stream.str();
+    EXPECT_EQ(sent_seq, 42u);
+    EXPECT_EQ(latency.late_responses(), 1u);
+    EXPECT_EQ(latency.unmatched_responses(), 1u);
+    LatencySnapshot action;
+    latency.histogram(0, 0).add_to(action);
+    EXPECT_EQ(action.count(), 1u);
+}
+
+TEST(NextSeqTest, IncrementsAndSkipsZero) {
+    pbcfg::CsMsgHead head;
+    EXPECT_EQ(NextSeq(head), 1u);
+    EXPECT_EQ(NextSeq(head), 2u);
+    EXPECT_EQ(head.seq(), 2u);
+    head.set_seq(0xffffffffu);
+    EXPECT_EQ(NextSeq(head), 1u);
+    EXPECT_TRUE(SeqBefore(0xfffffff0u, 3));
+    EXPECT_FALSE(SeqBefore(3, 0xfffffff0u));
+}
+
 // Main function is removed as gtest_main is already linked.
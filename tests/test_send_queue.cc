@@ -0,0 +1,187 @@
+#include "gtest/gtest.h"
+#include "send_queue.h"
+#include "client.h"
+#include "robot.pb.h"
+#include <arpa/inet.h>
+#include <string>
+
+namespace {
+
+std::string Gather(const SendQueue &q, int max = kSendIovMax) {
+    struct iovec iov[kSendIovMax];
+    int n = q.fill_iov(iov, max);
+    std::string out;
+    for (int i = 0; i < n; i++) {
+        out.append(static_cast<const char *>(iov[i].iov_base), iov[i].iov_len);
+    }
+    return out;
+}
+
+// Loopback listener; the test reads the accepted side with blocking read().
+class Peer {
+public:
+    Peer() : listenfd_(socket(AF_INET, SOCK_STREAM, 0)), fd_(-1) {
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr);
+        bind(listenfd_, (struct sockaddr *)&addr, sizeof(addr));
+        listen(listenfd_, 8);
+        getsockname(listenfd_, (struct sockaddr *)&addr, &len);
+        addr_ = "127.0.0.1:" + std::to_string(ntohs(addr.sin_port));
+    }
+    ~Peer() {
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+        close(listenfd_);
+    }
+
+    bool Connect(Client &client) {
+        std::ostringstream err;
+        if (client.start_connect(addr_, err) == -1) {
+            return false;
+        }
+        // accept() returns once the handshake is done, so finish_connect sees it established.
+        fd_ = accept(listenfd_, NULL, NULL);
+        return fd_ >= 0 && client.finish_connect(err);
+    }
+
+    std::string Read(size_t len) {
+        std::string out(len, '\0');
+        for (size_t off = 0; off < len; ) {
+            ssize_t n = read(fd_, &out[off], len - off);
+            if (n <= 0) {
+                return out.substr(0, off);
+            }
+            off += n;
+        }
+        return out;
+    }
+
+private:
+    int listenfd_;
+    int fd_;
+    std::string addr_;
+};
+
+} // namespace
+
+TEST(SendQueueTest, InterleavesInlineBytesAndReferences) {
+    std::string big(300, 'B');
+    SendQueue q(64, 256);
+    q.append("head1", 5);
+    q.append_ref(big.data(), big.size());
+    q.append("tail1head2", 10);
+    q.append_ref("ref2", 4);
+    q.append("tail2", 5);
+
+    EXPECT_EQ(q.size(), 5 + big.size() + 10 + 4 + 5);
+    EXPECT_EQ(q.refs(), 2u);
+    EXPECT_EQ(Gather(q), "head1" + big + "tail1head2" + "ref2" + "tail2");
+
+    struct iovec iov[kSendIovMax];
+    EXPECT_EQ(q.fill_iov(iov, kSendIovMax), 5);
+    EXPECT_EQ(iov[1].iov_base, big.data()); // referenced, not copied
+}
+
+TEST(SendQueueTest, PartialConsumeResumesInsideAnySegment) {
+    std::string big(300, 'B');
+    std::string expect = "head1" + big + "tail1" + "ref2" + "tail2";
+    SendQueue q(64, 256);
+    q.append("head1", 5);
+    q.append_ref(big.data(), big.size());
+    q.append("tail1", 5);
+    q.append_ref("ref2", 4);
+    q.append("tail2", 5);
+
+    // Short writes that stop inside inline bytes, inside a reference and on a boundary.
+    const size_t steps[] = { 3, 100, 202, 6, 1, 3, 4 };
+    size_t off = 0;
+    for (size_t i = 0; i < sizeof(steps) / sizeof(steps[0]); i++) {
+        q.consume(steps[i]);
+        off += steps[i];
+        ASSERT_EQ(q.size(), expect.size() - off);
+        ASSERT_EQ(Gather(q), expect.substr(off));
+    }
+    EXPECT_TRUE(q.empty());
+    EXPECT_EQ(q.refs(), 0u);
+}
+
+TEST(SendQueueTest, FillStopsAtIovLimit) {
+    SendQueue q(64, 256);
+    std::string refs[3] = { "aaa", "bbb", "ccc" };
+    for (int i = 0; i < 3; i++) {
+        q.append("-", 1);
+        q.append_ref(refs[i].data(), refs[i].size());
+    }
+    q.append("!", 1);
+    EXPECT_EQ(Gather(q, 3), "-aaa-");
+    q.consume(5);
+    EXPECT_EQ(Gather(q), "bbb-ccc!");
+    q.clear();
+    EXPECT_TRUE(q.empty());
+    EXPECT_EQ(q.size(), 0u);
+}
+
+class ClientSendTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        head.set_msg_type_name("pbcfg.Client");
+        head.set_uid(1001);
+        head.set_role_tm(77);
+        head.set_ret(0);
+        body.set_uid(42);
+        body.set_role_time(7);
+        // An unknown length-delimited field pads the body past kSendRefMinBytes.
+        big_body = body.SerializeAsString();
+        big_body += std::string("\x7a\x90\x03", 3) + std::string(400, 'p');
+    }
+
+    pbcfg::CsMsgHead head;
+    pbcfg::Client body;
+    std::string big_body;
+};
+
+TEST_F(ClientSendTest, SendPathMatchesEncode) {
+    const ChecksumType types[] = { kChecksumSum32, kChecksumCrc32c };
+    for (int checked = 0; checked < 2; checked++) {
+        for (size_t t = 0; t < sizeof(types) / sizeof(types[0]); t++) {
+            Client client(1 << 20, checked != 0, types[t]);
+            Peer peer;
+            ASSERT_TRUE(peer.Connect(client));
+
+            std::string expect, pkg;
+            ASSERT_TRUE(client.encode(head, body, pkg));
+            expect += pkg;
+            ASSERT_TRUE(client.encode(head, big_body, pkg));
+            expect += pkg;
+            std::string small_body = body.SerializeAsString();
+            ASSERT_TRUE(client.encode(head, small_body, pkg));
+            expect += pkg;
+
+            std::ostringstream err;
+            ASSERT_TRUE(client.send_msg(head, body, err)) << err.str();
+            ASSERT_TRUE(client.send_msg(head, "pbcfg.Client", big_body, err)) << err.str();
+            ASSERT_TRUE(client.send_msg(head, "pbcfg.Client", small_body, err)) << err.str();
+            // Only the large pre-serialized body is referenced; the small one is copied.
+            EXPECT_EQ(client.buffer().send.refs(), 1u);
+            EXPECT_EQ(client.buffer().send.size(), expect.size());
+
+            ASSERT_EQ(client.net_tcp_send(err), 0) << err.str();
+            EXPECT_TRUE(client.buffer().send.empty());
+            EXPECT_EQ(peer.Read(expect.size()), expect);
+        }
+    }
+}
+
+TEST_F(ClientSendTest, RejectsFramesOverMaxPackageLength) {
+    Client client(256, true);
+    Peer peer;
+    ASSERT_TRUE(peer.Connect(client));
+    std::ostringstream err;
+    EXPECT_FALSE(client.send_msg(head, "pbcfg.Client", big_body, err));
+    EXPECT_NE(err.str().find("too big msg"), std::string::npos) << err.str();
+    EXPECT_TRUE(client.buffer().send.empty());
+}
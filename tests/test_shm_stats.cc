@@ -0,0 +1,153 @@
+#include "gtest/gtest.h"
+#include "shm_stats.h"
+#include "stats_server.h"
+#include <thread>
+
+namespace {
+
+std::string TestPath(const char *name) {
+    return std::string("/tmp/robot_shm_test.") + name + "." + std::to_string(getpid());
+}
+
+} // namespace
+
+TEST(ShmStatsTest, ReaderSeesWhatWriterPublished) {
+    std::string path = TestPath("rw");
+    ShmStatsSegment writer;
+    std::ostringstream err;
+    ASSERT_TRUE(writer.create(path, err)) << err.str();
+
+    ShmStatsSegment reader;
+    ASSERT_TRUE(reader.attach(path, err)) << err.str();
+    EXPECT_EQ(reader.pid(), getpid());
+    ShmStatsData data;
+    ASSERT_TRUE(reader.read(data));
+    EXPECT_EQ(data.group_num, 0);
+
+    ShmStatsData *out = new ShmStatsData();
+    out->group_num = 1;
+    out->publish_count = 7;
+    strcpy(out->groups[0].name, "g1");
+    out->groups[0].completed = 12345;
+    out->groups[0].recent.p99 = 800;
+    writer.write(*out);
+    ASSERT_TRUE(reader.read(data));
+    EXPECT_EQ(data.publish_count, 7u);
+    EXPECT_STREQ(data.groups[0].name, "g1");
+    EXPECT_EQ(data.groups[0].completed, 12345u);
+    EXPECT_EQ(data.groups[0].recent.p99, 800u);
+    delete out;
+
+    // The writer owns the file and removes it; the reader keeps its mapping.
+    writer.close();
+    EXPECT_NE(access(path.c_str(), F_OK), 0);
+    EXPECT_TRUE(reader.read(data));
+    EXPECT_FALSE(reader.attach(path, err));
+}
+
+TEST(ShmStatsTest, ReaderNeverSeesATornWrite) {
+    std::string path = TestPath("torn");
+    ShmStatsSegment writer, reader;
+    std::ostringstream err;
+    ASSERT_TRUE(writer.create(path, err)) << err.str();
+    ASSERT_TRUE(reader.attach(path, err)) << err.str();
+
+    std::atomic<bool> done(false);
+    std::thread publisher([&]() {
+        ShmStatsData *data = new ShmStatsData();
+        for (uint64_t n = 1; n <= 20000; n++) {
+            data->publish_count = n;
+            data->group_num = kShmStatsMaxGroups;
+            for (int g = 0; g < kShmStatsMaxGroups; g++) {
+                data->groups[g].completed = n;
+                data->groups[g].total.max = n;
+            }
+            writer.write(*data);
+        }
+        delete data;
+        done = true;
+    });
+
+    ShmStatsData *data = new ShmStatsData();
+    int reads = 0;
+    while (!done.load() || reads == 0) {
+        if (!reader.read(*data)) {
+            continue;
+        }
+        reads++;
+        for (int g = 0; g < data->group_num; g++) {
+            ASSERT_EQ(data->groups[g].completed, data->publish_count);
+            ASSERT_EQ(data->groups[g].total.max, data->publish_count);
+        }
+    }
+    publisher.join();
+    delete data;
+    EXPECT_GT(reads, 0);
+}
+
+TEST(ShmStatsTest, AttachRejectsOtherFiles) {
+    std::string path = TestPath("bad");
+    FILE *f = fopen(path.c_str(), "w");
+    fputs("not stats", f);
+    fclose(f);
+    ShmStatsSegment reader;
+    std::ostringstream err;
+    EXPECT_FALSE(reader.attach(path, err));
+    EXPECT_FALSE(reader.attached());
+    unlink(path.c_str());
+}
+
+TEST(ShmStatsTest, PublisherWritesGroupCountersAndRecentLatency) {
+    pbcfg::CfgRoot cfg;
+    pbcfg::Group *group = cfg.add_group_config();
+    group->set_name("g1");
+    group->add_action()->add_response("pbcfg.Client");
+    LATENCY_STATS.init(cfg, 2);
+    GroupLatency *latency = LATENCY_STATS.recorder(1, 0);
+    latency->record_connect(10);
+    latency->record_request(0);
+    latency->record_request(0);
+    latency->record_action(0, 100);
+
+    std::string path = TestPath("pub");
+    ShmStatsPublisher publisher;
+    std::ostringstream err;
+    ASSERT_TRUE(publisher.start(path, err)) << err.str();
+    ShmStatsSegment reader;
+    ASSERT_TRUE(reader.attach(path, err)) << err.str();
+    ShmStatsData *data = new ShmStatsData();
+    // The first publish happens as soon as the thread starts.
+    for (int i = 0; i < 100 && (!reader.read(*data) || data->publish_count == 0); i++) {
+        usleep(10000);
+    }
+    ASSERT_EQ(data->group_num, 1);
+    EXPECT_STREQ(data->groups[0].name, "g1");
+    EXPECT_EQ(data->groups[0].connected, 1u);
+    EXPECT_EQ(data->groups[0].in_flight, 1u);
+    EXPECT_EQ(data->groups[0].total.count, 1u);
+    EXPECT_EQ(data->groups[0].recent.p50, 100u);
+
+    publisher.stop();
+    EXPECT_NE(access(path.c_str(), F_OK), 0);
+    // stop() publishes once more: nothing new since the first publish.
+    ASSERT_TRUE(reader.read(*data));
+    EXPECT_GE(data->publish_count, 2u);
+    EXPECT_EQ(data->groups[0].total.count, 1u);
+    EXPECT_EQ(data->groups[0].recent.count, 0u);
+    delete data;
+    LATENCY_STATS.clear();
+}
+
+TEST(ShmStatsTest, SubtractLeavesTheRecentWindow) {
+    LatencySnapshot earlier;
+    earlier.record(10, 5);
+    LatencySnapshot now = earlier;
+    now.record(2000, 3);
+    now.subtract(earlier);
+    EXPECT_EQ(now.count(), 3u);
+    EXPECT_EQ(now.value_at_percentile(50), 2000u);
+    EXPECT_EQ(now.max(), 2000u);
+    now.subtract(now);
+    EXPECT_EQ(now.count(), 0u);
+    EXPECT_EQ(now.max(), 0u);
+}
@@ -0,0 +1,134 @@
+#include "gtest/gtest.h"
+#include "source_binder.h"
+#include "client.h"
+#include <arpa/inet.h>
+
+namespace {
+
+pbcfg::SourceAddress Source(const std::vector<std::string> &ips, int port_min = 0, int port_max = 0) {
+    pbcfg::SourceAddress cfg;
+    for (size_t i = 0; i < ips.size(); i++) {
+        cfg.add_ip(ips[i]);
+    }
+    cfg.set_port_min(port_min);
+    cfg.set_port_max(port_max);
+    return cfg;
+}
+
+// Loopback listener on 127.0.0.1 that accepts nothing; the backlog completes the handshakes.
+class Listener {
+public:
+    Listener() : fd_(socket(AF_INET, SOCK_STREAM, 0)) {
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr);
+        bind(fd_, (struct sockaddr *)&addr, sizeof(addr));
+        listen(fd_, 64);
+        getsockname(fd_, (struct sockaddr *)&addr, &len);
+        addr_ = "127.0.0.1:" + std::to_string(ntohs(addr.sin_port));
+    }
+    ~Listener() { close(fd_); }
+    const std::string &addr() const { return addr_; }
+
+private:
+    int fd_;
+    std::string addr_;
+};
+
+// "ip:port" of the local end of a connected socket.
+std::string LocalAddr(int fd) {
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    getsockname(fd, (struct sockaddr *)&addr, &len);
+    char buf[INET_ADDRSTRLEN];
+    return std::string(inet_ntop(AF_INET, &addr.sin_addr, buf, sizeof(buf))) + ":" +
+           std::to_string(ntohs(addr.sin_port));
+}
+
+// A port the kernel currently considers free on 127.0.0.9.
+int FreePort() {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    inet_pton(AF_INET, "127.0.0.9", &addr.sin_addr);
+    socklen_t len = sizeof(addr);
+    bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    getsockname(fd, (struct sockaddr *)&addr, &len);
+    close(fd);
+    return ntohs(addr.sin_port);
+}
+
+} // namespace
+
+TEST(SourceBinderTest, ValidatesIpsAndPortRange) {
+    std::ostringstream err;
+    EXPECT_TRUE(SourceBinder::validate(Source({}), err));
+    EXPECT_TRUE(SourceBinder::validate(Source({"127.0.0.2", "10.0.0.1"}, 20000, 20099), err));
+    EXPECT_FALSE(SourceBinder::validate(Source({"127.0.0.300"}), err));
+    EXPECT_FALSE(SourceBinder::validate(Source({"::1"}), err));
+    EXPECT_FALSE(SourceBinder::validate(Source({}, 0, 100), err));
+    EXPECT_FALSE(SourceBinder::validate(Source({}, 200, 100), err));
+    EXPECT_FALSE(SourceBinder::validate(Source({}, 1, 70000), err));
+    EXPECT_TRUE(SourceBinder(Source({})).empty());
+    EXPECT_FALSE(SourceBinder(Source({}, 20000, 20001)).empty());
+}
+
+TEST(SourceBinderTest, ConnectionsRoundRobinOverSourceIps) {
+    Listener listener;
+    SourceBinder source(Source({"127.0.0.2", "127.0.0.3", "127.0.0.4"}));
+    std::vector<Client *> clients;
+    for (int i = 0; i < 6; i++) {
+        Client *client = new Client(8192, false);
+        client->set_source(&source);
+        std::ostringstream err;
+        ASSERT_TRUE(client->try_connect_to_peer(listener.addr(), err)) << err.str();
+        std::string local = LocalAddr(client->connfd());
+        EXPECT_EQ(local.substr(0, local.find(':')), "127.0.0." + std::to_string(2 + i % 3));
+        clients.push_back(client);
+    }
+    for (size_t i = 0; i < clients.size(); i++) {
+        delete clients[i];
+    }
+}
+
+TEST(SourceBinderTest, PortRangeSkipsPortsInUse) {
+    Listener listener;
+    int base = FreePort();
+    ASSERT_LT(base, 65533);
+    // Hold the middle port of the range with a listener, which SO_REUSEADDR cannot share.
+    int holder = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    inet_pton(AF_INET, "127.0.0.9", &addr.sin_addr);
+    addr.sin_port = htons(base + 1);
+    ASSERT_EQ(bind(holder, (struct sockaddr *)&addr, sizeof(addr)), 0);
+    ASSERT_EQ(listen(holder, 1), 0);
+
+    SourceBinder source(Source({"127.0.0.9"}, base, base + 2));
+    Client first(8192, false), second(8192, false), third(8192, false);
+    first.set_source(&source);
+    second.set_source(&source);
+    third.set_source(&source);
+    std::ostringstream err;
+    ASSERT_TRUE(first.try_connect_to_peer(listener.addr(), err)) << err.str();
+    ASSERT_TRUE(second.try_connect_to_peer(listener.addr(), err)) << err.str();
+    EXPECT_EQ(LocalAddr(first.connfd()), "127.0.0.9:" + std::to_string(base));
+    EXPECT_EQ(LocalAddr(second.connfd()), "127.0.0.9:" + std::to_string(base + 2));
+
+    // Every port of the range already has a connection to this peer; the binds succeed
+    // (SO_REUSEADDR) but each connect collides on the 4-tuple, and the retries give up.
+    EXPECT_FALSE(third.try_connect_to_peer(listener.addr(), err));
+    EXPECT_EQ(errno, EADDRNOTAVAIL);
+    // The same source ports still reach a different peer.
+    Listener other;
+    err.str("");
+    ASSERT_TRUE(third.try_connect_to_peer(other.addr(), err)) << err.str();
+    std::string local = LocalAddr(third.connfd());
+    EXPECT_TRUE(local == "127.0.0.9:" + std::to_string(base) || local == "127.0.0.9:" + std::to_string(base + 2))
+        << local;
+    close(holder);
+}
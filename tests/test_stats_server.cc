@@ -0,0 +1,133 @@
+#include "gtest/gtest.h"
+#include "stats_server.h"
+#include "latency_stats.h"
+#include <sys/un.h>
+#include <thread>
+#include <vector>
+
+namespace {
+
+class StatsServerTest : public ::testing::Test {
+protected:
+    pbcfg::CfgRoot cfg;
+
+    void SetUp() override {
+        pbcfg::Group *group = cfg.add_group_config();
+        group->set_name("g\"1");
+        group->set_peer_addr("127.0.0.1:1");
+        group->set_max_pkg_len(1024);
+        group->set_has_checksum(false);
+        pbcfg::Action *action = group->add_action();
+        action->add_response("pbcfg.Client");
+        LATENCY_STATS.init(cfg, 4);
+    }
+    void TearDown() override {
+        LATENCY_STATS.clear();
+    }
+
+    static std::string Scrape() {
+        std::ostringstream out;
+        LATENCY_STATS.write_prometheus(out);
+        return out.str();
+    }
+    static bool Contains(const std::string &text, const std::string &line) {
+        return text.find(line + "\n") != std::string::npos;
+    }
+};
+
+std::string Get(const std::string &unix_path, const std::string &path) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, unix_path.c_str(), sizeof(addr.sun_path) - 1);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        close(fd);
+        return "";
+    }
+    std::string request = "GET " + path + " HTTP/1.1\r\nHost: x\r\n\r\n";
+    send(fd, request.data(), request.size(), 0);
+    std::string response;
+    char buf[4096];
+    ssize_t n = 0;
+    while ((n = recv(fd, buf, sizeof(buf), 0)) > 0) {
+        response.append(buf, n);
+    }
+    close(fd);
+    return response;
+}
+
+} // namespace
+
+TEST_F(StatsServerTest, AggregatesPerThreadCountersOnScrape) {
+    // Each thread records into its own recorder; only a scrape merges them.
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.push_back(std::thread([t]() {
+            GroupLatency *latency = LATENCY_STATS.recorder(t, 0);
+            latency->record_connect(100);
+            for (int i = 0; i < 100; i++) {
+                latency->record_request(0);
+                if (i < 90) {
+                    latency->record_action(0, 1000);
+                } else if (i < 95) {
+                    latency->record_timeout(0, 1000);
+                }
+            }
+        }));
+    }
+    for (size_t t = 0; t < threads.size(); t++) {
+        threads[t].join();
+    }
+    GroupLatency *latency = LATENCY_STATS.recorder(0, 0);
+    latency->record_abandoned(0, 3);
+    latency->record_error();
+    latency->record_disconnect();
+
+    GroupCounters counters;
+    LATENCY_STATS.counters(0, counters);
+    EXPECT_EQ(counters.requests, 400u);
+    EXPECT_EQ(counters.completed, 360u);
+    EXPECT_EQ(counters.timeouts, 20u);
+    EXPECT_EQ(counters.in_flight(), 17u);
+    EXPECT_EQ(counters.connected(), 3u);
+
+    std::string text = Scrape();
+    EXPECT_TRUE(Contains(text, "# TYPE robot_requests_total counter")) << text;
+    EXPECT_TRUE(Contains(text, "robot_requests_total{group=\"g\\\"1\"} 400")) << text;
+    EXPECT_TRUE(Contains(text, "robot_inflight_requests{group=\"g\\\"1\"} 17")) << text;
+    EXPECT_TRUE(Contains(text, "robot_connected_clients{group=\"g\\\"1\"} 3")) << text;
+    EXPECT_TRUE(Contains(text, "robot_errors_total{group=\"g\\\"1\"} 1")) << text;
+    EXPECT_TRUE(Contains(text, "robot_timeouts_total{group=\"g\\\"1\",action=\"0\"} 20")) << text;
+    EXPECT_TRUE(Contains(text,
+        "robot_latency_usec_count{group=\"g\\\"1\",action=\"0\",response=\"(action)\"} 360")) << text;
+    EXPECT_TRUE(Contains(text,
+        "robot_latency_usec{group=\"g\\\"1\",action=\"0\",response=\"(action)\",quantile=\"0.99\"} 1000")) << text;
+}
+
+TEST_F(StatsServerTest, ThroughputComesFromSamples) {
+    LATENCY_STATS.sample_throughput(1000000);
+    for (int i = 0; i < 50; i++) {
+        LATENCY_STATS.recorder(i, 0)->record_action(0, 10);
+    }
+    LATENCY_STATS.sample_throughput(1500000);
+    EXPECT_TRUE(Contains(Scrape(), "robot_throughput{group=\"g\\\"1\"} 100"));
+}
+
+TEST_F(StatsServerTest, ServesMetricsOverUnixSocket) {
+    std::string path = "/tmp/robot_stats_test." + std::to_string(getpid());
+    StatsServer server;
+    std::ostringstream err;
+    ASSERT_TRUE(server.start("unix:" + path, err)) << err.str();
+    LATENCY_STATS.recorder(0, 0)->record_connect(10);
+
+    std::string response = Get(path, "/metrics");
+    EXPECT_EQ(response.compare(0, 15, "HTTP/1.0 200 OK"), 0) << response;
+    EXPECT_NE(response.find("robot_connects_total{group=\"g\\\"1\"} 1\n"), std::string::npos) << response;
+    response = Get(path, "/nope");
+    EXPECT_EQ(response.compare(0, 12, "HTTP/1.0 404"), 0) << response;
+
+    server.stop();
+    EXPECT_NE(access(path.c_str(), F_OK), 0);
+    EXPECT_FALSE(server.start("nohost", err));
+}
@@ -0,0 +1,173 @@
+#include "gtest/gtest.h"
+#include "timer_wheel.h"
+#include <random>
+#include <vector>
+
+namespace {
+
+struct Fired {
+    TimerWheel *wheel;
+    uint64_t now;
+    std::vector<std::pair<int, uint64_t> > events; // (id, fired at)
+};
+
+struct TestTimer {
+    TimerNode node;
+    int id;
+};
+
+void RecordExpire(TimerNode *node, void *arg) {
+    Fired *fired = static_cast<Fired *>(arg);
+    TestTimer *timer = static_cast<TestTimer *>(node->owner);
+    fired->events.push_back(std::make_pair(timer->id, fired->now));
+}
+
+// Advances one millisecond at a time so the firing time of each timer is exact.
+void Step(TimerWheel &wheel, Fired &fired, uint64_t from, uint64_t to) {
+    for (uint64_t t = from; t <= to; t++) {
+        fired.now = t;
+        wheel.advance(t, RecordExpire, &fired);
+    }
+}
+
+} // namespace
+
+TEST(TimerWheelTest, FiresAtExpireInEveryLevel) {
+    const uint64_t start = 1000;
+    TimerWheel wheel(start);
+    const uint64_t delays[] = {0, 1, 255, 256, 1000, 16383, 16384, 70000, 1u << 20, (1u << 20) + 12345};
+    const int n = sizeof(delays) / sizeof(delays[0]);
+    std::vector<TestTimer> timers(n);
+    for (int i = 0; i < n; i++) {
+        timers[i].id = i;
+        timers[i].node.owner = &timers[i];
+        wheel.add(&timers[i].node, start + delays[i]);
+    }
+    EXPECT_EQ(wheel.size(), size_t(n));
+
+    Fired fired;
+    Step(wheel, fired, start, start + (1u << 20) + 20000);
+    ASSERT_EQ(fired.events.size(), size_t(n));
+    for (int i = 0; i < n; i++) {
+        EXPECT_EQ(fired.events[i].first, i);
+        EXPECT_EQ(fired.events[i].second, start + delays[i]) << "delay " << delays[i];
+    }
+    EXPECT_EQ(wheel.size(), 0u);
+    EXPECT_FALSE(timers[0].node.armed());
+}
+
+TEST(TimerWheelTest, RemoveAndRearm) {
+    TimerWheel wheel(0);
+    TestTimer a, b;
+    a.id = 1; a.node.owner = &a;
+    b.id = 2; b.node.owner = &b;
+    wheel.add(&a.node, 50);
+    wheel.add(&b.node, 60);
+    wheel.remove(&a.node);
+    wheel.remove(&a.node); // removing twice is harmless
+    wheel.add(&b.node, 5000); // re-adding replaces the previous deadline
+    EXPECT_EQ(wheel.size(), 1u);
+
+    Fired fired;
+    Step(wheel, fired, 0, 6000);
+    ASSERT_EQ(fired.events.size(), 1u);
+    EXPECT_EQ(fired.events[0].first, 2);
+    EXPECT_EQ(fired.events[0].second, 5000u);
+}
+
+TEST(TimerWheelTest, PastExpireFiresOnNextAdvance) {
+    TimerWheel wheel(100);
+    Fired fired;
+    Step(wheel, fired, 100, 200);
+    TestTimer a;
+    a.id = 1; a.node.owner = &a;
+    wheel.add(&a.node, 10);
+    Step(wheel, fired, 201, 201);
+    ASSERT_EQ(fired.events.size(), 1u);
+    EXPECT_EQ(fired.events[0].second, 201u);
+}
+
+TEST(TimerWheelTest, PastExpireFiresWithoutWaitingForNextMillisecond) {
+    TimerWheel wheel(100);
+    Fired fired;
+    Step(wheel, fired, 100, 200);
+    TestTimer a;
+    a.id = 1; a.node.owner = &a;
+    wheel.add(&a.node, 0);
+    // Millisecond 200 was already processed; the timer still must not wait for 201.
+    EXPECT_EQ(wheel.next_timeout(200), 0);
+    fired.now = 200;
+    wheel.advance(200, RecordExpire, &fired);
+    ASSERT_EQ(fired.events.size(), 1u);
+    EXPECT_EQ(wheel.size(), 0u);
+    EXPECT_EQ(wheel.next_timeout(200), -1);
+}
+
+TEST(TimerWheelTest, LargeJumpFiresEverythingDue) {
+    TimerWheel wheel(0);
+    std::mt19937 rng(7);
+    std::vector<TestTimer> timers(1000);
+    for (size_t i = 0; i < timers.size(); i++) {
+        timers[i].id = int(i);
+        timers[i].node.owner = &timers[i];
+        wheel.add(&timers[i].node, rng() % 100000);
+    }
+    Fired fired;
+    fired.now = 50000;
+    wheel.advance(50000, RecordExpire, &fired);
+    for (size_t i = 0; i < fired.events.size(); i++) {
+        EXPECT_LE(timers[fired.events[i].first].node.expire, 50000u);
+    }
+    fired.now = 100000;
+    wheel.advance(100000, RecordExpire, &fired);
+    EXPECT_EQ(fired.events.size(), timers.size());
+    EXPECT_EQ(wheel.size(), 0u);
+}
+
+TEST(TimerWheelTest, NextTimeoutNeverLate) {
+    TimerWheel wheel(0);
+    Fired fired;
+    EXPECT_EQ(wheel.next_timeout(0), -1);
+    TestTimer a;
+    a.id = 1; a.node.owner = &a;
+    wheel.add(&a.node, 30);
+    Step(wheel, fired, 0, 0);
+    EXPECT_EQ(wheel.next_timeout(0), 30);
+
+    wheel.add(&a.node, 10000);
+    int timeout = wheel.next_timeout(0);
+    EXPECT_GT(timeout, 0);
+    EXPECT_LE(timeout, 10000);
+    // Sleeping for next_timeout() repeatedly reaches the deadline without skipping it.
+    uint64_t now = 0;
+    while (fired.events.empty()) {
+        timeout = wheel.next_timeout(now);
+        ASSERT_GE(timeout, 0);
+        now += timeout;
+        fired.now = now;
+        wheel.advance(now, RecordExpire, &fired);
+    }
+    EXPECT_EQ(fired.events[0].second, 10000u);
+}
+
+TEST(TimerWheelTest, CallbackMayRearm) {
+    TimerWheel wheel(0);
+    struct Periodic {
+        TimerNode node;
+        TimerWheel *wheel;
+        int fired;
+    } periodic;
+    periodic.node.owner = &periodic;
+    periodic.wheel = &wheel;
+    periodic.fired = 0;
+    wheel.add(&periodic.node, 100);
+    for (uint64_t t = 0; t <= 1000; t++) {
+        wheel.advance(t, [](TimerNode *node, void *) {
+            Periodic *p = static_cast<Periodic *>(node->owner);
+            p->fired++;
+            p->wheel->add(node, node->expire + 100);
+        }, NULL);
+    }
+    EXPECT_EQ(periodic.fired, 10);
+    EXPECT_EQ(wheel.size(), 1u);
+}
@@ -0,0 +1,198 @@
+#include "gtest/gtest.h"
+#include "uring.h"
+#include "event_loop.h"
+#include "message_pool.h"
+#include "robot.pb.h"
+#include <arpa/inet.h>
+#include <functional>
+
+namespace {
+
+struct RecordingHandler : public EventHandler {
+    RecordingHandler() : events(0), calls(0) { }
+    void on_events(uint32_t e) override {
+        events |= e;
+        calls++;
+    }
+    void on_timer() override { }
+
+    uint32_t events;
+    int calls;
+};
+
+// A loopback listener; accept() blocks until the client's connect is done.
+class Listener {
+public:
+    Listener() : fd_(socket(AF_INET, SOCK_STREAM, 0)) {
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr);
+        bind(fd_, (struct sockaddr *)&addr, sizeof(addr));
+        listen(fd_, 8);
+        getsockname(fd_, (struct sockaddr *)&addr, &len);
+        addr_ = "127.0.0.1:" + std::to_string(ntohs(addr.sin_port));
+    }
+    ~Listener() { close(fd_); }
+
+    const std::string &addr() const { return addr_; }
+    int accept_one() { return accept(fd_, NULL, NULL); }
+
+private:
+    int fd_;
+    std::string addr_;
+};
+
+bool PollUntil(EventLoop &loop, const std::function<bool()> &done) {
+    for (int i = 0; i < 300 && !done(); i++) {
+        if (loop.poll(10) == -1) {
+            return false;
+        }
+    }
+    return done();
+}
+
+bool ReadFull(int fd, std::string &out, size_t len) {
+    out.resize(len);
+    for (size_t off = 0; off < len; ) {
+        ssize_t n = read(fd, &out[off], len - off);
+        if (n <= 0) {
+            return false;
+        }
+        off += n;
+    }
+    return true;
+}
+
+class UringTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        std::ostringstream err;
+        ASSERT_TRUE(loop.init(err)) << err.str();
+        if (!loop.enable_uring(err)) {
+            GTEST_SKIP() << "io_uring not available: " << err.str();
+        }
+        client = NewLoopClient(loop.uring(), &handler, 1 << 20, true, kChecksumCrc32c);
+        head.set_msg_type_name("pbcfg.Client");
+        head.set_uid(1001);
+        head.set_role_tm(77);
+        head.set_ret(0);
+        body.set_uid(42);
+        body.set_role_time(7);
+    }
+    void TearDown() override {
+        delete client;
+        if (peer >= 0) {
+            close(peer);
+        }
+    }
+
+    // Connects through the ring's poll and accepts the server side into peer.
+    void Connect() {
+        std::ostringstream err;
+        int ret = client->start_connect(listener.addr(), err);
+        ASSERT_NE(ret, -1) << err.str();
+        loop.add_fd(client->connfd(), EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, &handler);
+        peer = listener.accept_one();
+        ASSERT_GE(peer, 0);
+        if (ret == 1) {
+            ASSERT_TRUE(PollUntil(loop, [this]() { return (handler.events & EPOLLOUT) != 0; }));
+        }
+        ASSERT_TRUE(client->finish_connect(err)) << err.str();
+        handler.events = 0;
+    }
+
+    EventLoop loop;
+    RecordingHandler handler;
+    Client *client = NULL;
+    Listener listener;
+    int peer = -1;
+    pbcfg::CsMsgHead head;
+    pbcfg::Client body;
+};
+
+} // namespace
+
+TEST(UringFallbackTest, LoopWithoutRingUsesPlainClient) {
+    EventLoop loop;
+    std::ostringstream err;
+    ASSERT_TRUE(loop.init(err)) << err.str();
+    EXPECT_EQ(loop.uring(), (UringRing *)NULL);
+    RecordingHandler handler;
+    Client *client = NewLoopClient(loop.uring(), &handler, 8192, false, kChecksumSum32);
+    EXPECT_EQ(dynamic_cast<UringClient *>(client), (UringClient *)NULL);
+    delete client;
+}
+
+TEST_F(UringTest, SendsAndReceivesThroughTheRing) {
+    ASSERT_NE(dynamic_cast<UringClient *>(client), (UringClient *)NULL);
+    Connect();
+    std::string pkg;
+    ASSERT_TRUE(client->encode(head, body, pkg));
+
+    // Two packets queued before a single flush go out as one send.
+    std::ostringstream err;
+    ASSERT_TRUE(client->send_msg(head, body, err)) << err.str();
+    ASSERT_TRUE(client->send_msg(head, body, err)) << err.str();
+    ASSERT_EQ(client->net_tcp_send(err), 0) << err.str();
+    EXPECT_TRUE(client->buffer().send.empty());
+    uint64_t enters = loop.uring()->enters();
+    loop.poll(0);
+    EXPECT_EQ(loop.uring()->enters(), enters + 1);
+    std::string got;
+    ASSERT_TRUE(ReadFull(peer, got, 2 * pkg.size()));
+    EXPECT_EQ(got, pkg + pkg);
+
+    // Replies land in the receive buffer before the handler is told.
+    std::string reply = pkg + pkg + pkg;
+    ASSERT_EQ(write(peer, reply.data(), reply.size()), ssize_t(reply.size()));
+    ASSERT_TRUE(PollUntil(loop, [this, &reply]() { return client->buffer().recv.size() == int32_t(reply.size()); }));
+    EXPECT_TRUE(handler.events & EPOLLIN);
+    ASSERT_EQ(client->net_tcp_recv(err), 0) << err.str();
+    for (int i = 0; i < 3; i++) {
+        google::protobuf::Message *rsphead = NULL, *rspbody = NULL;
+        bool complete = false;
+        ASSERT_TRUE(client->recv_msg(&rsphead, &rspbody, complete, err)) << err.str();
+        ASSERT_TRUE(complete);
+        EXPECT_EQ(rspbody->SerializeAsString(), body.SerializeAsString());
+        MessagePool::local().release(rsphead);
+        MessagePool::local().release(rspbody);
+    }
+}
+
+TEST_F(UringTest, ReassemblesPacketsLargerThanOneBuffer) {
+    Connect();
+    pbcfg::CsMsgHead big = head;
+    big.set_msg_type_name(std::string(5 * kUringBufferSize, 'n'));
+    head.set_msg_type_name("pbcfg.CsMsgHead");
+    std::string pkg;
+    ASSERT_TRUE(client->encode(head, big, pkg));
+    // Nothing to send yet; this only arms the receive.
+    std::ostringstream err;
+    ASSERT_EQ(client->net_tcp_send(err), 0) << err.str();
+    loop.poll(0);
+    ASSERT_EQ(write(peer, pkg.data(), pkg.size()), ssize_t(pkg.size()));
+    ASSERT_TRUE(PollUntil(loop, [this, &pkg]() { return client->buffer().recv.size() == int32_t(pkg.size()); }));
+
+    google::protobuf::Message *rsphead = NULL, *rspbody = NULL;
+    bool complete = false;
+    ASSERT_TRUE(client->recv_msg(&rsphead, &rspbody, complete, err)) << err.str();
+    ASSERT_TRUE(complete);
+    EXPECT_EQ(rspbody->SerializeAsString(), big.SerializeAsString());
+    MessagePool::local().release(rsphead);
+    MessagePool::local().release(rspbody);
+}
+
+TEST_F(UringTest, ReportsPeerShutdownAndCloses) {
+    Connect();
+    std::ostringstream err;
+    ASSERT_EQ(client->net_tcp_recv(err), 0) << err.str();
+    close(peer);
+    peer = -1;
+    ASSERT_TRUE(PollUntil(loop, [this]() { return handler.events != 0; }));
+    EXPECT_TRUE(handler.events & EPOLLIN);
+    EXPECT_EQ(client->net_tcp_recv(err), -1);
+    EXPECT_NE(err.str().find("EOF"), std::string::npos) << err.str();
+    EXPECT_FALSE(client->is_connected());
+}
@@ -0,0 +1,173 @@
+#include "timer_wheel.h"
+
+
+TimerWheel::TimerWheel(uint64_t now_ms)
+	: now_(now_ms),
+	  count_(0) {
+	list_init(&due_);
+	for (int i = 0; i < kRootSize; i++) {
+		list_init(&root_[i]);
+	}
+	for (int l = 0; l < kLevels; l++) {
+		for (int i = 0; i < kLevelSize; i++) {
+			list_init(&levels_[l][i]);
+		}
+	}
+}
+
+TimerWheel::~TimerWheel() {
+	// 节点属于使用者, 这里只把它们标记成未挂载
+	while (!list_empty(&due_)) {
+		list_unlink(due_.next);
+	}
+	for (int i = 0; i < kRootSize; i++) {
+		while (!list_empty(&root_[i])) {
+			list_unlink(root_[i].next);
+		}
+	}
+	for (int l = 0; l < kLevels; l++) {
+		for (int i = 0; i < kLevelSize; i++) {
+			while (!list_empty(&levels_[l][i])) {
+				list_unlink(levels_[l][i].next);
+			}
+		}
+	}
+}
+
+void TimerWheel::list_append(TimerNode *head, TimerNode *node) {
+	node->prev = head->prev;
+	node->next = head;
+	head->prev->next = node;
+	head->prev = node;
+}
+
+void TimerWheel::list_unlink(TimerNode *node) {
+	node->prev->next = node->next;
+	node->next->prev = node->prev;
+	node->prev = node->next = 0;
+}
+
+void TimerWheel::place(TimerNode *node) {
+	uint64_t expire = node->expire;
+	if (expire < now_) {
+		expire = now_;
+	}
+	uint64_t delta = expire - now_;
+	if (delta < uint64_t(kRootSize)) {
+		list_append(&root_[expire & (kRootSize - 1)], node);
+		return ;
+	}
+	for (int l = 0; l < kLevels; l++) {
+		int shift = kRootBits + (l + 1) * kLevelBits;
+		if (delta < (uint64_t(1) << shift) || l == kLevels - 1) {
+			if (delta >= (uint64_t(1) << shift)) {
+				// 超出整个轮子的范围, 先放在最远的位置, 转到时会再重新放置
+				expire = now_ + (uint64_t(1) << shift) - 1;
+			}
+			int index = int((expire >> (shift - kLevelBits)) & (kLevelSize - 1));
+			list_append(&levels_[l][index], node);
+			return ;
+		}
+	}
+}
+
+void TimerWheel::add(TimerNode *node, uint64_t expire_ms) {
+	if (node->armed()) {
+		remove(node);
+	}
+	node->expire = expire_ms;
+	if (expire_ms < now_) {
+		// 当前时刻的槽已经处理过了, 放到 now_ 的槽里就要再等一毫秒
+		list_append(&due_, node);
+	} else {
+		place(node);
+	}
+	count_++;
+}
+
+void TimerWheel::remove(TimerNode *node) {
+	if (!node->armed()) return ;
+	list_unlink(node);
+	count_--;
+}
+
+int TimerWheel::cascade(int level, int index) {
+	TimerNode pending;
+	list_init(&pending);
+	TimerNode *slot = &levels_[level][index];
+	// 整条链表挪到 pending 上再逐个重新放置
+	if (!list_empty(slot)) {
+		pending.next = slot->next;
+		pending.prev = slot->prev;
+		pending.next->prev = &pending;
+		pending.prev->next = &pending;
+		list_init(slot);
+	}
+	while (!list_empty(&pending)) {
+		TimerNode *node = pending.next;
+		list_unlink(node);
+		place(node);
+	}
+	return index;
+}
+
+void TimerWheel::advance(uint64_t now_ms, ExpireFunc on_expire, void *arg) {
+	if (!list_empty(&due_)) {
+		// 先整条挪走, 回调里再加入的过期节点留到下一次 advance
+		TimerNode pending;
+		pending.next = due_.next;
+		pending.prev = due_.prev;
+		pending.next->prev = &pending;
+		pending.prev->next = &pending;
+		list_init(&due_);
+		while (!list_empty(&pending)) {
+			TimerNode *node = pending.next;
+			list_unlink(node);
+			count_--;
+			on_expire(node, arg);
+		}
+	}
+	while (now_ <= now_ms) {
+		if (count_ == 0) {
+			now_ = now_ms + 1;
+			return ;
+		}
+		int index = int(now_ & (kRootSize - 1));
+		if (index == 0) {
+			for (int l = 0; l < kLevels; l++) {
+				int shift = kRootBits + l * kLevelBits;
+				if (cascade(l, int((now_ >> shift) & (kLevelSize - 1))) != 0) {
+					break;
+				}
+			}
+		}
+
+		TimerNode *slot = &root_[index];
+		now_++;
+		// 回调里可能重新挂到同一个槽 (已到期的节点会放到 now_ 的槽), 所以每次只取表头
+		while (!list_empty(slot)) {
+			TimerNode *node = slot->next;
+			list_unlink(node);
+			count_--;
+			on_expire(node, arg);
+		}
+	}
+}
+
+int TimerWheel::next_timeout(uint64_t now_ms) const {
+	if (count_ == 0) {
+		return -1;
+	}
+	if ((now_ <= now_ms) || !list_empty(&due_)) {
+		// 还有没推进的毫秒
+		return 0;
+	}
+	// 在第 0 层本圈剩余的槽里找最近的非空槽; 找不到就睡到下一次 cascade
+	int index = int(now_ & (kRootSize - 1));
+	for (int i = index; i < kRootSize; i++) {
+		if (!list_empty(&root_[i])) {
+			return int(now_ + (i - index) - now_ms);
+		}
+	}
+	return int(now_ + (kRootSize - index) - now_ms);
+}
@@ -0,0 +1,75 @@
+#ifndef __TIMER_WHEEL_H__
+#define __TIMER_WHEEL_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+// TimerNode: 侵入式的定时器节点, 嵌在使用者的对象里, 挂在 TimerWheel 的某个槽位链表上
+struct TimerNode {
+	TimerNode() : prev(0), next(0), expire(0), owner(0) { }
+	bool armed(void) const { return next != 0; }
+
+	TimerNode *prev;
+	TimerNode *next;
+	uint64_t expire;	// 到期时刻 (毫秒)
+	void *owner;		// 使用者自己的对象
+};
+
+// TimerWheel: 毫秒精度的分层时间轮 (与 Linux 内核旧版 timer wheel 相同的结构)
+//   第 0 层 256 个槽, 每槽 1ms; 第 1~4 层各 64 个槽, 每层每槽是上一层一整圈的时长,
+//   覆盖 2^32 ms (约 49 天), 更远的定时器按 2^32 ms 处理.
+// add/remove 都是 O(1) (算出槽位后挂链表/摘链表); 第 0 层转完一圈时把上一层的一个槽
+// 重新分散到下层 (cascade), 每个定时器最多被搬动 4 次.
+class TimerWheel {
+public:
+	// @now_ms: 时间轴的起点
+	explicit TimerWheel(uint64_t now_ms);
+	~TimerWheel();
+
+public:
+	// 已经挂上的节点会先被摘下; expire 早于当前时刻的节点在下一次 advance 时到期 (即使时间没有往前走)
+	void add(TimerNode *node, uint64_t expire_ms);
+	void remove(TimerNode *node);
+
+	// 推进到 now_ms (含), 依次把到期的节点摘下并交给 on_expire;
+	// on_expire 里可以 add/remove 任意节点 (包括同一批里还没到期回调的)
+	typedef void (*ExpireFunc)(TimerNode *node, void *arg);
+	void advance(uint64_t now_ms, ExpireFunc on_expire, void *arg);
+
+	// 距离下一个定时器可能到期还有多少毫秒 (用作 epoll_wait 的超时),
+	// 不一定精确 (可能提前醒来做一次 cascade), 但不会晚; -1: 没有定时器
+	int next_timeout(uint64_t now_ms) const;
+
+	size_t size(void) const { return count_; }
+
+private:
+	static const int kRootBits = 8;
+	static const int kRootSize = 1 << kRootBits;
+	static const int kLevelBits = 6;
+	static const int kLevelSize = 1 << kLevelBits;
+	static const int kLevels = 4;
+
+	// 每个槽是一个带哨兵的双向循环链表
+	static void list_init(TimerNode *head) { head->prev = head->next = head; }
+	static bool list_empty(const TimerNode *head) { return head->next == head; }
+	static void list_append(TimerNode *head, TimerNode *node);
+	static void list_unlink(TimerNode *node);
+
+	void place(TimerNode *node);
+	// 把 level 层 index 号槽里的节点重新放到下层; @return: index
+	int cascade(int level, int index);
+
+	TimerWheel(const TimerWheel &);
+	TimerWheel &operator=(const TimerWheel &);
+
+private:
+	uint64_t now_;		// 下一个要处理的毫秒
+	size_t count_;
+	TimerNode due_;		// 加入时就已经过期的节点
+	TimerNode root_[kRootSize];
+	TimerNode levels_[kLevels][kLevelSize];
+};
+
+
+#endif // __TIMER_WHEEL_H__
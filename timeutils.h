@@ -0,0 +1,20 @@
+#ifndef __TIMEUTILS_H__
+#define __TIMEUTILS_H__
+
+#include <stdint.h>
+#include <time.h>
+
+
+// 单调时钟 (不受系统时间调整影响), 用于计算超时和延迟
+inline uint64_t now_usec(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return uint64_t(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+inline uint64_t now_msec(void) {
+	return now_usec() / 1000;
+}
+
+
+#endif // __TIMEUTILS_H__
@@ -0,0 +1,244 @@
+// Offline decoder for the binary event log a robot writes with --event_log.
+//   ./robot_events [--csv | --json | --summary] <prefix>
+// Reads <prefix>.meta and <prefix>.0.bin, <prefix>.1.bin, ... (until one is missing),
+// merges all files in time order and prints one line per event (--csv, --json) or
+// per-(group, action, kind, status) aggregates with exact latency percentiles (--summary,
+// the default).
+#include "event_log.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <unistd.h>
+
+namespace {
+
+const char *const kKindNames[] = {"", "connect", "request", "response", "action", "client_stop"};
+const char *const kStatusNames[] = {"ok", "timeout", "failed", "late", "unmatched"};
+
+const char *KindName(uint8_t kind) {
+    return (kind >= 1 && kind <= kEventClientStop) ? kKindNames[kind] : "unknown";
+}
+
+const char *StatusName(uint8_t status) {
+    return (status <= kEventUnmatched) ? kStatusNames[status] : "unknown";
+}
+
+// Names from <prefix>.meta; names are the rest of the line so they may contain spaces.
+struct Meta {
+    Meta() : version(0), start_usec(0), start_unix_usec(0) { }
+
+    uint32_t version;
+    uint64_t start_usec;
+    uint64_t start_unix_usec;
+    std::map<int, std::string> groups;
+    std::map<int, std::string> types;
+
+    std::string group(uint16_t g) const {
+        std::map<int, std::string>::const_iterator it = groups.find(g);
+        return (it == groups.end()) ? std::to_string(g) : it->second;
+    }
+    std::string type(uint16_t t) const {
+        if (t == kEventNoType) {
+            return "";
+        }
+        std::map<int, std::string>::const_iterator it = types.find(t);
+        return (it == types.end()) ? std::to_string(t) : it->second;
+    }
+};
+
+bool ReadMeta(const std::string &path, Meta &meta) {
+    std::ifstream fin(path.c_str());
+    if (!fin) {
+        fprintf(stderr, "cannot read %s\n", path.c_str());
+        return false;
+    }
+    std::string line;
+    while (std::getline(fin, line)) {
+        std::istringstream in(line);
+        std::string key;
+        in >> key;
+        if (key == "version") {
+            in >> meta.version;
+        } else if (key == "start") {
+            in >> meta.start_usec >> meta.start_unix_usec;
+        } else if (key == "group" || key == "type") {
+            int id = 0;
+            std::string name;
+            in >> id;
+            in.ignore(1);
+            std::getline(in, name);
+            (key == "group" ? meta.groups : meta.types)[id] = name;
+        }
+    }
+    if (meta.version != kEventLogVersion) {
+        fprintf(stderr, "%s: version %u, expect %u\n", path.c_str(), meta.version, kEventLogVersion);
+        return false;
+    }
+    return true;
+}
+
+bool ByTime(const EventRecord &a, const EventRecord &b) {
+    return a.usec < b.usec;
+}
+
+std::string JsonEscape(const std::string &s) {
+    std::string out;
+    for (size_t i = 0; i < s.size(); i++) {
+        char c = s[i];
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out += buf;
+        } else {
+            out += c;
+        }
+    }
+    return out;
+}
+
+std::string Action(uint16_t action) {
+    return (action == kEventNoAction) ? "" : std::to_string(action);
+}
+
+void PrintCsv(const Meta &meta, const std::vector<EventRecord> &records) {
+    printf("unix_usec,elapsed_usec,kind,status,client,seq,group,action,type,latency_usec,bytes\n");
+    for (size_t i = 0; i < records.size(); i++) {
+        const EventRecord &r = records[i];
+        uint64_t elapsed = r.usec - meta.start_usec;
+        printf("%llu,%llu,%s,%s,%u,%u,%s,%s,%s,%u,%u\n",
+               (unsigned long long)(meta.start_unix_usec + elapsed), (unsigned long long)elapsed,
+               KindName(r.kind), StatusName(r.status), r.client, r.seq, meta.group(r.group).c_str(),
+               Action(r.action).c_str(), meta.type(r.type).c_str(), r.latency, r.bytes);
+    }
+}
+
+void PrintJson(const Meta &meta, const std::vector<EventRecord> &records) {
+    for (size_t i = 0; i < records.size(); i++) {
+        const EventRecord &r = records[i];
+        uint64_t elapsed = r.usec - meta.start_usec;
+        printf("{\"unix_usec\":%llu,\"elapsed_usec\":%llu,\"kind\":\"%s\",\"status\":\"%s\",\"client\":%u,"
+               "\"seq\":%u,\"group\":\"%s\",\"action\":%s,\"type\":\"%s\",\"latency_usec\":%u,\"bytes\":%u}\n",
+               (unsigned long long)(meta.start_unix_usec + elapsed), (unsigned long long)elapsed,
+               KindName(r.kind), StatusName(r.status), r.client, r.seq,
+               JsonEscape(meta.group(r.group)).c_str(),
+               r.action == kEventNoAction ? "null" : std::to_string(r.action).c_str(),
+               JsonEscape(meta.type(r.type)).c_str(), r.latency, r.bytes);
+    }
+}
+
+struct Aggregate {
+    Aggregate() : bytes(0), first_usec(UINT64_MAX), last_usec(0) { }
+
+    std::vector<uint32_t> latencies;
+    uint64_t bytes;
+    uint64_t first_usec;
+    uint64_t last_usec;
+};
+
+uint32_t Percentile(const std::vector<uint32_t> &sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t rank = static_cast<size_t>(p / 100 * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(rank, sorted.size() - 1)];
+}
+
+void PrintSummary(const Meta &meta, const std::vector<EventRecord> &records) {
+    // Key: group, action, kind, status; the map keeps the output ordered.
+    typedef std::pair<std::pair<uint16_t, uint16_t>, std::pair<uint8_t, uint8_t> > Key;
+    std::map<Key, Aggregate> aggregates;
+    for (size_t i = 0; i < records.size(); i++) {
+        const EventRecord &r = records[i];
+        Aggregate &agg = aggregates[Key(std::make_pair(r.group, r.action), std::make_pair(r.kind, r.status))];
+        agg.latencies.push_back(r.latency);
+        agg.bytes += r.bytes;
+        agg.first_usec = std::min(agg.first_usec, r.usec);
+        agg.last_usec = std::max(agg.last_usec, r.usec);
+    }
+    double span = records.empty() ? 0 : (records.back().usec - records.front().usec) / 1e6;
+    printf("%zu events over %.3fs\n\n", records.size(), span);
+    printf("%-16s %6s %-11s %-9s %10s %10s %9s %9s %9s %9s %9s %12s\n", "GROUP", "ACTION", "KIND", "STATUS",
+           "COUNT", "RATE/s", "P50", "P90", "P99", "P999", "MAX", "BYTES");
+    for (std::map<Key, Aggregate>::iterator it = aggregates.begin(); it != aggregates.end(); ++it) {
+        const Key &key = it->first;
+        Aggregate &agg = it->second;
+        std::sort(agg.latencies.begin(), agg.latencies.end());
+        double rate = (span > 0) ? agg.latencies.size() / span : 0;
+        printf("%-16s %6s %-11s %-9s %10zu %10.1f %9u %9u %9u %9u %9u %12llu\n",
+               meta.group(key.first.first).c_str(), Action(key.first.second).c_str(),
+               KindName(key.second.first), StatusName(key.second.second), agg.latencies.size(), rate,
+               Percentile(agg.latencies, 50), Percentile(agg.latencies, 90), Percentile(agg.latencies, 99),
+               Percentile(agg.latencies, 99.9), agg.latencies.back(), (unsigned long long)agg.bytes);
+    }
+}
+
+void Usage(const char *argv0) {
+    fprintf(stderr, "usage: %s [--csv | --json | --summary] <prefix>\n", argv0);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    std::string mode = "--summary";
+    std::string prefix;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--csv" || arg == "--json" || arg == "--summary") {
+            mode = arg;
+        } else if (arg.compare(0, 1, "-") == 0 || !prefix.empty()) {
+            Usage(argv[0]);
+            return 2;
+        } else {
+            prefix = arg;
+        }
+    }
+    if (prefix.empty()) {
+        Usage(argv[0]);
+        return 2;
+    }
+
+    Meta meta;
+    if (!ReadMeta(prefix + ".meta", meta)) {
+        return 1;
+    }
+    std::vector<EventRecord> records;
+    int files = 0;
+    for (;; files++) {
+        std::string path = prefix + "." + std::to_string(files) + ".bin";
+        if (access(path.c_str(), F_OK) != 0) {
+            break;
+        }
+        EventLogHeader header;
+        std::ostringstream err;
+        if (!ReadEventLog(path, header, records, err)) {
+            fprintf(stderr, "%s\n", err.str().c_str());
+            return 1;
+        }
+        uint64_t appended = header.appended.load();
+        if (appended > header.capacity) {
+            fprintf(stderr, "%s: %llu oldest events were overwritten\n", path.c_str(),
+                    (unsigned long long)(appended - header.capacity));
+        }
+    }
+    if (files == 0) {
+        fprintf(stderr, "no %s.0.bin\n", prefix.c_str());
+        return 1;
+    }
+    // Each file is in append order, which is only roughly time order across threads.
+    std::stable_sort(records.begin(), records.end(), ByTime);
+
+    if (mode == "--csv") {
+        PrintCsv(meta, records);
+    } else if (mode == "--json") {
+        PrintJson(meta, records);
+    } else {
+        PrintSummary(meta, records);
+    }
+    return 0;
+}
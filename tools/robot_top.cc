@@ -0,0 +1,148 @@
+// Live viewer for the shared-memory stats a robot publishes with --shm_stats.
+//   ./robot_top [pid | /dev/shm/robot.<pid>] [-d interval_ms] [-n iterations] [-c]
+// Without a target it attaches to the most recently updated live robot.
+// Rates are computed from the difference between two reads; latency columns show
+// the publisher's most recent interval, or the whole run with -c.
+// Reading is a plain copy from a read-only mapping: the robot never waits for us.
+#include "shm_stats.h"
+#include "timeutils.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+bool ProcessAlive(int pid) {
+    return (pid > 0) && ((kill(pid, 0) == 0) || (errno == EPERM));
+}
+
+// @return: the newest /dev/shm/robot.<pid> whose process is still running, or "".
+std::string FindNewestSegment() {
+    std::string best;
+    time_t best_mtime = 0;
+    DIR *dir = opendir("/dev/shm");
+    if (!dir) {
+        return best;
+    }
+    struct dirent *entry = NULL;
+    while ((entry = readdir(dir)) != NULL) {
+        int pid = 0;
+        char tail = 0;
+        if (sscanf(entry->d_name, "robot.%d%c", &pid, &tail) != 1 || !ProcessAlive(pid)) {
+            continue;
+        }
+        std::string path = std::string("/dev/shm/") + entry->d_name;
+        struct stat st;
+        if (stat(path.c_str(), &st) == 0 && (best.empty() || st.st_mtime > best_mtime)) {
+            best = path;
+            best_mtime = st.st_mtime;
+        }
+    }
+    closedir(dir);
+    return best;
+}
+
+double PerSecond(uint64_t now, uint64_t before, uint64_t usec) {
+    return usec ? double(now - before) * 1000000 / usec : 0.0;
+}
+
+void Render(const ShmStatsData &cur, const ShmStatsData *prev, int pid, bool cumulative) {
+    uint64_t usec = prev ? cur.update_usec - prev->update_usec : cur.update_usec - cur.start_usec;
+    printf("robot %d  up %.1fs  publish #%llu  groups %d%s  latency: %s (usec)\n\n", pid,
+           (cur.update_usec - cur.start_usec) / 1e6, (unsigned long long)cur.publish_count,
+           cur.group_total, cur.group_total > cur.group_num ? " (truncated)" : "",
+           cumulative ? "whole run" : "last interval");
+    printf("%-20s %8s %8s %10s %8s %7s %9s %9s %9s %9s %9s %12s\n", "GROUP", "CONN", "INFLIGHT",
+           "QPS", "ERR/s", "TMO%", "p50", "p90", "p99", "p99.9", "max", "COMPLETED");
+    for (int g = 0; g < cur.group_num; g++) {
+        const ShmGroupStats &s = cur.groups[g];
+        // Compare against the previous read only if it is the same group.
+        static const ShmGroupStats kZero = ShmGroupStats();
+        const ShmGroupStats &p = (prev && g < prev->group_num && strcmp(prev->groups[g].name, s.name) == 0)
+            ? prev->groups[g] : kZero;
+        uint64_t finished = (s.completed - p.completed) + (s.timeouts - p.timeouts);
+        double timeout_pct = finished ? 100.0 * (s.timeouts - p.timeouts) / finished : 0.0;
+        const ShmLatency &lat = cumulative ? s.total : s.recent;
+        printf("%-20.20s %8llu %8llu %10.1f %8.1f %6.2f%% %9llu %9llu %9llu %9llu %9llu %12llu\n", s.name,
+               (unsigned long long)s.connected, (unsigned long long)s.in_flight,
+               PerSecond(s.completed, p.completed, usec), PerSecond(s.errors, p.errors, usec), timeout_pct,
+               (unsigned long long)lat.p50, (unsigned long long)lat.p90, (unsigned long long)lat.p99,
+               (unsigned long long)lat.p999, (unsigned long long)lat.max, (unsigned long long)s.completed);
+    }
+    fflush(stdout);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    std::string target;
+    int interval_ms = 1000;
+    long iterations = -1;
+    bool cumulative = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            interval_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            iterations = atol(argv[++i]);
+        } else if (strcmp(argv[i], "-c") == 0) {
+            cumulative = true;
+        } else if (argv[i][0] != '-' && target.empty()) {
+            target = argv[i];
+        } else {
+            fprintf(stderr, "usage: %s [pid | path] [-d interval_ms] [-n iterations] [-c]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (target.empty()) {
+        target = FindNewestSegment();
+        if (target.empty()) {
+            fprintf(stderr, "no running robot publishes stats in /dev/shm (start it with --shm_stats)\n");
+            return 1;
+        }
+    } else if (target.find('/') == std::string::npos) {
+        target = ShmStatsSegment::path_of(atoi(target.c_str()));
+    }
+
+    ShmStatsSegment segment;
+    std::ostringstream err;
+    if (!segment.attach(target, err)) {
+        fprintf(stderr, "%s\n", err.str().c_str());
+        return 1;
+    }
+    int pid = segment.pid();
+    bool tty = isatty(STDOUT_FILENO);
+
+    ShmStatsData *cur = new ShmStatsData();
+    ShmStatsData *prev = new ShmStatsData();
+    bool have_prev = false;
+    for (long n = 0; iterations < 0 || n < iterations; n++) {
+        if (n > 0) {
+            usleep(interval_ms * 1000);
+        }
+        if (!segment.read(*cur)) {
+            continue;
+        }
+        // The publisher did not run again since the last read: nothing new to show.
+        if (have_prev && cur->publish_count == prev->publish_count && ProcessAlive(pid)) {
+            continue;
+        }
+        if (tty) {
+            printf("\033[H\033[2J");
+        }
+        Render(*cur, have_prev ? prev : NULL, pid, cumulative);
+        if (!ProcessAlive(pid)) {
+            printf("\nrobot %d exited\n", pid);
+            break;
+        }
+        std::swap(cur, prev);
+        have_prev = true;
+    }
+    delete cur;
+    delete prev;
+    return 0;
+}
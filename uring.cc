@@ -0,0 +1,444 @@
+#include "uring.h"
+#include "event_loop.h"
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+// user_data 的低 3 位: 完成事件属于哪种请求, 其余是对象指针 (至少 8 字节对齐)
+enum UringOp {
+	kUringNoop = 0,			// cancel/close, 不关心结果
+	kUringRecv = 1,			// UringClient
+	kUringSend = 2,			// UringClient
+	kUringPoll = 3,			// EventHandler
+};
+const uint64_t kUringOpMask = 7;
+// UringClient::io_error_: 对端关闭
+const int kUringEof = -1;
+
+static uint64_t uring_user_data(const void *ptr, UringOp op) {
+	return reinterpret_cast<uint64_t>(ptr) | op;
+}
+
+
+UringRing::~UringRing() {
+	// 还没提交的 cancel/close 要提交掉, 否则 fd 不会被关闭
+	if (sq_tail_) {
+		submit();
+	}
+	if (buf_ring_) {
+		munmap(buf_ring_, buf_ring_size_);
+	}
+	free(buffers_);
+	if (sqes_) {
+		munmap(sqes_, sqes_size_);
+	}
+	if (cq_ring_ && (cq_ring_ != sq_ring_)) {
+		munmap(cq_ring_, cq_ring_size_);
+	}
+	if (sq_ring_) {
+		munmap(sq_ring_, sq_ring_size_);
+	}
+	// 关闭 ring 时内核取消所有还没完成的请求
+	if (ring_fd_ >= 0) {
+		close(ring_fd_);
+	}
+}
+
+UringRing::UringRing()
+	: ring_fd_(-1), sq_ring_(NULL), cq_ring_(NULL), sq_ring_size_(0), cq_ring_size_(0),
+	  sqes_(NULL), sqes_size_(0), sq_head_(NULL), sq_tail_(NULL), sq_array_(NULL), sq_mask_(0),
+	  sq_entries_(0), sqe_tail_(0), cq_head_(NULL), cq_tail_(NULL), cq_mask_(0), cqes_(NULL),
+	  buf_ring_(NULL), buf_ring_size_(0), buffers_(NULL), buf_tail_(0), multishot_(true), enters_(0) { }
+
+bool UringRing::init(std::ostringstream &err) {
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	// 完成事件的收尾工作留到 io_uring_enter 时做, 不打断 loop 线程 (5.19); 老内核不认识就不用.
+	// ring 在主线程创建, 在 loop 线程使用, 所以不能用 SINGLE_ISSUER
+	params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_COOP_TASKRUN;
+	params.cq_entries = kUringEntries * kUringCqFactor;
+	ring_fd_ = syscall(__NR_io_uring_setup, kUringEntries, &params);
+	if ((ring_fd_ == -1) && (errno == EINVAL)) {
+		memset(&params, 0, sizeof(params));
+		params.flags = IORING_SETUP_CQSIZE;
+		params.cq_entries = kUringEntries * kUringCqFactor;
+		ring_fd_ = syscall(__NR_io_uring_setup, kUringEntries, &params);
+	}
+	if (ring_fd_ == -1) {
+		err << "io_uring_setup: " << strerror(errno);
+		return false;
+	}
+	// 等待时要带超时 (5.11), 而且满了的 CQ 不能丢事件
+	if (!(params.features & IORING_FEAT_EXT_ARG) || !(params.features & IORING_FEAT_NODROP)) {
+		err << "io_uring lacks EXT_ARG/NODROP (kernel too old)";
+		return false;
+	}
+
+	sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+	if (single_mmap) {
+		sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+	}
+	sq_ring_ = mmap(NULL, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+					ring_fd_, IORING_OFF_SQ_RING);
+	if (sq_ring_ == MAP_FAILED) {
+		sq_ring_ = NULL;
+		err << "mmap sq ring: " << strerror(errno);
+		return false;
+	}
+	if (single_mmap) {
+		cq_ring_ = sq_ring_;
+	} else {
+		cq_ring_ = mmap(NULL, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+						ring_fd_, IORING_OFF_CQ_RING);
+		if (cq_ring_ == MAP_FAILED) {
+			cq_ring_ = NULL;
+			err << "mmap cq ring: " << strerror(errno);
+			return false;
+		}
+	}
+	sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+	void *sqes = mmap(NULL, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+					  ring_fd_, IORING_OFF_SQES);
+	if (sqes == MAP_FAILED) {
+		err << "mmap sqes: " << strerror(errno);
+		return false;
+	}
+	sqes_ = static_cast<struct io_uring_sqe *>(sqes);
+
+	char *sq = static_cast<char *>(sq_ring_);
+	sq_head_ = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+	sq_tail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+	sq_array_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+	sq_mask_ = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+	sq_entries_ = params.sq_entries;
+	sqe_tail_ = *sq_tail_;
+	char *cq = static_cast<char *>(cq_ring_);
+	cq_head_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+	cq_tail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+	cq_mask_ = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+	cqes_ = reinterpret_cast<struct io_uring_cqe *>(cq + params.cq_off.cqes);
+
+	// provided buffer ring (5.19): 环本身由我们分配, 注册给内核
+	buf_ring_size_ = kUringBufferCount * sizeof(struct io_uring_buf);
+	void *buf_ring = mmap(NULL, buf_ring_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (buf_ring == MAP_FAILED) {
+		err << "mmap buffer ring: " << strerror(errno);
+		return false;
+	}
+	buf_ring_ = static_cast<struct io_uring_buf_ring *>(buf_ring);
+	struct io_uring_buf_reg reg;
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = reinterpret_cast<uint64_t>(buf_ring_);
+	reg.ring_entries = kUringBufferCount;
+	reg.bgid = kUringBufferGroup;
+	if (syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_PBUF_RING, &reg, 1) == -1) {
+		err << "register buffer ring: " << strerror(errno);
+		return false;
+	}
+	buffers_ = static_cast<char *>(malloc(size_t(kUringBufferCount) * kUringBufferSize));
+	for (unsigned i = 0; i < kUringBufferCount; i++) {
+		recycle_buffer(static_cast<uint16_t>(i));
+	}
+	return true;
+}
+
+void UringRing::recycle_buffer(uint16_t bid) {
+	// 按 C++ 编译时内核头文件里的 bufs 偏移是错的 (空结构体占了 8 字节), 所以直接当数组用, tail 和 bufs[0] 重叠
+	struct io_uring_buf *buf = reinterpret_cast<struct io_uring_buf *>(buf_ring_) + (buf_tail_ & (kUringBufferCount - 1));
+	buf->addr = reinterpret_cast<uint64_t>(buffer(bid));
+	buf->len = kUringBufferSize;
+	buf->bid = bid;
+	buf_tail_++;
+	__atomic_store_n(&buf_ring_->tail, buf_tail_, __ATOMIC_RELEASE);
+}
+
+int UringRing::enter(unsigned to_submit, unsigned min_complete, unsigned flags, void *arg, size_t argsz) {
+	enters_++;
+	return syscall(__NR_io_uring_enter, ring_fd_, to_submit, min_complete, flags, arg, argsz);
+}
+
+struct io_uring_sqe *UringRing::get_sqe(void) {
+	if (sqe_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= sq_entries_) {
+		submit();
+	}
+	unsigned index = sqe_tail_ & sq_mask_;
+	struct io_uring_sqe *sqe = &sqes_[index];
+	memset(sqe, 0, sizeof(*sqe));
+	sq_array_[index] = index;
+	sqe_tail_++;
+	return sqe;
+}
+
+int UringRing::submit(void) {
+	unsigned to_submit = sqe_tail_ - *sq_tail_;
+	__atomic_store_n(sq_tail_, sqe_tail_, __ATOMIC_RELEASE);
+	if (to_submit == 0) {
+		return 0;
+	}
+	int ret;
+	do {
+		ret = enter(to_submit, 0, 0, NULL, 0);
+	} while ((ret == -1) && (errno == EINTR));
+	return ret;
+}
+
+int UringRing::submit_and_wait(int timeout_ms) {
+	unsigned to_submit = sqe_tail_ - *sq_tail_;
+	__atomic_store_n(sq_tail_, sqe_tail_, __ATOMIC_RELEASE);
+	bool ready = (__atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE) != *cq_head_);
+
+	struct __kernel_timespec ts;
+	struct io_uring_getevents_arg arg;
+	memset(&arg, 0, sizeof(arg));
+	if (timeout_ms >= 0) {
+		ts.tv_sec = timeout_ms / 1000;
+		ts.tv_nsec = (timeout_ms % 1000) * 1000000LL;
+		arg.ts = reinterpret_cast<uint64_t>(&ts);
+	}
+	// 已经有完成事件时只提交不等; 什么都不用提交又已经有事件时连系统调用都省了
+	if (!ready || (to_submit > 0)) {
+		int ret = enter(to_submit, ready ? 0 : 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+		if ((ret == -1) && (errno != EINTR) && (errno != ETIME) && (errno != EBUSY)) {
+			LOG(ERROR) << "io_uring_enter meet error(" << errno << "): " << strerror(errno);
+			return -1;
+		}
+	}
+	return reap();
+}
+
+int UringRing::reap(void) {
+	int n = 0;
+	unsigned head = *cq_head_;
+	unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+	while (head != tail) {
+		// 拷出来再回调, 回调里可能会再放 SQE 或提交
+		struct io_uring_cqe cqe = cqes_[head & cq_mask_];
+		head++;
+		__atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+		dispatch(cqe);
+		n++;
+		if (head == tail) {
+			tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+		}
+	}
+	return n;
+}
+
+void UringRing::dispatch(const struct io_uring_cqe &cqe) {
+	void *ptr = reinterpret_cast<void *>(cqe.user_data & ~kUringOpMask);
+	switch (cqe.user_data & kUringOpMask) {
+	case kUringRecv:
+		static_cast<UringClient *>(ptr)->on_recv(cqe);
+		break;
+	case kUringSend:
+		static_cast<UringClient *>(ptr)->on_send(cqe);
+		break;
+	case kUringPoll:
+		// 被取消的 (连接已经关闭) 不再回调
+		if (cqe.res != -ECANCELED) {
+			static_cast<EventHandler *>(ptr)->on_events((cqe.res < 0) ? EPOLLERR : uint32_t(cqe.res));
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+void UringRing::poll_fd(int fd, uint32_t events, EventHandler *handler) {
+	struct io_uring_sqe *sqe = get_sqe();
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = fd;
+	// 一次性的, 边沿/水平触发对它没有意义
+	sqe->poll32_events = events & (EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLERR | EPOLLHUP);
+	sqe->user_data = uring_user_data(handler, kUringPoll);
+}
+
+void UringRing::cancel_fd(int fd, bool close_fd) {
+	struct io_uring_sqe *sqe = get_sqe();
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = fd;
+	sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+	sqe->user_data = uring_user_data(NULL, kUringNoop);
+	if (!close_fd) {
+		return ;
+	}
+	// 取消在提交时按 fd 找请求, 所以 fd 要等取消之后再关 (硬链接: 没有可取消的也照样关)
+	sqe->flags |= IOSQE_IO_HARDLINK;
+	sqe = get_sqe();
+	sqe->opcode = IORING_OP_CLOSE;
+	sqe->fd = fd;
+	sqe->user_data = uring_user_data(NULL, kUringNoop);
+}
+
+
+UringClient::~UringClient() {
+	close_connection();
+}
+
+UringClient::UringClient(UringRing *ring, EventHandler *handler,
+						 int max_pkg_len, bool has_checksum, ChecksumType checksum_type)
+	: Client(max_pkg_len, has_checksum, checksum_type),
+	  ring_(ring),
+	  handler_(handler),
+	  recv_armed_(false),
+	  sending_(false),
+	  inflight_off_(0),
+	  io_error_(0) { }
+
+void UringClient::close_connection(void) {
+	if (!is_connected()) return ;
+	// 还在途的 recv/send 持有 socket, 不取消的话关了 fd 连接也不会断
+	ring_->cancel_fd(connfd_, true);
+	connfd_ = -1;
+}
+
+void UringClient::arm_recv(void) {
+	struct io_uring_sqe *sqe = ring_->get_sqe();
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = connfd_;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = kUringBufferGroup;
+	sqe->ioprio = ring_->multishot() ? IORING_RECV_MULTISHOT : 0;
+	sqe->user_data = uring_user_data(this, kUringRecv);
+	recv_armed_ = true;
+}
+
+void UringClient::submit_send(void) {
+	if (inflight_off_ >= inflight_.size()) {
+		// 内核异步读, 发送队列里引用的 body 不一定活到完成, 这里拼成一份拷贝
+		struct iovec iov[kSendIovMax];
+		inflight_.clear();
+		inflight_off_ = 0;
+		while (!buffer_.send.empty()) {
+			int n = buffer_.send.fill_iov(iov, kSendIovMax);
+			size_t bytes = 0;
+			for (int i = 0; i < n; i++) {
+				inflight_.append(static_cast<const char *>(iov[i].iov_base), iov[i].iov_len);
+				bytes += iov[i].iov_len;
+			}
+			buffer_.send.consume(bytes);
+		}
+	}
+	struct io_uring_sqe *sqe = ring_->get_sqe();
+	sqe->opcode = IORING_OP_SEND;
+	sqe->fd = connfd_;
+	sqe->addr = reinterpret_cast<uint64_t>(inflight_.data() + inflight_off_);
+	sqe->len = inflight_.size() - inflight_off_;
+	sqe->msg_flags = MSG_NOSIGNAL;
+	sqe->user_data = uring_user_data(this, kUringSend);
+	sending_ = true;
+}
+
+int UringClient::net_tcp_send(std::ostringstream &errmsg) {
+	if (io_error_ != 0) {
+		return net_tcp_recv(errmsg);
+	}
+	if (!is_connected()) {
+		errmsg << "send on closed connection";
+		return -1;
+	}
+	// 连上后第一次发包时发起 recv, 连接还没完成时发起的 recv 会直接失败
+	if (!recv_armed_) {
+		arm_recv();
+	}
+	if (!sending_ && !buffer_.send.empty()) {
+		submit_send();
+	}
+	return 0;
+}
+
+int UringClient::net_tcp_recv(std::ostringstream &errmsg) {
+	if (io_error_ == kUringEof) {
+		errmsg << "recv meet EOF (peer shutdown), fd: " << connfd_;
+		close_connection();
+		return -1;
+	}
+	if (io_error_ != 0) {
+		errmsg << "io_uring recv/send meet error, fd: " << connfd_
+			<< ", err(" << io_error_ << "): " << strerror(io_error_);
+		close_connection();
+		return -1;
+	}
+	if (!is_connected()) {
+		errmsg << "recv on closed connection";
+		return -1;
+	}
+	if (!recv_armed_) {
+		arm_recv();
+	}
+	return 0;
+}
+
+void UringClient::fail_io(int err) {
+	if (io_error_ == 0) {
+		io_error_ = err;
+	}
+	handler_->on_events(EPOLLIN | EPOLLOUT | EPOLLERR);
+}
+
+void UringClient::on_recv(const struct io_uring_cqe &cqe) {
+	bool more = cqe.flags & IORING_CQE_F_MORE;
+	if (!more) {
+		recv_armed_ = false;
+	}
+	if (cqe.flags & IORING_CQE_F_BUFFER) {
+		uint16_t bid = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+		if ((cqe.res > 0) && is_connected()) {
+			buffer_.recv.append(ring_->buffer(bid), cqe.res);
+		}
+		ring_->recycle_buffer(bid);
+	}
+	if (!is_connected() || (io_error_ != 0) || (cqe.res == -ECANCELED)) {
+		return ;
+	}
+	if (cqe.res == 0) {
+		fail_io(kUringEof);
+		return ;
+	}
+	if (cqe.res < 0) {
+		if ((cqe.res == -EINVAL) && ring_->multishot()) {
+			// 内核不支持多发 recv, 以后每次完成后重新发起
+			LOG(WARNING) << "io_uring multishot recv not supported, falling back to single-shot";
+			ring_->disable_multishot();
+			arm_recv();
+			return ;
+		}
+		if (cqe.res != -ENOBUFS) {
+			fail_io(-cqe.res);
+			return ;
+		}
+		// 缓冲暂时用完了, 处理完这一批会归还
+	}
+	if (!recv_armed_) {
+		arm_recv();
+	}
+	if (cqe.res > 0) {
+		handler_->on_events(EPOLLIN);
+	}
+}
+
+void UringClient::on_send(const struct io_uring_cqe &cqe) {
+	sending_ = false;
+	if (!is_connected() || (io_error_ != 0) || (cqe.res == -ECANCELED)) {
+		return ;
+	}
+	if (cqe.res < 0) {
+		fail_io(-cqe.res);
+		return ;
+	}
+	inflight_off_ += cqe.res;
+	// 没发完的接着发; 发完了再把在途期间攒下的一起发
+	if ((inflight_off_ < inflight_.size()) || !buffer_.send.empty()) {
+		submit_send();
+	}
+}
+
+
+Client *NewLoopClient(UringRing *ring, EventHandler *handler,
+					  int max_pkg_len, bool has_checksum, ChecksumType checksum_type) {
+	if (ring) {
+		return new UringClient(ring, handler, max_pkg_len, has_checksum, checksum_type);
+	}
+	return new Client(max_pkg_len, has_checksum, checksum_type);
+}
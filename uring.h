@@ -0,0 +1,128 @@
+#ifndef __URING_H__
+#define __URING_H__
+
+#include "common.h"
+#include "client.h"
+#include <linux/io_uring.h>
+
+class EventHandler;
+
+// SQ 的大小, 满了会先提交一次; CQ 是它的 kUringCqFactor 倍, 多发 recv 一次可能产生多个完成事件
+const unsigned kUringEntries = 4096;
+const unsigned kUringCqFactor = 4;
+// 内核收包用的缓冲 (provided buffer ring), 个数必须是 2 的幂; 用完时多发 recv 会结束, 归还后重新发起
+const unsigned kUringBufferCount = 4096;
+const unsigned kUringBufferSize = 4096;
+const uint16_t kUringBufferGroup = 0;
+
+
+// UringRing: 一个 EventLoop 的 io_uring, 直接用系统调用 (不依赖 liburing).
+// 一轮循环里所有客户端要发的包和要发起的 recv 都先放进 SQ, 在等待完成事件的那一次 io_uring_enter 里一起提交;
+// recv 是多发的 (一次发起, 每次有数据都产生一个完成事件), 数据放在内核从 provided buffer ring 里挑的缓冲里.
+// 只在 EventLoop 的线程里使用
+class UringRing {
+public:
+	~UringRing();
+	UringRing();
+
+public:
+	// 内核不支持 (没有 io_uring, 被禁用, 或者早于 5.19 没有 provided buffer ring) 时返回 false,
+	// 调用者退回 epoll + read/write
+	bool init(std::ostringstream &err);
+
+	// 取一个空的 SQE, SQ 满时先把已有的提交掉; user_data 的低 3 位是 UringOp
+	struct io_uring_sqe *get_sqe(void);
+	// 提交所有 SQE, 等到至少有一个完成事件或者 timeout_ms (-1: 不限), 然后处理所有完成事件
+	// @return: -1: 出错, 否则是处理的完成事件个数
+	int submit_and_wait(int timeout_ms);
+
+	// 关注 fd 的一次事件 (只用于等 connect 完成), 完成时回调 handler->on_events
+	void poll_fd(int fd, uint32_t events, EventHandler *handler);
+	// 取消 fd 上所有还没完成的请求; @close_fd: 取消之后由 io_uring 关闭 fd
+	void cancel_fd(int fd, bool close_fd);
+
+	const char *buffer(uint16_t bid) const { return buffers_ + size_t(bid) * kUringBufferSize; }
+	void recycle_buffer(uint16_t bid);
+	// 内核不支持多发 recv (早于 6.0) 时退回每次完成后重新发起
+	bool multishot(void) const { return multishot_; }
+	void disable_multishot(void) { multishot_ = false; }
+
+	// io_uring_enter 的次数, 给 bench 算每条消息的系统调用数
+	uint64_t enters(void) const { return enters_; }
+
+private:
+	int enter(unsigned to_submit, unsigned min_complete, unsigned flags, void *arg, size_t argsz);
+	// @return: -1: 出错
+	int submit(void);
+	int reap(void);
+	void dispatch(const struct io_uring_cqe &cqe);
+
+private:
+	int ring_fd_;
+	void *sq_ring_;
+	void *cq_ring_;
+	size_t sq_ring_size_;
+	size_t cq_ring_size_;
+	struct io_uring_sqe *sqes_;
+	size_t sqes_size_;
+	unsigned *sq_head_;
+	unsigned *sq_tail_;
+	unsigned *sq_array_;
+	unsigned sq_mask_;
+	unsigned sq_entries_;
+	unsigned sqe_tail_;			// 已填好还没发布到 sq_tail_ 的位置
+	unsigned *cq_head_;
+	unsigned *cq_tail_;
+	unsigned cq_mask_;
+	struct io_uring_cqe *cqes_;
+
+	struct io_uring_buf_ring *buf_ring_;
+	size_t buf_ring_size_;
+	char *buffers_;
+	uint16_t buf_tail_;
+	bool multishot_;
+	uint64_t enters_;
+};
+
+// UringClient: 在 UringRing 上收发的 Client, 替换 net_tcp_send/net_tcp_recv, 其余 (编解码, connect) 和 Client 一样.
+//   net_tcp_send: 把发送缓冲拷到在途缓冲, 放一个 SEND 进 SQ (在途时不再放, 完成后再把新攒的一起发), 不做系统调用
+//   net_tcp_recv: 数据已经在完成事件里放进接收缓冲了, 只报告之前的错误 / 对端关闭
+// 收到数据或出错时回调 handler->on_events (EPOLLIN/EPOLLOUT|EPOLLERR), 和 epoll 的边沿触发用法一样.
+// 同一个 UringClient 的连接关闭后不能再连
+class UringClient : public Client {
+public:
+	~UringClient();
+	UringClient(UringRing *ring, EventHandler *handler,
+				int max_pkg_len, bool has_checksum, ChecksumType checksum_type = kChecksumSum32);
+
+public:
+	virtual int net_tcp_send(std::ostringstream &errmsg);
+	virtual int net_tcp_recv(std::ostringstream &errmsg);
+	virtual void close_connection(void);
+	virtual bool io_pending(void) const { return recv_armed_ || sending_; }
+
+	// 只由 UringRing 调用
+	void on_recv(const struct io_uring_cqe &cqe);
+	void on_send(const struct io_uring_cqe &cqe);
+
+private:
+	void arm_recv(void);
+	void submit_send(void);
+	void fail_io(int err);
+
+private:
+	UringRing *ring_;
+	EventHandler *handler_;
+	bool recv_armed_;
+	bool sending_;
+	std::string inflight_;		// 正在发的数据, 发送缓冲在途时可能被挪动, 所以拷一份
+	size_t inflight_off_;
+	int io_error_;				// 0, 或者收发出错的 errno; kUringEof 表示对端关闭
+};
+
+// 按 loop 是否用 io_uring 创建 UringClient 或者 Client; @handler: 关注这个连接的 handler
+Client *NewLoopClient(UringRing *ring, EventHandler *handler,
+					  int max_pkg_len, bool has_checksum, ChecksumType checksum_type);
+
+
+#endif // __URING_H__